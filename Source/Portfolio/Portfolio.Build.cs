@@ -14,7 +14,8 @@ public class Portfolio : ModuleRules
             "Engine",
             "InputCore",
             "GameplayAbilities",
-            "GameplayTags"
+            "GameplayTags",
+            "ProceduralMeshComponent"
         });
 
         PrivateDependencyModuleNames.AddRange(new string[] {  });
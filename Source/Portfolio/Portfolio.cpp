@@ -2,5 +2,17 @@
 
 #include "Portfolio.h"
 #include "Modules/ModuleManager.h"
+#include "KeplerSolverTable.h"
 
-IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, Portfolio, "Portfolio" );
+class FPortfolioModule : public FDefaultGameModuleImpl
+{
+public:
+
+	virtual void StartupModule() override
+	{
+		// Built before any orbit is solved, so the table can be read from any thread without locking.
+		FKeplerSolverTable::Get().Build();
+	}
+};
+
+IMPLEMENT_PRIMARY_GAME_MODULE( FPortfolioModule, Portfolio, "Portfolio" );
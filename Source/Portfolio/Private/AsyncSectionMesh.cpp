@@ -0,0 +1,101 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "AsyncSectionMesh.h"
+#include "Async/Async.h"
+
+UAsyncSectionMeshComponent::UAsyncSectionMeshComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+
+	NextGeneration = 0;
+}
+
+void UAsyncSectionMeshComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	DispatchBuilds();
+	SetComponentTickEnabled(false);
+}
+
+void UAsyncSectionMeshComponent::RequestSectionBuild(const int32 SectionIndex)
+{
+	FSectionBuild* Build = SectionBuilds.Find(SectionIndex);
+	if (!Build)
+	{
+		Build = &SectionBuilds.Add(SectionIndex);
+		Build->bIsPending = false;
+	}
+	Build->Generation = ++NextGeneration;
+	Build->bIsDirty = true;
+
+	// Builds are started on the next tick, so several changes in a frame start a single build.
+	SetComponentTickEnabled(true);
+}
+
+void UAsyncSectionMeshComponent::RemoveSection(const int32 SectionIndex)
+{
+	if (SectionBuilds.Remove(SectionIndex) > 0)
+	{
+		ClearMeshSection(SectionIndex);
+	}
+}
+
+void UAsyncSectionMeshComponent::ClearSections()
+{
+	SectionBuilds.Empty();
+	ClearAllMeshSections();
+}
+
+int32 UAsyncSectionMeshComponent::GetNumPendingSections() const
+{
+	int32 NumPending = 0;
+	for (const TPair<int32, FSectionBuild>& Pair : SectionBuilds)
+	{
+		NumPending += (Pair.Value.bIsDirty || Pair.Value.bIsPending) ? 1 : 0;
+	}
+	return NumPending;
+}
+
+void UAsyncSectionMeshComponent::DispatchBuilds()
+{
+	TWeakObjectPtr<UAsyncSectionMeshComponent> WeakThis(this);
+	for (TPair<int32, FSectionBuild>& Pair : SectionBuilds)
+	{
+		FSectionBuild& Build = Pair.Value;
+		if (!Build.bIsDirty) continue;
+
+		Build.bIsDirty = false;
+		Build.bIsPending = true;
+
+		// The task owns copies of its inputs, so the section can change while it runs.
+		const int32 SectionIndex = Pair.Key;
+		const uint32 Generation = Build.Generation;
+		Async(EAsyncExecution::TaskGraph, [WeakThis, SectionIndex, Generation, BuildMesh = CreateSectionBuild(SectionIndex)]()
+		{
+			FAsyncMeshSection Mesh;
+			BuildMesh(Mesh);
+
+			AsyncTask(ENamedThreads::GameThread, [WeakThis, SectionIndex, Generation, Mesh = MoveTemp(Mesh)]()
+			{
+				UAsyncSectionMeshComponent* Component = WeakThis.Get();
+				if (!Component) return;
+
+				Component->OnSectionBuilt(SectionIndex, Generation, Mesh);
+			});
+		});
+	}
+}
+
+void UAsyncSectionMeshComponent::OnSectionBuilt(const int32 SectionIndex, const uint32 Generation, const FAsyncMeshSection& Mesh)
+{
+	FSectionBuild* Build = SectionBuilds.Find(SectionIndex);
+	if (!Build || Build->Generation != Generation) return;
+
+	Build->bIsPending = false;
+	CreateMeshSection_LinearColor(SectionIndex, Mesh.Vertices, Mesh.Triangles, Mesh.Normals, Mesh.UV0, Mesh.Colors, Mesh.Tangents, false);
+	SetMaterial(SectionIndex, GetSectionMaterial(SectionIndex));
+}
@@ -0,0 +1,465 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "CityBuilder.h"
+#include "Async/Async.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "Math/RandomStream.h"
+#include "ProceduralMeshComponent.h"
+
+namespace CityBuilder
+{
+	/** Add a quad with flat shading. Corners may come in either order; the triangles face along the normal. */
+	static void AddFace(FCityMeshSection& Section, const FVector (&Corners)[4], const FVector2D (&UVs)[4], const FVector& Normal)
+	{
+		const int32 First = Section.Vertices.Num();
+		for (int32 Corner = 0; Corner < 4; Corner++)
+		{
+			Section.Vertices.Add(Corners[Corner]);
+			Section.UVs.Add(UVs[Corner]);
+			Section.Normals.Add(Normal);
+		}
+
+		// Same convention as the tangents of the procedural mesh library.
+		const bool bIsFacingNormal = (((Corners[2] - Corners[0]) ^ (Corners[1] - Corners[0])) | Normal) > 0.0f;
+		if (bIsFacingNormal)
+		{
+			Section.Triangles.Append({ First, First + 1, First + 2, First, First + 2, First + 3 });
+		}
+		else
+		{
+			Section.Triangles.Append({ First, First + 2, First + 1, First, First + 3, First + 2 });
+		}
+	}
+
+	/** Walls and a flat roof over the lot. */
+	static void AddBuilding(FCityMeshSection& Section, const FQuad2D& Lot, const float Height, const float TextureSize)
+	{
+		const FVector2D Corners[4] = { Lot.A, Lot.B, Lot.C, Lot.D };
+		const float SignedArea = (Lot.A ^ Lot.B) + (Lot.B ^ Lot.C) + (Lot.C ^ Lot.D) + (Lot.D ^ Lot.A);
+		const float Winding = (SignedArea >= 0.0f) ? 1.0f : -1.0f;
+
+		// Facade UVs run around the building, so textures line up at the corners.
+		float U = 0.0f;
+		for (int32 Corner = 0; Corner < 4; Corner++)
+		{
+			const FVector2D& Start = Corners[Corner];
+			const FVector2D& End = Corners[(Corner + 1) % 4];
+			const FVector2D Direction = (End - Start).GetSafeNormal();
+			const float Length = FVector2D::Distance(Start, End);
+			if (Length <= KINDA_SMALL_NUMBER) continue;
+
+			const FVector Outward(Winding * Direction.Y, -Winding * Direction.X, 0.0f);
+			const FVector Wall[4] = { FVector(Start, 0.0f), FVector(End, 0.0f), FVector(End, Height), FVector(Start, Height) };
+			const float EndU = U + Length / TextureSize;
+			const float Top = Height / TextureSize;
+			const FVector2D UVs[4] = { FVector2D(U, Top), FVector2D(EndU, Top), FVector2D(EndU, 0.0f), FVector2D(U, 0.0f) };
+			AddFace(Section, Wall, UVs, Outward);
+			U = EndU;
+		}
+
+		const FVector Roof[4] = { FVector(Lot.A, Height), FVector(Lot.B, Height), FVector(Lot.C, Height), FVector(Lot.D, Height) };
+		const FVector2D UVs[4] = { Lot.A / TextureSize, Lot.B / TextureSize, Lot.C / TextureSize, Lot.D / TextureSize };
+		AddFace(Section, Roof, UVs, FVector::UpVector);
+	}
+
+	/** Flat road surface, with UVs along its centerline so markings follow the road. */
+	static void AddRoad(FCityMeshSection& Section, const FQuad2D& Road, const float Height, const float TextureSize)
+	{
+		const FVector2D Along = (0.5f * (Road.B + Road.C) - 0.5f * (Road.A + Road.D)).GetSafeNormal();
+		const FVector2D Across(-Along.Y, Along.X);
+		const FVector2D Corners2D[4] = { Road.A, Road.B, Road.C, Road.D };
+		FVector Corners[4];
+		FVector2D UVs[4];
+		for (int32 Corner = 0; Corner < 4; Corner++)
+		{
+			const FVector2D Offset = Corners2D[Corner] - Road.A;
+			Corners[Corner] = FVector(Corners2D[Corner], Height);
+			UVs[Corner] = FVector2D(Offset | Along, Offset | Across) / TextureSize;
+		}
+		AddFace(Section, Corners, UVs, FVector::UpVector);
+	}
+
+	static FTransform MakePropTransform(const FVector2D& Location, const float Height, const FVector2D& Forward, const FCityPropSettings& Prop, FRandomStream& Random)
+	{
+		const float Scale = Random.FRandRange(Prop.MinScale, FMath::Max(Prop.MinScale, Prop.MaxScale));
+		const float Yaw = FMath::RadiansToDegrees(FMath::Atan2(Forward.Y, Forward.X));
+		return FTransform(FRotator(0.0f, Yaw, 0.0f), FVector(Location, Height), FVector(Scale));
+	}
+
+	/** Props along the two long sides of the road, evenly spread, facing its middle. */
+	static void AddRoadProps(TArray<FTransform>& OutTransforms, const FQuad2D& Road, const float Height, const FCityPropSettings& Prop, FRandomStream& Random)
+	{
+		const FVector2D Sides[2][2] = { { Road.A, Road.B }, { Road.D, Road.C } };
+		for (int32 Side = 0; Side < 2; Side++)
+		{
+			const FVector2D& Start = Sides[Side][0];
+			const FVector2D& End = Sides[Side][1];
+			const FVector2D& OtherStart = Sides[1 - Side][0];
+			const FVector2D& OtherEnd = Sides[1 - Side][1];
+			const int32 NumProps = FMath::FloorToInt(FVector2D::Distance(Start, End) / FMath::Max(Prop.Spacing, 1.0f));
+			for (int32 i = 0; i < NumProps; i++)
+			{
+				const float Fraction = (i + 0.5f) / NumProps;
+				const FVector2D Location = FMath::Lerp(Start, End, Fraction);
+				const FVector2D Inward = (FMath::Lerp(OtherStart, OtherEnd, Fraction) - Location).GetSafeNormal();
+				OutTransforms.Add(MakePropTransform(Location + Inward * Prop.Offset, Height, Inward, Prop, Random));
+			}
+		}
+	}
+}
+
+void FCityDistrictGeometry::Build(TArrayView<const FQuad2D> Lots, TArrayView<const FQuad2D> Roads, const FCityBuilderSettings& Settings, const uint32 Seed)
+{
+	using namespace CityBuilder;
+
+	Sections.Reset();
+	PropTransforms.Reset();
+	PropTransforms.SetNum(Settings.Props.Num());
+	const int32 QuadsPerSection = FMath::Max(Settings.MaxQuadsPerSection, 1);
+	const int32 MaxFloors = FMath::Max(Settings.MinFloors, Settings.MaxFloors);
+
+	// Each lot has its own stream, so a building doesn't change when the lots before it do.
+	for (int32 LotIndex = 0; LotIndex < Lots.Num(); LotIndex++)
+	{
+		if (LotIndex % QuadsPerSection == 0)
+		{
+			FCityMeshSection& Section = Sections.AddDefaulted_GetRef();
+			const int32 NumLots = FMath::Min(QuadsPerSection, Lots.Num() - LotIndex);
+			Section.Vertices.Reserve(NumLots * 20);
+			Section.Normals.Reserve(NumLots * 20);
+			Section.UVs.Reserve(NumLots * 20);
+			Section.Triangles.Reserve(NumLots * 30);
+		}
+
+		const FQuad2D& Lot = Lots[LotIndex];
+		FRandomStream Random((int32)HashCombine(Seed, GetTypeHash(LotIndex)));
+		const float Height = Random.RandRange(Settings.MinFloors, MaxFloors) * Settings.FloorHeight;
+		AddBuilding(Sections.Last(), Lot, Height, Settings.TextureSize);
+
+		const FVector2D Center = 0.25f * (Lot.A + Lot.B + Lot.C + Lot.D);
+		for (int32 PropIndex = 0; PropIndex < Settings.Props.Num(); PropIndex++)
+		{
+			const FCityPropSettings& Prop = Settings.Props[PropIndex];
+			if (Prop.Placement != ECityPropPlacement::OnRoofs || Random.GetFraction() >= Prop.Chance) continue;
+
+			PropTransforms[PropIndex].Add(MakePropTransform(Center, Height, Lot.GetAB().GetSafeNormal(), Prop, Random));
+		}
+	}
+
+	FRandomStream RoadRandom((int32)HashCombine(Seed, GetTypeHash(-1)));
+	for (int32 RoadIndex = 0; RoadIndex < Roads.Num(); RoadIndex++)
+	{
+		if (RoadIndex % QuadsPerSection == 0)
+		{
+			FCityMeshSection& Section = Sections.AddDefaulted_GetRef();
+			const int32 NumRoads = FMath::Min(QuadsPerSection, Roads.Num() - RoadIndex);
+			Section.bIsRoad = true;
+			Section.Vertices.Reserve(NumRoads * 4);
+			Section.Normals.Reserve(NumRoads * 4);
+			Section.UVs.Reserve(NumRoads * 4);
+			Section.Triangles.Reserve(NumRoads * 6);
+		}
+
+		AddRoad(Sections.Last(), Roads[RoadIndex], Settings.RoadHeight, Settings.TextureSize);
+		for (int32 PropIndex = 0; PropIndex < Settings.Props.Num(); PropIndex++)
+		{
+			const FCityPropSettings& Prop = Settings.Props[PropIndex];
+			if (Prop.Placement != ECityPropPlacement::AlongRoads) continue;
+
+			AddRoadProps(PropTransforms[PropIndex], Roads[RoadIndex], Settings.RoadHeight, Prop, RoadRandom);
+		}
+	}
+}
+
+UCityBuilderComponent::UCityBuilderComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+
+	CommitBudgetMs = 2.0f;
+	InstancesPerStep = 256;
+	NextGeneration = 0;
+}
+
+void UCityBuilderComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	const double EndTime = FPlatformTime::Seconds() + CommitBudgetMs * 1e-3;
+	while (CommitStep() && FPlatformTime::Seconds() < EndTime)
+	{
+	}
+	if (CommitQueue.Num() == 0 && ReleaseQueue.Num() == 0)
+	{
+		SetComponentTickEnabled(false);
+	}
+}
+
+void UCityBuilderComponent::OnComponentDestroyed(bool bDestroyingHierarchy)
+{
+	// Nothing ticks past this point, so every component goes at once.
+	for (USceneComponent* Component : AllDistrictComponents)
+	{
+		if (Component)
+		{
+			Component->DestroyComponent();
+		}
+	}
+	Districts.Empty();
+	CommitQueue.Empty();
+	ReleaseQueue.Empty();
+	AllDistrictComponents.Empty();
+
+	Super::OnComponentDestroyed(bDestroyingHierarchy);
+}
+
+void UCityBuilderComponent::AddReferencedObjects(UObject* InThis, FReferenceCollector& Collector)
+{
+	UCityBuilderComponent* This = CastChecked<UCityBuilderComponent>(InThis);
+	for (TPair<int32, FDistrict>& Pair : This->Districts)
+	{
+		Collector.AddReferencedObject(Pair.Value.BuildingMaterial, This);
+		Collector.AddReferencedObject(Pair.Value.RoadMaterial, This);
+		Collector.AddReferencedObjects(Pair.Value.PropMeshes, This);
+	}
+
+	Super::AddReferencedObjects(InThis, Collector);
+}
+
+void UCityBuilderComponent::BuildPlan(const int32 DistrictIndex, const FCityPlan& Plan)
+{
+	TArray<FQuad2D> Lots;
+	TArray<FQuad2D> Roads;
+	Plan.GetQuads(ECityPlanNodeType::Lot, Lots);
+	Plan.GetQuads(ECityPlanNodeType::Road, Roads);
+	BuildQuads(DistrictIndex, Lots, Roads);
+}
+
+void UCityBuilderComponent::BuildQuads(const int32 DistrictIndex, const TArray<FQuad2D>& Lots, const TArray<FQuad2D>& Roads)
+{
+	FDistrict& District = Districts.FindOrAdd(DistrictIndex);
+	District.Generation = ++NextGeneration;
+	District.Geometry.Reset();
+	District.bIsPending = true;
+	CommitQueue.Remove(DistrictIndex);
+
+	// A commit cut short leaves incomplete components. The previous geometry stays up instead.
+	if (District.bIsCommitting)
+	{
+		ReleaseComponents(District.Components);
+		District.MeshComponent = nullptr;
+		District.PropComponent = nullptr;
+		District.bIsCommitting = false;
+	}
+
+	// The assets are taken with the inputs, so the commit matches the settings of the request.
+	District.BuildingMaterial = Settings.BuildingMaterial;
+	District.RoadMaterial = Settings.RoadMaterial;
+	District.PropMeshes.Reset(Settings.Props.Num());
+	for (const FCityPropSettings& Prop : Settings.Props)
+	{
+		District.PropMeshes.Add(Prop.Mesh);
+	}
+
+	// The task owns copies of its inputs, so they can change while it runs.
+	TWeakObjectPtr<UCityBuilderComponent> WeakThis(this);
+	const uint32 Generation = District.Generation;
+	const uint32 Seed = HashCombine((uint32)Settings.Seed, GetTypeHash(DistrictIndex));
+	Async(EAsyncExecution::ThreadPool, [WeakThis, DistrictIndex, Generation, Seed, Lots, Roads, BuildSettings = Settings]()
+	{
+		TSharedRef<FCityDistrictGeometry, ESPMode::ThreadSafe> Geometry = MakeShared<FCityDistrictGeometry, ESPMode::ThreadSafe>();
+		Geometry->Build(Lots, Roads, BuildSettings, Seed);
+
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, DistrictIndex, Generation, Geometry]()
+		{
+			UCityBuilderComponent* Component = WeakThis.Get();
+			if (!Component) return;
+
+			Component->OnGeometryBuilt(DistrictIndex, Generation, Geometry);
+		});
+	});
+}
+
+void UCityBuilderComponent::RemoveDistrict(const int32 DistrictIndex)
+{
+	FDistrict* District = Districts.Find(DistrictIndex);
+	if (!District) return;
+
+	ReleaseComponents(District->Components);
+	ReleaseComponents(District->PreviousComponents);
+	Districts.Remove(DistrictIndex);
+	CommitQueue.Remove(DistrictIndex);
+}
+
+void UCityBuilderComponent::ClearDistricts()
+{
+	for (TPair<int32, FDistrict>& Pair : Districts)
+	{
+		ReleaseComponents(Pair.Value.Components);
+		ReleaseComponents(Pair.Value.PreviousComponents);
+	}
+	Districts.Empty();
+	CommitQueue.Empty();
+}
+
+int32 UCityBuilderComponent::GetNumPendingDistricts() const
+{
+	int32 NumPending = 0;
+	for (const TPair<int32, FDistrict>& Pair : Districts)
+	{
+		NumPending += (Pair.Value.bIsPending || Pair.Value.Geometry.IsValid()) ? 1 : 0;
+	}
+	return NumPending;
+}
+
+void UCityBuilderComponent::OnGeometryBuilt(const int32 DistrictIndex, const uint32 Generation, TSharedRef<FCityDistrictGeometry, ESPMode::ThreadSafe> Geometry)
+{
+	FDistrict* District = Districts.Find(DistrictIndex);
+	if (!District || District->Generation != Generation) return;
+
+	District->bIsPending = false;
+	District->Geometry = Geometry;
+	District->NextSection = 0;
+	District->NextProp = 0;
+	District->NextInstance = 0;
+	District->bIsCommitting = false;
+	District->bHasCollision = false;
+	CommitQueue.Add(DistrictIndex);
+	SetComponentTickEnabled(true);
+}
+
+bool UCityBuilderComponent::CommitStep()
+{
+	// Destroying a component frees its render and physics state, which costs about as much as a commit.
+	while (ReleaseQueue.Num() > 0)
+	{
+		USceneComponent* Component = ReleaseQueue.Pop(false);
+		AllDistrictComponents.RemoveSingleSwap(Component, false);
+		if (Component)
+		{
+			Component->DestroyComponent();
+			return true;
+		}
+	}
+
+	while (CommitQueue.Num() > 0)
+	{
+		const int32 DistrictIndex = CommitQueue[0];
+		FDistrict* District = Districts.Find(DistrictIndex);
+		if (!District || !District->Geometry.IsValid() || !GetOwner())
+		{
+			CommitQueue.RemoveAt(0);
+			continue;
+		}
+
+		// The new geometry goes into new components, so the previous one stays up until it is complete.
+		if (!District->bIsCommitting)
+		{
+			District->PreviousComponents.Append(District->Components);
+			District->Components.Reset();
+			District->MeshComponent = NewObject<UProceduralMeshComponent>(GetOwner());
+
+			// Collision is cooked on a worker, so the commit doesn't wait for it.
+			District->MeshComponent->bUseAsyncCooking = true;
+			AddDistrictComponent(District->MeshComponent);
+			District->Components.Add(District->MeshComponent);
+			District->bIsCommitting = true;
+			return true;
+		}
+
+		// Sections go in without collision, so it is cooked once for the district instead of once per section.
+		const FCityDistrictGeometry& Geometry = *District->Geometry;
+		UProceduralMeshComponent* MeshComponent = District->MeshComponent;
+		if (District->NextSection < Geometry.Sections.Num())
+		{
+			const int32 SectionIndex = District->NextSection++;
+			const FCityMeshSection& Section = Geometry.Sections[SectionIndex];
+			MeshComponent->CreateMeshSection(SectionIndex, Section.Vertices, Section.Triangles, Section.Normals, Section.UVs, TArray<FColor>(), TArray<FProcMeshTangent>(), false);
+			MeshComponent->SetMaterial(SectionIndex, Section.bIsRoad ? District->RoadMaterial : District->BuildingMaterial);
+			return true;
+		}
+
+		if (!District->bHasCollision)
+		{
+			District->bHasCollision = true;
+			const int32 NumSections = MeshComponent->GetNumSections();
+			if (NumSections > 0)
+			{
+				for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+				{
+					MeshComponent->GetProcMeshSection(SectionIndex)->bEnableCollision = true;
+				}
+
+				// Setting a section again updates the collision of the whole component.
+				MeshComponent->SetProcMeshSection(NumSections - 1, *MeshComponent->GetProcMeshSection(NumSections - 1));
+				return true;
+			}
+		}
+
+		while (District->NextProp < Geometry.PropTransforms.Num())
+		{
+			const TArray<FTransform>& Transforms = Geometry.PropTransforms[District->NextProp];
+			UStaticMesh* Mesh = District->PropMeshes.IsValidIndex(District->NextProp) ? District->PropMeshes[District->NextProp] : nullptr;
+			if (!Mesh || Transforms.Num() == 0)
+			{
+				District->NextProp++;
+				District->NextInstance = 0;
+				continue;
+			}
+
+			// The tree is only built once every instance of the component is in.
+			if (District->NextInstance == 0)
+			{
+				District->PropComponent = NewObject<UHierarchicalInstancedStaticMeshComponent>(GetOwner());
+				District->PropComponent->SetStaticMesh(Mesh);
+				District->PropComponent->bAutoRebuildTreeOnInstanceChanges = false;
+				AddDistrictComponent(District->PropComponent);
+				District->Components.Add(District->PropComponent);
+			}
+
+			UHierarchicalInstancedStaticMeshComponent* PropComponent = District->PropComponent;
+			const int32 EndInstance = FMath::Min(District->NextInstance + FMath::Max(InstancesPerStep, 1), Transforms.Num());
+			for (int32 i = District->NextInstance; i < EndInstance; i++)
+			{
+				PropComponent->AddInstance(Transforms[i]);
+			}
+			District->NextInstance = EndInstance;
+			if (EndInstance == Transforms.Num())
+			{
+				PropComponent->BuildTreeIfOutdated(true, false);
+				District->NextProp++;
+				District->NextInstance = 0;
+			}
+			return true;
+		}
+
+		ReleaseComponents(District->PreviousComponents);
+		District->MeshComponent = nullptr;
+		District->PropComponent = nullptr;
+		District->Geometry.Reset();
+		District->bIsCommitting = false;
+		CommitQueue.RemoveAt(0);
+		OnDistrictBuilt.Broadcast(DistrictIndex);
+		return true;
+	}
+	return false;
+}
+
+void UCityBuilderComponent::AddDistrictComponent(USceneComponent* Component)
+{
+	Component->SetupAttachment(this);
+	Component->RegisterComponent();
+	AllDistrictComponents.Add(Component);
+}
+
+void UCityBuilderComponent::ReleaseComponents(TArray<USceneComponent*>& Components)
+{
+	ReleaseQueue.Append(Components);
+	Components.Reset();
+	if (ReleaseQueue.Num() > 0)
+	{
+		SetComponentTickEnabled(true);
+	}
+}
@@ -0,0 +1,580 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "CityPathfinder.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "Misc/ScopeLock.h"
+
+namespace CityPathfinder
+{
+	/** Witness searches give up after settling this many nodes, and add the shortcut instead. */
+	static const int32 MaxWitnessSettled = 256;
+
+	/** Batches are split so each worker answers at least this many queries. */
+	static const int32 MinQueriesPerWorker = 16;
+
+	/** Cells along each side of the nearest node grid, at most. */
+	static const int32 MaxGridCells = 1024;
+
+	struct FHeapEntry
+	{
+		float Key;
+		int32 Node;
+
+		bool operator<(const FHeapEntry& Other) const { return Key < Other.Key; }
+	};
+
+	struct FArc
+	{
+		int32 Target;
+		float Weight;
+		int32 Middle;
+	};
+
+	/** Road graph during contraction, with the shortcuts added as nodes are removed. */
+	struct FContraction
+	{
+		TArray<TArray<FArc>> Arcs;
+		TArray<bool> bIsContracted;
+		TArray<int32> NumContractedNeighbors;
+
+		/** Uncontracted neighbors of the last node contracted or estimated. */
+		TArray<FArc> Neighbors;
+
+		/** Witness search, with nodes tagged by search number instead of cleared. */
+		TArray<float> Distances;
+		TArray<uint32> Visits;
+		TArray<FHeapEntry> Heap;
+		uint32 SearchNumber;
+
+		explicit FContraction(const FCityRoadGraph& Graph)
+			: SearchNumber(0)
+		{
+			const int32 NumNodes = Graph.GetNumNodes();
+			Arcs.SetNum(NumNodes);
+			bIsContracted.Init(false, NumNodes);
+			NumContractedNeighbors.Init(0, NumNodes);
+			Distances.SetNumUninitialized(NumNodes);
+			Visits.Init(0, NumNodes);
+
+			// The graph already holds every edge in both directions.
+			for (int32 Node = 0; Node < NumNodes; Node++)
+			{
+				for (int32 Edge = Graph.GetFirstEdge(Node); Edge < Graph.GetEndEdge(Node); Edge++)
+				{
+					AddArc(Node, Graph.EdgeTargets[Edge], Graph.EdgeLengths[Edge], INDEX_NONE);
+				}
+			}
+		}
+
+		/** Add an arc, or shorten the existing one between the same nodes. */
+		void AddArc(const int32 From, const int32 To, const float Weight, const int32 Middle)
+		{
+			if (From == To) return;
+
+			for (FArc& Arc : Arcs[From])
+			{
+				if (Arc.Target != To) continue;
+
+				if (Weight < Arc.Weight)
+				{
+					Arc.Weight = Weight;
+					Arc.Middle = Middle;
+				}
+				return;
+			}
+			Arcs[From].Add({ To, Weight, Middle });
+		}
+
+		/** Dijkstra from the source over uncontracted nodes other than the skipped one, up to the distance. */
+		void SearchWitnesses(const int32 Source, const int32 Skipped, const float MaxDistance)
+		{
+			SearchNumber++;
+			Heap.Reset();
+			Distances[Source] = 0.0f;
+			Visits[Source] = SearchNumber;
+			Heap.HeapPush({ 0.0f, Source });
+			int32 NumSettled = 0;
+			while (Heap.Num() > 0 && NumSettled < MaxWitnessSettled)
+			{
+				FHeapEntry Entry;
+				Heap.HeapPop(Entry, false);
+				if (Entry.Key > Distances[Entry.Node]) continue;
+				if (Entry.Key > MaxDistance) break;
+
+				NumSettled++;
+				for (const FArc& Arc : Arcs[Entry.Node])
+				{
+					if (Arc.Target == Skipped || bIsContracted[Arc.Target]) continue;
+
+					const float Distance = Entry.Key + Arc.Weight;
+					if (Visits[Arc.Target] == SearchNumber && Distance >= Distances[Arc.Target]) continue;
+
+					Visits[Arc.Target] = SearchNumber;
+					Distances[Arc.Target] = Distance;
+					Heap.HeapPush({ Distance, Arc.Target });
+				}
+			}
+		}
+
+		float GetWitnessDistance(const int32 Node) const
+		{
+			return (Visits[Node] == SearchNumber) ? Distances[Node] : MAX_FLT;
+		}
+
+		/** Shortcuts needed to remove the node, which are added if bApply is true. */
+		int32 Contract(const int32 Node, const bool bApply)
+		{
+			Neighbors.Reset();
+			for (const FArc& Arc : Arcs[Node])
+			{
+				if (!bIsContracted[Arc.Target])
+				{
+					Neighbors.Add(Arc);
+				}
+			}
+
+			// Each pair is checked once, from its first neighbor. Shortcuts added on the way are
+			// real paths around the node, so they can serve as witnesses for the next pairs.
+			int32 NumShortcuts = 0;
+			for (int32 i = 0; i + 1 < Neighbors.Num(); i++)
+			{
+				const FArc& From = Neighbors[i];
+				float MaxWeight = 0.0f;
+				for (int32 j = i + 1; j < Neighbors.Num(); j++)
+				{
+					MaxWeight = FMath::Max(MaxWeight, Neighbors[j].Weight);
+				}
+				SearchWitnesses(From.Target, Node, From.Weight + MaxWeight);
+
+				for (int32 j = i + 1; j < Neighbors.Num(); j++)
+				{
+					const FArc& To = Neighbors[j];
+					const float Weight = From.Weight + To.Weight;
+					if (GetWitnessDistance(To.Target) <= Weight) continue;
+
+					NumShortcuts++;
+					if (bApply)
+					{
+						AddArc(From.Target, To.Target, Weight, Node);
+						AddArc(To.Target, From.Target, Weight, Node);
+					}
+				}
+			}
+			return NumShortcuts;
+		}
+
+		/** Edge difference, plus the neighbors already removed so contraction spreads evenly. */
+		float GetPriority(const int32 Node)
+		{
+			const int32 NumShortcuts = Contract(Node, false);
+			return (float)(NumShortcuts - Neighbors.Num() + NumContractedNeighbors[Node]);
+		}
+	};
+}
+
+void FCityPathScratch::Prepare(const int32 NumNodes)
+{
+	if (Visits[0].Num() != NumNodes)
+	{
+		for (int32 Direction = 0; Direction < 2; Direction++)
+		{
+			Distances[Direction].SetNumUninitialized(NumNodes);
+			Parents[Direction].SetNumUninitialized(NumNodes);
+			Visits[Direction].Init(0, NumNodes);
+		}
+		QueryNumber = 0;
+	}
+
+	// Tags are only cleared when the query number wraps around.
+	QueryNumber++;
+	if (QueryNumber == 0)
+	{
+		for (int32 Direction = 0; Direction < 2; Direction++)
+		{
+			FMemory::Memzero(Visits[Direction].GetData(), Visits[Direction].Num() * sizeof(uint32));
+		}
+		QueryNumber = 1;
+	}
+	Heaps[0].Reset();
+	Heaps[1].Reset();
+	UnpackStack.Reset();
+}
+
+void FCityPathfinder::Build(const FCityRoadGraph& Graph)
+{
+	using namespace CityPathfinder;
+
+	NodeLocations = Graph.NodeLocations;
+	UpOffsets.Reset();
+	UpTargets.Reset();
+	UpWeights.Reset();
+	UpMiddles.Reset();
+	GridOffsets.Reset();
+	GridNodes.Reset();
+	NumShortcuts = 0;
+	const int32 NumNodes = NodeLocations.Num();
+	if (NumNodes == 0) return;
+
+	// Contract the node with the lowest priority first. Priorities only grow as the graph is
+	// contracted, so a node is re-estimated when popped, and put back if it is no longer lowest.
+	FContraction Contraction(Graph);
+	TArray<FHeapEntry> Queue;
+	Queue.Reserve(NumNodes);
+	for (int32 Node = 0; Node < NumNodes; Node++)
+	{
+		Queue.Add({ Contraction.GetPriority(Node), Node });
+	}
+	Queue.Heapify();
+
+	TArray<int32> Ranks;
+	Ranks.SetNumUninitialized(NumNodes);
+	int32 NextRank = 0;
+	while (Queue.Num() > 0)
+	{
+		FHeapEntry Entry;
+		Queue.HeapPop(Entry, false);
+		const int32 Node = Entry.Node;
+		const float Priority = Contraction.GetPriority(Node);
+		if (Queue.Num() > 0 && Priority > Queue.HeapTop().Key)
+		{
+			Queue.HeapPush({ Priority, Node });
+			continue;
+		}
+
+		NumShortcuts += Contraction.Contract(Node, true);
+		Contraction.bIsContracted[Node] = true;
+		for (const FArc& Neighbor : Contraction.Neighbors)
+		{
+			Contraction.NumContractedNeighbors[Neighbor.Target]++;
+		}
+		Ranks[Node] = NextRank++;
+	}
+
+	// Queries only ever climb, so each node keeps the arcs to the nodes contracted after it.
+	UpOffsets.SetNumZeroed(NumNodes + 1);
+	for (int32 Node = 0; Node < NumNodes; Node++)
+	{
+		for (const FArc& Arc : Contraction.Arcs[Node])
+		{
+			UpOffsets[Node + 1] += (Ranks[Arc.Target] > Ranks[Node]) ? 1 : 0;
+		}
+	}
+	for (int32 Node = 1; Node <= NumNodes; Node++)
+	{
+		UpOffsets[Node] += UpOffsets[Node - 1];
+	}
+	const int32 NumArcs = UpOffsets.Last();
+	UpTargets.SetNumUninitialized(NumArcs);
+	UpWeights.SetNumUninitialized(NumArcs);
+	UpMiddles.SetNumUninitialized(NumArcs);
+	for (int32 Node = 0; Node < NumNodes; Node++)
+	{
+		int32 Cursor = UpOffsets[Node];
+		for (const FArc& Arc : Contraction.Arcs[Node])
+		{
+			if (Ranks[Arc.Target] < Ranks[Node]) continue;
+
+			UpTargets[Cursor] = Arc.Target;
+			UpWeights[Cursor] = Arc.Weight;
+			UpMiddles[Cursor] = Arc.Middle;
+			Cursor++;
+		}
+	}
+
+	// Grid of about one node per cell, bucketed with a counting sort.
+	FBox2D Bounds(ForceInit);
+	for (const FVector2D& Location : NodeLocations)
+	{
+		Bounds += Location;
+	}
+	const FVector2D Size = Bounds.GetSize();
+	GridOrigin = Bounds.Min;
+	GridCellSize = FMath::Max3(FMath::Sqrt(FMath::Max(Size.X * Size.Y, 1.0f) / NumNodes), FMath::Max(Size.X, Size.Y) / MaxGridCells, 1.0f);
+	GridSize = FIntPoint(FMath::Min(FMath::FloorToInt(Size.X / GridCellSize) + 1, MaxGridCells), FMath::Min(FMath::FloorToInt(Size.Y / GridCellSize) + 1, MaxGridCells));
+	auto GetCell = [this](const FVector2D& Location)
+	{
+		const int32 X = FMath::Clamp(FMath::FloorToInt((Location.X - GridOrigin.X) / GridCellSize), 0, GridSize.X - 1);
+		const int32 Y = FMath::Clamp(FMath::FloorToInt((Location.Y - GridOrigin.Y) / GridCellSize), 0, GridSize.Y - 1);
+		return Y * GridSize.X + X;
+	};
+	GridOffsets.SetNumZeroed(GridSize.X * GridSize.Y + 1);
+	for (const FVector2D& Location : NodeLocations)
+	{
+		GridOffsets[GetCell(Location) + 1]++;
+	}
+	for (int32 Cell = 1; Cell < GridOffsets.Num(); Cell++)
+	{
+		GridOffsets[Cell] += GridOffsets[Cell - 1];
+	}
+	GridNodes.SetNumUninitialized(NumNodes);
+	TArray<int32> Cursors(GridOffsets.GetData(), GridOffsets.Num() - 1);
+	for (int32 Node = 0; Node < NumNodes; Node++)
+	{
+		GridNodes[Cursors[GetCell(NodeLocations[Node])]++] = Node;
+	}
+
+	UE_LOG(LogProceduralGenerator, Verbose, TEXT("Road hierarchy built: %d nodes, %d shortcuts, %d upward arcs."), NumNodes, NumShortcuts, NumArcs);
+}
+
+int32 FCityPathfinder::FindNearestNode(const FVector2D& Location) const
+{
+	if (NodeLocations.Num() == 0 || GridOffsets.Num() == 0) return INDEX_NONE;
+
+	// Search rings of cells around the closest cell inside the grid. Nodes beyond ring R are at
+	// least R cells away from that cell, and so from the location.
+	const int32 CenterX = FMath::Clamp(FMath::FloorToInt((Location.X - GridOrigin.X) / GridCellSize), 0, GridSize.X - 1);
+	const int32 CenterY = FMath::Clamp(FMath::FloorToInt((Location.Y - GridOrigin.Y) / GridCellSize), 0, GridSize.Y - 1);
+	const int32 MaxRing = FMath::Max(GridSize.X, GridSize.Y);
+	int32 BestNode = INDEX_NONE;
+	float BestDistanceSquared = MAX_FLT;
+	for (int32 Ring = 0; Ring <= MaxRing; Ring++)
+	{
+		for (int32 Y = FMath::Max(CenterY - Ring, 0); Y <= FMath::Min(CenterY + Ring, GridSize.Y - 1); Y++)
+		{
+			// Rows inside the ring only have a cell at each end.
+			const bool bIsEdgeRow = FMath::Abs(Y - CenterY) == Ring;
+			const int32 Step = (bIsEdgeRow || Ring == 0) ? 1 : 2 * Ring;
+			for (int32 X = CenterX - Ring; X <= CenterX + Ring; X += Step)
+			{
+				if (X < 0 || X >= GridSize.X) continue;
+
+				const int32 Cell = Y * GridSize.X + X;
+				for (int32 i = GridOffsets[Cell]; i < GridOffsets[Cell + 1]; i++)
+				{
+					const float DistanceSquared = FVector2D::DistSquared(NodeLocations[GridNodes[i]], Location);
+					if (DistanceSquared < BestDistanceSquared)
+					{
+						BestDistanceSquared = DistanceSquared;
+						BestNode = GridNodes[i];
+					}
+				}
+			}
+		}
+		if (BestNode != INDEX_NONE && BestDistanceSquared <= FMath::Square(Ring * GridCellSize)) break;
+	}
+	return BestNode;
+}
+
+bool FCityPathfinder::FindPath(const int32 Start, const int32 Goal, FCityPathScratch& Scratch, TArray<int32>& OutPath, float& OutLength) const
+{
+	if (!IsBuilt() || !NodeLocations.IsValidIndex(Start) || !NodeLocations.IsValidIndex(Goal)) return false;
+	if (Start == Goal)
+	{
+		OutPath.Add(Start);
+		OutLength = 0.0f;
+		return true;
+	}
+
+	Scratch.Prepare(NodeLocations.Num());
+	const int32 Sources[2] = { Start, Goal };
+	for (int32 Direction = 0; Direction < 2; Direction++)
+	{
+		Scratch.Distances[Direction][Sources[Direction]] = 0.0f;
+		Scratch.Parents[Direction][Sources[Direction]] = INDEX_NONE;
+		Scratch.Visits[Direction][Sources[Direction]] = Scratch.QueryNumber;
+		Scratch.Heaps[Direction].HeapPush({ 0.0f, Sources[Direction] });
+	}
+
+	// Both searches climb the hierarchy, always advancing the one with the closest node, until
+	// neither can find anything shorter than the best meeting point.
+	float BestLength = MAX_FLT;
+	int32 MeetingNode = INDEX_NONE;
+	for (;;)
+	{
+		const bool bCanGoForward = Scratch.Heaps[0].Num() > 0 && Scratch.Heaps[0].HeapTop().Distance < BestLength;
+		const bool bCanGoBackward = Scratch.Heaps[1].Num() > 0 && Scratch.Heaps[1].HeapTop().Distance < BestLength;
+		if (!bCanGoForward && !bCanGoBackward) break;
+
+		const int32 Direction = (bCanGoForward && (!bCanGoBackward || Scratch.Heaps[0].HeapTop().Distance <= Scratch.Heaps[1].HeapTop().Distance)) ? 0 : 1;
+		FCityPathScratch::FHeapEntry Entry;
+		Scratch.Heaps[Direction].HeapPop(Entry, false);
+		if (Entry.Distance > Scratch.Distances[Direction][Entry.Node]) continue;
+
+		if (Scratch.IsVisited(1 - Direction, Entry.Node))
+		{
+			const float Length = Entry.Distance + Scratch.Distances[1 - Direction][Entry.Node];
+			if (Length < BestLength)
+			{
+				BestLength = Length;
+				MeetingNode = Entry.Node;
+			}
+		}
+
+		for (int32 Arc = UpOffsets[Entry.Node]; Arc < UpOffsets[Entry.Node + 1]; Arc++)
+		{
+			const int32 Target = UpTargets[Arc];
+			const float Distance = Entry.Distance + UpWeights[Arc];
+			if (Scratch.IsVisited(Direction, Target) && Distance >= Scratch.Distances[Direction][Target]) continue;
+
+			Scratch.Visits[Direction][Target] = Scratch.QueryNumber;
+			Scratch.Distances[Direction][Target] = Distance;
+			Scratch.Parents[Direction][Target] = Entry.Node;
+			Scratch.Heaps[Direction].HeapPush({ Distance, Target });
+		}
+	}
+	if (MeetingNode == INDEX_NONE) return false;
+
+	// The forward arcs are stacked from the meeting point down, so the first one is expanded
+	// first. The backward arcs are already in order, so each is expanded as it is reached.
+	OutPath.Add(Start);
+	for (int32 Node = MeetingNode; Scratch.Parents[0][Node] != INDEX_NONE; Node = Scratch.Parents[0][Node])
+	{
+		Scratch.UnpackStack.Emplace(Scratch.Parents[0][Node], Node);
+	}
+	UnpackArcs(Scratch, OutPath);
+	for (int32 Node = MeetingNode; Scratch.Parents[1][Node] != INDEX_NONE; Node = Scratch.Parents[1][Node])
+	{
+		Scratch.UnpackStack.Emplace(Node, Scratch.Parents[1][Node]);
+		UnpackArcs(Scratch, OutPath);
+	}
+	OutLength = BestLength;
+	return true;
+}
+
+void FCityPathfinder::FindPaths(TArrayView<const FCityPathQuery> Queries, FCityPathBatch& OutBatch) const
+{
+	using namespace CityPathfinder;
+
+	OutBatch.Reset();
+	OutBatch.Results.SetNum(Queries.Num());
+	if (Queries.Num() == 0) return;
+
+	// Each worker answers a contiguous range of queries into its own node array, so the arrays
+	// only need to be appended in order afterwards.
+	const int32 NumWorkers = FMath::Clamp(Queries.Num() / MinQueriesPerWorker, 1, FTaskGraphInterface::Get().GetNumWorkerThreads() + 1);
+	TArray<TArray<int32>> WorkerNodes;
+	WorkerNodes.SetNum(NumWorkers);
+	ParallelFor(NumWorkers, [this, &Queries, &OutBatch, &WorkerNodes, NumWorkers](const int32 WorkerIndex)
+	{
+		const int32 FirstQuery = (int32)(((int64)Queries.Num() * WorkerIndex) / NumWorkers);
+		const int32 EndQuery = (int32)(((int64)Queries.Num() * (WorkerIndex + 1)) / NumWorkers);
+		TArray<int32>& Nodes = WorkerNodes[WorkerIndex];
+		FCityPathScratch* Scratch = AcquireScratch();
+		for (int32 QueryIndex = FirstQuery; QueryIndex < EndQuery; QueryIndex++)
+		{
+			FCityPathResult& Result = OutBatch.Results[QueryIndex];
+			Result.FirstNode = Nodes.Num();
+			float Length = 0.0f;
+			if (FindPath(Queries[QueryIndex].Start, Queries[QueryIndex].Goal, *Scratch, Nodes, Length))
+			{
+				Result.NumNodes = Nodes.Num() - Result.FirstNode;
+				Result.Length = Length;
+			}
+		}
+		ReleaseScratch(Scratch);
+	});
+
+	int32 NumNodes = 0;
+	for (const TArray<int32>& Nodes : WorkerNodes)
+	{
+		NumNodes += Nodes.Num();
+	}
+	OutBatch.Nodes.Reserve(NumNodes);
+	for (int32 WorkerIndex = 0; WorkerIndex < NumWorkers; WorkerIndex++)
+	{
+		const int32 Offset = OutBatch.Nodes.Num();
+		const int32 FirstQuery = (int32)(((int64)Queries.Num() * WorkerIndex) / NumWorkers);
+		const int32 EndQuery = (int32)(((int64)Queries.Num() * (WorkerIndex + 1)) / NumWorkers);
+		for (int32 QueryIndex = FirstQuery; QueryIndex < EndQuery; QueryIndex++)
+		{
+			OutBatch.Results[QueryIndex].FirstNode += Offset;
+		}
+		OutBatch.Nodes.Append(WorkerNodes[WorkerIndex]);
+	}
+}
+
+void FCityPathfinder::FindPathsAsync(const TSharedRef<const FCityPathfinder, ESPMode::ThreadSafe>& Pathfinder, TArray<FCityPathQuery>&& Queries, TFunction<void(FCityPathBatch&&)>&& OnComplete)
+{
+	Async(EAsyncExecution::ThreadPool, [Pathfinder, Queries = MoveTemp(Queries), OnComplete = MoveTemp(OnComplete)]() mutable
+	{
+		FCityPathBatch Batch;
+		Pathfinder->FindPaths(Queries, Batch);
+
+		AsyncTask(ENamedThreads::GameThread, [Batch = MoveTemp(Batch), OnComplete = MoveTemp(OnComplete)]() mutable
+		{
+			OnComplete(MoveTemp(Batch));
+		});
+	});
+}
+
+SIZE_T FCityPathfinder::GetAllocatedSize() const
+{
+	return NodeLocations.GetAllocatedSize() + UpOffsets.GetAllocatedSize() + UpTargets.GetAllocatedSize() + UpWeights.GetAllocatedSize()
+		+ UpMiddles.GetAllocatedSize() + GridOffsets.GetAllocatedSize() + GridNodes.GetAllocatedSize();
+}
+
+float FCityPathfinder::FindPathLengthReference(const FCityRoadGraph& Graph, const int32 Start, const int32 Goal)
+{
+	if (!Graph.NodeLocations.IsValidIndex(Start) || !Graph.NodeLocations.IsValidIndex(Goal)) return MAX_FLT;
+
+	TArray<float> Distances;
+	Distances.Init(MAX_FLT, Graph.GetNumNodes());
+	TArray<CityPathfinder::FHeapEntry> Heap;
+	Distances[Start] = 0.0f;
+	Heap.HeapPush({ 0.0f, Start });
+	while (Heap.Num() > 0)
+	{
+		CityPathfinder::FHeapEntry Entry;
+		Heap.HeapPop(Entry, false);
+		if (Entry.Node == Goal) return Entry.Key;
+		if (Entry.Key > Distances[Entry.Node]) continue;
+
+		for (int32 Edge = Graph.GetFirstEdge(Entry.Node); Edge < Graph.GetEndEdge(Entry.Node); Edge++)
+		{
+			const int32 Target = Graph.EdgeTargets[Edge];
+			const float Distance = Entry.Key + Graph.EdgeLengths[Edge];
+			if (Distance >= Distances[Target]) continue;
+
+			Distances[Target] = Distance;
+			Heap.HeapPush({ Distance, Target });
+		}
+	}
+	return MAX_FLT;
+}
+
+int32 FCityPathfinder::FindArc(const int32 From, const int32 To) const
+{
+	for (int32 Arc = UpOffsets[From]; Arc < UpOffsets[From + 1]; Arc++)
+	{
+		if (UpTargets[Arc] == To) return Arc;
+	}
+	for (int32 Arc = UpOffsets[To]; Arc < UpOffsets[To + 1]; Arc++)
+	{
+		if (UpTargets[Arc] == From) return Arc;
+	}
+	return INDEX_NONE;
+}
+
+void FCityPathfinder::UnpackArcs(FCityPathScratch& Scratch, TArray<int32>& OutPath) const
+{
+	// A shortcut stands for the two arcs through the node it skips, which was contracted before
+	// both ends, so both arcs are stored on it.
+	while (Scratch.UnpackStack.Num() > 0)
+	{
+		const TPair<int32, int32> Pair = Scratch.UnpackStack.Pop(false);
+		const int32 Arc = FindArc(Pair.Key, Pair.Value);
+		check(Arc != INDEX_NONE);
+		const int32 Middle = UpMiddles[Arc];
+		if (Middle == INDEX_NONE)
+		{
+			OutPath.Add(Pair.Value);
+			continue;
+		}
+		Scratch.UnpackStack.Emplace(Middle, Pair.Value);
+		Scratch.UnpackStack.Emplace(Pair.Key, Middle);
+	}
+}
+
+FCityPathScratch* FCityPathfinder::AcquireScratch() const
+{
+	FScopeLock Lock(&ScratchLock);
+	return (ScratchPool.Num() > 0) ? ScratchPool.Pop(false).Release() : new FCityPathScratch();
+}
+
+void FCityPathfinder::ReleaseScratch(FCityPathScratch* Scratch) const
+{
+	FScopeLock Lock(&ScratchLock);
+	ScratchPool.Emplace(Scratch);
+}
@@ -0,0 +1,455 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "CityPlanGenerator.h"
+#include "Async/ParallelFor.h"
+#include "ConvexVolume.h"
+#include "Quad2DSet.h"
+
+namespace CityPlanGenerator
+{
+	/** Stack of a query. Siblings don't overlap, so it rarely holds more than a few nodes per level. */
+	typedef TArray<int32, TInlineAllocator<64>> FQueryStack;
+
+	/** Seed of the n-th child of an area. */
+	static uint32 GetChildSeed(const uint32 ParentSeed, const int32 ChildIndex)
+	{
+		return HashCombine(ParentSeed, GetTypeHash(ChildIndex + 1));
+	}
+
+	/** Bounds test that includes the edges, so points on an edge shared by siblings are found in one of them. */
+	static bool IsInsideOrOn(const FBox2D& Box, const FVector2D& Point)
+	{
+		return Point.X >= Box.Min.X && Point.X <= Box.Max.X && Point.Y >= Box.Min.Y && Point.Y <= Box.Max.Y;
+	}
+
+	/** The plan itself if it has bounds, otherwise a copy of its nodes with bounds built into the scratch plan. */
+	static const FCityPlan& GetQueryablePlan(const FCityPlan& Plan, FCityPlan& ScratchPlan)
+	{
+		if (Plan.HasBounds()) return Plan;
+
+		ScratchPlan.Nodes = Plan.Nodes;
+		ScratchPlan.BuildBounds();
+		return ScratchPlan;
+	}
+
+	/**
+	 * Pick the axis to cut the quad across, if any side is longer than MaxSize and can fit two
+	 * sides of MinSize with the gap between them. Also picks the length of the first part.
+	 */
+	static bool ChooseCut(const FQuad2D& Quad, const FCityPlanSettings& Settings, const int32 Depth, const float MinSize, const float MaxSize, const float Gap, FRandomStream& Random, bool& bOutUseADAxis, float& OutFirstLength, float& OutLength)
+	{
+		const float LengthAD = Quad.GetLength(true);
+		const float LengthAB = Quad.GetLength(false);
+		const bool bCanCutAD = LengthAD > MaxSize && LengthAD >= (2.0f * MinSize) + Gap;
+		const bool bCanCutAB = LengthAB > MaxSize && LengthAB >= (2.0f * MinSize) + Gap;
+		if (!bCanCutAD && !bCanCutAB) return false;
+
+		if (bCanCutAD && bCanCutAB)
+		{
+			switch (Settings.SplitAxis)
+			{
+			case ECityPlanSplitAxis::Alternate:
+				bOutUseADAxis = (Depth % 2) == 0;
+				break;
+			case ECityPlanSplitAxis::Random:
+				bOutUseADAxis = Random.GetFraction() < 0.5f;
+				break;
+			case ECityPlanSplitAxis::Longest:
+			default:
+				bOutUseADAxis = LengthAD >= LengthAB;
+				break;
+			}
+		}
+		else
+		{
+			bOutUseADAxis = bCanCutAD;
+		}
+
+		OutLength = bOutUseADAxis ? LengthAD : LengthAB;
+		OutFirstLength = Random.FRandRange(MinSize, OutLength - Gap - MinSize);
+		return true;
+	}
+
+	/** District at the fan-out depth, generated on its own by a worker. */
+	struct FSubtreeTask
+	{
+		int32 NodeIndex;
+		uint32 Seed;
+		int32 Depth;
+
+		/** Worker arena that holds the subtree, and where in it. */
+		int32 WorkerIndex;
+		int32 FirstArenaNode;
+		int32 NumArenaNodes;
+	};
+
+	/** Recursion state, shared by every area it generates. */
+	struct FBuilder
+	{
+		const FCityPlanSettings& Settings;
+
+		TArray<FCityPlanNode>& Nodes;
+
+		/** If set, districts at TaskDepth are deferred here instead of being split. */
+		TArray<FSubtreeTask>* Tasks;
+
+		int32 TaskDepth;
+
+		/** Areas of the block being split, with their depth. Reused by every block. */
+		TArray<TPair<FQuad2D, int32>> LotStack;
+
+		/** Finished lots of the block being split. Reused by every block. */
+		TArray<FQuad2D> Lots;
+
+		FBuilder(const FCityPlanSettings& InSettings, TArray<FCityPlanNode>& InNodes)
+			: Settings(InSettings)
+			, Nodes(InNodes)
+			, Tasks(nullptr)
+			, TaskDepth(0)
+		{
+		}
+
+		int32 AddNode(const FQuad2D& Quad, const ECityPlanNodeType Type, const int32 Parent)
+		{
+			const int32 NodeIndex = Nodes.AddDefaulted();
+			FCityPlanNode& Node = Nodes[NodeIndex];
+			Node.Quad = Quad;
+			Node.Type = Type;
+			Node.Parent = Parent;
+			return NodeIndex;
+		}
+
+		/** Cut the district in two with a road, or turn it into a block if small enough. */
+		void SubdivideDistrict(const int32 NodeIndex, const uint32 Seed, const int32 Depth)
+		{
+			if (Tasks && Depth >= TaskDepth)
+			{
+				FSubtreeTask& Task = Tasks->AddDefaulted_GetRef();
+				Task.NodeIndex = NodeIndex;
+				Task.Seed = Seed;
+				Task.Depth = Depth;
+				return;
+			}
+
+			FRandomStream Random((int32)Seed);
+			const FQuad2D Quad = Nodes[NodeIndex].Quad;
+			bool bUseADAxis = false;
+			float FirstLength = 0.0f;
+			float Length = 0.0f;
+			if (Depth >= Settings.MaxDepth || !ChooseCut(Quad, Settings, Depth, Settings.MinBlockSize, Settings.MaxBlockSize, Settings.RoadWidth, Random, bUseADAxis, FirstLength, Length))
+			{
+				Nodes[NodeIndex].Type = ECityPlanNodeType::Block;
+				SubdivideBlock(NodeIndex, Seed);
+				return;
+			}
+
+			// The road is cut from the rest, so its edges match the parts on both sides exactly.
+			FQuad2D First;
+			FQuad2D Rest;
+			FQuad2D Road;
+			FQuad2D Second;
+			Quad.Divide(FirstLength / Length, bUseADAxis, First, Rest);
+			Rest.Divide(Settings.RoadWidth / (Length - FirstLength), bUseADAxis, Road, Second);
+			if (!bUseADAxis)
+			{
+				// Turn the road so its centerline always runs from DA to BC, keeping the winding.
+				Road = FQuad2D(Road.D, Road.A, Road.B, Road.C);
+			}
+
+			const int32 FirstChild = AddNode(First, ECityPlanNodeType::District, NodeIndex);
+			AddNode(Road, ECityPlanNodeType::Road, NodeIndex);
+			AddNode(Second, ECityPlanNodeType::District, NodeIndex);
+			Nodes[NodeIndex].FirstChild = FirstChild;
+			Nodes[NodeIndex].NumChildren = 3;
+
+			SubdivideDistrict(FirstChild, GetChildSeed(Seed, 0), Depth + 1);
+			SubdivideDistrict(FirstChild + 2, GetChildSeed(Seed, 2), Depth + 1);
+		}
+
+		/** Split the block into lots, then add them as its children. */
+		void SubdivideBlock(const int32 NodeIndex, const uint32 Seed)
+		{
+			FRandomStream Random((int32)Seed);
+			LotStack.Reset();
+			Lots.Reset();
+			LotStack.Emplace(UGeneratorLibrary::ResizeQuad2D(Nodes[NodeIndex].Quad, -Settings.SidewalkWidth), 0);
+			while (LotStack.Num() > 0)
+			{
+				const TPair<FQuad2D, int32> Area = LotStack.Pop(false);
+				bool bUseADAxis = false;
+				float FirstLength = 0.0f;
+				float Length = 0.0f;
+				if (Area.Value >= Settings.MaxDepth || !ChooseCut(Area.Key, Settings, Area.Value, Settings.MinLotSize, Settings.MaxLotSize, 0.0f, Random, bUseADAxis, FirstLength, Length))
+				{
+					Lots.Add(Area.Key);
+					continue;
+				}
+
+				// The second part is pushed first, so lots come out in order along the block.
+				FQuad2D First;
+				FQuad2D Second;
+				Area.Key.Divide(FirstLength / Length, bUseADAxis, First, Second);
+				LotStack.Emplace(Second, Area.Value + 1);
+				LotStack.Emplace(First, Area.Value + 1);
+			}
+
+			// Every lot of the block is inset at once, four at a time.
+			FQuad2DSet::ResizeQuads(Lots, -Settings.LotSetback, Lots);
+
+			const int32 FirstChild = Nodes.Num();
+			for (const FQuad2D& Lot : Lots)
+			{
+				AddNode(Lot, ECityPlanNodeType::Lot, NodeIndex);
+			}
+			Nodes[NodeIndex].FirstChild = FirstChild;
+			Nodes[NodeIndex].NumChildren = Lots.Num();
+		}
+	};
+}
+
+void FCityPlan::GetQuads(const ECityPlanNodeType Type, TArray<FQuad2D>& OutQuads) const
+{
+	OutQuads.Reserve(OutQuads.Num() + GetNumNodes(Type));
+	for (const FCityPlanNode& Node : Nodes)
+	{
+		if (Node.Type == Type)
+		{
+			OutQuads.Add(Node.Quad);
+		}
+	}
+}
+
+int32 FCityPlan::GetNumNodes(const ECityPlanNodeType Type) const
+{
+	int32 NumNodes = 0;
+	for (const FCityPlanNode& Node : Nodes)
+	{
+		NumNodes += (Node.Type == Type) ? 1 : 0;
+	}
+	return NumNodes;
+}
+
+void FCityPlan::BuildBounds()
+{
+	Bounds.SetNumUninitialized(Nodes.Num());
+	for (int32 NodeIndex = 0; NodeIndex < Nodes.Num(); NodeIndex++)
+	{
+		Bounds[NodeIndex] = Nodes[NodeIndex].Quad.GetBounds();
+	}
+
+	// Children always come after their parent, so a reverse pass sees every subtree complete.
+	for (int32 NodeIndex = Nodes.Num() - 1; NodeIndex > 0; NodeIndex--)
+	{
+		const int32 Parent = Nodes[NodeIndex].Parent;
+		if (Parent != INDEX_NONE)
+		{
+			Bounds[Parent] += Bounds[NodeIndex];
+		}
+	}
+}
+
+void FCityPlan::BuildIndex()
+{
+	BuildBounds();
+	RoadGraph.Build(*this);
+}
+
+void FCityPlan::PostSerialize(const FArchive& Ar)
+{
+	if (Ar.IsLoading() && Nodes.Num() > 0)
+	{
+		BuildIndex();
+	}
+}
+
+int32 FCityPlan::FindLeafAt(const FVector2D& Point) const
+{
+	if (!ensureMsgf(HasBounds(), TEXT("City plan queried without bounds. Call BuildIndex after editing the nodes."))) return INDEX_NONE;
+	if (!CityPlanGenerator::IsInsideOrOn(Bounds[0], Point) || !Nodes[0].Quad.Contains(Point)) return INDEX_NONE;
+
+	// Siblings don't overlap, so at most one child contains the point at each level.
+	int32 NodeIndex = 0;
+	for (;;)
+	{
+		const FCityPlanNode& Node = Nodes[NodeIndex];
+		int32 ContainingChild = INDEX_NONE;
+		for (int32 ChildIndex = Node.FirstChild; ChildIndex < Node.FirstChild + Node.NumChildren; ChildIndex++)
+		{
+			if (CityPlanGenerator::IsInsideOrOn(Bounds[ChildIndex], Point) && Nodes[ChildIndex].Quad.Contains(Point))
+			{
+				ContainingChild = ChildIndex;
+				break;
+			}
+		}
+		if (ContainingChild == INDEX_NONE) return NodeIndex;
+
+		NodeIndex = ContainingChild;
+	}
+}
+
+int32 FCityPlan::FindNodeAt(const FVector2D& Point, const ECityPlanNodeType Type) const
+{
+	int32 NodeIndex = FindLeafAt(Point);
+	while (NodeIndex != INDEX_NONE && Nodes[NodeIndex].Type != Type)
+	{
+		NodeIndex = Nodes[NodeIndex].Parent;
+	}
+	return NodeIndex;
+}
+
+void FCityPlan::QueryRadius(const FVector2D& Center, const float Radius, const ECityPlanNodeType Type, TArray<int32>& OutNodes) const
+{
+	if (!ensureMsgf(HasBounds(), TEXT("City plan queried without bounds. Call BuildIndex after editing the nodes."))) return;
+
+	const float RadiusSquared = Radius * Radius;
+	CityPlanGenerator::FQueryStack Stack;
+	Stack.Add(0);
+	while (Stack.Num() > 0)
+	{
+		const int32 NodeIndex = Stack.Pop(false);
+		const FBox2D& NodeBounds = Bounds[NodeIndex];
+		const FVector2D Closest(FMath::Clamp(Center.X, NodeBounds.Min.X, NodeBounds.Max.X), FMath::Clamp(Center.Y, NodeBounds.Min.Y, NodeBounds.Max.Y));
+		if (FVector2D::DistSquared(Center, Closest) > RadiusSquared) continue;
+
+		const FCityPlanNode& Node = Nodes[NodeIndex];
+		if (Node.Type == Type && Node.Quad.GetDistanceSquared(Center) <= RadiusSquared)
+		{
+			OutNodes.Add(NodeIndex);
+		}
+		for (int32 ChildIndex = Node.FirstChild + Node.NumChildren - 1; ChildIndex >= Node.FirstChild; ChildIndex--)
+		{
+			Stack.Add(ChildIndex);
+		}
+	}
+}
+
+void FCityPlan::QueryFrustum(const FConvexVolume& Frustum, const float MinHeight, const float MaxHeight, const ECityPlanNodeType Type, TArray<int32>& OutNodes) const
+{
+	if (!ensureMsgf(HasBounds(), TEXT("City plan queried without bounds. Call BuildIndex after editing the nodes."))) return;
+
+	const float Middle = 0.5f * (MinHeight + MaxHeight);
+	const float HalfHeight = 0.5f * FMath::Abs(MaxHeight - MinHeight);
+	CityPlanGenerator::FQueryStack Stack;
+	Stack.Add(0);
+	while (Stack.Num() > 0)
+	{
+		const int32 NodeIndex = Stack.Pop(false);
+		const FBox2D& NodeBounds = Bounds[NodeIndex];
+		if (!Frustum.IntersectBox(FVector(NodeBounds.GetCenter(), Middle), FVector(NodeBounds.GetExtent(), HalfHeight))) continue;
+
+		const FCityPlanNode& Node = Nodes[NodeIndex];
+		if (Node.Type == Type)
+		{
+			OutNodes.Add(NodeIndex);
+		}
+		for (int32 ChildIndex = Node.FirstChild + Node.NumChildren - 1; ChildIndex >= Node.FirstChild; ChildIndex--)
+		{
+			Stack.Add(ChildIndex);
+		}
+	}
+}
+
+void UCityPlanGenerator::Generate(const FQuad2D& District, FCityPlan& OutPlan) const
+{
+	GeneratePlan(District, Settings, OutPlan);
+}
+
+void UCityPlanGenerator::GetPlanQuads(const FCityPlan& Plan, const ECityPlanNodeType Type, TArray<FQuad2D>& OutQuads)
+{
+	OutQuads.Reset();
+	Plan.GetQuads(Type, OutQuads);
+}
+
+void UCityPlanGenerator::RebuildPlanIndex(FCityPlan& Plan)
+{
+	Plan.BuildIndex();
+}
+
+int32 UCityPlanGenerator::FindPlanNodeAt(const FCityPlan& Plan, const FVector& Location, const ECityPlanNodeType Type)
+{
+	if (Plan.Nodes.Num() == 0) return INDEX_NONE;
+
+	FCityPlan ScratchPlan;
+	return CityPlanGenerator::GetQueryablePlan(Plan, ScratchPlan).FindNodeAt(FVector2D(Location), Type);
+}
+
+void UCityPlanGenerator::GetPlanNodesInRadius(const FCityPlan& Plan, const FVector& Location, const float Radius, const ECityPlanNodeType Type, TArray<int32>& OutNodes)
+{
+	OutNodes.Reset();
+	if (Plan.Nodes.Num() == 0) return;
+
+	FCityPlan ScratchPlan;
+	CityPlanGenerator::GetQueryablePlan(Plan, ScratchPlan).QueryRadius(FVector2D(Location), Radius, Type, OutNodes);
+}
+
+void UCityPlanGenerator::GeneratePlan(const FQuad2D& District, const FCityPlanSettings& InSettings, FCityPlan& OutPlan)
+{
+	OutPlan.Reset();
+
+	// Roughly two nodes per lot, so the array rarely grows during the recursion.
+	const float AverageLotSize = 0.5f * (InSettings.MinLotSize + InSettings.MaxLotSize);
+	const float EstimatedLots = District.GetArea() / FMath::Max(AverageLotSize * AverageLotSize, 1.0f);
+	const int32 EstimatedNodes = FMath::Min((int32)(2.0f * EstimatedLots) + 16, 1 << 22);
+	OutPlan.Nodes.Reserve(EstimatedNodes);
+
+	// The top of the tree is generated here, down to the fan-out depth. The depth doesn't depend
+	// on the number of threads, so neither do the subtrees nor the merged plan.
+	TArray<CityPlanGenerator::FSubtreeTask> Tasks;
+	CityPlanGenerator::FBuilder Builder(InSettings, OutPlan.Nodes);
+	Builder.Tasks = &Tasks;
+	Builder.TaskDepth = FMath::Max(0, InSettings.ParallelDepth);
+	Builder.AddNode(District, ECityPlanNodeType::District, INDEX_NONE);
+	Builder.SubdivideDistrict(0, (uint32)InSettings.Seed, 0);
+	if (Tasks.Num() == 0)
+	{
+		OutPlan.BuildIndex();
+		return;
+	}
+
+	// Each worker owns an arena that its subtrees are appended to, with its own scratch, so
+	// workers never share memory. Tasks are taken in any order, but each one is self-contained.
+	const int32 NumWorkers = InSettings.bMultithreaded ? FMath::Min(Tasks.Num(), FTaskGraphInterface::Get().GetNumWorkerThreads() + 1) : 1;
+	TArray<TArray<FCityPlanNode>> Arenas;
+	Arenas.SetNum(NumWorkers);
+	FThreadSafeCounter NextTask;
+	ParallelFor(NumWorkers, [&](int32 WorkerIndex)
+	{
+		TArray<FCityPlanNode>& Arena = Arenas[WorkerIndex];
+		Arena.Reserve(EstimatedNodes / NumWorkers);
+		CityPlanGenerator::FBuilder WorkerBuilder(InSettings, Arena);
+		for (int32 TaskIndex = NextTask.Increment() - 1; TaskIndex < Tasks.Num(); TaskIndex = NextTask.Increment() - 1)
+		{
+			CityPlanGenerator::FSubtreeTask& Task = Tasks[TaskIndex];
+			Task.WorkerIndex = WorkerIndex;
+			Task.FirstArenaNode = Arena.Add(OutPlan.Nodes[Task.NodeIndex]);
+			WorkerBuilder.SubdivideDistrict(Task.FirstArenaNode, Task.Seed, Task.Depth);
+			Task.NumArenaNodes = Arena.Num() - Task.FirstArenaNode;
+		}
+	}, !InSettings.bMultithreaded);
+
+	// Merge in task order. The root of each subtree is already in the plan, and the rest is
+	// appended after it, with indices moved from the arena to the plan.
+	for (const CityPlanGenerator::FSubtreeTask& Task : Tasks)
+	{
+		const TArray<FCityPlanNode>& Arena = Arenas[Task.WorkerIndex];
+		const int32 Offset = OutPlan.Nodes.Num() - (Task.FirstArenaNode + 1);
+		auto Remap = [&Task, Offset](const int32 ArenaIndex)
+		{
+			return (ArenaIndex == INDEX_NONE) ? INDEX_NONE : ((ArenaIndex == Task.FirstArenaNode) ? Task.NodeIndex : ArenaIndex + Offset);
+		};
+
+		FCityPlanNode& Root = OutPlan.Nodes[Task.NodeIndex];
+		Root.Type = Arena[Task.FirstArenaNode].Type;
+		Root.FirstChild = Remap(Arena[Task.FirstArenaNode].FirstChild);
+		Root.NumChildren = Arena[Task.FirstArenaNode].NumChildren;
+		for (int32 ArenaIndex = Task.FirstArenaNode + 1; ArenaIndex < Task.FirstArenaNode + Task.NumArenaNodes; ArenaIndex++)
+		{
+			FCityPlanNode& Node = OutPlan.Nodes.Add_GetRef(Arena[ArenaIndex]);
+			Node.Parent = Remap(Node.Parent);
+			Node.FirstChild = Remap(Node.FirstChild);
+		}
+	}
+
+	OutPlan.BuildIndex();
+}
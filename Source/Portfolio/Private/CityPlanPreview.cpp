@@ -0,0 +1,137 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "CityPlanPreview.h"
+#include "Misc/Crc.h"
+
+void FCityPreviewMesh::Build(TArrayView<const FQuad2D> Quads, TArrayView<const FLinearColor> QuadColors, const float LineWidth, const float Height)
+{
+	check(Quads.Num() == QuadColors.Num());
+
+	Vertices.Reset();
+	Triangles.Reset();
+	Colors.Reset();
+
+	const bool bIsFilled = LineWidth <= 0.0f;
+	const int32 VerticesPerQuad = bIsFilled ? 4 : 8;
+	const int32 IndicesPerQuad = bIsFilled ? 6 : 24;
+	Vertices.Reserve(Quads.Num() * VerticesPerQuad);
+	Colors.Reserve(Quads.Num() * VerticesPerQuad);
+	Triangles.Reserve(Quads.Num() * IndicesPerQuad);
+	for (int32 QuadIndex = 0; QuadIndex < Quads.Num(); QuadIndex++)
+	{
+		const FLinearColor& Color = QuadColors[QuadIndex];
+		if (Color.A <= 0.0f) continue;
+
+		const FQuad2D& Quad = Quads[QuadIndex];
+		const int32 First = Vertices.Num();
+		Vertices.Append({ FVector(Quad.A, Height), FVector(Quad.B, Height), FVector(Quad.C, Height), FVector(Quad.D, Height) });
+		if (bIsFilled)
+		{
+			Triangles.Append({ First, First + 1, First + 2, First, First + 2, First + 3 });
+		}
+		else
+		{
+			// Outer corners, then inner corners, with one quad per edge between them.
+			const FQuad2D Inner = UGeneratorLibrary::ResizeQuad2D(Quad, -LineWidth);
+			Vertices.Append({ FVector(Inner.A, Height), FVector(Inner.B, Height), FVector(Inner.C, Height), FVector(Inner.D, Height) });
+			for (int32 Corner = 0; Corner < 4; Corner++)
+			{
+				const int32 Outer0 = First + Corner;
+				const int32 Outer1 = First + ((Corner + 1) % 4);
+				const int32 Inner0 = Outer0 + 4;
+				const int32 Inner1 = Outer1 + 4;
+				Triangles.Append({ Outer0, Outer1, Inner1, Outer0, Inner1, Inner0 });
+			}
+		}
+		for (int32 i = First; i < Vertices.Num(); i++)
+		{
+			Colors.Add(Color);
+		}
+	}
+}
+
+UCityPlanPreviewComponent::UCityPlanPreviewComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	CastShadow = false;
+
+	LineWidth = 50.0f;
+	Height = 10.0f;
+	TypeColors.Add(ECityPlanNodeType::Road, FLinearColor(0.2f, 0.2f, 0.2f));
+	TypeColors.Add(ECityPlanNodeType::Block, FLinearColor(0.1f, 0.4f, 1.0f));
+	TypeColors.Add(ECityPlanNodeType::Lot, FLinearColor(1.0f, 0.6f, 0.1f));
+	PreviewMaterial = nullptr;
+}
+
+void UCityPlanPreviewComponent::SetQuads(const int32 LayerIndex, const TArray<FQuad2D>& Quads, const FLinearColor Color)
+{
+	TArray<FQuad2D> LayerQuads = Quads;
+	TArray<FLinearColor> QuadColors;
+	QuadColors.Init(Color, Quads.Num());
+	SetLayer(LayerIndex, MoveTemp(LayerQuads), MoveTemp(QuadColors));
+}
+
+void UCityPlanPreviewComponent::SetPlan(const int32 LayerIndex, const FCityPlan& Plan)
+{
+	TArray<FQuad2D> Quads;
+	TArray<FLinearColor> QuadColors;
+	Quads.Reserve(Plan.Nodes.Num());
+	QuadColors.Reserve(Plan.Nodes.Num());
+	for (const FCityPlanNode& Node : Plan.Nodes)
+	{
+		const FLinearColor* Color = TypeColors.Find(Node.Type);
+		if (!Color) continue;
+
+		Quads.Add(Node.Quad);
+		QuadColors.Add(*Color);
+	}
+	SetLayer(LayerIndex, MoveTemp(Quads), MoveTemp(QuadColors));
+}
+
+void UCityPlanPreviewComponent::SetLayer(const int32 LayerIndex, TArray<FQuad2D>&& Quads, TArray<FLinearColor>&& QuadColors)
+{
+	if (LayerIndex < 0 || Quads.Num() != QuadColors.Num()) return;
+
+	const uint32 Hash = FCrc::MemCrc32(QuadColors.GetData(), QuadColors.Num() * sizeof(FLinearColor),
+		FCrc::MemCrc32(Quads.GetData(), Quads.Num() * sizeof(FQuad2D)));
+	FLayer* Layer = Layers.Find(LayerIndex);
+
+	// Matching hashes are confirmed byte for byte, so a collision never hides a change.
+	if (Layer && Layer->Hash == Hash && Layer->Quads.Num() == Quads.Num()
+		&& FMemory::Memcmp(Layer->Quads.GetData(), Quads.GetData(), Quads.Num() * sizeof(FQuad2D)) == 0
+		&& FMemory::Memcmp(Layer->QuadColors.GetData(), QuadColors.GetData(), QuadColors.Num() * sizeof(FLinearColor)) == 0) return;
+
+	if (!Layer)
+	{
+		Layer = &Layers.Add(LayerIndex);
+	}
+	Layer->Quads = MoveTemp(Quads);
+	Layer->QuadColors = MoveTemp(QuadColors);
+	Layer->Hash = Hash;
+	RequestSectionBuild(LayerIndex);
+}
+
+void UCityPlanPreviewComponent::RemoveLayer(const int32 LayerIndex)
+{
+	Layers.Remove(LayerIndex);
+	RemoveSection(LayerIndex);
+}
+
+void UCityPlanPreviewComponent::ClearLayers()
+{
+	Layers.Empty();
+	ClearSections();
+}
+
+TFunction<void(FAsyncMeshSection&)> UCityPlanPreviewComponent::CreateSectionBuild(const int32 SectionIndex) const
+{
+	const FLayer& Layer = Layers.FindChecked(SectionIndex);
+	return [Quads = Layer.Quads, QuadColors = Layer.QuadColors, Width = LineWidth, QuadHeight = Height](FAsyncMeshSection& OutMesh)
+	{
+		FCityPreviewMesh Mesh;
+		Mesh.Build(Quads, QuadColors, Width, QuadHeight);
+		OutMesh = MoveTemp(Mesh);
+	};
+}
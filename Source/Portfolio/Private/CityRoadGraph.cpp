@@ -0,0 +1,223 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "CityRoadGraph.h"
+#include "CityPlanGenerator.h"
+
+namespace CityRoadGraph
+{
+	/** Sides of a quad, by the edge they run along. */
+	enum ESide
+	{
+		SideAB,
+		SideBC,
+		SideCD,
+		SideDA,
+		NumSides
+	};
+
+	/** District waiting to be visited, with the road along each of its sides, or INDEX_NONE at the city border. */
+	struct FDistrict
+	{
+		int32 NodeIndex;
+		int32 SideRoads[NumSides];
+	};
+
+	/** Point where a road is crossed or ends, at a fraction of its centerline. */
+	struct FRoadPoint
+	{
+		int32 Road;
+		float Fraction;
+		FVector2D Location;
+	};
+
+	/** Centerline of a road. The generator lays roads out so it runs from the middle of DA to the middle of BC. */
+	static void GetCenterline(const FQuad2D& Road, FVector2D& OutStart, FVector2D& OutEnd)
+	{
+		OutStart = 0.5f * (Road.A + Road.D);
+		OutEnd = 0.5f * (Road.B + Road.C);
+	}
+
+	/** Fraction along the first line where it crosses the second. Returns false if they are parallel. */
+	static bool IntersectLines(const FVector2D& Start, const FVector2D& End, const FVector2D& OtherStart, const FVector2D& OtherEnd, float& OutFraction)
+	{
+		const FVector2D Direction = End - Start;
+		const FVector2D OtherDirection = OtherEnd - OtherStart;
+		const float Denominator = Direction ^ OtherDirection;
+		if (FMath::Abs(Denominator) <= KINDA_SMALL_NUMBER * Direction.Size() * OtherDirection.Size()) return false;
+
+		OutFraction = ((OtherStart - Start) ^ OtherDirection) / Denominator;
+		return true;
+	}
+}
+
+void FCityRoadGraph::Reset()
+{
+	NodeLocations.Reset();
+	EdgeOffsets.Reset();
+	EdgeTargets.Reset();
+	EdgeLengths.Reset();
+	EdgeRoads.Reset();
+}
+
+void FCityRoadGraph::Build(const FCityPlan& Plan, const float WeldTolerance)
+{
+	using namespace CityRoadGraph;
+
+	Reset();
+	if (Plan.Nodes.Num() == 0) return;
+
+	// Walk the tree from the root, keeping track of the road along each side of every district.
+	// A road cut across a district ends on the roads of the two sides it crosses, so each end is
+	// moved to the centerline of that road, and the crossing is added to both.
+	TArray<FRoadPoint> Points;
+	TArray<FDistrict, TInlineAllocator<64>> Stack;
+	Stack.Add({ 0, { INDEX_NONE, INDEX_NONE, INDEX_NONE, INDEX_NONE } });
+	while (Stack.Num() > 0)
+	{
+		const FDistrict District = Stack.Pop(false);
+		const FCityPlanNode& Node = Plan.Nodes[District.NodeIndex];
+		if (Node.Type != ECityPlanNodeType::District || Node.NumChildren != 3) continue;
+
+		// Cuts across AD keep the first two corners in the first part.
+		const int32 FirstIndex = Node.FirstChild;
+		const int32 RoadIndex = Node.FirstChild + 1;
+		const bool bIsCutAcrossAD = Plan.Nodes[FirstIndex].Quad.B == Node.Quad.B;
+		const int32 StartSide = bIsCutAcrossAD ? SideDA : SideCD;
+		const int32 EndSide = bIsCutAcrossAD ? SideBC : SideAB;
+
+		FVector2D Start;
+		FVector2D End;
+		GetCenterline(Plan.Nodes[RoadIndex].Quad, Start, End);
+		float Fractions[2] = { 0.0f, 1.0f };
+		const int32 EndRoads[2] = { District.SideRoads[StartSide], District.SideRoads[EndSide] };
+		for (int32 EndIndex = 0; EndIndex < 2; EndIndex++)
+		{
+			if (EndRoads[EndIndex] == INDEX_NONE) continue;
+
+			FVector2D OtherStart;
+			FVector2D OtherEnd;
+			GetCenterline(Plan.Nodes[EndRoads[EndIndex]].Quad, OtherStart, OtherEnd);
+			float Fraction = 0.0f;
+			float OtherFraction = 0.0f;
+			if (!IntersectLines(Start, End, OtherStart, OtherEnd, Fraction) || !IntersectLines(OtherStart, OtherEnd, Start, End, OtherFraction)) continue;
+
+			Fractions[EndIndex] = Fraction;
+			Points.Add({ EndRoads[EndIndex], OtherFraction, FMath::Lerp(Start, End, Fraction) });
+		}
+		Points.Add({ RoadIndex, Fractions[0], FMath::Lerp(Start, End, Fractions[0]) });
+		Points.Add({ RoadIndex, Fractions[1], FMath::Lerp(Start, End, Fractions[1]) });
+
+		FDistrict First = { FirstIndex, {} };
+		FDistrict Second = { Node.FirstChild + 2, {} };
+		FMemory::Memcpy(First.SideRoads, District.SideRoads, sizeof(District.SideRoads));
+		FMemory::Memcpy(Second.SideRoads, District.SideRoads, sizeof(District.SideRoads));
+		First.SideRoads[bIsCutAcrossAD ? SideCD : SideBC] = RoadIndex;
+		Second.SideRoads[bIsCutAcrossAD ? SideAB : SideDA] = RoadIndex;
+		Stack.Add(Second);
+		Stack.Add(First);
+	}
+	if (Points.Num() == 0) return;
+
+	// Bucket the points by road, then order each bucket along its road. Buckets hold the two
+	// ends and the roads that meet it, so they are small.
+	TArray<int32> RoadOffsets;
+	RoadOffsets.SetNumZeroed(Plan.Nodes.Num() + 1);
+	for (const FRoadPoint& Point : Points)
+	{
+		RoadOffsets[Point.Road + 1]++;
+	}
+	for (int32 i = 1; i < RoadOffsets.Num(); i++)
+	{
+		RoadOffsets[i] += RoadOffsets[i - 1];
+	}
+	TArray<FRoadPoint> SortedPoints;
+	SortedPoints.SetNumUninitialized(Points.Num());
+	{
+		TArray<int32> Cursors = RoadOffsets;
+		for (const FRoadPoint& Point : Points)
+		{
+			SortedPoints[Cursors[Point.Road]++] = Point;
+		}
+	}
+
+	// Weld the points into nodes through a spatial hash with cells the size of the tolerance, so
+	// each point only looks at its own cell and the eight around it.
+	const float CellSize = FMath::Max(WeldTolerance, KINDA_SMALL_NUMBER);
+	const float ToleranceSquared = WeldTolerance * WeldTolerance;
+	TMultiMap<FIntPoint, int32> NodeCells;
+	NodeCells.Reserve(SortedPoints.Num());
+	auto WeldNode = [this, &NodeCells, CellSize, ToleranceSquared](const FVector2D& Location)
+	{
+		const FIntPoint Cell(FMath::FloorToInt(Location.X / CellSize), FMath::FloorToInt(Location.Y / CellSize));
+		for (int32 Y = Cell.Y - 1; Y <= Cell.Y + 1; Y++)
+		{
+			for (int32 X = Cell.X - 1; X <= Cell.X + 1; X++)
+			{
+				for (auto It = NodeCells.CreateConstKeyIterator(FIntPoint(X, Y)); It; ++It)
+				{
+					if (FVector2D::DistSquared(NodeLocations[It.Value()], Location) <= ToleranceSquared) return It.Value();
+				}
+			}
+		}
+		const int32 NodeIndex = NodeLocations.Add(Location);
+		NodeCells.Add(Cell, NodeIndex);
+		return NodeIndex;
+	};
+
+	struct FEdge
+	{
+		int32 From;
+		int32 To;
+		int32 Road;
+	};
+	TArray<FEdge> Edges;
+	Edges.Reserve(SortedPoints.Num());
+	for (int32 Road = 0; Road < Plan.Nodes.Num(); Road++)
+	{
+		const int32 First = RoadOffsets[Road];
+		const int32 Last = RoadOffsets[Road + 1];
+		if (Last - First < 2) continue;
+
+		TArrayView<FRoadPoint>(SortedPoints.GetData() + First, Last - First).Sort([](const FRoadPoint& A, const FRoadPoint& B) { return A.Fraction < B.Fraction; });
+		int32 Previous = WeldNode(SortedPoints[First].Location);
+		for (int32 i = First + 1; i < Last; i++)
+		{
+			const int32 Current = WeldNode(SortedPoints[i].Location);
+			if (Current != Previous)
+			{
+				Edges.Add({ Previous, Current, Road });
+			}
+			Previous = Current;
+		}
+	}
+
+	// Compressed sparse rows, with every edge stored once from each end.
+	EdgeOffsets.SetNumZeroed(NodeLocations.Num() + 1);
+	for (const FEdge& Edge : Edges)
+	{
+		EdgeOffsets[Edge.From + 1]++;
+		EdgeOffsets[Edge.To + 1]++;
+	}
+	for (int32 i = 1; i < EdgeOffsets.Num(); i++)
+	{
+		EdgeOffsets[i] += EdgeOffsets[i - 1];
+	}
+	const int32 NumEdges = EdgeOffsets.Last();
+	EdgeTargets.SetNumUninitialized(NumEdges);
+	EdgeLengths.SetNumUninitialized(NumEdges);
+	EdgeRoads.SetNumUninitialized(NumEdges);
+	TArray<int32> Cursors(EdgeOffsets.GetData(), NodeLocations.Num());
+	for (const FEdge& Edge : Edges)
+	{
+		const float Length = FVector2D::Distance(NodeLocations[Edge.From], NodeLocations[Edge.To]);
+		const int32 Forward = Cursors[Edge.From]++;
+		const int32 Backward = Cursors[Edge.To]++;
+		EdgeTargets[Forward] = Edge.To;
+		EdgeTargets[Backward] = Edge.From;
+		EdgeLengths[Forward] = Length;
+		EdgeLengths[Backward] = Length;
+		EdgeRoads[Forward] = Edge.Road;
+		EdgeRoads[Backward] = Edge.Road;
+	}
+}
@@ -0,0 +1,264 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "CityStreaming.h"
+#include "Async/Async.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+
+UCityStreamingSubsystem::UCityStreamingSubsystem()
+{
+	NumPendingChunks = 0;
+	NextGeneration = 0;
+	bIsStreaming = false;
+	bIsInitialized = false;
+}
+
+void UCityStreamingSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	bIsInitialized = true;
+}
+
+void UCityStreamingSubsystem::Deinitialize()
+{
+	bIsInitialized = false;
+	bIsStreaming = false;
+
+	// Results still in flight find no chunk state and are dropped.
+	Chunks.Empty();
+	ViewLocations.Empty();
+	NumPendingChunks = 0;
+
+	Super::Deinitialize();
+}
+
+void UCityStreamingSubsystem::Tick(float DeltaTime)
+{
+	UpdateViews();
+	EvictChunks();
+	RequestChunks();
+}
+
+bool UCityStreamingSubsystem::IsTickable() const
+{
+	return bIsInitialized && bIsStreaming && !IsTemplate();
+}
+
+TStatId UCityStreamingSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UCityStreamingSubsystem, STATGROUP_Tickables);
+}
+
+void UCityStreamingSubsystem::StartStreaming(const FCityStreamingSettings& InSettings)
+{
+	StopStreaming();
+
+	Settings = InSettings;
+	Settings.ChunkSize = FMath::Max(Settings.ChunkSize, 1.0f);
+	Settings.UnloadRadius = FMath::Max(Settings.UnloadRadius, Settings.LoadRadius);
+	bIsStreaming = true;
+}
+
+void UCityStreamingSubsystem::StopStreaming()
+{
+	bIsStreaming = false;
+
+	TArray<FIntPoint> LoadedCoords;
+	for (const TPair<FIntPoint, FChunkState>& Pair : Chunks)
+	{
+		if (Pair.Value.bIsLoaded)
+		{
+			LoadedCoords.Add(Pair.Key);
+		}
+	}
+	Chunks.Empty();
+	NumPendingChunks = 0;
+
+	for (const FIntPoint& Coords : LoadedCoords)
+	{
+		OnChunkUnloaded.Broadcast(Coords);
+	}
+}
+
+FIntPoint UCityStreamingSubsystem::GetChunkCoords(const FVector& WorldLocation) const
+{
+	return FIntPoint(FMath::FloorToInt(WorldLocation.X / Settings.ChunkSize), FMath::FloorToInt(WorldLocation.Y / Settings.ChunkSize));
+}
+
+void UCityStreamingSubsystem::GenerateChunk(const FIntPoint& Coords, const FCityStreamingSettings& InSettings, FCityChunk& OutChunk)
+{
+	const float Size = InSettings.ChunkSize;
+	const float HalfRoad = 0.5f * InSettings.PlanSettings.RoadWidth;
+	const FVector2D Origin(Coords.X * Size, Coords.Y * Size);
+	const FQuad2D Square(Origin, Origin + FVector2D(Size, 0.0f), Origin + FVector2D(Size, Size), Origin + FVector2D(0.0f, Size));
+
+	OutChunk.Coords = Coords;
+	OutChunk.BorderRoads.Reset(4);
+	OutChunk.BorderRoads.Add(FQuad2D(Square.A, Square.B, Square.B + FVector2D(0.0f, HalfRoad), Square.A + FVector2D(0.0f, HalfRoad)));
+	OutChunk.BorderRoads.Add(FQuad2D(Square.D - FVector2D(0.0f, HalfRoad), Square.C - FVector2D(0.0f, HalfRoad), Square.C, Square.D));
+	OutChunk.BorderRoads.Add(FQuad2D(Square.A + FVector2D(HalfRoad, HalfRoad), Square.D + FVector2D(HalfRoad, -HalfRoad), Square.D - FVector2D(0.0f, HalfRoad), Square.A + FVector2D(0.0f, HalfRoad)));
+	OutChunk.BorderRoads.Add(FQuad2D(Square.B + FVector2D(0.0f, HalfRoad), Square.C - FVector2D(0.0f, HalfRoad), Square.C - FVector2D(HalfRoad, HalfRoad), Square.B + FVector2D(-HalfRoad, HalfRoad)));
+
+	// Chunks are already generated in parallel, so each one runs on a single thread.
+	FCityPlanSettings PlanSettings = InSettings.PlanSettings;
+	PlanSettings.Seed = (int32)HashCombine((uint32)InSettings.PlanSettings.Seed, GetTypeHash(Coords));
+	PlanSettings.bMultithreaded = false;
+	UCityPlanGenerator::GeneratePlan(UGeneratorLibrary::ResizeQuad2D(Square, -HalfRoad), PlanSettings, OutChunk.Plan);
+}
+
+bool UCityStreamingSubsystem::GetChunk(const FIntPoint& Coords, FCityChunk& OutChunk) const
+{
+	const FCityChunk* Chunk = FindChunk(Coords);
+	if (!Chunk) return false;
+
+	OutChunk = *Chunk;
+	return true;
+}
+
+const FCityChunk* UCityStreamingSubsystem::FindChunk(const FIntPoint& Coords) const
+{
+	const FChunkState* State = Chunks.Find(Coords);
+	return (State && State->bIsLoaded) ? &State->Chunk : nullptr;
+}
+
+int32 UCityStreamingSubsystem::GetNumLoadedChunks() const
+{
+	return Chunks.Num() - NumPendingChunks;
+}
+
+void UCityStreamingSubsystem::UpdateViews()
+{
+	ViewLocations.Reset();
+
+	UWorld* World = GetWorld();
+	if (!World) return;
+
+	for (FConstPlayerControllerIterator It = World->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		if (!PlayerController) continue;
+
+		const APawn* Pawn = PlayerController->GetPawn();
+		const APlayerCameraManager* CameraManager = PlayerController->PlayerCameraManager;
+		if (Pawn)
+		{
+			ViewLocations.Add(FVector2D(Pawn->GetActorLocation()) / Settings.ChunkSize);
+		}
+		else if (CameraManager && PlayerController->IsLocalController())
+		{
+			ViewLocations.Add(FVector2D(CameraManager->GetCameraLocation()) / Settings.ChunkSize);
+		}
+	}
+}
+
+void UCityStreamingSubsystem::EvictChunks()
+{
+	TArray<FIntPoint, TInlineAllocator<16>> EvictedCoords;
+	for (auto It = Chunks.CreateIterator(); It; ++It)
+	{
+		if (GetDistanceToViews(It->Key) <= Settings.UnloadRadius) continue;
+
+		if (It->Value.bIsLoaded)
+		{
+			EvictedCoords.Add(It->Key);
+		}
+		else
+		{
+			NumPendingChunks--;
+		}
+		It.RemoveCurrent();
+	}
+
+	for (const FIntPoint& Coords : EvictedCoords)
+	{
+		OnChunkUnloaded.Broadcast(Coords);
+	}
+}
+
+void UCityStreamingSubsystem::RequestChunks()
+{
+	if (NumPendingChunks >= Settings.MaxPendingChunks) return;
+
+	// Missing chunks in range of any player, closest first.
+	struct FRequest
+	{
+		FIntPoint Coords;
+		float Distance;
+
+		bool operator==(const FRequest& Other) const { return Coords == Other.Coords; }
+
+		bool operator<(const FRequest& Other) const { return Distance < Other.Distance; }
+	};
+	TArray<FRequest, TInlineAllocator<64>> Requests;
+	const int32 Reach = FMath::CeilToInt(Settings.LoadRadius);
+	for (const FVector2D& ViewLocation : ViewLocations)
+	{
+		const FIntPoint Center(FMath::FloorToInt(ViewLocation.X), FMath::FloorToInt(ViewLocation.Y));
+		for (int32 Y = Center.Y - Reach; Y <= Center.Y + Reach; Y++)
+		{
+			for (int32 X = Center.X - Reach; X <= Center.X + Reach; X++)
+			{
+				const FIntPoint Coords(X, Y);
+				if (Chunks.Contains(Coords)) continue;
+
+				const float Distance = GetDistanceToViews(Coords);
+				if (Distance > Settings.LoadRadius) continue;
+
+				Requests.AddUnique({ Coords, Distance });
+			}
+		}
+	}
+	Requests.Sort();
+
+	TWeakObjectPtr<UCityStreamingSubsystem> WeakThis(this);
+	for (int32 i = 0; i < Requests.Num() && NumPendingChunks < Settings.MaxPendingChunks; i++)
+	{
+		const FIntPoint Coords = Requests[i].Coords;
+		const uint32 Generation = ++NextGeneration;
+		FChunkState& State = Chunks.Add(Coords);
+		State.Generation = Generation;
+		State.bIsLoaded = false;
+		NumPendingChunks++;
+
+		// The task owns a copy of the settings, so streaming can restart while it runs.
+		Async(EAsyncExecution::ThreadPool, [WeakThis, Coords, Generation, ChunkSettings = Settings]()
+		{
+			FCityChunk Chunk;
+			GenerateChunk(Coords, ChunkSettings, Chunk);
+
+			AsyncTask(ENamedThreads::GameThread, [WeakThis, Generation, Chunk = MoveTemp(Chunk)]() mutable
+			{
+				UCityStreamingSubsystem* Subsystem = WeakThis.Get();
+				if (!Subsystem) return;
+
+				Subsystem->OnChunkGenerated(Generation, MoveTemp(Chunk));
+			});
+		});
+	}
+}
+
+void UCityStreamingSubsystem::OnChunkGenerated(const uint32 Generation, FCityChunk&& Chunk)
+{
+	FChunkState* State = Chunks.Find(Chunk.Coords);
+	if (!State || State->bIsLoaded || State->Generation != Generation) return;
+
+	State->Chunk = MoveTemp(Chunk);
+	State->bIsLoaded = true;
+	NumPendingChunks--;
+	OnChunkLoaded.Broadcast(State->Chunk);
+}
+
+float UCityStreamingSubsystem::GetDistanceToViews(const FIntPoint& Coords) const
+{
+	const FVector2D ChunkCenter(Coords.X + 0.5f, Coords.Y + 0.5f);
+	float MinDistanceSquared = MAX_FLT;
+	for (const FVector2D& ViewLocation : ViewLocations)
+	{
+		MinDistanceSquared = FMath::Min(MinDistanceSquared, FVector2D::DistSquared(ChunkCenter, ViewLocation));
+	}
+	return FMath::Sqrt(MinDistanceSquared);
+}
@@ -0,0 +1,315 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "KeplerConjunction.h"
+#include "Async/ParallelFor.h"
+
+namespace KeplerConjunction
+{
+	/** Upper bound of distance evaluations per pair. Pairs that need more are reported as truncated. */
+	static const int32 MaxSteps = 4096;
+
+	/** Iterations of the golden-section search that refines each minimum. */
+	static const int32 NumRefineIterations = 24;
+
+	/** Largest change of distance, as a fraction of the threshold, between samples inside the threshold. */
+	static const float InnerStepFraction = 0.25f;
+}
+
+FKeplerConjunctionFinder::FKeplerConjunctionFinder()
+{
+	Threshold = 1000.0f;
+	StartTime = 0.0;
+	Duration = 60.0;
+	NumCandidatePairs = 0;
+	NumTruncatedPairs = 0;
+	bHasDirtyOrbits = false;
+	bIsFullUpdateNeeded = true;
+}
+
+int32 FKeplerConjunctionFinder::Add(const FKeplerOrbitConfig& OrbitConfig, const double Epoch)
+{
+	const int32 Index = Orbits.AddDefaulted();
+	BuildOrbit(Orbits[Index], OrbitConfig, Epoch);
+	bHasDirtyOrbits = true;
+	return Index;
+}
+
+void FKeplerConjunctionFinder::Set(const int32 Index, const FKeplerOrbitConfig& OrbitConfig, const double Epoch)
+{
+	check(Orbits.IsValidIndex(Index));
+
+	BuildOrbit(Orbits[Index], OrbitConfig, Epoch);
+	bHasDirtyOrbits = true;
+}
+
+void FKeplerConjunctionFinder::Reset()
+{
+	Orbits.Reset();
+	Encounters.Reset();
+	NumCandidatePairs = 0;
+	NumTruncatedPairs = 0;
+	bHasDirtyOrbits = false;
+	bIsFullUpdateNeeded = true;
+}
+
+void FKeplerConjunctionFinder::SetThreshold(const float NewThreshold)
+{
+	Threshold = FMath::Max(NewThreshold, 0.0f);
+	bIsFullUpdateNeeded = true;
+}
+
+void FKeplerConjunctionFinder::SetWindow(const double NewStartTime, const double NewDuration)
+{
+	StartTime = NewStartTime;
+	Duration = FMath::Max(NewDuration, 0.0);
+	bIsFullUpdateNeeded = true;
+}
+
+const TArray<FKeplerEncounter>& FKeplerConjunctionFinder::GetEncounters()
+{
+	if (!bHasDirtyOrbits && !bIsFullUpdateNeeded) return Encounters;
+
+	const bool bAll = bIsFullUpdateNeeded;
+	if (bAll)
+	{
+		Encounters.Reset();
+	}
+	else
+	{
+		Encounters.RemoveAll([this](const FKeplerEncounter& Encounter)
+		{
+			return Orbits[Encounter.OrbitA].bIsDirty || Orbits[Encounter.OrbitB].bIsDirty;
+		});
+	}
+
+	TArray<TPair<int32, int32>> Pairs;
+	FindCandidatePairs(bAll, Pairs);
+	NumCandidatePairs = Pairs.Num();
+
+	TArray<TArray<FKeplerEncounter>> PairEncounters;
+	PairEncounters.SetNum(Pairs.Num());
+	FThreadSafeCounter NumTruncated;
+	ParallelFor(Pairs.Num(), [this, &Pairs, &PairEncounters, &NumTruncated](int32 PairIndex)
+	{
+		if (SearchPair(Pairs[PairIndex].Key, Pairs[PairIndex].Value, PairEncounters[PairIndex]))
+		{
+			NumTruncated.Increment();
+		}
+	});
+
+	NumTruncatedPairs = NumTruncated.GetValue();
+	if (NumTruncatedPairs > 0)
+	{
+		UE_LOG(LogKepler, Warning, TEXT("Conjunction search of %d pairs hit the limit of %d steps, so some encounters may be missing. Shorten the window or raise the threshold."),
+			NumTruncatedPairs, KeplerConjunction::MaxSteps);
+	}
+
+	for (const TArray<FKeplerEncounter>& NewEncounters : PairEncounters)
+	{
+		Encounters.Append(NewEncounters);
+	}
+
+	// Ties are broken by index, so the order doesn't depend on the order of the search.
+	Encounters.Sort([](const FKeplerEncounter& A, const FKeplerEncounter& B)
+	{
+		if (A.PreciseTime != B.PreciseTime) return A.PreciseTime < B.PreciseTime;
+		if (A.OrbitA != B.OrbitA) return A.OrbitA < B.OrbitA;
+		return A.OrbitB < B.OrbitB;
+	});
+
+	for (FOrbit& Orbit : Orbits)
+	{
+		Orbit.bIsDirty = false;
+	}
+	bHasDirtyOrbits = false;
+	bIsFullUpdateNeeded = false;
+	return Encounters;
+}
+
+void FKeplerConjunctionFinder::BuildOrbit(FOrbit& Orbit, const FKeplerOrbitConfig& OrbitConfig, const double Epoch)
+{
+	// Copying the config refreshes its derived data.
+	const FKeplerOrbitConfig UpdatedConfig = OrbitConfig;
+	const FKeplerCompiledOrbit& Compiled = UpdatedConfig.Compiled;
+	Orbit.Compiled = Compiled;
+	Orbit.Epoch = Epoch;
+	Orbit.MaxSpeed = Compiled.GetPeriapsisSpeed();
+	Orbit.bIsDirty = true;
+
+	// The ellipse is centered behind the focus. Its extent along each axis combines both semi-axes.
+	const FVector Center = Compiled.PeriapsisAxis * (-Compiled.SemiMajorAxis * Compiled.Eccentricity);
+	const FVector MajorAxis = Compiled.PeriapsisAxis * Compiled.SemiMajorAxis;
+	const FVector MinorAxis = Compiled.SemiLatusAxis * Compiled.SemiMinorAxis;
+	const FVector Extent(
+		FVector2D(MajorAxis.X, MinorAxis.X).Size(),
+		FVector2D(MajorAxis.Y, MinorAxis.Y).Size(),
+		FVector2D(MajorAxis.Z, MinorAxis.Z).Size());
+	Orbit.Bounds = FBox(Center - Extent, Center + Extent);
+}
+
+void FKeplerConjunctionFinder::FindCandidatePairs(const bool bAll, TArray<TPair<int32, int32>>& OutPairs) const
+{
+	struct FShell
+	{
+		float Min;
+		float Max;
+		int32 Index;
+	};
+
+	// Two bodies can only get closer than the threshold if their shells, grown by half of it each, overlap.
+	const float Margin = 0.5f * Threshold;
+	TArray<FShell> Shells;
+	Shells.Reserve(Orbits.Num());
+	for (int32 i = 0; i < Orbits.Num(); i++)
+	{
+		const FKeplerCompiledOrbit& Compiled = Orbits[i].Compiled;
+		const float Periapsis = Compiled.SemiMajorAxis * (1.0f - Compiled.Eccentricity);
+		const float Apoapsis = Compiled.SemiMajorAxis * (1.0f + Compiled.Eccentricity);
+		Shells.Add({ Periapsis - Margin, Apoapsis + Margin, i });
+	}
+	Shells.Sort([](const FShell& A, const FShell& B) { return A.Min < B.Min; });
+
+	TArray<int32> ActiveShells;
+	for (int32 ShellIndex = 0; ShellIndex < Shells.Num(); ShellIndex++)
+	{
+		const FShell& Shell = Shells[ShellIndex];
+		for (int32 i = ActiveShells.Num() - 1; i >= 0; i--)
+		{
+			if (Shells[ActiveShells[i]].Max < Shell.Min)
+			{
+				ActiveShells.RemoveAtSwap(i, 1, false);
+			}
+		}
+
+		const FOrbit& Orbit = Orbits[Shell.Index];
+		const FBox Bounds = Orbit.Bounds.ExpandBy(Threshold);
+		for (const int32 ActiveShell : ActiveShells)
+		{
+			const int32 OtherIndex = Shells[ActiveShell].Index;
+			const FOrbit& OtherOrbit = Orbits[OtherIndex];
+			if (!bAll && !Orbit.bIsDirty && !OtherOrbit.bIsDirty) continue;
+			if (!Bounds.Intersect(OtherOrbit.Bounds)) continue;
+
+			OutPairs.Emplace(FMath::Min(Shell.Index, OtherIndex), FMath::Max(Shell.Index, OtherIndex));
+		}
+		ActiveShells.Add(ShellIndex);
+	}
+}
+
+bool FKeplerConjunctionFinder::SearchPair(const int32 IndexA, const int32 IndexB, TArray<FKeplerEncounter>& OutEncounters) const
+{
+	const FOrbit& OrbitA = Orbits[IndexA];
+	const FOrbit& OrbitB = Orbits[IndexB];
+	auto GetDistance = [&OrbitA, &OrbitB](const double Time)
+	{
+		const FVector PositionA = OrbitA.Compiled.GetPositionAtTime(Time - OrbitA.Epoch);
+		const FVector PositionB = OrbitB.Compiled.GetPositionAtTime(Time - OrbitB.Epoch);
+		return FVector::Dist(PositionA, PositionB);
+	};
+	auto AddEncounter = [&OutEncounters, IndexA, IndexB](const double Time, const float Distance)
+	{
+		FKeplerEncounter Encounter;
+		Encounter.OrbitA = IndexA;
+		Encounter.OrbitB = IndexB;
+		Encounter.Time = (float)Time;
+		Encounter.PreciseTime = Time;
+		Encounter.Distance = Distance;
+		OutEncounters.Add(Encounter);
+	};
+
+	const double EndTime = StartTime + Duration;
+	const float MaxSpeed = OrbitA.MaxSpeed + OrbitB.MaxSpeed;
+	if (MaxSpeed <= 0.0f)
+	{
+		const float Distance = GetDistance(StartTime);
+		if (Distance <= Threshold)
+		{
+			AddEncounter(StartTime, Distance);
+		}
+		return false;
+	}
+
+	const double MinStep = FMath::Max(Duration / KeplerConjunction::MaxSteps, (double)KINDA_SMALL_NUMBER);
+	const double ThresholdStep = (double)((KeplerConjunction::InnerStepFraction * Threshold) / MaxSpeed);
+	const double InnerStep = FMath::Max(ThresholdStep, MinStep);
+	double LastTime = StartTime;
+	double Time = StartTime;
+	float Distance = GetDistance(Time);
+	int32 NumSteps = 0;
+	while (Time < EndTime && NumSteps < KeplerConjunction::MaxSteps)
+	{
+		// Conservative advancement. The distance can't shrink faster than MaxSpeed, so no step jumps into the threshold.
+		if (Distance > Threshold)
+		{
+			LastTime = Time;
+			Time = FMath::Min(Time + FMath::Max((double)((Distance - Threshold) / MaxSpeed), MinStep), EndTime);
+			Distance = GetDistance(Time);
+			NumSteps++;
+			continue;
+		}
+
+		// Walk down until the distance grows again, so the minimum is bracketed.
+		double NextTime = FMath::Min(Time + InnerStep, EndTime);
+		float NextDistance = GetDistance(NextTime);
+		NumSteps++;
+		while (NextDistance < Distance && NextTime < EndTime && NumSteps < KeplerConjunction::MaxSteps)
+		{
+			LastTime = Time;
+			Time = NextTime;
+			Distance = NextDistance;
+			NextTime = FMath::Min(Time + InnerStep, EndTime);
+			NextDistance = GetDistance(NextTime);
+			NumSteps++;
+		}
+
+		// Golden-section search of the minimum between the samples around it.
+		const double InvPhi = 0.6180339887;
+		double Low = LastTime;
+		double High = NextTime;
+		double MidLow = High - (InvPhi * (High - Low));
+		double MidHigh = Low + (InvPhi * (High - Low));
+		float DistanceLow = GetDistance(MidLow);
+		float DistanceHigh = GetDistance(MidHigh);
+		for (int32 Iteration = 0; Iteration < KeplerConjunction::NumRefineIterations; Iteration++)
+		{
+			if (DistanceLow < DistanceHigh)
+			{
+				High = MidHigh;
+				MidHigh = MidLow;
+				DistanceHigh = DistanceLow;
+				MidLow = High - (InvPhi * (High - Low));
+				DistanceLow = GetDistance(MidLow);
+			}
+			else
+			{
+				Low = MidLow;
+				MidLow = MidHigh;
+				DistanceLow = DistanceHigh;
+				MidHigh = Low + (InvPhi * (High - Low));
+				DistanceHigh = GetDistance(MidHigh);
+			}
+		}
+
+		const double MinTime = (DistanceLow < DistanceHigh) ? MidLow : MidHigh;
+		const float MinDistance = FMath::Min(DistanceLow, DistanceHigh);
+		if (MinDistance <= Threshold)
+		{
+			AddEncounter(MinTime, MinDistance);
+		}
+
+		// Leave the threshold before looking for the next encounter.
+		Time = NextTime;
+		Distance = NextDistance;
+		while (Distance <= Threshold && Time < EndTime && NumSteps < KeplerConjunction::MaxSteps)
+		{
+			Time = FMath::Min(Time + InnerStep, EndTime);
+			Distance = GetDistance(Time);
+			NumSteps++;
+		}
+		LastTime = Time;
+	}
+
+	// Steps coarser than the threshold needs can jump over short encounters.
+	return Time < EndTime || ThresholdStep < MinStep;
+}
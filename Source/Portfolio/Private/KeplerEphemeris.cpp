@@ -0,0 +1,284 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "KeplerEphemeris.h"
+#include "Misc/ScopeLock.h"
+
+namespace KeplerEphemeris
+{
+	/** Samples per segment used to validate the finished fit against the analytic path. */
+	static const int32 NumValidationSamples = 16;
+
+	/** Clenshaw evaluation of a Chebyshev series with Degree + 1 coefficients, at U in [-1, 1]. */
+	static float EvaluateChebyshev(const float* Coefficients, const int32 Degree, const float U)
+	{
+		float B1 = 0.0f;
+		float B2 = 0.0f;
+		for (int32 j = Degree; j >= 1; j--)
+		{
+			const float B0 = (2.0f * U * B1) - B2 + Coefficients[j];
+			B2 = B1;
+			B1 = B0;
+		}
+		return (U * B1) - B2 + Coefficients[0];
+	}
+}
+
+void FKeplerEphemeris::Build(const FKeplerOrbitConfig& OrbitConfig, const FKeplerEphemerisSettings& Settings)
+{
+	// Copying the config refreshes its derived data.
+	const FKeplerOrbitConfig UpdatedConfig = OrbitConfig;
+	Compiled = UpdatedConfig.Compiled;
+	Degree = FMath::Clamp(Settings.Degree, 2, 16);
+
+	const int32 MaxSegments = FMath::Clamp(Settings.MaxSegments, 1, 4096);
+	const int32 NumCoefficients = Degree + 1;
+	const int32 NumTestPoints = 2 * NumCoefficients;
+	const float TwoPi = 2.0f * PI;
+
+	SegmentStarts.Reset();
+	Coefficients.Reset();
+	SegmentLookup.Reset();
+	Report = FKeplerEphemerisReport();
+	Report.bMeetsErrorBound = true;
+
+	struct FSpan
+	{
+		float Start;
+		float End;
+	};
+
+	// Depth-first bisection. Spans are pushed right before left, so segments come out sorted.
+	TArray<FSpan> Stack;
+	const int32 NumInitialSpans = FMath::Min(4, MaxSegments);
+	for (int32 i = NumInitialSpans - 1; i >= 0; i--)
+	{
+		Stack.Push({ (TwoPi * i) / NumInitialSpans, (TwoPi * (i + 1)) / NumInitialSpans });
+	}
+
+	TArray<float> SpanCoefficients;
+	SpanCoefficients.SetNumUninitialized(NumCoefficients * 2);
+	float MinSegmentWidth = TwoPi;
+	while (Stack.Num() > 0)
+	{
+		const FSpan Span = Stack.Pop(false);
+		FitSegment(Span.Start, Span.End, SpanCoefficients.GetData());
+
+		// Test between the interpolation nodes, where the fit is the least accurate.
+		float SpanError = 0.0f;
+		for (int32 k = 0; k < NumTestPoints; k++)
+		{
+			const float U = -1.0f + ((2.0f * (k + 0.5f)) / NumTestPoints);
+			const float MeanAnomaly = FMath::Lerp(Span.Start, Span.End, 0.5f * (U + 1.0f));
+			const FVector2D Fitted(
+				KeplerEphemeris::EvaluateChebyshev(SpanCoefficients.GetData(), Degree, U),
+				KeplerEphemeris::EvaluateChebyshev(SpanCoefficients.GetData() + NumCoefficients, Degree, U));
+			SpanError = FMath::Max(SpanError, FVector2D::Distance(Fitted, EvaluateAnalytic(MeanAnomaly)));
+		}
+
+		const int32 NumSegmentsIfAccepted = SegmentStarts.Num() + Stack.Num() + 1;
+		if (SpanError > Settings.MaxError && NumSegmentsIfAccepted < MaxSegments)
+		{
+			const float Middle = 0.5f * (Span.Start + Span.End);
+			Stack.Push({ Middle, Span.End });
+			Stack.Push({ Span.Start, Middle });
+			continue;
+		}
+
+		if (SpanError > Settings.MaxError)
+		{
+			Report.bMeetsErrorBound = false;
+		}
+		SegmentStarts.Add(Span.Start);
+		Coefficients.Append(SpanCoefficients);
+		MinSegmentWidth = FMath::Min(MinSegmentWidth, Span.End - Span.Start);
+	}
+
+	// Cells no wider than the smallest segment, so a lookup is off by one segment at most.
+	const int32 NumCells = FMath::Clamp(FMath::CeilToInt(TwoPi / MinSegmentWidth), 1, 65536);
+	SegmentLookup.SetNumUninitialized(NumCells);
+	int32 Segment = 0;
+	for (int32 Cell = 0; Cell < NumCells; Cell++)
+	{
+		const float CellStart = (TwoPi * Cell) / NumCells;
+		while (Segment + 1 < SegmentStarts.Num() && SegmentStarts[Segment + 1] <= CellStart)
+		{
+			Segment++;
+		}
+		SegmentLookup[Cell] = (uint16)Segment;
+	}
+
+	SegmentStarts.Shrink();
+	Coefficients.Shrink();
+
+	// Validate the whole lookup and evaluation path against the analytic one.
+	const FKeplerSolverSettings SolverSettings;
+	double TotalError = 0.0;
+	int32 NumSamples = 0;
+	for (int32 i = 0; i < SegmentStarts.Num(); i++)
+	{
+		const float Start = SegmentStarts[i];
+		const float End = (i + 1 < SegmentStarts.Num()) ? SegmentStarts[i + 1] : TwoPi;
+		for (int32 k = 0; k < KeplerEphemeris::NumValidationSamples; k++)
+		{
+			const float MeanAnomaly = FMath::Lerp(Start, End, (k + 0.5f) / KeplerEphemeris::NumValidationSamples);
+			const float Time = (MeanAnomaly - Compiled.InitialMeanAnomaly) / Compiled.MeanMotion;
+			const float Error = FVector::Distance(Evaluate(Time), Compiled.GetPositionAtTime(Time, SolverSettings));
+			Report.MaxError = FMath::Max(Report.MaxError, Error);
+			TotalError += Error;
+			NumSamples++;
+		}
+	}
+
+	Report.NumSegments = SegmentStarts.Num();
+	Report.MemoryBytes = (int32)GetAllocatedSize();
+	Report.AverageError = (NumSamples > 0) ? (float)(TotalError / NumSamples) : 0.0f;
+
+	UE_LOG(LogKepler, Verbose, TEXT("Ephemeris built: %d segments, %d bytes, max error %f, average error %f."),
+		Report.NumSegments, Report.MemoryBytes, Report.MaxError, Report.AverageError);
+}
+
+FVector FKeplerEphemeris::Evaluate(const double Time) const
+{
+	checkSlow(IsValid());
+
+	const float TwoPi = 2.0f * PI;
+	// Already in [-PI, PI], so a single wrap brings it to [0, 2 * PI).
+	float MeanAnomaly = Compiled.GetMeanAnomalyAtTime(Time);
+	MeanAnomaly += (MeanAnomaly < 0.0f) ? TwoPi : 0.0f;
+
+	const int32 NumCells = SegmentLookup.Num();
+	const int32 Cell = FMath::Clamp(FMath::FloorToInt((MeanAnomaly * NumCells) / TwoPi), 0, NumCells - 1);
+	int32 Segment = SegmentLookup[Cell];
+	const int32 LastSegment = SegmentStarts.Num() - 1;
+	while (Segment < LastSegment && MeanAnomaly >= SegmentStarts[Segment + 1])
+	{
+		Segment++;
+	}
+
+	const FVector2D PlanePosition = EvaluateSegment(Segment, MeanAnomaly);
+	return (Compiled.PeriapsisAxis * PlanePosition.X) + (Compiled.SemiLatusAxis * PlanePosition.Y);
+}
+
+SIZE_T FKeplerEphemeris::GetAllocatedSize() const
+{
+	return SegmentStarts.GetAllocatedSize() + Coefficients.GetAllocatedSize() + SegmentLookup.GetAllocatedSize();
+}
+
+void FKeplerEphemeris::FitSegment(const float StartAnomaly, const float EndAnomaly, float* OutCoefficients) const
+{
+	const int32 NumCoefficients = Degree + 1;
+	const double Middle = 0.5 * ((double)StartAnomaly + EndAnomaly);
+	const double HalfWidth = 0.5 * ((double)EndAnomaly - StartAnomaly);
+
+	double SamplesX[17];
+	double SamplesY[17];
+	for (int32 k = 0; k < NumCoefficients; k++)
+	{
+		const double Node = cos(DOUBLE_PI * (k + 0.5) / NumCoefficients);
+		const FVector2D Sample = EvaluateAnalytic((float)(Middle + (HalfWidth * Node)));
+		SamplesX[k] = Sample.X;
+		SamplesY[k] = Sample.Y;
+	}
+
+	for (int32 j = 0; j < NumCoefficients; j++)
+	{
+		double SumX = 0.0;
+		double SumY = 0.0;
+		for (int32 k = 0; k < NumCoefficients; k++)
+		{
+			const double Weight = cos(DOUBLE_PI * j * (k + 0.5) / NumCoefficients);
+			SumX += SamplesX[k] * Weight;
+			SumY += SamplesY[k] * Weight;
+		}
+
+		// The constant term is halved, so the series can be summed without special cases.
+		const double Scale = (j == 0) ? (1.0 / NumCoefficients) : (2.0 / NumCoefficients);
+		OutCoefficients[j] = (float)(SumX * Scale);
+		OutCoefficients[NumCoefficients + j] = (float)(SumY * Scale);
+	}
+}
+
+FVector2D FKeplerEphemeris::EvaluateSegment(const int32 Segment, const float MeanAnomaly) const
+{
+	const int32 NumCoefficients = Degree + 1;
+	const float Start = SegmentStarts[Segment];
+	const float End = (Segment + 1 < SegmentStarts.Num()) ? SegmentStarts[Segment + 1] : (2.0f * PI);
+	const float U = FMath::Clamp(((2.0f * MeanAnomaly) - Start - End) / (End - Start), -1.0f, 1.0f);
+
+	const float* SegmentCoefficients = Coefficients.GetData() + (Segment * NumCoefficients * 2);
+	return FVector2D(
+		KeplerEphemeris::EvaluateChebyshev(SegmentCoefficients, Degree, U),
+		KeplerEphemeris::EvaluateChebyshev(SegmentCoefficients + NumCoefficients, Degree, U));
+}
+
+FVector2D FKeplerEphemeris::EvaluateAnalytic(const float MeanAnomaly) const
+{
+	FKeplerSolverSettings SolverSettings;
+	SolverSettings.Tolerance = 1e-7f;
+
+	int32 Iterations = 0;
+	const float EccAnomaly = FKeplerSolver::SolveEccentricAnomaly(MeanAnomaly, Compiled.Eccentricity, SolverSettings, Iterations);
+
+	float SinE;
+	float CosE;
+	FMath::SinCos(&SinE, &CosE, EccAnomaly);
+	return FVector2D(Compiled.SemiMajorAxis * (CosE - Compiled.Eccentricity), Compiled.SemiMinorAxis * SinE);
+}
+
+FKeplerEphemerisCache& FKeplerEphemerisCache::Get()
+{
+	static FKeplerEphemerisCache Instance;
+	return Instance;
+}
+
+FKeplerEphemerisPtr FKeplerEphemerisCache::FindOrBuild(const FKeplerOrbitConfig& OrbitConfig, const FKeplerEphemerisSettings& Settings)
+{
+	const FKey Key(OrbitConfig, Settings);
+	{
+		FScopeLock Lock(&CriticalSection);
+		const TWeakPtr<const FKeplerEphemeris, ESPMode::ThreadSafe>* CachedEphemeris = Ephemerides.Find(Key);
+		FKeplerEphemerisPtr PinnedEphemeris = CachedEphemeris ? CachedEphemeris->Pin() : nullptr;
+		if (PinnedEphemeris.IsValid())
+		{
+			return PinnedEphemeris;
+		}
+	}
+
+	// Build outside of the lock. If another thread built the same orbit meanwhile, keep theirs.
+	TSharedPtr<FKeplerEphemeris, ESPMode::ThreadSafe> NewEphemeris = MakeShared<FKeplerEphemeris, ESPMode::ThreadSafe>();
+	NewEphemeris->Build(OrbitConfig, Settings);
+
+	FScopeLock Lock(&CriticalSection);
+	TWeakPtr<const FKeplerEphemeris, ESPMode::ThreadSafe>& CachedEphemeris = Ephemerides.FindOrAdd(Key);
+	FKeplerEphemerisPtr PinnedEphemeris = CachedEphemeris.Pin();
+	if (PinnedEphemeris.IsValid())
+	{
+		return PinnedEphemeris;
+	}
+	CachedEphemeris = NewEphemeris;
+
+	if (Ephemerides.Num() > PruneThreshold)
+	{
+		PruneExpired();
+		PruneThreshold = FMath::Max(64, Ephemerides.Num() * 2);
+	}
+	return NewEphemeris;
+}
+
+int32 FKeplerEphemerisCache::Num() const
+{
+	FScopeLock Lock(&CriticalSection);
+	return Ephemerides.Num();
+}
+
+void FKeplerEphemerisCache::PruneExpired()
+{
+	for (auto It = Ephemerides.CreateIterator(); It; ++It)
+	{
+		if (!It.Value().IsValid())
+		{
+			It.RemoveCurrent();
+		}
+	}
+}
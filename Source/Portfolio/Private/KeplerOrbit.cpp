@@ -2,6 +2,10 @@
 
 
 #include "KeplerOrbit.h"
+#include "KeplerOrbitPolyline.h"
+#include "KeplerSolverTable.h"
+
+DEFINE_LOG_CATEGORY(LogKepler);
 
 bool FKeplerOrbitConfig::IsValid() const
 {
@@ -36,15 +40,412 @@ void FKeplerOrbitConfig::UpdateOrbitData()
 	SemiMinorAxis = SemiMajorAxis * FMath::Sqrt(1 - (Eccentricity * Eccentricity));
 
 	Period = (360.0f * 2.0f) * FMath::Sqrt(FMath::Pow(SemiMajorAxis, 3.0f));
+
+	Compiled.Compile(*this);
+}
+
+void FKeplerOrbitConfig::PostSerialize(const FArchive& Ar)
+{
+	if (Ar.IsLoading())
+	{
+		UpdateOrbitData();
+	}
+}
+
+namespace KeplerOrbit
+{
+	/** Distances closer than this are considered equal. */
+	static const double LengthQuantum = 1e-3;
+
+	/** Angles, in degrees, closer than this are considered equal. */
+	static const double AngleQuantum = 1e-4;
+
+	/**
+	 * Blueprints can make or edit a config without updating its derived data, so the library
+	 * compiles its own copy from the elements.
+	 */
+	static FKeplerOrbitConfig GetUpdatedConfig(const FKeplerOrbitConfig& OrbitConfig)
+	{
+		// Copying the config refreshes its derived data.
+		return FKeplerOrbitConfig(OrbitConfig);
+	}
 }
 
 bool FKeplerOrbitConfig::Equals(const FKeplerOrbitConfig& Other) const
 {
-	const bool bIsPeriapsisEqual = FMath::IsNearlyEqual(Periapsis, Other.Periapsis);
-	const bool bIsApoapsisEqual = FMath::IsNearlyEqual(Apoapsis, Other.Apoapsis);
-	const bool bIsOrientationEqual = Orientation.Equals(Other.Orientation, 1e-6f);
-	const bool bIsAnomalyEqual = FMath::IsNearlyEqual(InitialTrueAnomaly, Other.InitialTrueAnomaly);
-	return bIsPeriapsisEqual && bIsApoapsisEqual && bIsOrientationEqual && bIsAnomalyEqual;
+	const bool bIsShapeEqual = HasSameShape(Other);
+	const bool bIsPitchEqual = QuantizeAngle(Orientation.Pitch) == QuantizeAngle(Other.Orientation.Pitch);
+	const bool bIsYawEqual = QuantizeAngle(Orientation.Yaw) == QuantizeAngle(Other.Orientation.Yaw);
+	const bool bIsRollEqual = QuantizeAngle(Orientation.Roll) == QuantizeAngle(Other.Orientation.Roll);
+	const bool bIsAnomalyEqual = QuantizeAngle(InitialTrueAnomaly) == QuantizeAngle(Other.InitialTrueAnomaly);
+	return bIsShapeEqual && bIsPitchEqual && bIsYawEqual && bIsRollEqual && bIsAnomalyEqual;
+}
+
+bool FKeplerOrbitConfig::HasSameShape(const FKeplerOrbitConfig& Other) const
+{
+	const bool bIsPeriapsisEqual = QuantizeLength(Periapsis) == QuantizeLength(Other.Periapsis);
+	const bool bIsApoapsisEqual = QuantizeLength(Apoapsis) == QuantizeLength(Other.Apoapsis);
+	return bIsPeriapsisEqual && bIsApoapsisEqual;
+}
+
+uint32 FKeplerOrbitConfig::GetElementsHash() const
+{
+	uint32 Hash = GetShapeHash();
+	Hash = HashCombine(Hash, GetTypeHash(QuantizeAngle(Orientation.Pitch)));
+	Hash = HashCombine(Hash, GetTypeHash(QuantizeAngle(Orientation.Yaw)));
+	Hash = HashCombine(Hash, GetTypeHash(QuantizeAngle(Orientation.Roll)));
+	Hash = HashCombine(Hash, GetTypeHash(QuantizeAngle(InitialTrueAnomaly)));
+	return Hash;
+}
+
+uint32 FKeplerOrbitConfig::GetShapeHash() const
+{
+	uint32 Hash = GetTypeHash(QuantizeLength(Periapsis));
+	Hash = HashCombine(Hash, GetTypeHash(QuantizeLength(Apoapsis)));
+	return Hash;
+}
+
+int64 FKeplerOrbitConfig::QuantizeLength(const float Length)
+{
+	return (int64)FMath::RoundToDouble(Length / KeplerOrbit::LengthQuantum);
+}
+
+int64 FKeplerOrbitConfig::QuantizeAngle(const float Angle)
+{
+	// Wrap after rounding too, so -180 and 180 land on the same step.
+	const int64 StepsPerTurn = (int64)FMath::RoundToDouble(360.0 / KeplerOrbit::AngleQuantum);
+	int64 Steps = (int64)FMath::RoundToDouble(FRotator::NormalizeAxis(Angle) / KeplerOrbit::AngleQuantum);
+	Steps %= StepsPerTurn;
+	if (Steps <= -(StepsPerTurn / 2))
+	{
+		Steps += StepsPerTurn;
+	}
+	else if (Steps > (StepsPerTurn / 2))
+	{
+		Steps -= StepsPerTurn;
+	}
+	return Steps;
+}
+
+float FKeplerOrbitConfig::GetGravitationalParameter()
+{
+	// Period is 2 * PI * sqrt(a^3 / mu), so sqrt(mu) is 2 * PI / 720.
+	return (PI / 360.0f) * (PI / 360.0f);
+}
+
+bool FKeplerOrbitConfig::FromStateVectors(const FVector& Position, const FVector& Velocity, FKeplerOrbitConfig& OutOrbitConfig)
+{
+	const float GravitationalParameter = GetGravitationalParameter();
+	const float Distance = Position.Size();
+	const FVector AngularMomentum = Position ^ Velocity;
+	const float AngularMomentumSize = AngularMomentum.Size();
+	if (Distance < KINDA_SMALL_NUMBER || AngularMomentumSize <= KINDA_SMALL_NUMBER * Distance * Velocity.Size()) return false;
+
+	// Vis-viva. Non-positive values mean the body is not bound.
+	const float InvSemiMajorAxis = (2.0f / Distance) - (Velocity.SizeSquared() / GravitationalParameter);
+	if (InvSemiMajorAxis <= 0.0f) return false;
+
+	const FVector EccentricityVector = ((Velocity ^ AngularMomentum) / GravitationalParameter) - (Position / Distance);
+	const float NewEccentricity = EccentricityVector.Size();
+	if (NewEccentricity >= 1.0f) return false;
+
+	// Circular orbits have no periapsis, so put it under the body.
+	const FVector NormalAxis = AngularMomentum / AngularMomentumSize;
+	const FVector PeriapsisAxis = (NewEccentricity > KINDA_SMALL_NUMBER) ? (EccentricityVector / NewEccentricity) : (Position / Distance);
+	const FVector SemiLatusAxis = NormalAxis ^ PeriapsisAxis;
+
+	const float NewSemiMajorAxis = 1.0f / InvSemiMajorAxis;
+	OutOrbitConfig.Periapsis = NewSemiMajorAxis * (1.0f - NewEccentricity);
+	OutOrbitConfig.Apoapsis = NewSemiMajorAxis * (1.0f + NewEccentricity);
+
+	// Compile places the periapsis opposite to the forward vector, and the semi-latus axis along forward ^ up.
+	OutOrbitConfig.Orientation = FRotationMatrix::MakeFromXZ(-PeriapsisAxis, NormalAxis).Rotator();
+	OutOrbitConfig.InitialTrueAnomaly = FMath::RadiansToDegrees(FMath::Atan2(Position | SemiLatusAxis, Position | PeriapsisAxis));
+	OutOrbitConfig.UpdateOrbitData();
+	return true;
+}
+
+void FKeplerCompiledOrbit::Compile(const FKeplerOrbitConfig& OrbitConfig)
+{
+	// The library places the periapsis opposite to the forward vector of the orientation.
+	const FQuat OrbitalOrientation = FQuat(OrbitConfig.Orientation);
+	const FVector Forward = OrbitalOrientation.GetForwardVector();
+	const FVector Up = OrbitalOrientation.GetUpVector();
+	PeriapsisAxis = -Forward;
+	SemiLatusAxis = Forward ^ Up;
+	NormalAxis = Up;
+
+	SemiMajorAxis = OrbitConfig.SemiMajorAxis;
+	SemiMinorAxis = OrbitConfig.SemiMinorAxis;
+	Eccentricity = OrbitConfig.Eccentricity;
+	AxisRatio = FMath::Sqrt(1.0f - (Eccentricity * Eccentricity));
+	SemiLatusRectum = SemiMajorAxis * (1.0f - (Eccentricity * Eccentricity));
+	// From the semi-major axis in double precision, instead of the rounded period.
+	const double SemiMajorAxisCubed = (double)SemiMajorAxis * SemiMajorAxis * SemiMajorAxis;
+	MeanMotion = (SemiMajorAxisCubed > 0.0) ? (float)((2.0 * DOUBLE_PI) / (720.0 * sqrt(SemiMajorAxisCubed))) : 0.0f;
+
+	// Convert the initial true anomaly into a mean anomaly, so time can be advanced linearly.
+	InitialMeanAnomaly = GetMeanAnomalyFromTrueAnomaly(FMath::DegreesToRadians(OrbitConfig.InitialTrueAnomaly));
+}
+
+FVector FKeplerCompiledOrbit::GetPositionAtTime(const double Time, const FKeplerSolverSettings& Settings) const
+{
+	int32 Iterations = 0;
+	const float EccAnomaly = FKeplerSolver::SolveEccentricAnomaly(GetMeanAnomalyAtTime(Time), Eccentricity, Settings, Iterations);
+	return GetPositionFromEccentricAnomaly(EccAnomaly);
+}
+
+FVector FKeplerCompiledOrbit::GetVelocityFromEccentricAnomaly(const float EccentricAnomalyRad) const
+{
+	float SinE;
+	float CosE;
+	FMath::SinCos(&SinE, &CosE, EccentricAnomalyRad);
+
+	// Derivative of the position, with dE/dt = n / (1 - e * cos(E)).
+	const float EccAnomalyRate = MeanMotion / FMath::Max(1.0f - (Eccentricity * CosE), KINDA_SMALL_NUMBER);
+	return (PeriapsisAxis * (-SemiMajorAxis * SinE * EccAnomalyRate)) + (SemiLatusAxis * (SemiMinorAxis * CosE * EccAnomalyRate));
+}
+
+void FKeplerCompiledOrbit::GetStateAtTime(const double Time, FVector& OutPosition, FVector& OutVelocity, const FKeplerSolverSettings& Settings) const
+{
+	int32 Iterations = 0;
+	const float EccAnomaly = FKeplerSolver::SolveEccentricAnomaly(GetMeanAnomalyAtTime(Time), Eccentricity, Settings, Iterations);
+	OutPosition = GetPositionFromEccentricAnomaly(EccAnomaly);
+	OutVelocity = GetVelocityFromEccentricAnomaly(EccAnomaly);
+}
+
+float FKeplerCompiledOrbit::GetMeanAnomalyFromTrueAnomaly(const float TrueAnomalyRad) const
+{
+	float SinV;
+	float CosV;
+	FMath::SinCos(&SinV, &CosV, TrueAnomalyRad);
+	const float EccAnomaly = FMath::Atan2(AxisRatio * SinV, Eccentricity + CosV);
+	return EccAnomaly - (Eccentricity * FMath::Sin(EccAnomaly));
+}
+
+float FKeplerCompiledOrbit::GetTimeUntilTrueAnomaly(const double Time, const float TrueAnomalyRad) const
+{
+	if (MeanMotion <= 0.0f) return 0.0f;
+
+	// Mean anomaly grows linearly, so the wait is the angle left to sweep over the mean motion.
+	const float TwoPi = 2.0f * PI;
+	const float AngleLeft = FMath::Fmod(GetMeanAnomalyFromTrueAnomaly(TrueAnomalyRad) - GetMeanAnomalyAtTime(Time), TwoPi);
+	return ((AngleLeft < 0.0f) ? AngleLeft + TwoPi : AngleLeft) / MeanMotion;
+}
+
+bool FKeplerCompiledOrbit::GetAscendingNodeAnomaly(float& OutTrueAnomalyRad) const
+{
+	// Height is r * (cos(v) * P.z + sin(v) * Q.z), which is zero and rising at this anomaly.
+	const float PlaneTilt = FVector2D(PeriapsisAxis.Z, SemiLatusAxis.Z).Size();
+	if (PlaneTilt < KINDA_SMALL_NUMBER) return false;
+
+	OutTrueAnomalyRad = FMath::Atan2(-PeriapsisAxis.Z, SemiLatusAxis.Z);
+	return true;
+}
+
+float FKeplerCompiledOrbit::GetPeriapsisSpeed() const
+{
+	const float Flattening = FMath::Max(1.0f - Eccentricity, KINDA_SMALL_NUMBER);
+	return MeanMotion * SemiMajorAxis * FMath::Sqrt((1.0f + Eccentricity) / Flattening);
+}
+
+float FKeplerSolver::ReduceAngle(const float AngleRad)
+{
+	const float Revolutions = FMath::FloorToFloat((AngleRad / (2.0f * PI)) + 0.5f);
+	return AngleRad - (Revolutions * 2.0f * PI);
+}
+
+double FKeplerSolver::ReduceAngle(const double AngleRad)
+{
+	const double Revolutions = FMath::FloorToDouble((AngleRad / (2.0 * DOUBLE_PI)) + 0.5);
+	return AngleRad - (Revolutions * 2.0 * DOUBLE_PI);
+}
+
+float FKeplerSolver::GetStarterGuess(const float MeanAnomalyRad, const float Eccentricity)
+{
+	if (Eccentricity < 0.8f)
+	{
+		return MeanAnomalyRad + (Eccentricity * FMath::Sin(MeanAnomalyRad));
+	}
+
+	// Danby's starter. Stays inside the basin of convergence for highly eccentric orbits.
+	return MeanAnomalyRad + (0.85f * Eccentricity * FMath::Sign(MeanAnomalyRad));
+}
+
+float FKeplerSolver::GetMarkleyEstimate(const float MeanAnomalyRad, const float Eccentricity)
+{
+	// Markley (1995). The equation is odd in M, so solve for |M| and restore the sign at the end.
+	// Evaluated in double precision, as the cubic is prone to cancellation near the periapsis. FMath
+	// only has float overloads of these functions, so the C ones are used.
+	const double Mean = FMath::Abs((double)MeanAnomalyRad);
+	const double Ecc = Eccentricity;
+	const double PiSquared = DOUBLE_PI * DOUBLE_PI;
+
+	const double Alpha = ((3.0 * PiSquared) + (1.6 * DOUBLE_PI * (DOUBLE_PI - Mean) / (1.0 + Ecc))) / (PiSquared - 6.0);
+	const double D = (3.0 * (1.0 - Ecc)) + (Alpha * Ecc);
+	const double Q = (2.0 * Alpha * D * (1.0 - Ecc)) - (Mean * Mean);
+	const double R = (3.0 * Alpha * D * (D - 1.0 + Ecc) * Mean) + (Mean * Mean * Mean);
+	const double W = pow(FMath::Abs(R) + sqrt((Q * Q * Q) + (R * R)), 2.0 / 3.0);
+	const double Estimate = (((2.0 * R * W) / ((W * W) + (W * Q) + (Q * Q))) + Mean) / D;
+
+	// Fifth-order Householder correction of the cubic estimate.
+	const double SinE = sin(Estimate);
+	const double CosE = cos(Estimate);
+	const double F0 = Estimate - (Ecc * SinE) - Mean;
+	const double F1 = 1.0 - (Ecc * CosE);
+	const double F2 = Ecc * SinE;
+	const double F3 = Ecc * CosE;
+	const double D3 = -F0 / (F1 - (0.5 * F0 * F2 / F1));
+	const double D4 = -F0 / (F1 + (0.5 * D3 * F2) + (D3 * D3 * F3 / 6.0));
+	const double D5 = -F0 / (F1 + (0.5 * D4 * F2) + (D4 * D4 * F3 / 6.0) - (D4 * D4 * D4 * F2 / 24.0));
+	const double EccentricAnomaly = Estimate + D5;
+
+	return (float)((MeanAnomalyRad < 0.0f) ? -EccentricAnomaly : EccentricAnomaly);
+}
+
+float FKeplerSolver::SolveEccentricAnomaly(const float MeanAnomalyRad, const float Eccentricity, const FKeplerSolverSettings& Settings, int32& OutIterations)
+{
+	const float Mean = ReduceAngle(MeanAnomalyRad);
+	const float Ecc = Eccentricity;
+	const float Tolerance = Settings.Tolerance;
+	const int32 MaxIterations = FMath::Max(1, Settings.MaxIterations);
+
+	float EccentricAnomaly = 0.0f;
+	int32 Iterations = 0;
+	float SinE = 0.0f;
+	float CosE = 0.0f;
+
+	switch (Settings.Mode)
+	{
+	case EKeplerSolverMode::FixedPoint:
+		EccentricAnomaly = GetStarterGuess(Mean, Ecc);
+		while (Iterations < MaxIterations)
+		{
+			Iterations++;
+			const float NewEccentricAnomaly = Mean + (Ecc * FMath::Sin(EccentricAnomaly));
+			const float Step = NewEccentricAnomaly - EccentricAnomaly;
+			EccentricAnomaly = NewEccentricAnomaly;
+			if (FMath::Abs(Step) <= Tolerance)
+			{
+				break;
+			}
+		}
+		break;
+
+	case EKeplerSolverMode::Halley:
+		EccentricAnomaly = GetStarterGuess(Mean, Ecc);
+		while (Iterations < MaxIterations)
+		{
+			Iterations++;
+			FMath::SinCos(&SinE, &CosE, EccentricAnomaly);
+			const float F0 = EccentricAnomaly - (Ecc * SinE) - Mean;
+			const float F1 = 1.0f - (Ecc * CosE);
+			const float F2 = Ecc * SinE;
+			const float Step = F0 / (F1 - (0.5f * F0 * F2 / F1));
+			EccentricAnomaly -= Step;
+			if (FMath::Abs(Step) <= Tolerance)
+			{
+				break;
+			}
+		}
+		break;
+
+	case EKeplerSolverMode::LookupTable:
+		if (FKeplerSolverTable::Get().CanSolve(Ecc))
+		{
+			EccentricAnomaly = FKeplerSolverTable::Get().Solve(Mean, Ecc);
+			Iterations = 1;
+			break;
+		}
+		// Eccentricities outside the table are solved with Newton-Raphson.
+		// fall through
+
+	case EKeplerSolverMode::Markley:
+	case EKeplerSolverMode::NewtonRaphson:
+	default:
+		if (Settings.Mode == EKeplerSolverMode::Markley)
+		{
+			// The estimate normally meets the tolerance, so the loop below only verifies it.
+			EccentricAnomaly = GetMarkleyEstimate(Mean, Ecc);
+			Iterations++;
+		}
+		else
+		{
+			EccentricAnomaly = GetStarterGuess(Mean, Ecc);
+		}
+		while (Iterations < MaxIterations)
+		{
+			FMath::SinCos(&SinE, &CosE, EccentricAnomaly);
+			const float Step = (EccentricAnomaly - (Ecc * SinE) - Mean) / (1.0f - (Ecc * CosE));
+			if (Settings.Mode == EKeplerSolverMode::Markley && FMath::Abs(Step) <= Tolerance)
+			{
+				break;
+			}
+			Iterations++;
+			EccentricAnomaly -= Step;
+			if (FMath::Abs(Step) <= Tolerance)
+			{
+				break;
+			}
+		}
+		break;
+	}
+
+	if (FKeplerSolverStats::IsEnabled())
+	{
+		FKeplerSolverStats::Record(Ecc, Iterations);
+	}
+
+	OutIterations = Iterations;
+	return EccentricAnomaly;
+}
+
+TAtomic<bool> FKeplerSolverStats::bEnabled(false);
+volatile int32 FKeplerSolverStats::NumCalls[FKeplerSolverStats::NumBuckets] = {};
+volatile int64 FKeplerSolverStats::TotalIterations[FKeplerSolverStats::NumBuckets] = {};
+volatile int32 FKeplerSolverStats::MaxIterations[FKeplerSolverStats::NumBuckets] = {};
+
+void FKeplerSolverStats::Record(const float Eccentricity, const int32 Iterations)
+{
+	const int32 Bucket = FMath::Clamp(FMath::FloorToInt(Eccentricity * NumBuckets), 0, NumBuckets - 1);
+	FPlatformAtomics::InterlockedIncrement(&NumCalls[Bucket]);
+	FPlatformAtomics::InterlockedAdd(&TotalIterations[Bucket], (int64)Iterations);
+
+	int32 CurrentMax = MaxIterations[Bucket];
+	while (Iterations > CurrentMax)
+	{
+		const int32 PreviousMax = FPlatformAtomics::InterlockedCompareExchange(&MaxIterations[Bucket], Iterations, CurrentMax);
+		if (PreviousMax == CurrentMax)
+		{
+			break;
+		}
+		CurrentMax = PreviousMax;
+	}
+}
+
+void FKeplerSolverStats::Reset()
+{
+	for (int32 i = 0; i < NumBuckets; i++)
+	{
+		FPlatformAtomics::InterlockedExchange(&NumCalls[i], 0);
+		FPlatformAtomics::InterlockedExchange(&TotalIterations[i], (int64)0);
+		FPlatformAtomics::InterlockedExchange(&MaxIterations[i], 0);
+	}
+}
+
+void FKeplerSolverStats::GetBuckets(TArray<FKeplerSolverStatsBucket>& OutBuckets)
+{
+	OutBuckets.Reset(NumBuckets);
+	for (int32 i = 0; i < NumBuckets; i++)
+	{
+		FKeplerSolverStatsBucket& Bucket = OutBuckets.AddDefaulted_GetRef();
+		Bucket.MinEccentricity = (float)i / NumBuckets;
+		Bucket.MaxEccentricity = (float)(i + 1) / NumBuckets;
+		Bucket.NumCalls = NumCalls[i];
+		Bucket.TotalIterations = TotalIterations[i];
+		Bucket.MaxIterations = MaxIterations[i];
+		Bucket.AverageIterations = (Bucket.NumCalls > 0) ? (float)((double)Bucket.TotalIterations / Bucket.NumCalls) : 0.0f;
+	}
 }
 
 bool UKeplerLibrary::IsOrbitValid(const FKeplerOrbitConfig& OrbitConfig)
@@ -71,62 +472,82 @@ bool UKeplerLibrary::Equals(const FKeplerOrbitConfig& A, const FKeplerOrbitConfi
 
 float UKeplerLibrary::GetMeanAnomaly(const FKeplerOrbitConfig& OrbitConfig, const float Time)
 {
-	const float MeanMotion = 360.0f / OrbitConfig.Period;
-	const float MeanAnomaly = MeanMotion * Time;
+	const FKeplerOrbitConfig UpdatedConfig = KeplerOrbit::GetUpdatedConfig(OrbitConfig);
+	const float MeanAnomaly = FMath::RadiansToDegrees(FKeplerSolver::ReduceAngle((double)UpdatedConfig.Compiled.MeanMotion * Time));
 	return MeanAnomaly;
 }
 
 float UKeplerLibrary::GetEccentricAnomaly(const FKeplerOrbitConfig& OrbitConfig, const float MeanAnomaly)
+{
+	int32 Iterations = 0;
+	const float EccentricAnomaly = GetEccentricAnomalyWithSolver(OrbitConfig, MeanAnomaly, FKeplerSolverSettings(), Iterations);
+	return EccentricAnomaly;
+}
+
+float UKeplerLibrary::GetEccentricAnomalyWithSolver(const FKeplerOrbitConfig& OrbitConfig, const float MeanAnomaly, const FKeplerSolverSettings& Settings, int32& OutIterations)
 {
 	const float MeanAnomalyRad = FMath::DegreesToRadians(MeanAnomaly);
-	float EccentricAnomaly = MeanAnomalyRad;
-	for (int i = 0; i < 18; i++)
-	{
-		EccentricAnomaly = MeanAnomalyRad + (OrbitConfig.Eccentricity * FMath::Sin(EccentricAnomaly));
-	}
+	const float ReducedMeanAnomaly = FKeplerSolver::ReduceAngle(MeanAnomalyRad);
+	const FKeplerOrbitConfig UpdatedConfig = KeplerOrbit::GetUpdatedConfig(OrbitConfig);
+	float EccentricAnomaly = FKeplerSolver::SolveEccentricAnomaly(ReducedMeanAnomaly, UpdatedConfig.Eccentricity, Settings, OutIterations);
+
+	// Keep the result in the same revolution as the given mean anomaly.
+	EccentricAnomaly += (MeanAnomalyRad - ReducedMeanAnomaly);
 	EccentricAnomaly = FMath::RadiansToDegrees(EccentricAnomaly);
 	return EccentricAnomaly;
 }
 
 float UKeplerLibrary::GetTrueAnomaly(const FKeplerOrbitConfig& OrbitConfig, const float EccentricAnomaly)
 {
-	const float Eccentricity = OrbitConfig.Eccentricity;
 	const float EccentricAnomalyRad = FMath::DegreesToRadians(EccentricAnomaly);
-
-	const float X = FMath::Cos(EccentricAnomalyRad) - Eccentricity;
-	const float Y = FMath::Sqrt(1 - FMath::Pow(Eccentricity, 2)) * FMath::Sin(EccentricAnomalyRad);
-	float TrueAnomaly = FMath::Atan2(Y, X);
-
-	TrueAnomaly = FMath::RadiansToDegrees(TrueAnomaly);
+	const FKeplerOrbitConfig UpdatedConfig = KeplerOrbit::GetUpdatedConfig(OrbitConfig);
+	const float TrueAnomaly = FMath::RadiansToDegrees(UpdatedConfig.Compiled.GetTrueAnomaly(EccentricAnomalyRad));
 	return TrueAnomaly;
 }
 
 FVector UKeplerLibrary::GetOrbitalPositionTrue(const FKeplerOrbitConfig& OrbitConfig, const float TrueAnomaly)
 {
-	FQuat OrbitalOrientation = FQuat(OrbitConfig.Orientation);
-	FVector OrbitalPosition = OrbitalOrientation.GetForwardVector();
-	OrbitalPosition = OrbitalPosition.RotateAngleAxis(TrueAnomaly - 180.0f, OrbitalOrientation.GetUpVector());
-
-	const float Dividend = OrbitConfig.SemiMajorAxis * (1 - FMath::Pow(OrbitConfig.Eccentricity, 2));
-	const float Divisor = 1 + OrbitConfig.Eccentricity * FMath::Cos(FMath::DegreesToRadians(TrueAnomaly));
-	const float OrbitalDistance = Dividend / Divisor;
-
-	OrbitalPosition *= OrbitalDistance;
+	const FKeplerOrbitConfig UpdatedConfig = KeplerOrbit::GetUpdatedConfig(OrbitConfig);
+	const FVector OrbitalPosition = UpdatedConfig.Compiled.GetPositionFromTrueAnomaly(FMath::DegreesToRadians(TrueAnomaly));
 	return OrbitalPosition;
 }
 
 FVector UKeplerLibrary::GetOrbitalPositionEcc(const FKeplerOrbitConfig& OrbitConfig, const float EccentricAnomaly)
 {
-	FQuat OrbitalOrientation = FQuat(OrbitConfig.Orientation);
-	FVector OrbitalPosition = OrbitalOrientation.GetForwardVector();
-	OrbitalPosition = OrbitalPosition.RotateAngleAxis(EccentricAnomaly, OrbitalOrientation.GetUpVector());
+	const FKeplerOrbitConfig UpdatedConfig = KeplerOrbit::GetUpdatedConfig(OrbitConfig);
+	const FKeplerCompiledOrbit& Compiled = UpdatedConfig.Compiled;
 
-	const float EccentricAnomalyRad = FMath::DegreesToRadians(EccentricAnomaly);
-	const float OrbitalDistance = OrbitConfig.SemiMajorAxis * (1 - (OrbitConfig.Eccentricity * FMath::Cos(EccentricAnomalyRad)));
-	OrbitalPosition *= OrbitalDistance;
+	// Direction at the eccentric anomaly, measured from the apoapsis side.
+	float SinE;
+	float CosE;
+	FMath::SinCos(&SinE, &CosE, FMath::DegreesToRadians(EccentricAnomaly));
+	const FVector Direction = (Compiled.PeriapsisAxis * -CosE) - (Compiled.SemiLatusAxis * SinE);
+
+	const float OrbitalDistance = Compiled.SemiMajorAxis * (1.0f - (Compiled.Eccentricity * CosE));
+	const FVector OrbitalPosition = Direction * OrbitalDistance;
 	return OrbitalPosition;
 }
 
+FVector UKeplerLibrary::GetOrbitalPositionAtTime(const FKeplerOrbitConfig& OrbitConfig, const float Time)
+{
+	return KeplerOrbit::GetUpdatedConfig(OrbitConfig).Compiled.GetPositionAtTime(Time);
+}
+
+float UKeplerLibrary::GetTimeUntilTrueAnomaly(const FKeplerOrbitConfig& OrbitConfig, const float Time, const float TrueAnomaly)
+{
+	return KeplerOrbit::GetUpdatedConfig(OrbitConfig).Compiled.GetTimeUntilTrueAnomaly(Time, FMath::DegreesToRadians(TrueAnomaly));
+}
+
+bool UKeplerLibrary::GetTimeUntilNodeCrossing(const FKeplerOrbitConfig& OrbitConfig, const float Time, const bool bAscending, float& OutTime)
+{
+	const FKeplerOrbitConfig UpdatedConfig = KeplerOrbit::GetUpdatedConfig(OrbitConfig);
+	float NodeAnomaly = 0.0f;
+	if (!UpdatedConfig.Compiled.GetAscendingNodeAnomaly(NodeAnomaly)) return false;
+
+	OutTime = UpdatedConfig.Compiled.GetTimeUntilTrueAnomaly(Time, bAscending ? NodeAnomaly : NodeAnomaly + PI);
+	return true;
+}
+
 void UKeplerLibrary::GetOrbitPoints(const FKeplerOrbitConfig& OrbitConfig, const int NumOfPoints, TArray<FVector>& OutPoints)
 {
 	if (NumOfPoints < 1)
@@ -134,21 +555,46 @@ void UKeplerLibrary::GetOrbitPoints(const FKeplerOrbitConfig& OrbitConfig, const
 		return;
 	}
 
-	const float MeanMotion = 360.0f / (float)NumOfPoints;
-	FVector OrbPoint;
+	const FKeplerOrbitConfig UpdatedConfig = KeplerOrbit::GetUpdatedConfig(OrbitConfig);
+	const FKeplerCompiledOrbit& Compiled = UpdatedConfig.Compiled;
+	const FKeplerSolverSettings SolverSettings;
+	const float MeanMotion = (2.0f * PI) / (float)NumOfPoints;
+	OutPoints.Reserve(OutPoints.Num() + NumOfPoints);
 	for (int i = 0; i < NumOfPoints; i++)
 	{
+		int32 Iterations = 0;
 		const float MeanAnomaly = MeanMotion * i;
-		const float EccentricAnomaly = GetEccentricAnomaly(OrbitConfig, MeanAnomaly);
-		const float TrueAnomaly = GetTrueAnomaly(OrbitConfig, MeanAnomaly);
-		OrbPoint = GetOrbitalPositionTrue(OrbitConfig, TrueAnomaly);
-		OutPoints.Add(OrbPoint);
+		const float EccentricAnomaly = FKeplerSolver::SolveEccentricAnomaly(MeanAnomaly, Compiled.Eccentricity, SolverSettings, Iterations);
+		OutPoints.Add(Compiled.GetPositionFromEccentricAnomaly(EccentricAnomaly));
 	}
 }
 
+void UKeplerLibrary::GetOrbitPointsAdaptive(const FKeplerOrbitConfig& OrbitConfig, const float MaxChordError, TArray<FVector>& OutPoints)
+{
+	const FKeplerOrbitConfig UpdatedConfig = KeplerOrbit::GetUpdatedConfig(OrbitConfig);
+	const FKeplerPolylineCache::FPolylineRef PlanePoints = FKeplerPolylineCache::Get().FindOrBuild(UpdatedConfig, MaxChordError);
+	FKeplerPolylineCache::TransformPolyline(UpdatedConfig, PlanePoints.Get(), OutPoints);
+}
+
 FKeplerOrbitConfig UKeplerLibrary::GetOppositeFocus(const FKeplerOrbitConfig& OrbitConfig)
 {
 	FKeplerOrbitConfig OtherFocus = OrbitConfig;
 	OtherFocus.Orientation.Yaw += 180.0f;
+	OtherFocus.UpdateOrbitData();
 	return OtherFocus;
 }
+
+void UKeplerLibrary::SetSolverStatsEnabled(const bool bEnable)
+{
+	FKeplerSolverStats::SetEnabled(bEnable);
+}
+
+void UKeplerLibrary::ResetSolverStats()
+{
+	FKeplerSolverStats::Reset();
+}
+
+void UKeplerLibrary::GetSolverStats(TArray<FKeplerSolverStatsBucket>& OutBuckets)
+{
+	FKeplerSolverStats::GetBuckets(OutBuckets);
+}
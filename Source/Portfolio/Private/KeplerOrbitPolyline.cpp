@@ -0,0 +1,139 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "KeplerOrbitPolyline.h"
+#include "Misc/ScopeLock.h"
+
+namespace KeplerOrbitPolyline
+{
+	/** Upper bound of points per polyline, in case of very small tolerances. */
+	static const int32 MaxPoints = 4096;
+
+	/** Spans the orbit starts with, so no part of it can be skipped by a lucky midpoint. */
+	static const int32 NumInitialSpans = 8;
+}
+
+FKeplerPolylineCache& FKeplerPolylineCache::Get()
+{
+	static FKeplerPolylineCache Instance;
+	return Instance;
+}
+
+FKeplerPolylineCache::FPolylineRef FKeplerPolylineCache::FindOrBuild(const FKeplerOrbitConfig& OrbitConfig, const float MaxChordError)
+{
+	const FKeplerPolylineKey Key(OrbitConfig, MaxChordError);
+	{
+		FScopeLock Lock(&CriticalSection);
+		const TWeakPtr<const TArray<FVector2D>, ESPMode::ThreadSafe>* CachedPolyline = Polylines.Find(Key);
+		TSharedPtr<const TArray<FVector2D>, ESPMode::ThreadSafe> PinnedPolyline = CachedPolyline ? CachedPolyline->Pin() : nullptr;
+		if (PinnedPolyline.IsValid())
+		{
+			return PinnedPolyline.ToSharedRef();
+		}
+	}
+
+	// Build outside of the lock. If another thread built the same shape meanwhile, keep theirs.
+	TSharedRef<TArray<FVector2D>, ESPMode::ThreadSafe> NewPolyline = MakeShared<TArray<FVector2D>, ESPMode::ThreadSafe>();
+	BuildPolyline(OrbitConfig, MaxChordError, KeplerOrbitPolyline::MaxPoints, NewPolyline.Get());
+
+	FScopeLock Lock(&CriticalSection);
+	TWeakPtr<const TArray<FVector2D>, ESPMode::ThreadSafe>& CachedPolyline = Polylines.FindOrAdd(Key);
+	TSharedPtr<const TArray<FVector2D>, ESPMode::ThreadSafe> PinnedPolyline = CachedPolyline.Pin();
+	if (PinnedPolyline.IsValid())
+	{
+		return PinnedPolyline.ToSharedRef();
+	}
+	CachedPolyline = NewPolyline;
+
+	if (Polylines.Num() > PruneThreshold)
+	{
+		PruneExpired();
+		PruneThreshold = FMath::Max(64, Polylines.Num() * 2);
+	}
+	return NewPolyline;
+}
+
+void FKeplerPolylineCache::Empty()
+{
+	FScopeLock Lock(&CriticalSection);
+	Polylines.Empty();
+}
+
+int32 FKeplerPolylineCache::Num() const
+{
+	FScopeLock Lock(&CriticalSection);
+	return Polylines.Num();
+}
+
+void FKeplerPolylineCache::PruneExpired()
+{
+	for (auto It = Polylines.CreateIterator(); It; ++It)
+	{
+		if (!It.Value().IsValid())
+		{
+			It.RemoveCurrent();
+		}
+	}
+}
+
+void FKeplerPolylineCache::BuildPolyline(const FKeplerOrbitConfig& OrbitConfig, const float MaxChordError, const int32 MaxPoints, TArray<FVector2D>& OutPoints)
+{
+	const FKeplerCompiledOrbit& Compiled = OrbitConfig.Compiled;
+	const float Tolerance = FMath::Max(MaxChordError, KINDA_SMALL_NUMBER);
+	auto GetPlanePoint = [&Compiled](const float EccAnomaly)
+	{
+		float SinE;
+		float CosE;
+		FMath::SinCos(&SinE, &CosE, EccAnomaly);
+		return FVector2D(Compiled.SemiMajorAxis * (CosE - Compiled.Eccentricity), Compiled.SemiMinorAxis * SinE);
+	};
+
+	struct FSpan
+	{
+		float Start;
+		float End;
+	};
+
+	OutPoints.Reset();
+
+	// Depth-first bisection. Spans are pushed right before left, so points come out in order.
+	TArray<FSpan, TInlineAllocator<32>> Stack;
+	const int32 NumInitialSpans = KeplerOrbitPolyline::NumInitialSpans;
+	for (int32 i = NumInitialSpans - 1; i >= 0; i--)
+	{
+		Stack.Push({ (2.0f * PI * i) / NumInitialSpans, (2.0f * PI * (i + 1)) / NumInitialSpans });
+	}
+
+	while (Stack.Num() > 0)
+	{
+		const FSpan Span = Stack.Pop(false);
+		const FVector2D StartPoint = GetPlanePoint(Span.Start);
+		const float Middle = 0.5f * (Span.Start + Span.End);
+
+		// Distance from the middle of the curve to the middle of the chord. Chord error alone is
+		// symmetric between the periapsis and the apoapsis, so the tolerance follows r/a = 1 - e cos(E),
+		// which keeps the points dense where the body moves fast and sparse where it is slow.
+		const FVector2D ChordMiddle = 0.5f * (StartPoint + GetPlanePoint(Span.End));
+		const float ChordError = FVector2D::Distance(ChordMiddle, GetPlanePoint(Middle));
+		const float LocalTolerance = FMath::Max(Tolerance * (1.0f - (Compiled.Eccentricity * FMath::Cos(Middle))), KINDA_SMALL_NUMBER);
+
+		const int32 NumPointsIfSplit = OutPoints.Num() + Stack.Num() + 2;
+		if (ChordError > LocalTolerance && NumPointsIfSplit <= MaxPoints)
+		{
+			Stack.Push({ Middle, Span.End });
+			Stack.Push({ Span.Start, Middle });
+			continue;
+		}
+		OutPoints.Add(StartPoint);
+	}
+}
+
+void FKeplerPolylineCache::TransformPolyline(const FKeplerOrbitConfig& OrbitConfig, const TArray<FVector2D>& PlanePoints, TArray<FVector>& OutPoints)
+{
+	const FKeplerCompiledOrbit& Compiled = OrbitConfig.Compiled;
+	OutPoints.Reserve(OutPoints.Num() + PlanePoints.Num());
+	for (const FVector2D& PlanePoint : PlanePoints)
+	{
+		OutPoints.Add((Compiled.PeriapsisAxis * PlanePoint.X) + (Compiled.SemiLatusAxis * PlanePoint.Y));
+	}
+}
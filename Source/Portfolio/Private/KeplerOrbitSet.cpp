@@ -0,0 +1,214 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "KeplerOrbitSet.h"
+
+namespace KeplerOrbitSet
+{
+	/** Upper bound of Newton iterations per batch. */
+	static const int32 MaxIterations = 16;
+
+	/** Largest correction, in radians, that is still considered converged. */
+	static const float Tolerance = 1e-6f;
+}
+
+int32 FKeplerOrbitSet::Add(const FKeplerOrbitConfig& OrbitConfig, const double Epoch)
+{
+	const int32 Index = NumOrbits++;
+	OrbitConfigs.Add(OrbitConfig);
+
+	const int32 OldPaddedNum = Eccentricity.Num();
+	const int32 PaddedNum = GetPaddedNum();
+	if (OldPaddedNum < PaddedNum)
+	{
+		Eccentricity.SetNumUninitialized(PaddedNum);
+		SemiMajorAxis.SetNumUninitialized(PaddedNum);
+		SemiMinorAxis.SetNumUninitialized(PaddedNum);
+		MeanMotion.SetNumUninitialized(PaddedNum);
+		MeanAnomalyAtEpoch.SetNumUninitialized(PaddedNum);
+		Epochs.SetNumUninitialized(PaddedNum);
+		PeriapsisX.SetNumUninitialized(PaddedNum);
+		PeriapsisY.SetNumUninitialized(PaddedNum);
+		PeriapsisZ.SetNumUninitialized(PaddedNum);
+		SemiLatusX.SetNumUninitialized(PaddedNum);
+		SemiLatusY.SetNumUninitialized(PaddedNum);
+		SemiLatusZ.SetNumUninitialized(PaddedNum);
+		for (int32 i = OldPaddedNum; i < PaddedNum; i++)
+		{
+			WritePadding(i);
+		}
+	}
+
+	WriteOrbit(Index, OrbitConfigs[Index], Epoch);
+	return Index;
+}
+
+void FKeplerOrbitSet::Set(const int32 Index, const FKeplerOrbitConfig& OrbitConfig, const double Epoch)
+{
+	check(Index >= 0 && Index < NumOrbits);
+
+	OrbitConfigs[Index] = OrbitConfig;
+	OrbitConfigs[Index].UpdateOrbitData();
+	WriteOrbit(Index, OrbitConfigs[Index], Epoch);
+}
+
+void FKeplerOrbitSet::Reset()
+{
+	NumOrbits = 0;
+	OrbitConfigs.Reset();
+	Eccentricity.Reset();
+	SemiMajorAxis.Reset();
+	SemiMinorAxis.Reset();
+	MeanMotion.Reset();
+	MeanAnomalyAtEpoch.Reset();
+	Epochs.Reset();
+	PeriapsisX.Reset();
+	PeriapsisY.Reset();
+	PeriapsisZ.Reset();
+	SemiLatusX.Reset();
+	SemiLatusY.Reset();
+	SemiLatusZ.Reset();
+}
+
+void FKeplerOrbitSet::Reserve(const int32 Num)
+{
+	const int32 PaddedNum = Align(Num, 4);
+	OrbitConfigs.Reserve(Num);
+	Eccentricity.Reserve(PaddedNum);
+	SemiMajorAxis.Reserve(PaddedNum);
+	SemiMinorAxis.Reserve(PaddedNum);
+	MeanMotion.Reserve(PaddedNum);
+	MeanAnomalyAtEpoch.Reserve(PaddedNum);
+	Epochs.Reserve(PaddedNum);
+	PeriapsisX.Reserve(PaddedNum);
+	PeriapsisY.Reserve(PaddedNum);
+	PeriapsisZ.Reserve(PaddedNum);
+	SemiLatusX.Reserve(PaddedNum);
+	SemiLatusY.Reserve(PaddedNum);
+	SemiLatusZ.Reserve(PaddedNum);
+}
+
+void FKeplerOrbitSet::Propagate(const double Time, TArray<FVector>& OutPositions) const
+{
+	OutPositions.SetNumUninitialized(NumOrbits);
+	Propagate(Time, TArrayView<FVector>(OutPositions));
+}
+
+void FKeplerOrbitSet::Propagate(const double Time, TArrayView<FVector> OutPositions) const
+{
+	Propagate(Time, 0, NumOrbits, OutPositions);
+}
+
+void FKeplerOrbitSet::Propagate(const double Time, const int32 StartIndex, const int32 Count, TArrayView<FVector> OutPositions) const
+{
+	check(StartIndex >= 0 && (StartIndex % 4) == 0);
+	check(StartIndex + Count <= NumOrbits);
+	check(OutPositions.Num() >= Count);
+
+	const VectorRegister VOne = VectorOne();
+	const VectorRegister VTolerance = VectorSetFloat1(KeplerOrbitSet::Tolerance);
+
+	MS_ALIGN(16) float ReducedMean[4] GCC_ALIGN(16);
+	MS_ALIGN(16) float ResultX[4] GCC_ALIGN(16);
+	MS_ALIGN(16) float ResultY[4] GCC_ALIGN(16);
+	MS_ALIGN(16) float ResultZ[4] GCC_ALIGN(16);
+
+	const int32 EndIndex = StartIndex + Count;
+	for (int32 i = StartIndex; i < EndIndex; i += 4)
+	{
+		const VectorRegister Ecc = VectorLoadAligned(&Eccentricity[i]);
+
+		// Mean anomaly, range-reduced to [-PI, PI] in double precision, so the solver always starts
+		// near the root, and large times keep their fraction of a turn. Only the solve runs in float.
+		for (int32 Lane = 0; Lane < 4; Lane++)
+		{
+			const double ElapsedTime = Time - Epochs[i + Lane];
+			ReducedMean[Lane] = (float)FKeplerSolver::ReduceAngle((double)MeanAnomalyAtEpoch[i + Lane] + ((double)MeanMotion[i + Lane] * ElapsedTime));
+		}
+		const VectorRegister Mean = VectorLoadAligned(ReducedMean);
+
+		// Newton-Raphson on E - e * sin(E) = M, until every lane has converged.
+		VectorRegister Sin;
+		VectorRegister Cos;
+		VectorSinCos(&Sin, &Cos, &Mean);
+		VectorRegister EccAnomaly = VectorMultiplyAdd(Ecc, Sin, Mean);
+		for (int32 Iteration = 0; Iteration < KeplerOrbitSet::MaxIterations; Iteration++)
+		{
+			VectorSinCos(&Sin, &Cos, &EccAnomaly);
+			const VectorRegister Residual = VectorSubtract(VectorSubtract(EccAnomaly, VectorMultiply(Ecc, Sin)), Mean);
+			const VectorRegister Derivative = VectorSubtract(VOne, VectorMultiply(Ecc, Cos));
+			const VectorRegister Step = VectorDivide(Residual, Derivative);
+			EccAnomaly = VectorSubtract(EccAnomaly, Step);
+			if (!VectorAnyGreaterThan(VectorAbs(Step), VTolerance))
+			{
+				break;
+			}
+		}
+		VectorSinCos(&Sin, &Cos, &EccAnomaly);
+
+		// Position in the orbital plane, then rotated into the world by the orbit's basis.
+		const VectorRegister PlaneX = VectorMultiply(VectorLoadAligned(&SemiMajorAxis[i]), VectorSubtract(Cos, Ecc));
+		const VectorRegister PlaneY = VectorMultiply(VectorLoadAligned(&SemiMinorAxis[i]), Sin);
+		const VectorRegister PosX = VectorMultiplyAdd(PlaneX, VectorLoadAligned(&PeriapsisX[i]), VectorMultiply(PlaneY, VectorLoadAligned(&SemiLatusX[i])));
+		const VectorRegister PosY = VectorMultiplyAdd(PlaneX, VectorLoadAligned(&PeriapsisY[i]), VectorMultiply(PlaneY, VectorLoadAligned(&SemiLatusY[i])));
+		const VectorRegister PosZ = VectorMultiplyAdd(PlaneX, VectorLoadAligned(&PeriapsisZ[i]), VectorMultiply(PlaneY, VectorLoadAligned(&SemiLatusZ[i])));
+		VectorStoreAligned(PosX, ResultX);
+		VectorStoreAligned(PosY, ResultY);
+		VectorStoreAligned(PosZ, ResultZ);
+
+		const int32 NumInBatch = FMath::Min(4, EndIndex - i);
+		for (int32 Lane = 0; Lane < NumInBatch; Lane++)
+		{
+			OutPositions[i - StartIndex + Lane] = FVector(ResultX[Lane], ResultY[Lane], ResultZ[Lane]);
+		}
+	}
+}
+
+void FKeplerOrbitSet::PropagateScalar(const double Time, TArrayView<FVector> OutPositions) const
+{
+	check(OutPositions.Num() >= NumOrbits);
+
+	for (int32 i = 0; i < NumOrbits; i++)
+	{
+		const FKeplerOrbitConfig& OrbitConfig = OrbitConfigs[i];
+		const float InitialMeanAnomaly = FMath::RadiansToDegrees(MeanAnomalyAtEpoch[i]);
+		const float MeanAnomaly = UKeplerLibrary::GetMeanAnomaly(OrbitConfig, (float)(Time - Epochs[i])) + InitialMeanAnomaly;
+		const float EccentricAnomaly = UKeplerLibrary::GetEccentricAnomaly(OrbitConfig, MeanAnomaly);
+		const float TrueAnomaly = UKeplerLibrary::GetTrueAnomaly(OrbitConfig, EccentricAnomaly);
+		OutPositions[i] = UKeplerLibrary::GetOrbitalPositionTrue(OrbitConfig, TrueAnomaly);
+	}
+}
+
+void FKeplerOrbitSet::WriteOrbit(const int32 Index, const FKeplerOrbitConfig& OrbitConfig, const double Epoch)
+{
+	const FKeplerCompiledOrbit& Compiled = OrbitConfig.Compiled;
+
+	Eccentricity[Index] = Compiled.Eccentricity;
+	SemiMajorAxis[Index] = Compiled.SemiMajorAxis;
+	SemiMinorAxis[Index] = Compiled.SemiMinorAxis;
+	MeanMotion[Index] = Compiled.MeanMotion;
+	MeanAnomalyAtEpoch[Index] = Compiled.InitialMeanAnomaly;
+	Epochs[Index] = Epoch;
+	PeriapsisX[Index] = Compiled.PeriapsisAxis.X;
+	PeriapsisY[Index] = Compiled.PeriapsisAxis.Y;
+	PeriapsisZ[Index] = Compiled.PeriapsisAxis.Z;
+	SemiLatusX[Index] = Compiled.SemiLatusAxis.X;
+	SemiLatusY[Index] = Compiled.SemiLatusAxis.Y;
+	SemiLatusZ[Index] = Compiled.SemiLatusAxis.Z;
+}
+
+void FKeplerOrbitSet::WritePadding(const int32 Index)
+{
+	Eccentricity[Index] = 0.0f;
+	SemiMajorAxis[Index] = 0.0f;
+	SemiMinorAxis[Index] = 0.0f;
+	MeanMotion[Index] = 0.0f;
+	MeanAnomalyAtEpoch[Index] = 0.0f;
+	Epochs[Index] = 0.0;
+	PeriapsisX[Index] = 0.0f;
+	PeriapsisY[Index] = 0.0f;
+	PeriapsisZ[Index] = 0.0f;
+	SemiLatusX[Index] = 0.0f;
+	SemiLatusY[Index] = 0.0f;
+	SemiLatusZ[Index] = 0.0f;
+}
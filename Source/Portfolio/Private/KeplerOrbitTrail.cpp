@@ -0,0 +1,124 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "KeplerOrbitTrail.h"
+#include "KeplerOrbitPolyline.h"
+
+void FKeplerTrailMesh::Build(const FKeplerOrbitConfig& OrbitConfig, const FKeplerTrailSettings& Settings)
+{
+	Vertices.Reset();
+	Triangles.Reset();
+	Normals.Reset();
+	UV0.Reset();
+	Colors.Reset();
+	Tangents.Reset();
+
+	// Shapes are shared between orbits that only differ in orientation. The cache is thread-safe.
+	const FKeplerPolylineCache::FPolylineRef Polyline = FKeplerPolylineCache::Get().FindOrBuild(OrbitConfig, Settings.MaxChordError);
+	const TArray<FVector2D>& PlanePoints = Polyline.Get();
+	const int32 NumPoints = PlanePoints.Num();
+	if (NumPoints < 2) return;
+
+	const FKeplerCompiledOrbit& Compiled = OrbitConfig.Compiled;
+	const float HalfWidth = 0.5f * Settings.Width;
+	const FLinearColor EdgeColor(Settings.Color.R, Settings.Color.G, Settings.Color.B, Settings.Color.A * Settings.EdgeAlpha);
+	auto ToWorld = [&Compiled](const FVector2D& PlanePoint)
+	{
+		return (Compiled.PeriapsisAxis * PlanePoint.X) + (Compiled.SemiLatusAxis * PlanePoint.Y);
+	};
+
+	// The first point is repeated at the end, so U runs from 0 to 1 without wrapping inside a quad.
+	const int32 NumRows = NumPoints + 1;
+	Vertices.Reserve(NumRows * 3);
+	Normals.Reserve(NumRows * 3);
+	UV0.Reserve(NumRows * 3);
+	Colors.Reserve(NumRows * 3);
+	Tangents.Reserve(NumRows * 3);
+	for (int32 Row = 0; Row < NumRows; Row++)
+	{
+		const int32 PointIndex = Row % NumPoints;
+		const FVector2D& PlanePoint = PlanePoints[PointIndex];
+		const FVector Point = ToWorld(PlanePoint);
+		const FVector Previous = ToWorld(PlanePoints[(PointIndex + NumPoints - 1) % NumPoints]);
+		const FVector Next = ToWorld(PlanePoints[(PointIndex + 1) % NumPoints]);
+		const FVector Tangent = (Next - Previous).GetSafeNormal();
+		const FVector Side = (Tangent ^ Compiled.NormalAxis) * HalfWidth;
+
+		// Fraction of the period since the periapsis, from the eccentric anomaly of the point.
+		const float EccAnomaly = FMath::Atan2(PlanePoint.Y * Compiled.SemiMajorAxis, (PlanePoint.X + (Compiled.SemiMajorAxis * Compiled.Eccentricity)) * Compiled.SemiMinorAxis);
+		const float MeanAnomaly = EccAnomaly - (Compiled.Eccentricity * FMath::Sin(EccAnomaly));
+		float Phase = MeanAnomaly / (2.0f * PI);
+		Phase = (Row == NumPoints) ? 1.0f : ((Phase < 0.0f) ? Phase + 1.0f : Phase);
+
+		for (int32 Column = 0; Column < 3; Column++)
+		{
+			Vertices.Add(Point + (Side * (Column - 1)));
+			Normals.Add(Compiled.NormalAxis);
+			UV0.Add(FVector2D(Phase, 0.5f * Column));
+			Colors.Add((Column == 1) ? Settings.Color : EdgeColor);
+			Tangents.Add(FProcMeshTangent(Tangent, false));
+		}
+	}
+
+	// Two quads per segment, from the outer edge to the middle and from the middle to the inner edge.
+	Triangles.Reserve(NumPoints * 12);
+	for (int32 Row = 0; Row < NumPoints; Row++)
+	{
+		for (int32 Column = 0; Column < 2; Column++)
+		{
+			const int32 A = (Row * 3) + Column;
+			const int32 B = A + 1;
+			const int32 C = A + 3;
+			const int32 D = C + 1;
+			Triangles.Append({ A, C, B, B, C, D });
+		}
+	}
+}
+
+UKeplerOrbitTrailComponent::UKeplerOrbitTrailComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	CastShadow = false;
+
+	TrailMaterial = nullptr;
+}
+
+void UKeplerOrbitTrailComponent::SetTrail(const int32 TrailIndex, const FKeplerOrbitConfig& OrbitConfig, const FKeplerTrailSettings& Settings)
+{
+	if (TrailIndex < 0) return;
+
+	FTrail* Trail = Trails.Find(TrailIndex);
+	if (Trail && Trail->OrbitConfig == OrbitConfig && Trail->Settings == Settings) return;
+
+	if (!Trail)
+	{
+		Trail = &Trails.Add(TrailIndex);
+	}
+	Trail->OrbitConfig = OrbitConfig;
+	Trail->Settings = Settings;
+	RequestSectionBuild(TrailIndex);
+}
+
+void UKeplerOrbitTrailComponent::RemoveTrail(const int32 TrailIndex)
+{
+	Trails.Remove(TrailIndex);
+	RemoveSection(TrailIndex);
+}
+
+void UKeplerOrbitTrailComponent::ClearTrails()
+{
+	Trails.Empty();
+	ClearSections();
+}
+
+TFunction<void(FAsyncMeshSection&)> UKeplerOrbitTrailComponent::CreateSectionBuild(const int32 SectionIndex) const
+{
+	const FTrail& Trail = Trails.FindChecked(SectionIndex);
+	return [OrbitConfig = Trail.OrbitConfig, Settings = Trail.Settings](FAsyncMeshSection& OutMesh)
+	{
+		FKeplerTrailMesh Mesh;
+		Mesh.Build(OrbitConfig, Settings);
+		OutMesh = MoveTemp(Mesh);
+	};
+}
@@ -0,0 +1,218 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "KeplerPerturbation.h"
+
+namespace KeplerPerturbation
+{
+	/** Leaves hold up to this many sources before being split. */
+	static const int32 MaxLeafSources = 8;
+
+	/** Coincident sources can't be split apart, so stop at this depth. */
+	static const int32 MaxDepth = 24;
+}
+
+FKeplerGravityTree::FKeplerGravityTree()
+{
+}
+
+void FKeplerGravityTree::Build(TArrayView<const FVector> Positions, TArrayView<const float> Masses, const int32 MaxNodes)
+{
+	check(Positions.Num() == Masses.Num());
+
+	Reset();
+	const int32 NumSources = Positions.Num();
+	if (NumSources == 0) return;
+
+	// The pool never grows past the budget, so nodes can be held by index through the build.
+	Nodes.Reserve(FMath::Max(MaxNodes, 1));
+	SortedPositions.Append(Positions.GetData(), NumSources);
+	SortedMasses.Append(Masses.GetData(), NumSources);
+	SortedSources.SetNumUninitialized(NumSources);
+	ScratchSources.SetNumUninitialized(NumSources);
+	for (int32 i = 0; i < NumSources; i++)
+	{
+		SortedSources[i] = i;
+	}
+
+	const FBox Bounds(Positions.GetData(), NumSources);
+	FNode& Root = Nodes.AddDefaulted_GetRef();
+	Root.Center = Bounds.GetCenter();
+	Root.HalfSize = FMath::Max(Bounds.GetExtent().GetMax(), KINDA_SMALL_NUMBER);
+	Root.FirstSource = 0;
+	Root.NumSources = NumSources;
+	Subdivide(0, 0, FMath::Max(MaxNodes, 1));
+
+	// Store the sources in tree order, so each leaf reads a contiguous range.
+	SourceSlots.SetNumUninitialized(NumSources);
+	for (int32 Slot = 0; Slot < NumSources; Slot++)
+	{
+		const int32 SourceIndex = SortedSources[Slot];
+		SortedPositions[Slot] = Positions[SourceIndex];
+		SortedMasses[Slot] = Masses[SourceIndex];
+		SourceSlots[SourceIndex] = Slot;
+	}
+}
+
+void FKeplerGravityTree::Reset()
+{
+	Nodes.Reset();
+	SortedPositions.Reset();
+	SortedMasses.Reset();
+	SourceSlots.Reset();
+	SortedSources.Reset();
+	ScratchSources.Reset();
+}
+
+void FKeplerGravityTree::Subdivide(const int32 NodeIndex, const int32 Depth, const int32 MaxNodes)
+{
+	// Sources are still in their original order here, so read them through the sort.
+	{
+		FNode& Node = Nodes[NodeIndex];
+		Node.FirstChild = INDEX_NONE;
+		Node.NumChildren = 0;
+		Node.Mass = 0.0f;
+		FVector WeightedSum = FVector::ZeroVector;
+		for (int32 Slot = Node.FirstSource; Slot < Node.FirstSource + Node.NumSources; Slot++)
+		{
+			const int32 SourceIndex = SortedSources[Slot];
+			Node.Mass += SortedMasses[SourceIndex];
+			WeightedSum += SortedPositions[SourceIndex] * SortedMasses[SourceIndex];
+		}
+		Node.CenterOfMass = (Node.Mass > 0.0f) ? (WeightedSum / Node.Mass) : Node.Center;
+	}
+
+	const FNode Node = Nodes[NodeIndex];
+	if (Node.NumSources <= KeplerPerturbation::MaxLeafSources || Depth >= KeplerPerturbation::MaxDepth) return;
+
+	auto GetOctant = [this, &Node](const int32 SourceIndex)
+	{
+		const FVector& Position = SortedPositions[SourceIndex];
+		return ((Position.X >= Node.Center.X) ? 1 : 0) | ((Position.Y >= Node.Center.Y) ? 2 : 0) | ((Position.Z >= Node.Center.Z) ? 4 : 0);
+	};
+
+	int32 Counts[8] = {};
+	for (int32 Slot = Node.FirstSource; Slot < Node.FirstSource + Node.NumSources; Slot++)
+	{
+		Counts[GetOctant(SortedSources[Slot])]++;
+	}
+
+	int32 NumChildren = 0;
+	for (int32 Octant = 0; Octant < 8; Octant++)
+	{
+		NumChildren += (Counts[Octant] > 0) ? 1 : 0;
+	}
+
+	// Out of budget, the node stays a leaf and its sources are summed directly.
+	if (Nodes.Num() + NumChildren > MaxNodes) return;
+
+	// Counting sort of the range by octant.
+	int32 Offsets[8];
+	int32 Offset = Node.FirstSource;
+	for (int32 Octant = 0; Octant < 8; Octant++)
+	{
+		Offsets[Octant] = Offset;
+		Offset += Counts[Octant];
+	}
+	for (int32 Slot = Node.FirstSource; Slot < Node.FirstSource + Node.NumSources; Slot++)
+	{
+		const int32 SourceIndex = SortedSources[Slot];
+		ScratchSources[Offsets[GetOctant(SourceIndex)]++] = SourceIndex;
+	}
+	FMemory::Memcpy(SortedSources.GetData() + Node.FirstSource, ScratchSources.GetData() + Node.FirstSource, Node.NumSources * sizeof(int32));
+
+	const int32 FirstChild = Nodes.Num();
+	const float ChildHalfSize = 0.5f * Node.HalfSize;
+	int32 FirstSource = Node.FirstSource;
+	for (int32 Octant = 0; Octant < 8; Octant++)
+	{
+		if (Counts[Octant] == 0) continue;
+
+		FNode& Child = Nodes.AddDefaulted_GetRef();
+		Child.Center = Node.Center + FVector(
+			(Octant & 1) ? ChildHalfSize : -ChildHalfSize,
+			(Octant & 2) ? ChildHalfSize : -ChildHalfSize,
+			(Octant & 4) ? ChildHalfSize : -ChildHalfSize);
+		Child.HalfSize = ChildHalfSize;
+		Child.FirstSource = FirstSource;
+		Child.NumSources = Counts[Octant];
+		FirstSource += Counts[Octant];
+	}
+	Nodes[NodeIndex].FirstChild = FirstChild;
+	Nodes[NodeIndex].NumChildren = NumChildren;
+
+	for (int32 ChildIndex = FirstChild; ChildIndex < FirstChild + NumChildren; ChildIndex++)
+	{
+		Subdivide(ChildIndex, Depth + 1, MaxNodes);
+	}
+}
+
+FVector FKeplerGravityTree::GetAcceleration(const FVector& Location, const int32 IgnoredA, const int32 IgnoredB, const float OpeningAngle, const float Softening) const
+{
+	FVector Acceleration = FVector::ZeroVector;
+	if (Nodes.Num() == 0) return Acceleration;
+
+	const int32 IgnoredSlotA = SourceSlots.IsValidIndex(IgnoredA) ? SourceSlots[IgnoredA] : INDEX_NONE;
+	const int32 IgnoredSlotB = SourceSlots.IsValidIndex(IgnoredB) ? SourceSlots[IgnoredB] : INDEX_NONE;
+	const float OpeningAngleSquared = OpeningAngle * OpeningAngle;
+	const float SofteningSquared = Softening * Softening;
+	auto Contains = [](const FNode& Node, const int32 Slot)
+	{
+		return Slot >= Node.FirstSource && Slot < Node.FirstSource + Node.NumSources;
+	};
+
+	// Depth-first, so the stack holds at most 7 siblings per level.
+	TArray<int32, TInlineAllocator<8 * KeplerPerturbation::MaxDepth>> Stack;
+	Stack.Add(0);
+	while (Stack.Num() > 0)
+	{
+		const FNode& Node = Nodes[Stack.Pop(false)];
+		if (Node.Mass <= 0.0f) continue;
+
+		// Nodes that hold an ignored source can't stand in for it, so they are always opened.
+		if (!Contains(Node, IgnoredSlotA) && !Contains(Node, IgnoredSlotB))
+		{
+			const FVector Offset = Node.CenterOfMass - Location;
+			const float DistanceSquared = Offset.SizeSquared();
+			const float Size = 2.0f * Node.HalfSize;
+			if ((Size * Size) < (OpeningAngleSquared * DistanceSquared))
+			{
+				const float SoftDistanceSquared = DistanceSquared + SofteningSquared;
+				Acceleration += Offset * (Node.Mass / (SoftDistanceSquared * FMath::Sqrt(SoftDistanceSquared)));
+				continue;
+			}
+		}
+
+		if (Node.FirstChild == INDEX_NONE)
+		{
+			AddLeafAcceleration(Node, Location, IgnoredSlotA, IgnoredSlotB, SofteningSquared, Acceleration);
+			continue;
+		}
+
+		for (int32 ChildIndex = Node.FirstChild; ChildIndex < Node.FirstChild + Node.NumChildren; ChildIndex++)
+		{
+			Stack.Add(ChildIndex);
+		}
+	}
+	return Acceleration;
+}
+
+void FKeplerGravityTree::AddLeafAcceleration(const FNode& Node, const FVector& Location, const int32 IgnoredSlotA, const int32 IgnoredSlotB, const float SofteningSquared, FVector& OutAcceleration) const
+{
+	for (int32 Slot = Node.FirstSource; Slot < Node.FirstSource + Node.NumSources; Slot++)
+	{
+		if (Slot == IgnoredSlotA || Slot == IgnoredSlotB) continue;
+
+		const FVector Offset = SortedPositions[Slot] - Location;
+		const float SoftDistanceSquared = Offset.SizeSquared() + SofteningSquared;
+		if (SoftDistanceSquared <= SMALL_NUMBER) continue;
+
+		OutAcceleration += Offset * (SortedMasses[Slot] / (SoftDistanceSquared * FMath::Sqrt(SoftDistanceSquared)));
+	}
+}
+
+SIZE_T FKeplerGravityTree::GetAllocatedSize() const
+{
+	return Nodes.GetAllocatedSize() + SortedPositions.GetAllocatedSize() + SortedMasses.GetAllocatedSize()
+		+ SourceSlots.GetAllocatedSize() + SortedSources.GetAllocatedSize() + ScratchSources.GetAllocatedSize();
+}
@@ -0,0 +1,1204 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "KeplerSimulation.h"
+#include "Async/ParallelFor.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Components/SceneComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "GameFramework/GameStateBase.h"
+#include "GameFramework/PlayerController.h"
+#include "Net/UnrealNetwork.h"
+#include "TimerManager.h"
+
+namespace KeplerSimulation
+{
+	/** Bodies per packet. Matches the width of the orbit set solver. */
+	static const int32 PacketSize = 4;
+
+	/** Weight of the last frame in the smoothed cost of a packet. */
+	static const double CostSmoothing = 0.1;
+
+	/** Distance within which a sphere crossing is reported. Exits need twice as much, so a crossing is not reported twice. */
+	static const float SphereTolerance = 1.0f;
+
+	/** Steps of a single sphere crossing search. */
+	static const int32 MaxSphereSteps = 1024;
+
+	/** Fraction of the period skipped after an orbital event, so it is reported once. */
+	static const float MinEventDelay = 1e-4f;
+
+	/** Update intervals integrated at most by one perturbation update. Longer gaps, such as a fast forward, are skipped. */
+	static const float MaxPerturbationIntervals = 2.0f;
+}
+
+UKeplerOrbitComponent::UKeplerOrbitComponent()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+
+	OrbitConfig = FKeplerOrbitConfig(1000.0f, 1000.0f);
+	OrbitParent = nullptr;
+	bIsStaticBody = false;
+	bUseEphemeris = false;
+	Mass = 0.0f;
+	bIsPerturbed = false;
+	bReplicateOrbit = true;
+	SetIsReplicatedByDefault(bReplicateOrbit);
+	DriftCheckInterval = 0.0f;
+	DriftTolerance = 10.0f;
+	BodyId = INDEX_NONE;
+	bIsRegistering = false;
+	bHasNetState = false;
+	MaxDrift = 0.0f;
+}
+
+void UKeplerOrbitComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// Replicated by default only because the flag is on by default, so follow instances that turn it off.
+	if (!bReplicateOrbit && GetIsReplicated())
+	{
+		SetIsReplicated(false);
+	}
+
+	// The orbit is deterministic, so only its changes are replicated.
+	AActor* Owner = GetOwner();
+	if (bReplicateOrbit && !bIsStaticBody && Owner && GetOwnerRole() == ROLE_Authority)
+	{
+		Owner->SetReplicateMovement(false);
+	}
+
+	RegisterWithSubsystem();
+
+	if (bReplicateOrbit && !bIsStaticBody && DriftCheckInterval > 0.0f && GetOwnerRole() == ROLE_Authority)
+	{
+		GetWorld()->GetTimerManager().SetTimer(DriftCheckTimer, this, &UKeplerOrbitComponent::SendDriftCheck, DriftCheckInterval, true);
+	}
+}
+
+void UKeplerOrbitComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	UWorld* World = GetWorld();
+	if (World)
+	{
+		World->GetTimerManager().ClearTimer(DriftCheckTimer);
+	}
+	UnregisterFromSubsystem();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UKeplerOrbitComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(UKeplerOrbitComponent, NetState);
+}
+
+#if WITH_EDITOR
+void UKeplerOrbitComponent::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	OrbitConfig.UpdateOrbitData();
+}
+#endif
+
+void UKeplerOrbitComponent::RegisterWithSubsystem()
+{
+	// A parent that names us as its own parent would otherwise recurse forever.
+	if (BodyId != INDEX_NONE || bIsRegistering) return;
+
+	AActor* Owner = GetOwner();
+	UWorld* World = GetWorld();
+	UKeplerSubsystem* KeplerSubsystem = World ? World->GetSubsystem<UKeplerSubsystem>() : nullptr;
+	if (!Owner || !KeplerSubsystem) return;
+
+	USceneComponent* Target = Owner->GetRootComponent();
+	if (bIsStaticBody)
+	{
+		BodyId = KeplerSubsystem->RegisterStaticBody(Owner->GetActorLocation(), Target);
+		KeplerSubsystem->SetBodyMass(BodyId, Mass);
+		return;
+	}
+
+	bIsRegistering = true;
+
+	// Parents must be registered first, as their begin play may not have run yet.
+	int32 ParentId = INDEX_NONE;
+	UKeplerOrbitComponent* ParentComponent = OrbitParent ? OrbitParent->FindComponentByClass<UKeplerOrbitComponent>() : nullptr;
+	if (ParentComponent && ParentComponent != this)
+	{
+		ParentComponent->RegisterWithSubsystem();
+		ParentId = ParentComponent->GetBodyId();
+	}
+
+	OrbitConfig.UpdateOrbitData();
+	BodyId = KeplerSubsystem->RegisterBody(OrbitConfig, ParentId, Owner->GetActorLocation(), Target, bUseEphemeris ? &EphemerisSettings : nullptr);
+	KeplerSubsystem->SetBodyMass(BodyId, Mass);
+	KeplerSubsystem->SetBodyPerturbed(BodyId, bIsPerturbed);
+
+	bIsRegistering = false;
+
+	if (!bReplicateOrbit) return;
+
+	if (GetOwnerRole() == ROLE_Authority)
+	{
+		UpdateNetState();
+	}
+	else if (bHasNetState)
+	{
+		ApplyNetState();
+	}
+}
+
+void UKeplerOrbitComponent::UnregisterFromSubsystem()
+{
+	if (BodyId == INDEX_NONE) return;
+
+	UWorld* World = GetWorld();
+	UKeplerSubsystem* KeplerSubsystem = World ? World->GetSubsystem<UKeplerSubsystem>() : nullptr;
+	if (KeplerSubsystem)
+	{
+		KeplerSubsystem->UnregisterBody(BodyId);
+	}
+	BodyId = INDEX_NONE;
+}
+
+void UKeplerOrbitComponent::SetOrbitConfig(const FKeplerOrbitConfig& NewOrbitConfig)
+{
+	OrbitConfig = NewOrbitConfig;
+	OrbitConfig.UpdateOrbitData();
+
+	if (BodyId != INDEX_NONE)
+	{
+		UKeplerSubsystem* KeplerSubsystem = GetWorld()->GetSubsystem<UKeplerSubsystem>();
+		if (KeplerSubsystem)
+		{
+			KeplerSubsystem->SetOrbitConfig(BodyId, OrbitConfig);
+		}
+	}
+
+	if (bReplicateOrbit && GetOwnerRole() == ROLE_Authority)
+	{
+		UpdateNetState();
+	}
+}
+
+double UKeplerOrbitComponent::GetServerSimulationTime() const
+{
+	const UWorld* World = GetWorld();
+	const AGameStateBase* GameState = World ? World->GetGameState() : nullptr;
+	const float ServerWorldTime = GameState ? GameState->GetServerWorldTimeSeconds() : (World ? World->GetTimeSeconds() : 0.0f);
+	return NetState.GetServerSimulationTime(ServerWorldTime);
+}
+
+void UKeplerOrbitComponent::OnRep_NetState()
+{
+	OrbitConfig = NetState.OrbitConfig;
+	OrbitConfig.UpdateOrbitData();
+	bHasNetState = true;
+
+	if (BodyId != INDEX_NONE)
+	{
+		ApplyNetState();
+	}
+}
+
+void UKeplerOrbitComponent::UpdateNetState()
+{
+	UWorld* World = GetWorld();
+	UKeplerSubsystem* KeplerSubsystem = World ? World->GetSubsystem<UKeplerSubsystem>() : nullptr;
+	if (!KeplerSubsystem || BodyId == INDEX_NONE) return;
+
+	const AGameStateBase* GameState = World->GetGameState();
+	const float ServerWorldTime = GameState ? GameState->GetServerWorldTimeSeconds() : World->GetTimeSeconds();
+
+	FKeplerOrbitNetState NewNetState;
+	NewNetState.OrbitConfig = OrbitConfig;
+	NewNetState.Epoch = KeplerSubsystem->GetBodyEpoch(BodyId);
+	NewNetState.TimeScale = KeplerSubsystem->TimeScale;
+	NewNetState.ServerTimeOffset = KeplerSubsystem->GetPreciseSimulationTime() - ((double)KeplerSubsystem->TimeScale * ServerWorldTime);
+	NetState = NewNetState;
+}
+
+void UKeplerOrbitComponent::ApplyNetState()
+{
+	UWorld* World = GetWorld();
+	UKeplerSubsystem* KeplerSubsystem = World ? World->GetSubsystem<UKeplerSubsystem>() : nullptr;
+	if (!KeplerSubsystem || BodyId == INDEX_NONE) return;
+
+	// Keep the time the body has spent on this orbit, according to the server clock.
+	const AGameStateBase* GameState = World->GetGameState();
+	const float ServerWorldTime = GameState ? GameState->GetServerWorldTimeSeconds() : World->GetTimeSeconds();
+	KeplerSubsystem->SetOrbitConfig(BodyId, OrbitConfig, NetState.GetLocalEpoch(KeplerSubsystem->GetPreciseSimulationTime(), ServerWorldTime));
+}
+
+void UKeplerOrbitComponent::SendDriftCheck()
+{
+	UWorld* World = GetWorld();
+	UKeplerSubsystem* KeplerSubsystem = World ? World->GetSubsystem<UKeplerSubsystem>() : nullptr;
+	if (!KeplerSubsystem || BodyId == INDEX_NONE) return;
+
+	const double ServerSimulationTime = KeplerSubsystem->GetPreciseSimulationTime();
+	const FVector ServerPosition = OrbitConfig.Compiled.GetPositionAtTime(ServerSimulationTime - NetState.Epoch);
+	MulticastCheckDrift(ServerSimulationTime, ServerPosition);
+}
+
+void UKeplerOrbitComponent::MulticastCheckDrift_Implementation(const double ServerSimulationTime, const FVector_NetQuantize100& ServerPosition)
+{
+	if (GetOwnerRole() == ROLE_Authority || !bHasNetState) return;
+
+	UWorld* World = GetWorld();
+	UKeplerSubsystem* KeplerSubsystem = World ? World->GetSubsystem<UKeplerSubsystem>() : nullptr;
+	if (!KeplerSubsystem || BodyId == INDEX_NONE) return;
+
+	// Difference between the server time the local simulation is at, and the one given by the game state.
+	const double LocalServerTime = KeplerSubsystem->GetPreciseSimulationTime() - KeplerSubsystem->GetBodyEpoch(BodyId) + NetState.Epoch;
+	const float ClockError = (float)(LocalServerTime - GetServerSimulationTime());
+
+	// Where the local simulation places the body at the time of the server sample.
+	const double LocalTime = ServerSimulationTime + ClockError - NetState.Epoch;
+	const FVector ClientPosition = OrbitConfig.Compiled.GetPositionAtTime(LocalTime);
+	const float Drift = FVector::Dist(ClientPosition, ServerPosition);
+	MaxDrift = FMath::Max(MaxDrift, Drift);
+
+	UE_LOG(LogKepler, Verbose, TEXT("%s: drift %f, clock error %f s."), *GetNameSafe(GetOwner()), Drift, ClockError);
+	if (Drift > DriftTolerance)
+	{
+		UE_LOG(LogKepler, Warning, TEXT("%s: drift %f is above the tolerance of %f. Mapping the epoch again."), *GetNameSafe(GetOwner()), Drift, DriftTolerance);
+		ApplyNetState();
+	}
+}
+
+UKeplerSubsystem::UKeplerSubsystem()
+{
+	TimeScale = 1.0f;
+	BatchSize = 1024;
+	EventSearchWindow = 3600.0f;
+	FrameNumber = 0;
+	PacketCursor = 0;
+	RefreshCostPerPacket = 0.0;
+	NumRefreshedPackets = 0;
+	NumRefreshedBodies = 0;
+	bIsLodActive = false;
+	LastPerturbationTime = 0.0;
+	SimulationTime = 0.0;
+	bIsHierarchyDirty = false;
+	bIsInitialized = false;
+}
+
+void UKeplerSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	bIsInitialized = true;
+}
+
+void UKeplerSubsystem::Deinitialize()
+{
+	bIsInitialized = false;
+
+	Bodies.Empty();
+	Levels.Empty();
+	FlatParents.Empty();
+	FlatFoci.Empty();
+	FlatLocations.Empty();
+	FlatTargets.Empty();
+	FlatRadii.Empty();
+	FlatEccAnomalies.Empty();
+	FlatEccRates.Empty();
+	FlatRefreshTimes.Empty();
+	Packets.Empty();
+	ViewLocations.Empty();
+	ViewScreenScales.Empty();
+	EventQueue.Empty();
+	GravityTree.Reset();
+	GravitySources.Empty();
+
+	Super::Deinitialize();
+}
+
+void UKeplerSubsystem::Tick(float DeltaTime)
+{
+	ProcessEvents(SimulationTime + (DeltaTime * TimeScale));
+
+	ApplyPerturbations();
+
+	if (bIsHierarchyDirty)
+	{
+		RebuildHierarchy();
+	}
+
+	UpdateViews();
+	ScheduleRefreshes();
+	PropagateOrbits();
+	WriteTransforms();
+}
+
+bool UKeplerSubsystem::IsTickable() const
+{
+	return bIsInitialized && !IsTemplate() && Bodies.Num() > 0;
+}
+
+TStatId UKeplerSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UKeplerSubsystem, STATGROUP_Tickables);
+}
+
+int32 UKeplerSubsystem::RegisterBody(const FKeplerOrbitConfig& OrbitConfig, const int32 ParentId, const FVector& Focus, USceneComponent* Target, const FKeplerEphemerisSettings* EphemerisSettings)
+{
+	FBody NewBody;
+	NewBody.OrbitConfig = OrbitConfig;
+	NewBody.OrbitConfig.UpdateOrbitData();
+	NewBody.ParentId = ParentId;
+	NewBody.Focus = Focus;
+	NewBody.Epoch = SimulationTime;
+	NewBody.Target = Target;
+	if (EphemerisSettings)
+	{
+		NewBody.Ephemeris = FKeplerEphemerisCache::Get().FindOrBuild(NewBody.OrbitConfig, *EphemerisSettings);
+		NewBody.EphemerisSettings = *EphemerisSettings;
+	}
+	NewBody.bIsStatic = false;
+	NewBody.Mass = 0.0f;
+	NewBody.bIsPerturbed = false;
+	NewBody.Level = INDEX_NONE;
+	NewBody.LevelIndex = INDEX_NONE;
+	NewBody.FlatIndex = INDEX_NONE;
+
+	const int32 BodyId = Bodies.Add(NewBody);
+	bIsHierarchyDirty = true;
+	return BodyId;
+}
+
+int32 UKeplerSubsystem::RegisterStaticBody(const FVector& Location, USceneComponent* Target)
+{
+	FBody NewBody;
+	NewBody.ParentId = INDEX_NONE;
+	NewBody.Focus = Location;
+	NewBody.Epoch = SimulationTime;
+	NewBody.Target = Target;
+	NewBody.bIsStatic = true;
+	NewBody.Mass = 0.0f;
+	NewBody.bIsPerturbed = false;
+	NewBody.Level = INDEX_NONE;
+	NewBody.LevelIndex = INDEX_NONE;
+	NewBody.FlatIndex = INDEX_NONE;
+
+	const int32 BodyId = Bodies.Add(NewBody);
+	bIsHierarchyDirty = true;
+	return BodyId;
+}
+
+void UKeplerSubsystem::UnregisterBody(const int32 BodyId)
+{
+	if (!Bodies.IsValidIndex(BodyId)) return;
+
+	UnwatchBody(BodyId);
+
+	const FVector LastLocation = GetBodyLocation(BodyId);
+	TArray<int32> ChildIds;
+	for (auto It = Bodies.CreateIterator(); It; ++It)
+	{
+		if (It->ParentId == BodyId)
+		{
+			It->ParentId = INDEX_NONE;
+			It->Focus = LastLocation;
+			ChildIds.Add(It.GetIndex());
+		}
+	}
+
+	Bodies.RemoveAt(BodyId);
+	bIsHierarchyDirty = true;
+
+	for (const int32 ChildId : ChildIds)
+	{
+		RescheduleEvents(ChildId);
+	}
+}
+
+void UKeplerSubsystem::SetOrbitConfig(const int32 BodyId, const FKeplerOrbitConfig& OrbitConfig)
+{
+	SetOrbitConfig(BodyId, OrbitConfig, SimulationTime);
+}
+
+void UKeplerSubsystem::SetOrbitConfig(const int32 BodyId, const FKeplerOrbitConfig& OrbitConfig, const double Epoch)
+{
+	if (!Bodies.IsValidIndex(BodyId)) return;
+
+	FBody& Body = Bodies[BodyId];
+	Body.OrbitConfig = OrbitConfig;
+	Body.OrbitConfig.UpdateOrbitData();
+	Body.Epoch = Epoch;
+	if (Body.Ephemeris.IsValid())
+	{
+		Body.Ephemeris = FKeplerEphemerisCache::Get().FindOrBuild(Body.OrbitConfig, Body.EphemerisSettings);
+	}
+
+	// A change of orbit doesn't change the hierarchy, so patch the level in place.
+	if (!bIsHierarchyDirty && !Body.bIsStatic && Body.FlatIndex != INDEX_NONE)
+	{
+		FLevel& Level = Levels[Body.Level];
+		const int32 NumAnalytic = Level.OrbitSet.Num();
+		int32 PacketIndex = Level.FirstPacket;
+		if (Body.LevelIndex < NumAnalytic)
+		{
+			Level.OrbitSet.Set(Body.LevelIndex, Body.OrbitConfig, Body.Epoch);
+			PacketIndex += Body.LevelIndex / KeplerSimulation::PacketSize;
+		}
+		else
+		{
+			Level.Ephemerides[Body.LevelIndex - NumAnalytic] = Body.Ephemeris;
+			Level.EphemerisEpochs[Body.LevelIndex - NumAnalytic] = Body.Epoch;
+			PacketIndex += Level.NumAnalyticPackets + ((Body.LevelIndex - NumAnalytic) / KeplerSimulation::PacketSize);
+		}
+		Level.Orbits[Body.LevelIndex] = Body.OrbitConfig.Compiled;
+
+		// The extrapolation state belongs to the old orbit, so solve the packet on the next frame.
+		Packets[PacketIndex].Lod = 0;
+		Packets[PacketIndex].NextRefreshFrame = 0;
+	}
+
+	RescheduleEvents(BodyId);
+}
+
+double UKeplerSubsystem::GetBodyEpoch(const int32 BodyId) const
+{
+	return Bodies.IsValidIndex(BodyId) ? Bodies[BodyId].Epoch : SimulationTime;
+}
+
+void UKeplerSubsystem::SetBodyMass(const int32 BodyId, const float Mass)
+{
+	if (!Bodies.IsValidIndex(BodyId)) return;
+
+	Bodies[BodyId].Mass = FMath::Max(Mass, 0.0f);
+}
+
+void UKeplerSubsystem::SetBodyPerturbed(const int32 BodyId, const bool bIsPerturbed)
+{
+	if (!Bodies.IsValidIndex(BodyId)) return;
+
+	Bodies[BodyId].bIsPerturbed = bIsPerturbed;
+}
+
+FVector UKeplerSubsystem::GetBodyLocation(const int32 BodyId) const
+{
+	if (!Bodies.IsValidIndex(BodyId)) return FVector::ZeroVector;
+
+	const FBody& Body = Bodies[BodyId];
+	if (Body.FlatIndex != INDEX_NONE && FlatLocations.IsValidIndex(Body.FlatIndex))
+	{
+		return FlatLocations[Body.FlatIndex];
+	}
+	return Body.Focus;
+}
+
+FVector UKeplerSubsystem::GetBodyLocationAtTime(const int32 BodyId, const float Time) const
+{
+	return GetBodyLocationAtPreciseTime(BodyId, Time);
+}
+
+FVector UKeplerSubsystem::GetBodyLocationAtPreciseTime(const int32 BodyId, const double Time) const
+{
+	FVector Location = FVector::ZeroVector;
+	int32 CurrentId = BodyId;
+	for (int32 Depth = 0; Bodies.IsValidIndex(CurrentId) && Depth < Bodies.Num(); Depth++)
+	{
+		const FBody& Body = Bodies[CurrentId];
+		if (Body.bIsStatic) return Location + Body.Focus;
+
+		Location += Body.OrbitConfig.Compiled.GetPositionAtTime(Time - Body.Epoch);
+		if (!Bodies.IsValidIndex(Body.ParentId)) return Location + Body.Focus;
+
+		CurrentId = Body.ParentId;
+	}
+	return Location;
+}
+
+void UKeplerSubsystem::WatchEvent(const int32 BodyId, const EKeplerEventType Type)
+{
+	if (Type == EKeplerEventType::SphereEntry || Type == EKeplerEventType::SphereExit) return;
+
+	FScheduledEvent Scheduled;
+	Scheduled.Event.BodyId = BodyId;
+	Scheduled.Event.Type = Type;
+	Scheduled.Radius = 0.0f;
+	Scheduled.bIsRecheck = false;
+	ScheduleEvent(Scheduled, SimulationTime);
+}
+
+void UKeplerSubsystem::WatchSphere(const int32 BodyId, const int32 OtherBodyId, const float Radius)
+{
+	if (!Bodies.IsValidIndex(BodyId) || !Bodies.IsValidIndex(OtherBodyId) || BodyId == OtherBodyId) return;
+
+	// Look for the crossing that changes the current side of the sphere.
+	const float Distance = FVector::Dist(GetBodyLocationAtPreciseTime(BodyId, SimulationTime), GetBodyLocationAtPreciseTime(OtherBodyId, SimulationTime));
+	const bool bIsInside = Distance < Radius + (2.0f * KeplerSimulation::SphereTolerance);
+
+	FScheduledEvent Scheduled;
+	Scheduled.Event.BodyId = BodyId;
+	Scheduled.Event.Type = bIsInside ? EKeplerEventType::SphereExit : EKeplerEventType::SphereEntry;
+	Scheduled.Event.OtherBodyId = OtherBodyId;
+	Scheduled.Radius = Radius;
+	Scheduled.bIsRecheck = false;
+	ScheduleEvent(Scheduled, SimulationTime);
+}
+
+void UKeplerSubsystem::UnwatchBody(const int32 BodyId)
+{
+	const int32 NumRemoved = EventQueue.RemoveAllSwap([BodyId](const FScheduledEvent& Scheduled)
+	{
+		return Scheduled.Event.BodyId == BodyId || Scheduled.Event.OtherBodyId == BodyId;
+	}, false);
+
+	if (NumRemoved > 0)
+	{
+		EventQueue.Heapify();
+	}
+}
+
+bool UKeplerSubsystem::GetNextEvent(FKeplerEvent& OutEvent) const
+{
+	// Rechecks are not events, so the top of the heap is not always the answer.
+	const FScheduledEvent* NextEvent = nullptr;
+	for (const FScheduledEvent& Scheduled : EventQueue)
+	{
+		if (!Scheduled.bIsRecheck && (!NextEvent || Scheduled < *NextEvent))
+		{
+			NextEvent = &Scheduled;
+		}
+	}
+
+	if (!NextEvent) return false;
+
+	OutEvent = NextEvent->Event;
+	return true;
+}
+
+int32 UKeplerSubsystem::FastForward(const float Duration)
+{
+	if (Duration <= 0.0f) return 0;
+
+	const int32 NumEvents = ProcessEvents(SimulationTime + Duration);
+
+	// Extrapolation can't span a jump, so every body is solved on the next tick.
+	bIsLodActive = false;
+	return NumEvents;
+}
+
+bool UKeplerSubsystem::GetEphemerisReport(const int32 BodyId, FKeplerEphemerisReport& OutReport) const
+{
+	if (!Bodies.IsValidIndex(BodyId) || !Bodies[BodyId].Ephemeris.IsValid()) return false;
+
+	OutReport = Bodies[BodyId].Ephemeris->GetReport();
+	return true;
+}
+
+void UKeplerSubsystem::RebuildHierarchy()
+{
+	for (FBody& Body : Bodies)
+	{
+		Body.Level = INDEX_NONE;
+	}
+
+	// Resolve the level of every body. Walk up to the first ancestor with a known level,
+	// then assign levels on the way back down, so each body is resolved once.
+	int32 NumLevels = 1;
+	TArray<int32> Stack;
+	for (auto It = Bodies.CreateIterator(); It; ++It)
+	{
+		Stack.Reset();
+		int32 BodyId = It.GetIndex();
+		while (BodyId != INDEX_NONE && Bodies[BodyId].Level == INDEX_NONE)
+		{
+			const FBody& Body = Bodies[BodyId];
+			Stack.Push(BodyId);
+			if (Body.bIsStatic || !Bodies.IsValidIndex(Body.ParentId) || Stack.Num() > Bodies.Num())
+			{
+				break;
+			}
+			BodyId = Body.ParentId;
+		}
+
+		while (Stack.Num() > 0)
+		{
+			FBody& Body = Bodies[Stack.Pop(false)];
+			if (Body.bIsStatic)
+			{
+				Body.Level = 0;
+			}
+			else if (Bodies.IsValidIndex(Body.ParentId) && Bodies[Body.ParentId].Level != INDEX_NONE)
+			{
+				Body.Level = Bodies[Body.ParentId].Level + 1;
+			}
+			else
+			{
+				Body.Level = 1;
+			}
+			NumLevels = FMath::Max(NumLevels, Body.Level + 1);
+		}
+	}
+
+	Levels.SetNum(NumLevels);
+	for (FLevel& Level : Levels)
+	{
+		Level.OrbitSet.Reset();
+		Level.Ephemerides.Reset();
+		Level.EphemerisEpochs.Reset();
+		Level.Orbits.Reset();
+		Level.Num = 0;
+	}
+
+	// Analytic bodies first, then the ephemeris ones, so each kind is contiguous in its level.
+	for (FBody& Body : Bodies)
+	{
+		if (Body.Ephemeris.IsValid()) continue;
+
+		FLevel& Level = Levels[Body.Level];
+		Body.LevelIndex = Level.Num++;
+		if (!Body.bIsStatic)
+		{
+			Level.OrbitSet.Add(Body.OrbitConfig, Body.Epoch);
+			Level.Orbits.Add(Body.OrbitConfig.Compiled);
+		}
+	}
+	for (FBody& Body : Bodies)
+	{
+		if (!Body.Ephemeris.IsValid()) continue;
+
+		FLevel& Level = Levels[Body.Level];
+		Body.LevelIndex = Level.Num++;
+		Level.Ephemerides.Add(Body.Ephemeris);
+		Level.EphemerisEpochs.Add(Body.Epoch);
+		Level.Orbits.Add(Body.OrbitConfig.Compiled);
+	}
+
+	int32 NumFlat = 0;
+	for (FLevel& Level : Levels)
+	{
+		Level.FirstFlatIndex = NumFlat;
+		NumFlat += Level.Num;
+	}
+
+	for (FBody& Body : Bodies)
+	{
+		Body.FlatIndex = Levels[Body.Level].FirstFlatIndex + Body.LevelIndex;
+	}
+
+	FlatParents.SetNumUninitialized(NumFlat);
+	FlatFoci.SetNumUninitialized(NumFlat);
+	FlatLocations.SetNumUninitialized(NumFlat);
+	FlatTargets.SetNum(NumFlat);
+	FlatRadii.SetNumUninitialized(NumFlat);
+	FlatEccAnomalies.SetNumZeroed(NumFlat);
+	FlatEccRates.SetNumZeroed(NumFlat);
+	FlatRefreshTimes.SetNumZeroed(NumFlat);
+	for (const FBody& Body : Bodies)
+	{
+		// Only trust parents from a lower level. Anything else is a cycle, which orbits the focus instead.
+		const bool bHasParent = !Body.bIsStatic && Bodies.IsValidIndex(Body.ParentId) && Bodies[Body.ParentId].Level < Body.Level;
+		FlatParents[Body.FlatIndex] = bHasParent ? Bodies[Body.ParentId].FlatIndex : INDEX_NONE;
+		FlatFoci[Body.FlatIndex] = Body.Focus;
+		FlatLocations[Body.FlatIndex] = Body.Focus;
+		FlatTargets[Body.FlatIndex] = Body.Target;
+		FlatRadii[Body.FlatIndex] = Body.Target.IsValid() ? Body.Target->Bounds.SphereRadius : 0.0f;
+	}
+
+	// New packets start at LOD 0, so they are solved on the next frame and get a valid extrapolation state.
+	const int32 PacketSize = KeplerSimulation::PacketSize;
+	Packets.Reset();
+	for (int32 LevelIndex = 0; LevelIndex < Levels.Num(); LevelIndex++)
+	{
+		FLevel& Level = Levels[LevelIndex];
+		Level.FirstPacket = Packets.Num();
+		Level.NumAnalyticPackets = 0;
+		Level.NumPackets = 0;
+		if (LevelIndex == 0) continue;
+
+		// Ephemeris packets start at their first body, so analytic packets stay aligned with the orbit set.
+		const int32 NumAnalytic = Level.OrbitSet.Num();
+		for (int32 Start = 0; Start < NumAnalytic; Start += PacketSize)
+		{
+			Packets.Add({ Start, FMath::Min(PacketSize, NumAnalytic - Start), 0, 0, true });
+		}
+		for (int32 Start = NumAnalytic; Start < Level.Num; Start += PacketSize)
+		{
+			Packets.Add({ Start, FMath::Min(PacketSize, Level.Num - Start), 0, 0, true });
+		}
+		Level.NumAnalyticPackets = FMath::DivideAndRoundUp(NumAnalytic, PacketSize);
+		Level.NumPackets = Packets.Num() - Level.FirstPacket;
+	}
+	PacketCursor = 0;
+
+	bIsHierarchyDirty = false;
+}
+
+void UKeplerSubsystem::UpdateViews()
+{
+	ViewLocations.Reset();
+	ViewScreenScales.Reset();
+
+	UWorld* World = GetWorld();
+	if (!World) return;
+
+	for (FConstPlayerControllerIterator It = World->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		const APlayerCameraManager* CameraManager = PlayerController ? PlayerController->PlayerCameraManager : nullptr;
+		if (!CameraManager || !PlayerController->IsLocalController()) continue;
+
+		const float HalfFov = FMath::DegreesToRadians(0.5f * CameraManager->GetFOVAngle());
+		ViewLocations.Add(CameraManager->GetCameraLocation());
+		ViewScreenScales.Add(1.0f / FMath::Max(FMath::Tan(HalfFov), KINDA_SMALL_NUMBER));
+	}
+}
+
+void UKeplerSubsystem::ScheduleRefreshes()
+{
+	FrameNumber++;
+	NumRefreshedPackets = 0;
+	NumRefreshedBodies = 0;
+
+	const bool bWasLodActive = bIsLodActive;
+	bIsLodActive = LodSettings.bEnabled && ViewLocations.Num() > 0;
+
+	// Without LOD every packet is solved, and its extrapolation state goes stale.
+	if (!bIsLodActive)
+	{
+		for (FPacket& Packet : Packets)
+		{
+			Packet.bRefresh = true;
+			NumRefreshedBodies += Packet.Count;
+		}
+		NumRefreshedPackets = Packets.Num();
+		return;
+	}
+
+	auto RefreshPacket = [this](FPacket& Packet, const int32 PacketIndex, const int32 FirstFlatIndex)
+	{
+		int32 Lod = LodSettings.MaxLod;
+		for (int32 i = 0; i < Packet.Count && Lod > 0; i++)
+		{
+			Lod = FMath::Min(Lod, ComputeLod(FirstFlatIndex + i));
+		}
+
+		// Next frame of the packet's bucket. Packets are spread over the buckets by index.
+		const uint64 Interval = 1ull << Lod;
+		Packet.Lod = Lod;
+		Packet.NextRefreshFrame = FrameNumber + Interval - ((FrameNumber + PacketIndex) & (Interval - 1));
+		Packet.bRefresh = true;
+		NumRefreshedPackets++;
+		NumRefreshedBodies += Packet.Count;
+	};
+
+	// Near packets are always solved. So is every packet right after LOD is turned on.
+	for (int32 LevelIndex = 1; LevelIndex < Levels.Num(); LevelIndex++)
+	{
+		const FLevel& Level = Levels[LevelIndex];
+		for (int32 PacketIndex = Level.FirstPacket; PacketIndex < Level.FirstPacket + Level.NumPackets; PacketIndex++)
+		{
+			FPacket& Packet = Packets[PacketIndex];
+			Packet.bRefresh = false;
+			if (!bWasLodActive)
+			{
+				Packet.Lod = 0;
+				Packet.NextRefreshFrame = 0;
+			}
+			if (Packet.Lod == 0 && FrameNumber >= Packet.NextRefreshFrame)
+			{
+				RefreshPacket(Packet, PacketIndex, Level.FirstFlatIndex + Packet.Start);
+			}
+		}
+	}
+
+	// Far packets share what is left of the budget. Those that don't fit are postponed, and go first on the next frame.
+	const double Budget = LodSettings.BudgetMicroseconds * 1e-6;
+	const double CostPerPacket = FMath::Max(RefreshCostPerPacket, 1e-9);
+	const int32 MaxRefreshedPackets = (int32)FMath::Min(Budget / CostPerPacket, (double)MAX_int32);
+	int32 NumFarRefreshesLeft = FMath::Max(1, MaxRefreshedPackets - NumRefreshedPackets);
+
+	const int32 NumPackets = Packets.Num();
+	int32 PacketIndex = (PacketCursor < NumPackets) ? PacketCursor : 0;
+	for (int32 Step = 0; Step < NumPackets && NumFarRefreshesLeft > 0; Step++)
+	{
+		FPacket& Packet = Packets[PacketIndex];
+		if (!Packet.bRefresh && FrameNumber >= Packet.NextRefreshFrame)
+		{
+			// Packets are in flat order, so the flat index follows from the packet's level.
+			int32 LevelIndex = 1;
+			while (PacketIndex >= Levels[LevelIndex].FirstPacket + Levels[LevelIndex].NumPackets)
+			{
+				LevelIndex++;
+			}
+			RefreshPacket(Packet, PacketIndex, Levels[LevelIndex].FirstFlatIndex + Packet.Start);
+			NumFarRefreshesLeft--;
+		}
+		PacketIndex = (PacketIndex + 1 < NumPackets) ? PacketIndex + 1 : 0;
+	}
+	PacketCursor = PacketIndex;
+}
+
+int32 UKeplerSubsystem::ComputeLod(const int32 FlatIndex) const
+{
+	const FVector& Location = FlatLocations[FlatIndex];
+	const float Radius = (FlatRadii[FlatIndex] > 0.0f) ? FlatRadii[FlatIndex] : LodSettings.DefaultBodyRadius;
+
+	float MinDistance = BIG_NUMBER;
+	float MaxScreenSize = 0.0f;
+	for (int32 ViewIndex = 0; ViewIndex < ViewLocations.Num(); ViewIndex++)
+	{
+		const float Distance = FVector::Dist(ViewLocations[ViewIndex], Location);
+		MinDistance = FMath::Min(MinDistance, Distance);
+		MaxScreenSize = FMath::Max(MaxScreenSize, (Radius * ViewScreenScales[ViewIndex]) / FMath::Max(Distance, 1.0f));
+	}
+
+	const int32 MaxLod = FMath::Clamp(LodSettings.MaxLod, 0, 8);
+	if (MaxScreenSize < LodSettings.MinScreenSize) return MaxLod;
+
+	const float FullRateDistance = FMath::Max(LodSettings.FullRateDistance, 1.0f);
+	if (MinDistance <= FullRateDistance) return 0;
+
+	const uint32 DistanceRatio = (uint32)FMath::Min(MinDistance / FullRateDistance, 65536.0f);
+	return FMath::Min(MaxLod, 1 + (int32)FMath::FloorLog2(DistanceRatio));
+}
+
+void UKeplerSubsystem::PropagateOrbits()
+{
+	const double Time = SimulationTime;
+	const int32 PacketsPerBatch = FMath::Max(1, BatchSize / KeplerSimulation::PacketSize);
+	const bool bStoreState = bIsLodActive;
+	volatile int64 RefreshCycles = 0;
+
+	// Static bodies never move, so start at the first level of orbiting bodies.
+	for (int32 LevelIndex = 1; LevelIndex < Levels.Num(); LevelIndex++)
+	{
+		const FLevel& Level = Levels[LevelIndex];
+		const int32 NumAnalytic = Level.OrbitSet.Num();
+		const int32 NumBatches = FMath::DivideAndRoundUp(Level.NumPackets, PacketsPerBatch);
+		ParallelFor(NumBatches, [this, &Level, &RefreshCycles, Time, PacketsPerBatch, NumAnalytic, bStoreState](int32 BatchIndex)
+		{
+			const int32 FirstPacket = Level.FirstPacket + (BatchIndex * PacketsPerBatch);
+			const int32 EndPacket = FMath::Min(FirstPacket + PacketsPerBatch, Level.FirstPacket + Level.NumPackets);
+			uint64 BatchCycles = 0;
+
+			// Write the local positions in place, then offset them by the focus.
+			for (int32 PacketIndex = FirstPacket; PacketIndex < EndPacket; PacketIndex++)
+			{
+				const FPacket& Packet = Packets[PacketIndex];
+				const int32 FirstFlatIndex = Level.FirstFlatIndex + Packet.Start;
+				if (!Packet.bRefresh)
+				{
+					for (int32 i = 0; i < Packet.Count; i++)
+					{
+						const int32 FlatIndex = FirstFlatIndex + i;
+						const float EccAnomaly = FlatEccAnomalies[FlatIndex] + (FlatEccRates[FlatIndex] * (float)(Time - FlatRefreshTimes[FlatIndex]));
+						FlatLocations[FlatIndex] = Level.Orbits[Packet.Start + i].GetPositionFromEccentricAnomaly(EccAnomaly);
+					}
+					continue;
+				}
+
+				const uint64 StartCycles = FPlatformTime::Cycles64();
+				const TArrayView<FVector> OutPositions(FlatLocations.GetData() + FirstFlatIndex, Packet.Count);
+				if (Packet.Start < NumAnalytic)
+				{
+					Level.OrbitSet.Propagate(Time, Packet.Start, Packet.Count, OutPositions);
+				}
+				else
+				{
+					for (int32 i = 0; i < Packet.Count; i++)
+					{
+						const int32 EphemerisIndex = Packet.Start - NumAnalytic + i;
+						const double ElapsedTime = Time - Level.EphemerisEpochs[EphemerisIndex];
+						OutPositions[i] = Level.Ephemerides[EphemerisIndex]->Evaluate(ElapsedTime);
+					}
+				}
+				BatchCycles += FPlatformTime::Cycles64() - StartCycles;
+
+				if (!bStoreState) continue;
+
+				// Recover the eccentric anomaly from the position, so ephemeris bodies need no solve either.
+				for (int32 i = 0; i < Packet.Count; i++)
+				{
+					const FKeplerCompiledOrbit& Orbit = Level.Orbits[Packet.Start + i];
+					const FVector& Position = OutPositions[i];
+					const float X = Position | Orbit.PeriapsisAxis;
+					const float Y = Position | Orbit.SemiLatusAxis;
+					const float Distance = Position.Size();
+					const int32 FlatIndex = FirstFlatIndex + i;
+					FlatEccAnomalies[FlatIndex] = FMath::Atan2(Y * Orbit.SemiMajorAxis, (X + (Orbit.SemiMajorAxis * Orbit.Eccentricity)) * Orbit.SemiMinorAxis);
+					FlatEccRates[FlatIndex] = (Distance > KINDA_SMALL_NUMBER) ? ((Orbit.MeanMotion * Orbit.SemiMajorAxis) / Distance) : 0.0f;
+					FlatRefreshTimes[FlatIndex] = Time;
+				}
+			}
+
+			if (FirstPacket < EndPacket)
+			{
+				const int32 FirstFlatIndex = Level.FirstFlatIndex + Packets[FirstPacket].Start;
+				const int32 EndFlatIndex = Level.FirstFlatIndex + Packets[EndPacket - 1].Start + Packets[EndPacket - 1].Count;
+				for (int32 FlatIndex = FirstFlatIndex; FlatIndex < EndFlatIndex; FlatIndex++)
+				{
+					const int32 ParentIndex = FlatParents[FlatIndex];
+					FlatLocations[FlatIndex] += (ParentIndex != INDEX_NONE) ? FlatLocations[ParentIndex] : FlatFoci[FlatIndex];
+				}
+			}
+
+			FPlatformAtomics::InterlockedAdd(&RefreshCycles, (int64)BatchCycles);
+		}, NumBatches < 2);
+	}
+
+	if (NumRefreshedPackets > 0)
+	{
+		const double Cost = FPlatformTime::ToSeconds64((uint64)RefreshCycles) / NumRefreshedPackets;
+		RefreshCostPerPacket = (RefreshCostPerPacket > 0.0) ? FMath::Lerp(RefreshCostPerPacket, Cost, KeplerSimulation::CostSmoothing) : Cost;
+	}
+}
+
+void UKeplerSubsystem::ApplyPerturbations()
+{
+	const float Elapsed = (float)(SimulationTime - LastPerturbationTime);
+	if (!PerturbationSettings.bEnabled || Elapsed < 0.0f)
+	{
+		LastPerturbationTime = SimulationTime;
+		return;
+	}
+	if (Elapsed < PerturbationSettings.UpdateInterval) return;
+
+	LastPerturbationTime = SimulationTime;
+	const double Time = SimulationTime;
+	const float StepTime = FMath::Min(Elapsed, PerturbationSettings.UpdateInterval * KeplerSimulation::MaxPerturbationIntervals);
+
+	// Gather the massive bodies at the current time. The tree and the scratch keep their memory between updates.
+	GravitySourceLocations.Reset();
+	GravitySourceMasses.Reset();
+	PerturbedIds.Reset();
+	GravitySources.Reset();
+	GravitySources.SetNumUninitialized(Bodies.GetMaxIndex());
+	for (int32& GravitySource : GravitySources)
+	{
+		GravitySource = INDEX_NONE;
+	}
+	const float GravitationalParameter = FKeplerOrbitConfig::GetGravitationalParameter();
+	for (auto It = Bodies.CreateConstIterator(); It; ++It)
+	{
+		if (It->Mass > 0.0f)
+		{
+			GravitySources[It.GetIndex()] = GravitySourceLocations.Add(GetBodyLocationAtPreciseTime(It.GetIndex(), Time));
+			GravitySourceMasses.Add(It->Mass * GravitationalParameter);
+		}
+		if (It->bIsPerturbed && !It->bIsStatic && !It->Ephemeris.IsValid())
+		{
+			PerturbedIds.Add(It.GetIndex());
+		}
+	}
+
+	if (GravitySourceLocations.Num() == 0 || PerturbedIds.Num() == 0) return;
+
+	GravityTree.Build(GravitySourceLocations, GravitySourceMasses, PerturbationSettings.MaxNodes);
+
+	PerturbedOrbitConfigs.Reset();
+	PerturbedOrbitConfigs.SetNum(PerturbedIds.Num());
+	HasPerturbedOrbit.Reset();
+	HasPerturbedOrbit.SetNumZeroed(PerturbedIds.Num());
+	ParallelFor(PerturbedIds.Num(), [this, Time, StepTime](int32 Index)
+	{
+		const int32 BodyId = PerturbedIds[Index];
+		const FBody& Body = Bodies[BodyId];
+		FVector LocalPosition;
+		FVector LocalVelocity;
+		Body.OrbitConfig.Compiled.GetStateAtTime(Time - Body.Epoch, LocalPosition, LocalVelocity);
+
+		// The body and its parent are left out. The pull of the parent is the orbit itself.
+		const int32 SelfSource = GravitySources[BodyId];
+		const int32 ParentSource = GravitySources.IsValidIndex(Body.ParentId) ? GravitySources[Body.ParentId] : INDEX_NONE;
+		const float OpeningAngle = PerturbationSettings.OpeningAngle;
+		const float Softening = PerturbationSettings.Softening;
+		const FVector Location = GetBodyLocationAtPreciseTime(BodyId, Time);
+		FVector Acceleration = GravityTree.GetAcceleration(Location, SelfSource, ParentSource, OpeningAngle, Softening);
+
+		// A moving parent falls too, so only the difference disturbs the orbit around it.
+		if (Bodies.IsValidIndex(Body.ParentId) && !Bodies[Body.ParentId].bIsStatic)
+		{
+			Acceleration -= GravityTree.GetAcceleration(Location - LocalPosition, SelfSource, ParentSource, OpeningAngle, Softening);
+		}
+
+		// Orbits that would become unbound keep their last osculating elements.
+		HasPerturbedOrbit[Index] = FKeplerOrbitConfig::FromStateVectors(LocalPosition, LocalVelocity + (Acceleration * StepTime), PerturbedOrbitConfigs[Index]);
+	});
+
+	for (int32 Index = 0; Index < PerturbedIds.Num(); Index++)
+	{
+		if (HasPerturbedOrbit[Index])
+		{
+			SetOrbitConfig(PerturbedIds[Index], PerturbedOrbitConfigs[Index], Time);
+		}
+	}
+}
+
+void UKeplerSubsystem::WriteTransforms()
+{
+	const int32 FirstOrbitingIndex = (Levels.Num() > 0) ? Levels[0].Num : 0;
+	for (int32 FlatIndex = FirstOrbitingIndex; FlatIndex < FlatTargets.Num(); FlatIndex++)
+	{
+		USceneComponent* Target = FlatTargets[FlatIndex].Get();
+		if (Target)
+		{
+			Target->SetWorldLocation(FlatLocations[FlatIndex], false, nullptr, ETeleportType::TeleportPhysics);
+		}
+	}
+}
+
+int32 UKeplerSubsystem::ProcessEvents(const double EndTime)
+{
+	int32 NumEvents = 0;
+	while (EventQueue.Num() > 0 && EventQueue.HeapTop().Time <= EndTime)
+	{
+		FScheduledEvent Scheduled;
+		EventQueue.HeapPop(Scheduled, false);
+
+		// Broadcast at the time of the event, so orbits changed by listeners start from there.
+		SimulationTime = FMath::Max(SimulationTime, Scheduled.Time);
+		const FKeplerEvent Event = Scheduled.Event;
+		const bool bIsRecheck = Scheduled.bIsRecheck;
+
+		// After a crossing, look for the one that leads back out, or back in.
+		if (!bIsRecheck && Event.Type == EKeplerEventType::SphereEntry)
+		{
+			Scheduled.Event.Type = EKeplerEventType::SphereExit;
+		}
+		else if (!bIsRecheck && Event.Type == EKeplerEventType::SphereExit)
+		{
+			Scheduled.Event.Type = EKeplerEventType::SphereEntry;
+		}
+		ScheduleEvent(Scheduled, SimulationTime);
+
+		if (!bIsRecheck)
+		{
+			NumEvents++;
+			OnKeplerEvent.Broadcast(Event);
+		}
+	}
+
+	SimulationTime = FMath::Max(SimulationTime, EndTime);
+	return NumEvents;
+}
+
+void UKeplerSubsystem::RescheduleEvents(const int32 BodyId)
+{
+	TArray<FScheduledEvent> StaleEvents;
+	for (int32 i = EventQueue.Num() - 1; i >= 0; i--)
+	{
+		if (EventQueue[i].Event.BodyId == BodyId || EventQueue[i].Event.OtherBodyId == BodyId)
+		{
+			StaleEvents.Add(EventQueue[i]);
+			EventQueue.RemoveAtSwap(i, 1, false);
+		}
+	}
+
+	if (StaleEvents.Num() == 0) return;
+
+	EventQueue.Heapify();
+	for (const FScheduledEvent& Scheduled : StaleEvents)
+	{
+		if (Scheduled.Event.Type == EKeplerEventType::SphereEntry || Scheduled.Event.Type == EKeplerEventType::SphereExit)
+		{
+			WatchSphere(Scheduled.Event.BodyId, Scheduled.Event.OtherBodyId, Scheduled.Radius);
+		}
+		else
+		{
+			WatchEvent(Scheduled.Event.BodyId, Scheduled.Event.Type);
+		}
+	}
+}
+
+void UKeplerSubsystem::ScheduleEvent(FScheduledEvent Scheduled, const double FromTime)
+{
+	FKeplerEvent& Event = Scheduled.Event;
+	if (!Bodies.IsValidIndex(Event.BodyId) || Bodies[Event.BodyId].bIsStatic) return;
+
+	const FBody& Body = Bodies[Event.BodyId];
+	const FKeplerCompiledOrbit& Orbit = Body.OrbitConfig.Compiled;
+	if (Event.Type == EKeplerEventType::SphereEntry || Event.Type == EKeplerEventType::SphereExit)
+	{
+		if (!Bodies.IsValidIndex(Event.OtherBodyId)) return;
+
+		const double EndTime = FromTime + FMath::Max(EventSearchWindow, 1.0f);
+		double CrossingTime = FromTime;
+		Scheduled.bIsRecheck = !FindSphereCrossing(Scheduled, FromTime, EndTime, CrossingTime);
+
+		// Bodies that never move can't cross. Otherwise, always make progress, even past the time precision.
+		if (Scheduled.bIsRecheck && GetMaxBodySpeed(Event.BodyId) + GetMaxBodySpeed(Event.OtherBodyId) <= 0.0f) return;
+		const double MinDelay = FMath::Max((double)KINDA_SMALL_NUMBER, FMath::Abs(FromTime) * 2.0 * DBL_EPSILON);
+		Scheduled.Time = Scheduled.bIsRecheck ? FMath::Max(CrossingTime, FromTime + MinDelay) : CrossingTime;
+	}
+	else
+	{
+		if (Orbit.MeanMotion <= 0.0f) return;
+
+		float TargetAnomaly = 0.0f;
+		switch (Event.Type)
+		{
+		case EKeplerEventType::Periapsis:
+			TargetAnomaly = 0.0f;
+			break;
+		case EKeplerEventType::Apoapsis:
+			TargetAnomaly = PI;
+			break;
+		case EKeplerEventType::AscendingNode:
+		case EKeplerEventType::DescendingNode:
+			if (!Orbit.GetAscendingNodeAnomaly(TargetAnomaly)) return;
+			TargetAnomaly += (Event.Type == EKeplerEventType::DescendingNode) ? PI : 0.0f;
+			break;
+		default:
+			return;
+		}
+
+		// Skip the occurrence being processed, so each one is reported once.
+		const double SearchTime = FromTime + ((KeplerSimulation::MinEventDelay * 2.0f * PI) / Orbit.MeanMotion);
+		Scheduled.Time = SearchTime + Orbit.GetTimeUntilTrueAnomaly(SearchTime - Body.Epoch, TargetAnomaly);
+		Scheduled.bIsRecheck = false;
+	}
+
+	Event.Time = (float)Scheduled.Time;
+
+	EventQueue.HeapPush(Scheduled);
+}
+
+bool UKeplerSubsystem::FindSphereCrossing(const FScheduledEvent& Scheduled, const double StartTime, const double EndTime, double& OutTime) const
+{
+	const FKeplerEvent& Event = Scheduled.Event;
+	const float MaxSpeed = GetMaxBodySpeed(Event.BodyId) + GetMaxBodySpeed(Event.OtherBodyId);
+	const float Tolerance = KeplerSimulation::SphereTolerance;
+	const bool bIsEntry = (Event.Type == EKeplerEventType::SphereEntry);
+
+	OutTime = StartTime;
+	if (MaxSpeed <= 0.0f) return false;
+
+	// Conservative advancement. The distance can't change faster than MaxSpeed, so no step jumps over the crossing.
+	for (int32 Step = 0; Step < KeplerSimulation::MaxSphereSteps && OutTime <= EndTime; Step++)
+	{
+		const float Distance = FVector::Dist(GetBodyLocationAtPreciseTime(Event.BodyId, OutTime), GetBodyLocationAtPreciseTime(Event.OtherBodyId, OutTime));
+		const float Gap = bIsEntry ? (Distance - Scheduled.Radius) : (Scheduled.Radius + (3.0f * Tolerance) - Distance);
+		if (Gap <= Tolerance) return true;
+
+		OutTime += Gap / MaxSpeed;
+	}
+	return false;
+}
+
+float UKeplerSubsystem::GetMaxBodySpeed(const int32 BodyId) const
+{
+	float MaxSpeed = 0.0f;
+	int32 CurrentId = BodyId;
+	for (int32 Depth = 0; Bodies.IsValidIndex(CurrentId) && Depth < Bodies.Num(); Depth++)
+	{
+		const FBody& Body = Bodies[CurrentId];
+		if (Body.bIsStatic) break;
+
+		MaxSpeed += Body.OrbitConfig.Compiled.GetPeriapsisSpeed();
+		CurrentId = Body.ParentId;
+	}
+	return MaxSpeed;
+}
@@ -0,0 +1,159 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "KeplerSolverTable.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+
+namespace KeplerSolverTable
+{
+	/** Newton-Raphson steps of the reference solver. Converges long before this. */
+	static const int32 MaxReferenceIterations = 64;
+
+	/** Samples of the console benchmark. */
+	static const int32 NumBenchmarkSamples = 1 << 20;
+
+	static void RunBenchmark(const TArray<FString>& Args)
+	{
+		const int32 NumSamples = (Args.Num() > 0) ? FMath::Max(1, FCString::Atoi(*Args[0])) : NumBenchmarkSamples;
+		TArray<FKeplerSolverBenchmark> Results;
+		FKeplerSolverTable::Benchmark(NumSamples, Results);
+
+		const UEnum* ModeEnum = StaticEnum<EKeplerSolverMode>();
+		UE_LOG(LogKepler, Display, TEXT("Kepler solver benchmark, %d samples, e in [0, %.2f]:"), NumSamples, FKeplerSolverTable::MaxEccentricity);
+		for (const FKeplerSolverBenchmark& Result : Results)
+		{
+			UE_LOG(LogKepler, Display, TEXT("  %-14s %8.2f ns/solve, max error %e rad, %.2f iterations"),
+				*ModeEnum->GetNameStringByValue((int64)Result.Mode), Result.NanosecondsPerSolve, Result.MaxError, Result.AverageIterations);
+		}
+	}
+
+	static FAutoConsoleCommand BenchmarkCommand(
+		TEXT("Kepler.BenchmarkSolvers"),
+		TEXT("Time every Kepler solver mode and measure its largest error. Optional argument: number of samples."),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunBenchmark));
+}
+
+const float FKeplerSolverTable::MaxEccentricity = 0.9f;
+
+FKeplerSolverTable& FKeplerSolverTable::Get()
+{
+	static FKeplerSolverTable Instance;
+	return Instance;
+}
+
+void FKeplerSolverTable::Build()
+{
+	if (bIsBuilt) return;
+
+	Values.SetNumUninitialized(NumMeanSamples * NumEccSamples);
+	for (int32 EccIndex = 0; EccIndex < NumEccSamples; EccIndex++)
+	{
+		const double Eccentricity = (MaxEccentricity * (double)EccIndex) / (NumEccSamples - 1);
+		float* Row = Values.GetData() + (EccIndex * NumMeanSamples);
+		for (int32 MeanIndex = 0; MeanIndex < NumMeanSamples; MeanIndex++)
+		{
+			// Storing E - M keeps the values small and smooth, so interpolation loses less.
+			const double MeanAnomaly = (DOUBLE_PI * MeanIndex) / (NumMeanSamples - 1);
+			Row[MeanIndex] = (float)(SolveReference(MeanAnomaly, Eccentricity) - MeanAnomaly);
+		}
+	}
+
+	bIsBuilt = true;
+	UE_LOG(LogKepler, Verbose, TEXT("Kepler solver table built: %d x %d samples, %d bytes."), NumMeanSamples, NumEccSamples, (int32)GetAllocatedSize());
+}
+
+float FKeplerSolverTable::Solve(const float MeanAnomalyRad, const float Eccentricity) const
+{
+	checkSlow(CanSolve(Eccentricity));
+
+	const float Mean = FMath::Abs(MeanAnomalyRad);
+	const float MeanCoord = FMath::Min(Mean, PI) * ((NumMeanSamples - 1) / PI);
+	const float EccCoord = Eccentricity * ((NumEccSamples - 1) / MaxEccentricity);
+	const int32 MeanIndex = FMath::Min(FMath::FloorToInt(MeanCoord), NumMeanSamples - 2);
+	const int32 EccIndex = FMath::Min(FMath::FloorToInt(EccCoord), NumEccSamples - 2);
+	const float MeanAlpha = MeanCoord - MeanIndex;
+	const float EccAlpha = EccCoord - EccIndex;
+
+	const float* Row0 = Values.GetData() + (EccIndex * NumMeanSamples) + MeanIndex;
+	const float* Row1 = Row0 + NumMeanSamples;
+	const float Offset = FMath::Lerp(FMath::Lerp(Row0[0], Row0[1], MeanAlpha), FMath::Lerp(Row1[0], Row1[1], MeanAlpha), EccAlpha);
+	float EccentricAnomaly = Mean + Offset;
+
+	// One Newton-Raphson step. The lookup is close enough for it to converge quadratically.
+	float SinE;
+	float CosE;
+	FMath::SinCos(&SinE, &CosE, EccentricAnomaly);
+	EccentricAnomaly -= (EccentricAnomaly - (Eccentricity * SinE) - Mean) / (1.0f - (Eccentricity * CosE));
+
+	return (MeanAnomalyRad < 0.0f) ? -EccentricAnomaly : EccentricAnomaly;
+}
+
+double FKeplerSolverTable::SolveReference(const double MeanAnomalyRad, const double Eccentricity)
+{
+	// Starting at PI keeps Newton-Raphson from overshooting on eccentric orbits.
+	double EccentricAnomaly = (Eccentricity < 0.8) ? MeanAnomalyRad : ((MeanAnomalyRad < 0.0) ? -DOUBLE_PI : DOUBLE_PI);
+	for (int32 Iteration = 0; Iteration < KeplerSolverTable::MaxReferenceIterations; Iteration++)
+	{
+		const double Step = (EccentricAnomaly - (Eccentricity * sin(EccentricAnomaly)) - MeanAnomalyRad) / (1.0 - (Eccentricity * cos(EccentricAnomaly)));
+		EccentricAnomaly -= Step;
+		if (FMath::Abs(Step) <= 1e-15)
+		{
+			break;
+		}
+	}
+	return EccentricAnomaly;
+}
+
+void FKeplerSolverTable::Benchmark(const int32 NumSamples, TArray<FKeplerSolverBenchmark>& OutResults)
+{
+	// Same inputs for every mode, generated up front so only the solves are timed.
+	FRandomStream Random(0x4B45504C);
+	TArray<float> MeanAnomalies;
+	TArray<float> Eccentricities;
+	TArray<double> References;
+	MeanAnomalies.SetNumUninitialized(NumSamples);
+	Eccentricities.SetNumUninitialized(NumSamples);
+	References.SetNumUninitialized(NumSamples);
+	for (int32 i = 0; i < NumSamples; i++)
+	{
+		MeanAnomalies[i] = Random.FRandRange(-PI, PI);
+		Eccentricities[i] = Random.FRandRange(0.0f, MaxEccentricity);
+		References[i] = SolveReference(MeanAnomalies[i], Eccentricities[i]);
+	}
+
+	const bool bWasStatsEnabled = FKeplerSolverStats::IsEnabled();
+	FKeplerSolverStats::SetEnabled(false);
+
+	TArray<float> Results;
+	Results.SetNumUninitialized(NumSamples);
+	const EKeplerSolverMode Modes[] = { EKeplerSolverMode::FixedPoint, EKeplerSolverMode::NewtonRaphson, EKeplerSolverMode::Halley, EKeplerSolverMode::Markley, EKeplerSolverMode::LookupTable };
+	OutResults.Reset();
+	for (const EKeplerSolverMode Mode : Modes)
+	{
+		FKeplerSolverSettings Settings;
+		Settings.Mode = Mode;
+
+		int64 TotalIterations = 0;
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		for (int32 i = 0; i < NumSamples; i++)
+		{
+			int32 Iterations = 0;
+			Results[i] = FKeplerSolver::SolveEccentricAnomaly(MeanAnomalies[i], Eccentricities[i], Settings, Iterations);
+			TotalIterations += Iterations;
+		}
+		const double Seconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles);
+
+		FKeplerSolverBenchmark& Result = OutResults.AddDefaulted_GetRef();
+		Result.Mode = Mode;
+		Result.NanosecondsPerSolve = (float)((Seconds * 1e9) / NumSamples);
+		Result.AverageIterations = (float)((double)TotalIterations / NumSamples);
+		Result.MaxError = 0.0f;
+		for (int32 i = 0; i < NumSamples; i++)
+		{
+			Result.MaxError = FMath::Max(Result.MaxError, (float)FMath::Abs(Results[i] - References[i]));
+		}
+	}
+
+	FKeplerSolverStats::SetEnabled(bWasStatsEnabled);
+}
@@ -0,0 +1,352 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "KeplerTransfer.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+
+namespace KeplerTransfer
+{
+	/** Gravitational parameter implied by the library, where the period is 720 * sqrt(a^3). */
+	static const double GravitationalParameter = (DOUBLE_PI / 360.0) * (DOUBLE_PI / 360.0);
+
+	/** Bisection steps of the Lambert solver. Enough to reach double precision. */
+	static const int32 NumLambertIterations = 64;
+
+	/** Upper bound of steps of each refinement. */
+	static const int32 MaxRefineIterations = 64;
+
+	/** Moves tried by each refinement step, as departure and travel time. */
+	static const FVector2D RefineDirections[4] = { FVector2D(1.0f, 0.0f), FVector2D(-1.0f, 0.0f), FVector2D(0.0f, 1.0f), FVector2D(0.0f, -1.0f) };
+
+	/** Stumpff functions C(z) and S(z) of the universal variable formulation. */
+	static void GetStumpff(const double Z, double& OutC, double& OutS)
+	{
+		if (Z > 1e-6)
+		{
+			const double SqrtZ = sqrt(Z);
+			OutC = (1.0 - cos(SqrtZ)) / Z;
+			OutS = (SqrtZ - sin(SqrtZ)) / (Z * SqrtZ);
+		}
+		else if (Z < -1e-6)
+		{
+			const double SqrtZ = sqrt(-Z);
+			OutC = (cosh(SqrtZ) - 1.0) / -Z;
+			OutS = (sinh(SqrtZ) - SqrtZ) / (-Z * SqrtZ);
+		}
+		else
+		{
+			OutC = 0.5 - (Z / 24.0);
+			OutS = (1.0 / 6.0) - (Z / 120.0);
+		}
+	}
+
+	/** Total delta-v of a transfer, given the origin state at departure. Negative if there is no solution. */
+	static float EvaluateTransfer(const FKeplerCompiledOrbit& TargetOrbit, const FKeplerTransferSettings& Settings,
+		const FVector& OriginPosition, const FVector& OriginVelocity, const float DepartureTime, const float TravelTime,
+		FKeplerTransferWindow* OutWindow = nullptr)
+	{
+		FVector TargetPosition;
+		FVector TargetVelocity;
+		const float ArrivalTime = DepartureTime + TravelTime;
+		TargetOrbit.GetStateAtTime(ArrivalTime - Settings.TargetEpoch, TargetPosition, TargetVelocity);
+
+		// Prograde relative to the origin orbit, which is what a launch from it would follow.
+		FVector TransferV1;
+		FVector TransferV2;
+		const FVector Normal = OriginPosition ^ OriginVelocity;
+		if (!FKeplerTransferSearch::SolveLambert(OriginPosition, TargetPosition, TravelTime, Normal, TransferV1, TransferV2))
+		{
+			return -1.0f;
+		}
+
+		const FVector DepartureDeltaV = TransferV1 - OriginVelocity;
+		const FVector ArrivalDeltaV = TargetVelocity - TransferV2;
+		const float TotalDeltaV = DepartureDeltaV.Size() + ArrivalDeltaV.Size();
+		if (OutWindow)
+		{
+			OutWindow->DepartureTime = DepartureTime;
+			OutWindow->ArrivalTime = ArrivalTime;
+			OutWindow->DepartureDeltaV = DepartureDeltaV;
+			OutWindow->ArrivalDeltaV = ArrivalDeltaV;
+			OutWindow->TotalDeltaV = TotalDeltaV;
+		}
+		return TotalDeltaV;
+	}
+
+	/** Evaluate a transfer at any departure time, not just the ones of the grid. */
+	static float EvaluateTransfer(const FKeplerCompiledOrbit& OriginOrbit, const FKeplerCompiledOrbit& TargetOrbit, const FKeplerTransferSettings& Settings,
+		const float DepartureTime, const float TravelTime, FKeplerTransferWindow* OutWindow = nullptr)
+	{
+		FVector OriginPosition;
+		FVector OriginVelocity;
+		OriginOrbit.GetStateAtTime(DepartureTime - Settings.OriginEpoch, OriginPosition, OriginVelocity);
+		return EvaluateTransfer(TargetOrbit, Settings, OriginPosition, OriginVelocity, DepartureTime, TravelTime, OutWindow);
+	}
+}
+
+void FKeplerTransferSearch::Search(const FKeplerOrbitConfig& Origin, const FKeplerOrbitConfig& Target, const FKeplerTransferSettings& Settings, FKeplerTransferGrid& OutGrid)
+{
+	// Copying the configs refreshes their derived data. Every worker reads these two.
+	const FKeplerOrbitConfig OriginConfig = Origin;
+	const FKeplerOrbitConfig TargetConfig = Target;
+	const FKeplerCompiledOrbit& OriginOrbit = OriginConfig.Compiled;
+	const FKeplerCompiledOrbit& TargetOrbit = TargetConfig.Compiled;
+
+	const int32 NumDepartureSteps = FMath::Max(1, Settings.NumDepartureSteps);
+	const int32 NumTravelTimeSteps = FMath::Max(1, Settings.NumTravelTimeSteps);
+	const float MinTravelTime = FMath::Max(Settings.MinTravelTime, KINDA_SMALL_NUMBER);
+	const float MaxTravelTime = FMath::Max(Settings.MaxTravelTime, MinTravelTime);
+	const float DepartureStep = (NumDepartureSteps > 1) ? (Settings.DepartureDuration / (NumDepartureSteps - 1)) : 0.0f;
+	const float TravelTimeStep = (NumTravelTimeSteps > 1) ? ((MaxTravelTime - MinTravelTime) / (NumTravelTimeSteps - 1)) : 0.0f;
+
+	OutGrid.NumDepartureSteps = NumDepartureSteps;
+	OutGrid.NumTravelTimeSteps = NumTravelTimeSteps;
+	OutGrid.DeltaV.SetNumUninitialized(NumDepartureSteps * NumTravelTimeSteps);
+	OutGrid.BestWindow = FKeplerTransferWindow();
+	OutGrid.bFoundTransfer = false;
+
+	// One row per task. The origin state only depends on the departure, so it is solved once per row.
+	ParallelFor(NumDepartureSteps, [&](int32 DepartureIndex)
+	{
+		const float DepartureTime = Settings.DepartureStart + (DepartureIndex * DepartureStep);
+		FVector OriginPosition;
+		FVector OriginVelocity;
+		OriginOrbit.GetStateAtTime(DepartureTime - Settings.OriginEpoch, OriginPosition, OriginVelocity);
+		for (int32 TravelTimeIndex = 0; TravelTimeIndex < NumTravelTimeSteps; TravelTimeIndex++)
+		{
+			const float TravelTime = MinTravelTime + (TravelTimeIndex * TravelTimeStep);
+			OutGrid.DeltaV[(DepartureIndex * NumTravelTimeSteps) + TravelTimeIndex] =
+				KeplerTransfer::EvaluateTransfer(TargetOrbit, Settings, OriginPosition, OriginVelocity, DepartureTime, TravelTime);
+		}
+	});
+
+	// Local minima of the grid, cheapest first. Only these are refined.
+	struct FCandidate
+	{
+		int32 DepartureIndex;
+		int32 TravelTimeIndex;
+		float DeltaV;
+	};
+
+	TArray<FCandidate> Candidates;
+	for (int32 DepartureIndex = 0; DepartureIndex < NumDepartureSteps; DepartureIndex++)
+	{
+		for (int32 TravelTimeIndex = 0; TravelTimeIndex < NumTravelTimeSteps; TravelTimeIndex++)
+		{
+			const float DeltaV = OutGrid.GetDeltaV(DepartureIndex, TravelTimeIndex);
+			if (DeltaV < 0.0f) continue;
+
+			bool bIsMinimum = true;
+			for (int32 i = -1; i <= 1 && bIsMinimum; i++)
+			{
+				for (int32 j = -1; j <= 1 && bIsMinimum; j++)
+				{
+					const int32 OtherDeparture = DepartureIndex + i;
+					const int32 OtherTravelTime = TravelTimeIndex + j;
+					if ((i == 0 && j == 0) || OtherDeparture < 0 || OtherDeparture >= NumDepartureSteps || OtherTravelTime < 0 || OtherTravelTime >= NumTravelTimeSteps) continue;
+
+					const float OtherDeltaV = OutGrid.GetDeltaV(OtherDeparture, OtherTravelTime);
+					bIsMinimum = (OtherDeltaV < 0.0f) || (DeltaV <= OtherDeltaV);
+				}
+			}
+
+			if (bIsMinimum)
+			{
+				Candidates.Add({ DepartureIndex, TravelTimeIndex, DeltaV });
+			}
+		}
+	}
+
+	if (Candidates.Num() == 0) return;
+
+	Candidates.Sort([](const FCandidate& A, const FCandidate& B) { return A.DeltaV < B.DeltaV; });
+
+	// Compass search around each minimum, starting at the size of a cell. Stops early once the step is below the tolerance.
+	const int32 NumRefined = FMath::Min(Settings.NumRefinedMinima, Candidates.Num());
+	TArray<FKeplerTransferWindow> RefinedWindows;
+	RefinedWindows.SetNum(FMath::Max(NumRefined, 1));
+	ParallelFor(NumRefined, [&](int32 CandidateIndex)
+	{
+		const FCandidate& Candidate = Candidates[CandidateIndex];
+		float DepartureTime = Settings.DepartureStart + (Candidate.DepartureIndex * DepartureStep);
+		float TravelTime = MinTravelTime + (Candidate.TravelTimeIndex * TravelTimeStep);
+		float BestDeltaV = Candidate.DeltaV;
+		float Step = FMath::Max3(DepartureStep, TravelTimeStep, Settings.RefineTolerance);
+		const float Tolerance = FMath::Max(Settings.RefineTolerance, KINDA_SMALL_NUMBER);
+		for (int32 Iteration = 0; Iteration < KeplerTransfer::MaxRefineIterations && Step > Tolerance; Iteration++)
+		{
+			bool bHasImproved = false;
+			for (int32 Direction = 0; Direction < 4; Direction++)
+			{
+				const float NewDepartureTime = DepartureTime + (KeplerTransfer::RefineDirections[Direction].X * Step);
+				const float NewTravelTime = TravelTime + (KeplerTransfer::RefineDirections[Direction].Y * Step);
+				if (NewTravelTime < MinTravelTime) continue;
+
+				const float DeltaV = KeplerTransfer::EvaluateTransfer(OriginOrbit, TargetOrbit, Settings, NewDepartureTime, NewTravelTime);
+				if (DeltaV >= 0.0f && DeltaV < BestDeltaV)
+				{
+					DepartureTime = NewDepartureTime;
+					TravelTime = NewTravelTime;
+					BestDeltaV = DeltaV;
+					bHasImproved = true;
+				}
+			}
+
+			if (!bHasImproved)
+			{
+				Step *= 0.5f;
+			}
+		}
+
+		KeplerTransfer::EvaluateTransfer(OriginOrbit, TargetOrbit, Settings, DepartureTime, TravelTime, &RefinedWindows[CandidateIndex]);
+	});
+
+	if (NumRefined == 0)
+	{
+		const FCandidate& Best = Candidates[0];
+		const float DepartureTime = Settings.DepartureStart + (Best.DepartureIndex * DepartureStep);
+		const float TravelTime = MinTravelTime + (Best.TravelTimeIndex * TravelTimeStep);
+		KeplerTransfer::EvaluateTransfer(OriginOrbit, TargetOrbit, Settings, DepartureTime, TravelTime, &RefinedWindows[0]);
+	}
+
+	for (const FKeplerTransferWindow& Window : RefinedWindows)
+	{
+		if (Window.TotalDeltaV >= 0.0f && (!OutGrid.bFoundTransfer || Window.TotalDeltaV < OutGrid.BestWindow.TotalDeltaV))
+		{
+			OutGrid.BestWindow = Window;
+			OutGrid.bFoundTransfer = true;
+		}
+	}
+}
+
+TFuture<FKeplerTransferGrid> FKeplerTransferSearch::SearchAsync(const FKeplerOrbitConfig& Origin, const FKeplerOrbitConfig& Target, const FKeplerTransferSettings& Settings)
+{
+	return Async(EAsyncExecution::ThreadPool, [Origin, Target, Settings]()
+	{
+		FKeplerTransferGrid Grid;
+		Search(Origin, Target, Settings, Grid);
+		return Grid;
+	});
+}
+
+bool FKeplerTransferSearch::SolveLambert(const FVector& R1, const FVector& R2, const float TravelTime, const FVector& Normal, FVector& OutV1, FVector& OutV2)
+{
+	const double Mu = KeplerTransfer::GravitationalParameter;
+	const double Radius1 = R1.Size();
+	const double Radius2 = R2.Size();
+	if (Radius1 < KINDA_SMALL_NUMBER || Radius2 < KINDA_SMALL_NUMBER || TravelTime <= 0.0f) return false;
+
+	// Angle swept by the transfer, the long way if the short one would be retrograde.
+	const double CosAngle = FMath::Clamp((double)(R1 | R2) / (Radius1 * Radius2), -1.0, 1.0);
+	double Angle = acos(CosAngle);
+	if (((R1 ^ R2) | Normal) < 0.0f)
+	{
+		Angle = (2.0 * DOUBLE_PI) - Angle;
+	}
+
+	// Both ends aligned with the focus leave the plane of the transfer undefined.
+	const double A = sin(Angle) * sqrt((Radius1 * Radius2) / FMath::Max(1.0 - CosAngle, 1e-12));
+	if (FMath::Abs(A) < 1e-6) return false;
+
+	auto GetY = [Radius1, Radius2, A](const double Z)
+	{
+		double C;
+		double S;
+		KeplerTransfer::GetStumpff(Z, C, S);
+		return Radius1 + Radius2 + ((A * ((Z * S) - 1.0)) / sqrt(C));
+	};
+	auto GetTimeOfFlight = [Mu, A, &GetY](const double Z)
+	{
+		double C;
+		double S;
+		KeplerTransfer::GetStumpff(Z, C, S);
+		const double Y = GetY(Z);
+		const double X = sqrt(Y / C);
+		return (((X * X * X) * S) + (A * sqrt(Y))) / sqrt(Mu);
+	};
+
+	// Within one revolution, the time of flight grows with Z up to 4 * PI^2. Short transfers are hyperbolic, with Z below 0.
+	double High = 4.0 * DOUBLE_PI * DOUBLE_PI * (1.0 - 1e-9);
+	double Low = -4.0 * DOUBLE_PI * DOUBLE_PI;
+	for (int32 i = 0; i < 32 && GetY(Low) > 0.0 && GetTimeOfFlight(Low) > TravelTime; i++)
+	{
+		Low *= 2.0;
+	}
+
+	// Y must stay positive. Where it doesn't, move the lower bound up to where it does.
+	if (GetY(Low) <= 0.0)
+	{
+		double Outside = Low;
+		double Inside = High;
+		for (int32 i = 0; i < KeplerTransfer::NumLambertIterations; i++)
+		{
+			const double Middle = 0.5 * (Outside + Inside);
+			if (GetY(Middle) > 0.0)
+			{
+				Inside = Middle;
+			}
+			else
+			{
+				Outside = Middle;
+			}
+		}
+		Low = Inside;
+	}
+
+	if (GetTimeOfFlight(Low) > TravelTime || GetTimeOfFlight(High) < TravelTime) return false;
+
+	for (int32 i = 0; i < KeplerTransfer::NumLambertIterations; i++)
+	{
+		const double Middle = 0.5 * (Low + High);
+		if (GetTimeOfFlight(Middle) < TravelTime)
+		{
+			Low = Middle;
+		}
+		else
+		{
+			High = Middle;
+		}
+	}
+
+	// Lagrange coefficients of the solution.
+	const double Y = GetY(0.5 * (Low + High));
+	const double F = 1.0 - (Y / Radius1);
+	const double G = A * sqrt(Y / Mu);
+	const double GDot = 1.0 - (Y / Radius2);
+	if (FMath::Abs(G) < 1e-12) return false;
+
+	OutV1 = (R2 - (R1 * F)) / G;
+	OutV2 = ((R2 * GDot) - R1) / G;
+	return true;
+}
+
+UKeplerTransferSearchAction* UKeplerTransferSearchAction::FindTransferWindow(UObject* WorldContextObject, const FKeplerOrbitConfig& Origin, const FKeplerOrbitConfig& Target, const FKeplerTransferSettings& Settings)
+{
+	UKeplerTransferSearchAction* Action = NewObject<UKeplerTransferSearchAction>();
+	Action->Origin = Origin;
+	Action->Target = Target;
+	Action->Settings = Settings;
+	Action->RegisterWithGameInstance(WorldContextObject);
+	return Action;
+}
+
+void UKeplerTransferSearchAction::Activate()
+{
+	// The action stays registered with the game instance until it is ready to destroy, so the weak pointer only guards shutdown.
+	TWeakObjectPtr<UKeplerTransferSearchAction> WeakThis(this);
+	Async(EAsyncExecution::ThreadPool, [WeakThis, Origin = Origin, Target = Target, Settings = Settings]()
+	{
+		FKeplerTransferGrid Grid;
+		FKeplerTransferSearch::Search(Origin, Target, Settings, Grid);
+
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, Grid = MoveTemp(Grid)]()
+		{
+			UKeplerTransferSearchAction* Action = WeakThis.Get();
+			if (!Action) return;
+
+			Action->OnCompleted.Broadcast(Grid);
+			Action->SetReadyToDestroy();
+		});
+	});
+}
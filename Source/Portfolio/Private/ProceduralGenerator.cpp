@@ -4,6 +4,8 @@
 #include "ProceduralGenerator.h"
 #include "DrawDebugHelpers.h"
 
+DEFINE_LOG_CATEGORY(LogProceduralGenerator);
+
 void FQuad2D::DebugDraw(UWorld* InWorld, FColor DrawColor, float Height) const
 {
 	DrawDebugLine(InWorld, FVector(A, Height), FVector(B, Height), DrawColor, true, -1.0f, 0, 5.0f);
@@ -21,6 +23,58 @@ bool FQuad2D::Equals(const FQuad2D& Other) const
 	return DoesAMatch && DoesBMatch && DoesCMatch && DoesDMatch;
 }
 
+bool FQuad2D::Contains(const FVector2D& Point) const
+{
+	const float CrossA = GetAB() ^ (Point - A);
+	const float CrossB = GetBC() ^ (Point - B);
+	const float CrossC = GetCD() ^ (Point - C);
+	const float CrossD = GetDA() ^ (Point - D);
+	const bool bIsLeftOfAll = CrossA >= 0.0f && CrossB >= 0.0f && CrossC >= 0.0f && CrossD >= 0.0f;
+	const bool bIsRightOfAll = CrossA <= 0.0f && CrossB <= 0.0f && CrossC <= 0.0f && CrossD <= 0.0f;
+	return bIsLeftOfAll || bIsRightOfAll;
+}
+
+float FQuad2D::GetDistanceSquared(const FVector2D& Point) const
+{
+	if (Contains(Point)) return 0.0f;
+
+	const float DistanceAB = FVector2D::DistSquared(Point, FMath::ClosestPointOnSegment2D(Point, A, B));
+	const float DistanceBC = FVector2D::DistSquared(Point, FMath::ClosestPointOnSegment2D(Point, B, C));
+	const float DistanceCD = FVector2D::DistSquared(Point, FMath::ClosestPointOnSegment2D(Point, C, D));
+	const float DistanceDA = FVector2D::DistSquared(Point, FMath::ClosestPointOnSegment2D(Point, D, A));
+	return FMath::Min(FMath::Min(DistanceAB, DistanceBC), FMath::Min(DistanceCD, DistanceDA));
+}
+
+void FQuad2D::Divide(const float Fraction, const bool bUseADAxis, FQuad2D& OutFirst, FQuad2D& OutSecond) const
+{
+	if (bUseADAxis)
+	{
+		OutFirst = FQuad2D(
+			A,
+			B,
+			B + (GetBC() * Fraction),
+			A - (GetDA() * Fraction));
+		OutSecond = FQuad2D(
+			A - (GetDA() * Fraction),
+			B + (GetBC() * Fraction),
+			C,
+			D);
+	}
+	else
+	{
+		OutFirst = FQuad2D(
+			A,
+			A + (GetAB() * Fraction),
+			D - (GetCD() * Fraction),
+			D);
+		OutSecond = FQuad2D(
+			A + (GetAB() * Fraction),
+			B,
+			C,
+			D - (GetCD() * Fraction));
+	}
+}
+
 void UGeneratorLibrary::DrawQuad2D(UObject* WorldContext, FQuad2D QuadToDraw, FLinearColor LineColor, float Height)
 {
 	if (WorldContext)
@@ -29,36 +83,19 @@ void UGeneratorLibrary::DrawQuad2D(UObject* WorldContext, FQuad2D QuadToDraw, FL
 	}
 }
 
+void UGeneratorLibrary::ClearDrawnQuad2Ds(UObject* WorldContext)
+{
+	if (WorldContext)
+	{
+		FlushPersistentDebugLines(WorldContext->GetWorld());
+	}
+}
+
 void UGeneratorLibrary::DivideQuad2D(const FQuad2D& InQuad, const float Fraction, const bool bUseADAxis, TArray<FQuad2D>& OutResult)
 {
 	FQuad2D NewQuad1;
 	FQuad2D NewQuad2;
-	if (bUseADAxis)
-	{
-		NewQuad1 = FQuad2D(
-			InQuad.A,
-			InQuad.B,
-			InQuad.B + (InQuad.GetBC() * Fraction),
-			InQuad.A - (InQuad.GetDA() * Fraction));
-		NewQuad2 = FQuad2D(
-			InQuad.A - (InQuad.GetDA() * Fraction),
-			InQuad.B + (InQuad.GetBC() * Fraction),
-			InQuad.C,
-			InQuad.D);
-	}
-	else
-	{
-		NewQuad1 = FQuad2D(
-			InQuad.A,
-			InQuad.A + (InQuad.GetAB() * Fraction),
-			InQuad.D - (InQuad.GetCD() * Fraction),
-			InQuad.D);
-		NewQuad2 = FQuad2D(
-			InQuad.A + (InQuad.GetAB() * Fraction),
-			InQuad.B,
-			InQuad.C,
-			InQuad.D - (InQuad.GetCD() * Fraction));
-	}
+	InQuad.Divide(Fraction, bUseADAxis, NewQuad1, NewQuad2);
 	OutResult.Add(NewQuad1);
 	OutResult.Add(NewQuad2);
 }
@@ -113,27 +150,22 @@ FQuad2D UGeneratorLibrary::ResizeQuad2D(const FQuad2D& InQuad, const float Delta
 
 	// Scale the VectorQuad by moving each vector towards or
 	// away from their respective adjacent vectors.
+	// Each edge is shared by two vectors, so it is normalized once.
+
+	const FVector2D NormalAB = InQuad.GetAB().GetSafeNormal(1e-6f);
+	const FVector2D NormalBC = InQuad.GetBC().GetSafeNormal(1e-6f);
+	const FVector2D NormalCD = InQuad.GetCD().GetSafeNormal(1e-6f);
+	const FVector2D NormalDA = InQuad.GetDA().GetSafeNormal(1e-6f);
 
-	ResizedQuad.A += (InQuad.GetDA().GetSafeNormal(1e-6f) * Delta
-		+ InQuad.GetAB().GetSafeNormal(1e-6f) * Delta * -1.0f);
-	ResizedQuad.B += (InQuad.GetAB().GetSafeNormal(1e-6f) * Delta
-		+ InQuad.GetBC().GetSafeNormal(1e-6f) * Delta * -1.0f);
-	ResizedQuad.C += (InQuad.GetBC().GetSafeNormal(1e-6f) * Delta
-		+ InQuad.GetCD().GetSafeNormal(1e-6f) * Delta * -1.0f);
-	ResizedQuad.D += (InQuad.GetCD().GetSafeNormal(1e-6f) * Delta
-		+ InQuad.GetDA().GetSafeNormal(1e-6f) * Delta * -1.0f);
+	ResizedQuad.A += (NormalDA - NormalAB) * Delta;
+	ResizedQuad.B += (NormalAB - NormalBC) * Delta;
+	ResizedQuad.C += (NormalBC - NormalCD) * Delta;
+	ResizedQuad.D += (NormalCD - NormalDA) * Delta;
 
 	return ResizedQuad;
 }
 
 void UGeneratorLibrary::ResizeQuad2DRef(FQuad2D& InOutQuad, const float Delta)
 {
-	InOutQuad.A += (InOutQuad.GetDA().GetSafeNormal(1e-6f) * Delta
-		+ InOutQuad.GetAB().GetSafeNormal(1e-6f) * Delta * -1.0f);
-	InOutQuad.B += (InOutQuad.GetAB().GetSafeNormal(1e-6f) * Delta
-		+ InOutQuad.GetBC().GetSafeNormal(1e-6f) * Delta * -1.0f);
-	InOutQuad.C += (InOutQuad.GetBC().GetSafeNormal(1e-6f) * Delta
-		+ InOutQuad.GetCD().GetSafeNormal(1e-6f) * Delta * -1.0f);
-	InOutQuad.D += (InOutQuad.GetCD().GetSafeNormal(1e-6f) * Delta
-		+ InOutQuad.GetDA().GetSafeNormal(1e-6f) * Delta * -1.0f);
+	InOutQuad = ResizeQuad2D(InOutQuad, Delta);
 }
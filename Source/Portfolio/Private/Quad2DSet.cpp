@@ -0,0 +1,299 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "Quad2DSet.h"
+
+namespace Quad2DSet
+{
+	/** Edges with a squared length under this have no direction, as in FVector2D::GetSafeNormal. */
+	static const float NormalTolerance = 1e-6f;
+
+	/**
+	 * Resize four quads. Edge i goes from corner i to the next, and each corner moves along its
+	 * incoming edge and against its outgoing one.
+	 */
+	static void ResizePacket(const VectorRegister InX[4], const VectorRegister InY[4], const VectorRegister Delta, VectorRegister OutX[4], VectorRegister OutY[4])
+	{
+		const VectorRegister VTolerance = VectorSetFloat1(NormalTolerance);
+		VectorRegister NormalX[4];
+		VectorRegister NormalY[4];
+		for (int32 Edge = 0; Edge < 4; Edge++)
+		{
+			const VectorRegister EdgeX = VectorSubtract(InX[(Edge + 1) % 4], InX[Edge]);
+			const VectorRegister EdgeY = VectorSubtract(InY[(Edge + 1) % 4], InY[Edge]);
+			const VectorRegister SizeSquared = VectorMultiplyAdd(EdgeX, EdgeX, VectorMultiply(EdgeY, EdgeY));
+			const VectorRegister InvSize = VectorSelect(VectorCompareGT(SizeSquared, VTolerance), VectorReciprocalSqrtAccurate(VectorMax(SizeSquared, VTolerance)), VectorZero());
+			NormalX[Edge] = VectorMultiply(EdgeX, InvSize);
+			NormalY[Edge] = VectorMultiply(EdgeY, InvSize);
+		}
+		for (int32 Corner = 0; Corner < 4; Corner++)
+		{
+			const int32 Incoming = (Corner + 3) % 4;
+			OutX[Corner] = VectorMultiplyAdd(VectorSubtract(NormalX[Incoming], NormalX[Corner]), Delta, InX[Corner]);
+			OutY[Corner] = VectorMultiplyAdd(VectorSubtract(NormalY[Incoming], NormalY[Corner]), Delta, InY[Corner]);
+		}
+	}
+
+	/** Divide four quads, with the same corner layout as FQuad2D::Divide. */
+	static void DividePacket(const VectorRegister InX[4], const VectorRegister InY[4], const VectorRegister Fraction, const bool bUseADAxis, VectorRegister FirstX[4], VectorRegister FirstY[4], VectorRegister SecondX[4], VectorRegister SecondY[4])
+	{
+		// The cut runs from P to Q. Across AD, P is on DA and Q on BC. Across AB, P is on AB and Q on CD.
+		const int32 PStart = 0;
+		const int32 PEnd = bUseADAxis ? 3 : 1;
+		const int32 QStart = bUseADAxis ? 1 : 3;
+		const int32 QEnd = 2;
+		const VectorRegister PX = VectorMultiplyAdd(VectorSubtract(InX[PEnd], InX[PStart]), Fraction, InX[PStart]);
+		const VectorRegister PY = VectorMultiplyAdd(VectorSubtract(InY[PEnd], InY[PStart]), Fraction, InY[PStart]);
+		const VectorRegister QX = VectorMultiplyAdd(VectorSubtract(InX[QEnd], InX[QStart]), Fraction, InX[QStart]);
+		const VectorRegister QY = VectorMultiplyAdd(VectorSubtract(InY[QEnd], InY[QStart]), Fraction, InY[QStart]);
+		for (int32 Corner = 0; Corner < 4; Corner++)
+		{
+			FirstX[Corner] = InX[Corner];
+			FirstY[Corner] = InY[Corner];
+			SecondX[Corner] = InX[Corner];
+			SecondY[Corner] = InY[Corner];
+		}
+		FirstX[PEnd] = PX;
+		FirstY[PEnd] = PY;
+		FirstX[QEnd] = QX;
+		FirstY[QEnd] = QY;
+		SecondX[PStart] = PX;
+		SecondY[PStart] = PY;
+		SecondX[QStart] = QX;
+		SecondY[QStart] = QY;
+	}
+
+	/** Transpose up to four quads into corner registers. Missing quads are degenerate. */
+	static void LoadQuads(TArrayView<const FQuad2D> Quads, const int32 Start, VectorRegister OutX[4], VectorRegister OutY[4])
+	{
+		MS_ALIGN(16) float Lanes[8][4] GCC_ALIGN(16);
+		const int32 NumInPacket = FMath::Min(4, Quads.Num() - Start);
+		for (int32 Lane = 0; Lane < 4; Lane++)
+		{
+			const FQuad2D Quad = (Lane < NumInPacket) ? Quads[Start + Lane] : FQuad2D(FVector2D::ZeroVector, FVector2D::ZeroVector, FVector2D::ZeroVector, FVector2D::ZeroVector);
+			const FVector2D* Corners[4] = { &Quad.A, &Quad.B, &Quad.C, &Quad.D };
+			for (int32 Corner = 0; Corner < 4; Corner++)
+			{
+				Lanes[Corner][Lane] = Corners[Corner]->X;
+				Lanes[Corner + 4][Lane] = Corners[Corner]->Y;
+			}
+		}
+		for (int32 Corner = 0; Corner < 4; Corner++)
+		{
+			OutX[Corner] = VectorLoadAligned(Lanes[Corner]);
+			OutY[Corner] = VectorLoadAligned(Lanes[Corner + 4]);
+		}
+	}
+
+	/** Transpose corner registers back into up to four quads. */
+	static void StoreQuads(const VectorRegister InX[4], const VectorRegister InY[4], const int32 Start, TArrayView<FQuad2D> Quads)
+	{
+		MS_ALIGN(16) float Lanes[8][4] GCC_ALIGN(16);
+		for (int32 Corner = 0; Corner < 4; Corner++)
+		{
+			VectorStoreAligned(InX[Corner], Lanes[Corner]);
+			VectorStoreAligned(InY[Corner], Lanes[Corner + 4]);
+		}
+		const int32 NumInPacket = FMath::Min(4, Quads.Num() - Start);
+		for (int32 Lane = 0; Lane < NumInPacket; Lane++)
+		{
+			Quads[Start + Lane] = FQuad2D(
+				FVector2D(Lanes[0][Lane], Lanes[4][Lane]),
+				FVector2D(Lanes[1][Lane], Lanes[5][Lane]),
+				FVector2D(Lanes[2][Lane], Lanes[6][Lane]),
+				FVector2D(Lanes[3][Lane], Lanes[7][Lane]));
+		}
+	}
+}
+
+int32 FQuad2DSet::Add(const FQuad2D& Quad)
+{
+	const int32 Index = NumQuads;
+	SetNum(NumQuads + 1);
+	Set(Index, Quad);
+	return Index;
+}
+
+void FQuad2DSet::Set(const int32 Index, const FQuad2D& Quad)
+{
+	check(Index >= 0 && Index < NumQuads);
+
+	X[0][Index] = Quad.A.X;
+	Y[0][Index] = Quad.A.Y;
+	X[1][Index] = Quad.B.X;
+	Y[1][Index] = Quad.B.Y;
+	X[2][Index] = Quad.C.X;
+	Y[2][Index] = Quad.C.Y;
+	X[3][Index] = Quad.D.X;
+	Y[3][Index] = Quad.D.Y;
+}
+
+FQuad2D FQuad2DSet::Get(const int32 Index) const
+{
+	check(Index >= 0 && Index < NumQuads);
+
+	return FQuad2D(
+		FVector2D(X[0][Index], Y[0][Index]),
+		FVector2D(X[1][Index], Y[1][Index]),
+		FVector2D(X[2][Index], Y[2][Index]),
+		FVector2D(X[3][Index], Y[3][Index]));
+}
+
+void FQuad2DSet::Assign(TArrayView<const FQuad2D> Quads)
+{
+	Reset();
+	SetNum(Quads.Num());
+	for (int32 i = 0; i < Quads.Num(); i++)
+	{
+		Set(i, Quads[i]);
+	}
+}
+
+void FQuad2DSet::CopyTo(TArrayView<FQuad2D> OutQuads) const
+{
+	check(OutQuads.Num() >= NumQuads);
+
+	for (int32 i = 0; i < NumQuads; i++)
+	{
+		OutQuads[i] = Get(i);
+	}
+}
+
+void FQuad2DSet::SetNum(const int32 Num)
+{
+	const int32 OldPaddedNum = X[0].Num();
+	NumQuads = Num;
+	const int32 PaddedNum = GetPaddedNum();
+	for (int32 Corner = 0; Corner < 4; Corner++)
+	{
+		X[Corner].SetNumZeroed(PaddedNum);
+		Y[Corner].SetNumZeroed(PaddedNum);
+
+		// Lanes past the end may hold old quads, so clear them back to the origin.
+		for (int32 i = Num; i < FMath::Min(OldPaddedNum, PaddedNum); i++)
+		{
+			X[Corner][i] = 0.0f;
+			Y[Corner][i] = 0.0f;
+		}
+	}
+}
+
+void FQuad2DSet::Reset()
+{
+	NumQuads = 0;
+	for (int32 Corner = 0; Corner < 4; Corner++)
+	{
+		X[Corner].Reset();
+		Y[Corner].Reset();
+	}
+}
+
+void FQuad2DSet::Resize(const float Delta)
+{
+	const VectorRegister VDelta = VectorSetFloat1(Delta);
+	VectorRegister InX[4];
+	VectorRegister InY[4];
+	VectorRegister OutX[4];
+	VectorRegister OutY[4];
+
+	const int32 PaddedNum = GetPaddedNum();
+	for (int32 i = 0; i < PaddedNum; i += 4)
+	{
+		for (int32 Corner = 0; Corner < 4; Corner++)
+		{
+			InX[Corner] = VectorLoadAligned(&X[Corner][i]);
+			InY[Corner] = VectorLoadAligned(&Y[Corner][i]);
+		}
+		Quad2DSet::ResizePacket(InX, InY, VDelta, OutX, OutY);
+		for (int32 Corner = 0; Corner < 4; Corner++)
+		{
+			VectorStoreAligned(OutX[Corner], &X[Corner][i]);
+			VectorStoreAligned(OutY[Corner], &Y[Corner][i]);
+		}
+	}
+}
+
+void FQuad2DSet::Divide(TArrayView<const float> Fractions, const bool bUseADAxis, FQuad2DSet& OutFirst, FQuad2DSet& OutSecond) const
+{
+	check(Fractions.Num() >= NumQuads);
+	check(&OutFirst != this && &OutSecond != this);
+
+	OutFirst.SetNum(NumQuads);
+	OutSecond.SetNum(NumQuads);
+
+	MS_ALIGN(16) float PacketFractions[4] GCC_ALIGN(16);
+	VectorRegister InX[4];
+	VectorRegister InY[4];
+	VectorRegister FirstX[4];
+	VectorRegister FirstY[4];
+	VectorRegister SecondX[4];
+	VectorRegister SecondY[4];
+
+	const int32 PaddedNum = GetPaddedNum();
+	for (int32 i = 0; i < PaddedNum; i += 4)
+	{
+		for (int32 Lane = 0; Lane < 4; Lane++)
+		{
+			PacketFractions[Lane] = (i + Lane < NumQuads) ? Fractions[i + Lane] : 0.0f;
+		}
+		for (int32 Corner = 0; Corner < 4; Corner++)
+		{
+			InX[Corner] = VectorLoadAligned(&X[Corner][i]);
+			InY[Corner] = VectorLoadAligned(&Y[Corner][i]);
+		}
+		Quad2DSet::DividePacket(InX, InY, VectorLoadAligned(PacketFractions), bUseADAxis, FirstX, FirstY, SecondX, SecondY);
+		for (int32 Corner = 0; Corner < 4; Corner++)
+		{
+			VectorStoreAligned(FirstX[Corner], &OutFirst.X[Corner][i]);
+			VectorStoreAligned(FirstY[Corner], &OutFirst.Y[Corner][i]);
+			VectorStoreAligned(SecondX[Corner], &OutSecond.X[Corner][i]);
+			VectorStoreAligned(SecondY[Corner], &OutSecond.Y[Corner][i]);
+		}
+	}
+}
+
+void FQuad2DSet::ResizeQuads(TArrayView<const FQuad2D> InQuads, const float Delta, TArrayView<FQuad2D> OutQuads)
+{
+	check(OutQuads.Num() >= InQuads.Num());
+
+	const VectorRegister VDelta = VectorSetFloat1(Delta);
+	VectorRegister InX[4];
+	VectorRegister InY[4];
+	VectorRegister OutX[4];
+	VectorRegister OutY[4];
+	const TArrayView<FQuad2D> Results(OutQuads.GetData(), InQuads.Num());
+	for (int32 i = 0; i < InQuads.Num(); i += 4)
+	{
+		// A whole packet is read before it is written, so the views may alias.
+		Quad2DSet::LoadQuads(InQuads, i, InX, InY);
+		Quad2DSet::ResizePacket(InX, InY, VDelta, OutX, OutY);
+		Quad2DSet::StoreQuads(OutX, OutY, i, Results);
+	}
+}
+
+void FQuad2DSet::DivideQuads(TArrayView<const FQuad2D> InQuads, TArrayView<const float> Fractions, const bool bUseADAxis, TArrayView<FQuad2D> OutFirst, TArrayView<FQuad2D> OutSecond)
+{
+	check(Fractions.Num() >= InQuads.Num());
+	check(OutFirst.Num() >= InQuads.Num() && OutSecond.Num() >= InQuads.Num());
+
+	MS_ALIGN(16) float PacketFractions[4] GCC_ALIGN(16);
+	VectorRegister InX[4];
+	VectorRegister InY[4];
+	VectorRegister FirstX[4];
+	VectorRegister FirstY[4];
+	VectorRegister SecondX[4];
+	VectorRegister SecondY[4];
+	const TArrayView<FQuad2D> FirstResults(OutFirst.GetData(), InQuads.Num());
+	const TArrayView<FQuad2D> SecondResults(OutSecond.GetData(), InQuads.Num());
+	for (int32 i = 0; i < InQuads.Num(); i += 4)
+	{
+		for (int32 Lane = 0; Lane < 4; Lane++)
+		{
+			PacketFractions[Lane] = (i + Lane < InQuads.Num()) ? Fractions[i + Lane] : 0.0f;
+		}
+		Quad2DSet::LoadQuads(InQuads, i, InX, InY);
+		Quad2DSet::DividePacket(InX, InY, VectorLoadAligned(PacketFractions), bUseADAxis, FirstX, FirstY, SecondX, SecondY);
+		Quad2DSet::StoreQuads(FirstX, FirstY, i, FirstResults);
+		Quad2DSet::StoreQuads(SecondX, SecondY, i, SecondResults);
+	}
+}
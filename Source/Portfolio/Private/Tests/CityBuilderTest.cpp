@@ -0,0 +1,169 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "Misc/AutomationTest.h"
+#include "CityBuilder.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace CityBuilderTest
+{
+	static const int32 NumLots = 10;
+	static const int32 NumRoads = 7;
+
+	/** Four walls and a roof. */
+	static const int32 FacesPerLot = 5;
+
+	static const int32 FacesPerRoad = 1;
+
+	/** Not a multiple of the spacing, so rounding doesn't change the number of props along a side. */
+	static const float RoadLength = 5500.0f;
+	static const float PropSpacing = 1000.0f;
+
+	/** Rectangular lots in a row, with every third one wound the other way. */
+	static void MakeLots(TArray<FQuad2D>& OutLots)
+	{
+		for (int32 i = 0; i < NumLots; i++)
+		{
+			const FVector2D Min(i * 1500.0f, 0.0f);
+			const FVector2D Max = Min + FVector2D(1000.0f, 1000.0f + 100.0f * i);
+			const FVector2D A = Min;
+			const FVector2D B(Max.X, Min.Y);
+			const FVector2D C = Max;
+			const FVector2D D(Min.X, Max.Y);
+			OutLots.Add((i % 3 == 0) ? FQuad2D(A, D, C, B) : FQuad2D(A, B, C, D));
+		}
+	}
+
+	/** Roads with their centerline from the middle of DA to the middle of BC, at several angles. */
+	static void MakeRoads(TArray<FQuad2D>& OutRoads)
+	{
+		for (int32 i = 0; i < NumRoads; i++)
+		{
+			const float Angle = (PI * i) / NumRoads;
+			const FVector2D Along(FMath::Cos(Angle), FMath::Sin(Angle));
+			const FVector2D Across(-Along.Y, Along.X);
+			const FVector2D Start(0.0f, -5000.0f * (i + 1));
+			const FVector2D End = Start + (Along * RoadLength);
+			OutRoads.Add(FQuad2D(Start - (Across * 400.0f), End - (Across * 400.0f), End + (Across * 400.0f), Start + (Across * 400.0f)));
+		}
+	}
+
+	static FCityBuilderSettings MakeSettings()
+	{
+		FCityBuilderSettings Settings;
+		Settings.MaxQuadsPerSection = 4;
+
+		FCityPropSettings& RoadProp = Settings.Props.AddDefaulted_GetRef();
+		RoadProp.Placement = ECityPropPlacement::AlongRoads;
+		RoadProp.Spacing = PropSpacing;
+
+		FCityPropSettings& RoofProp = Settings.Props.AddDefaulted_GetRef();
+		RoofProp.Placement = ECityPropPlacement::OnRoofs;
+		RoofProp.Chance = 1.0f;
+		return Settings;
+	}
+
+	/** Faces are quads of four vertices and two triangles. */
+	static int32 GetNumFaces(const FCityMeshSection& Section)
+	{
+		return Section.Vertices.Num() / 4;
+	}
+
+	static bool IsSameGeometry(const FCityDistrictGeometry& A, const FCityDistrictGeometry& B)
+	{
+		if (A.Sections.Num() != B.Sections.Num() || A.PropTransforms.Num() != B.PropTransforms.Num()) return false;
+
+		for (int32 SectionIndex = 0; SectionIndex < A.Sections.Num(); SectionIndex++)
+		{
+			const FCityMeshSection& SectionA = A.Sections[SectionIndex];
+			const FCityMeshSection& SectionB = B.Sections[SectionIndex];
+			if (SectionA.bIsRoad != SectionB.bIsRoad || SectionA.Vertices != SectionB.Vertices || SectionA.Triangles != SectionB.Triangles
+				|| SectionA.Normals != SectionB.Normals || SectionA.UVs != SectionB.UVs) return false;
+		}
+		for (int32 PropIndex = 0; PropIndex < A.PropTransforms.Num(); PropIndex++)
+		{
+			const TArray<FTransform>& TransformsA = A.PropTransforms[PropIndex];
+			const TArray<FTransform>& TransformsB = B.PropTransforms[PropIndex];
+			if (TransformsA.Num() != TransformsB.Num()) return false;
+
+			for (int32 i = 0; i < TransformsA.Num(); i++)
+			{
+				if (!TransformsA[i].Equals(TransformsB[i], 0.0f)) return false;
+			}
+		}
+		return true;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCityBuilderGeometryTest, "Portfolio.City.Builder.Geometry", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FCityBuilderGeometryTest::RunTest(const FString& Parameters)
+{
+	TArray<FQuad2D> Lots;
+	TArray<FQuad2D> Roads;
+	CityBuilderTest::MakeLots(Lots);
+	CityBuilderTest::MakeRoads(Roads);
+	const FCityBuilderSettings Settings = CityBuilderTest::MakeSettings();
+
+	FCityDistrictGeometry Geometry;
+	Geometry.Build(Lots, Roads, Settings, 1234);
+
+	// Lots come first, then roads, each split into sections of at most MaxQuadsPerSection quads.
+	const int32 NumLotSections = FMath::DivideAndRoundUp(CityBuilderTest::NumLots, Settings.MaxQuadsPerSection);
+	const int32 NumRoadSections = FMath::DivideAndRoundUp(CityBuilderTest::NumRoads, Settings.MaxQuadsPerSection);
+	if (!TestEqual(TEXT("Sections"), Geometry.Sections.Num(), NumLotSections + NumRoadSections)) return false;
+
+	int32 NumLotFaces = 0;
+	int32 NumRoadFaces = 0;
+	int32 NumMisplacedSections = 0;
+	int32 NumBadSections = 0;
+	int32 NumBackfacing = 0;
+	for (int32 SectionIndex = 0; SectionIndex < Geometry.Sections.Num(); SectionIndex++)
+	{
+		const FCityMeshSection& Section = Geometry.Sections[SectionIndex];
+		const int32 NumFaces = CityBuilderTest::GetNumFaces(Section);
+		NumMisplacedSections += (Section.bIsRoad == (SectionIndex >= NumLotSections)) ? 0 : 1;
+		NumRoadFaces += Section.bIsRoad ? NumFaces : 0;
+		NumLotFaces += Section.bIsRoad ? 0 : NumFaces;
+
+		const bool bIsComplete = Section.Vertices.Num() == NumFaces * 4 && Section.Triangles.Num() == NumFaces * 6
+			&& Section.Normals.Num() == Section.Vertices.Num() && Section.UVs.Num() == Section.Vertices.Num();
+		NumBadSections += bIsComplete ? 0 : 1;
+
+		// The front of each triangle is the side its normal points to, in the convention of the procedural mesh library.
+		for (int32 Index = 0; Index + 2 < Section.Triangles.Num(); Index += 3)
+		{
+			const FVector& V0 = Section.Vertices[Section.Triangles[Index]];
+			const FVector& V1 = Section.Vertices[Section.Triangles[Index + 1]];
+			const FVector& V2 = Section.Vertices[Section.Triangles[Index + 2]];
+			const FVector& Normal = Section.Normals[Section.Triangles[Index]];
+			NumBackfacing += ((((V2 - V0) ^ (V1 - V0)) | Normal) > 0.0f) ? 0 : 1;
+		}
+	}
+	TestEqual(TEXT("Sections in lot then road order"), NumMisplacedSections, 0);
+	TestEqual(TEXT("Faces per lot"), NumLotFaces, CityBuilderTest::NumLots * CityBuilderTest::FacesPerLot);
+	TestEqual(TEXT("Faces per road"), NumRoadFaces, CityBuilderTest::NumRoads * CityBuilderTest::FacesPerRoad);
+	TestEqual(TEXT("Sections with mismatched buffers"), NumBadSections, 0);
+	TestEqual(TEXT("Triangles facing away from their normal"), NumBackfacing, 0);
+
+	// Both sides of each road, and one on each roof.
+	const int32 PropsPerSide = FMath::FloorToInt(CityBuilderTest::RoadLength / CityBuilderTest::PropSpacing);
+	if (TestEqual(TEXT("Prop lists"), Geometry.PropTransforms.Num(), Settings.Props.Num()))
+	{
+		TestEqual(TEXT("Road props"), Geometry.PropTransforms[0].Num(), CityBuilderTest::NumRoads * 2 * PropsPerSide);
+		TestEqual(TEXT("Roof props"), Geometry.PropTransforms[1].Num(), CityBuilderTest::NumLots);
+	}
+
+	// The same seed gives the same city, and another seed gives other buildings.
+	FCityDistrictGeometry Same;
+	Same.Build(Lots, Roads, Settings, 1234);
+	TestTrue(TEXT("Same seed gives the same geometry"), CityBuilderTest::IsSameGeometry(Geometry, Same));
+
+	FCityDistrictGeometry Other;
+	Other.Build(Lots, Roads, Settings, 4321);
+	TestFalse(TEXT("Another seed gives other geometry"), CityBuilderTest::IsSameGeometry(Geometry, Other));
+	return true;
+}
+
+#endif
@@ -0,0 +1,95 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "Misc/AutomationTest.h"
+#include "Math/RandomStream.h"
+#include "CityPathfinder.h"
+#include "CityPlanGenerator.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace CityPathfinderTest
+{
+	static const int32 NumQueries = 500;
+
+	static const float CitySize = 100000.0f;
+
+	/** True if the path goes from start to goal through adjacent nodes, with a length and steps that add up to the reference. */
+	static bool IsPathValid(const FCityRoadGraph& Graph, const FCityPathQuery& Query, TArrayView<const int32> Path, const float Length, const float ReferenceLength)
+	{
+		if (Path.Num() == 0 || Path[0] != Query.Start || Path.Last() != Query.Goal) return false;
+
+		float WalkedLength = 0.0f;
+		for (int32 Step = 1; Step < Path.Num(); Step++)
+		{
+			if (!Graph.GetNeighbors(Path[Step - 1]).Contains(Path[Step])) return false;
+
+			WalkedLength += FVector2D::Distance(Graph.NodeLocations[Path[Step - 1]], Graph.NodeLocations[Path[Step]]);
+		}
+
+		const float Tolerance = 1e-3f * FMath::Max(ReferenceLength, 1.0f);
+		return FMath::Abs(Length - ReferenceLength) <= Tolerance && FMath::Abs(WalkedLength - ReferenceLength) <= Tolerance;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCityPathfinderReferenceTest, "Portfolio.City.Pathfinder.Reference", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FCityPathfinderReferenceTest::RunTest(const FString& Parameters)
+{
+	const float Size = CityPathfinderTest::CitySize;
+	FCityPlan Plan;
+	UCityPlanGenerator::GeneratePlan(FQuad2D(FVector2D(0.0f, 0.0f), FVector2D(Size, 0.0f), FVector2D(Size, Size), FVector2D(0.0f, Size)), FCityPlanSettings(), Plan);
+	const FCityRoadGraph& Graph = Plan.RoadGraph;
+	if (Graph.GetNumNodes() < 2)
+	{
+		AddError(FString::Printf(TEXT("City of %.0f has no roads to path on."), Size));
+		return false;
+	}
+
+	FCityPathfinder Pathfinder;
+	Pathfinder.Build(Graph);
+	TestTrue(TEXT("Pathfinder is built"), Pathfinder.IsBuilt());
+
+	FRandomStream Random(0x50415448);
+	TArray<FCityPathQuery> Queries;
+	Queries.SetNumUninitialized(CityPathfinderTest::NumQueries);
+	for (FCityPathQuery& Query : Queries)
+	{
+		Query = FCityPathQuery(Random.RandHelper(Graph.GetNumNodes()), Random.RandHelper(Graph.GetNumNodes()));
+	}
+
+	FCityPathBatch Batch;
+	Pathfinder.FindPaths(Queries, Batch);
+	TestEqual(TEXT("Batch results"), Batch.Results.Num(), Queries.Num());
+
+	// Paths of the batch and of single queries must be as short as Dijkstra's, and walk along edges that add up to their length.
+	FCityPathScratch Scratch;
+	TArray<int32> Path;
+	int32 NumBatchMismatches = 0;
+	int32 NumSingleMismatches = 0;
+	for (int32 i = 0; i < Queries.Num() && i < Batch.Results.Num(); i++)
+	{
+		const FCityPathQuery& Query = Queries[i];
+		const float ReferenceLength = FCityPathfinder::FindPathLengthReference(Graph, Query.Start, Query.Goal);
+		const bool bIsReachable = ReferenceLength < MAX_FLT;
+
+		const FCityPathResult& Result = Batch.Results[i];
+		if (Result.IsFound() != bIsReachable || (bIsReachable && !CityPathfinderTest::IsPathValid(Graph, Query, Batch.GetPath(i), Result.Length, ReferenceLength)))
+		{
+			NumBatchMismatches++;
+		}
+
+		Path.Reset();
+		float Length = 0.0f;
+		const bool bIsFound = Pathfinder.FindPath(Query.Start, Query.Goal, Scratch, Path, Length);
+		if (bIsFound != bIsReachable || (bIsReachable && !CityPathfinderTest::IsPathValid(Graph, Query, Path, Length, ReferenceLength)))
+		{
+			NumSingleMismatches++;
+		}
+	}
+	TestEqual(TEXT("Batch mismatches against Dijkstra"), NumBatchMismatches, 0);
+	TestEqual(TEXT("Single query mismatches against Dijkstra"), NumSingleMismatches, 0);
+	return true;
+}
+
+#endif
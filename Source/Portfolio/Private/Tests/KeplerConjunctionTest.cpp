@@ -0,0 +1,169 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "Misc/AutomationTest.h"
+#include "KeplerConjunction.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace KeplerConjunctionTest
+{
+	/** Seconds between the samples of the brute-force search. */
+	static const double SampleStep = 4.0;
+
+	static const float Threshold = 1.5f;
+
+	/** Stretch of the window with every sample under the threshold, and the smallest of those samples. */
+	struct FApproach
+	{
+		double StartTime;
+		double EndTime;
+		float Distance;
+	};
+
+	/** Orbits of a few units, so a window of a few periods is searched in a few thousand steps. Two pairs share a plane and go opposite ways, so they meet every half period. */
+	static void MakeOrbits(TArray<FKeplerOrbitConfig>& OutOrbitConfigs, TArray<double>& OutEpochs)
+	{
+		OutOrbitConfigs.Add(FKeplerOrbitConfig(10.0f, 10.0f, FRotator::ZeroRotator, 0.0f));
+		OutOrbitConfigs.Add(FKeplerOrbitConfig(10.0f, 10.0f, FRotator(0.0f, 0.0f, 180.0f), 90.0f));
+		OutOrbitConfigs.Add(FKeplerOrbitConfig(7.0f, 13.0f, FRotator(30.0f, 45.0f, 0.0f), 200.0f));
+		OutOrbitConfigs.Add(FKeplerOrbitConfig(8.0f, 12.0f, FRotator(-20.0f, 120.0f, 10.0f), 45.0f));
+		OutOrbitConfigs.Add(FKeplerOrbitConfig(9.0f, 11.0f, FRotator(60.0f, -30.0f, 0.0f), 300.0f));
+		OutOrbitConfigs.Add(FKeplerOrbitConfig(10.0f, 10.0f, FRotator(0.0f, 0.0f, 180.0f), 270.0f));
+		OutEpochs = { 0.0, 1000.0, -500.0, 2500.0, 0.0, 750.0 };
+	}
+
+	/** Sample the distance between both orbits across the window, and keep each stretch under the threshold. */
+	static void FindApproaches(const FKeplerOrbitConfig& OrbitConfigA, const double EpochA, const FKeplerOrbitConfig& OrbitConfigB, const double EpochB,
+		const double StartTime, const double Duration, TArray<FApproach>& OutApproaches)
+	{
+		const int32 NumSamples = FMath::CeilToInt(Duration / SampleStep);
+		for (int32 Sample = 0; Sample <= NumSamples; Sample++)
+		{
+			const double Time = StartTime + FMath::Min(Sample * SampleStep, Duration);
+			const float Distance = FVector::Dist(OrbitConfigA.Compiled.GetPositionAtTime(Time - EpochA), OrbitConfigB.Compiled.GetPositionAtTime(Time - EpochB));
+			if (Distance > Threshold) continue;
+
+			if (OutApproaches.Num() > 0 && OutApproaches.Last().EndTime >= Time - (1.5 * SampleStep))
+			{
+				OutApproaches.Last().EndTime = Time;
+				OutApproaches.Last().Distance = FMath::Min(OutApproaches.Last().Distance, Distance);
+			}
+			else
+			{
+				OutApproaches.Add({ Time, Time, Distance });
+			}
+		}
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FKeplerConjunctionBruteForceTest, "Portfolio.Kepler.Conjunction.BruteForce", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FKeplerConjunctionBruteForceTest::RunTest(const FString& Parameters)
+{
+	TArray<FKeplerOrbitConfig> OrbitConfigs;
+	TArray<double> Epochs;
+	KeplerConjunctionTest::MakeOrbits(OrbitConfigs, Epochs);
+
+	// Three periods, starting late, so the window is far from every epoch.
+	const double Period = (2.0 * PI) / OrbitConfigs[0].Compiled.MeanMotion;
+	const double StartTime = 10.0 * Period;
+	const double Duration = 3.0 * Period;
+
+	FKeplerConjunctionFinder Finder;
+	Finder.SetThreshold(KeplerConjunctionTest::Threshold);
+	Finder.SetWindow(StartTime, Duration);
+	float MaxSpeed = 0.0f;
+	for (int32 i = 0; i < OrbitConfigs.Num(); i++)
+	{
+		Finder.Add(OrbitConfigs[i], Epochs[i]);
+		MaxSpeed = FMath::Max(MaxSpeed, OrbitConfigs[i].Compiled.GetPeriapsisSpeed());
+	}
+	const TArray<FKeplerEncounter>& Encounters = Finder.GetEncounters();
+	TestEqual(TEXT("Truncated pairs"), Finder.GetNumTruncatedPairs(), 0);
+
+	// The samples can miss the true minimum by as much as both bodies move in half a step.
+	const float SampleTolerance = (float)(KeplerConjunctionTest::SampleStep * MaxSpeed);
+	const float RefineTolerance = 0.01f;
+
+	int32 NumApproaches = 0;
+	for (int32 IndexA = 0; IndexA < OrbitConfigs.Num(); IndexA++)
+	{
+		for (int32 IndexB = IndexA + 1; IndexB < OrbitConfigs.Num(); IndexB++)
+		{
+			TArray<KeplerConjunctionTest::FApproach> Approaches;
+			KeplerConjunctionTest::FindApproaches(OrbitConfigs[IndexA], Epochs[IndexA], OrbitConfigs[IndexB], Epochs[IndexB], StartTime, Duration, Approaches);
+			NumApproaches += Approaches.Num();
+
+			TArray<const FKeplerEncounter*> PairEncounters;
+			for (const FKeplerEncounter& Encounter : Encounters)
+			{
+				if (Encounter.OrbitA == IndexA && Encounter.OrbitB == IndexB)
+				{
+					PairEncounters.Add(&Encounter);
+				}
+			}
+
+			// Each stretch under the threshold has an encounter, at least as close as the closest sample.
+			// Grazes can fall between samples, so they are only checked when the finder reports them.
+			for (const KeplerConjunctionTest::FApproach& Approach : Approaches)
+			{
+				if (Approach.Distance > KeplerConjunctionTest::Threshold - SampleTolerance) continue;
+
+				const FKeplerEncounter* const* Match = PairEncounters.FindByPredicate([&Approach](const FKeplerEncounter* Encounter)
+				{
+					return Encounter->PreciseTime >= Approach.StartTime - KeplerConjunctionTest::SampleStep && Encounter->PreciseTime <= Approach.EndTime + KeplerConjunctionTest::SampleStep;
+				});
+				if (!Match)
+				{
+					AddError(FString::Printf(TEXT("No encounter of orbits %d and %d between %f and %f, where the samples reach %f."), IndexA, IndexB, Approach.StartTime, Approach.EndTime, Approach.Distance));
+					continue;
+				}
+
+				const float Distance = (*Match)->Distance;
+				TestTrue(FString::Printf(TEXT("Encounter of orbits %d and %d at %f (%f) is within the tolerance of the samples (%f)"), IndexA, IndexB, (*Match)->PreciseTime, Distance, Approach.Distance),
+					Distance <= Approach.Distance + RefineTolerance && Distance >= Approach.Distance - SampleTolerance);
+			}
+
+			// Each encounter is in one of those stretches, unless it is a graze.
+			for (const FKeplerEncounter* Encounter : PairEncounters)
+			{
+				if (Encounter->Distance > KeplerConjunctionTest::Threshold - SampleTolerance) continue;
+
+				const bool bIsSampled = Approaches.ContainsByPredicate([Encounter](const KeplerConjunctionTest::FApproach& Approach)
+				{
+					return Encounter->PreciseTime >= Approach.StartTime - KeplerConjunctionTest::SampleStep && Encounter->PreciseTime <= Approach.EndTime + KeplerConjunctionTest::SampleStep;
+				});
+				TestTrue(FString::Printf(TEXT("Encounter of orbits %d and %d at %f (%f) is under the threshold in the samples"), IndexA, IndexB, Encounter->PreciseTime, Encounter->Distance), bIsSampled);
+			}
+		}
+	}
+	TestTrue(TEXT("The samples found close approaches"), NumApproaches > 0);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FKeplerConjunctionTruncationTest, "Portfolio.Kepler.Conjunction.Truncation", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FKeplerConjunctionTruncationTest::RunTest(const FString& Parameters)
+{
+	TArray<FKeplerOrbitConfig> OrbitConfigs;
+	TArray<double> Epochs;
+	KeplerConjunctionTest::MakeOrbits(OrbitConfigs, Epochs);
+
+	// A thousand periods with a tiny threshold need far more steps than the limit allows.
+	const double Period = (2.0 * PI) / OrbitConfigs[0].Compiled.MeanMotion;
+	FKeplerConjunctionFinder Finder;
+	Finder.SetThreshold(0.01f);
+	Finder.SetWindow(0.0, 1000.0 * Period);
+	for (int32 i = 0; i < OrbitConfigs.Num(); i++)
+	{
+		Finder.Add(OrbitConfigs[i], Epochs[i]);
+	}
+
+	AddExpectedError(TEXT("hit the limit"), EAutomationExpectedErrorFlags::Contains, 1);
+	Finder.GetEncounters();
+	TestTrue(TEXT("Truncated pairs are reported"), Finder.GetNumTruncatedPairs() > 0);
+	return true;
+}
+
+#endif
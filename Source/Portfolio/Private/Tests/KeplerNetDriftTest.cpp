@@ -0,0 +1,101 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "Misc/AutomationTest.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "KeplerOrbit.h"
+#include "KeplerSimulation.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace KeplerNetDriftTest
+{
+	/** Game world with its subsystems, not ticked by the engine, so the test steps it by hand. */
+	static UWorld* CreateTestWorld()
+	{
+		UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+		FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+		WorldContext.SetCurrentWorld(World);
+		return World;
+	}
+
+	static void DestroyTestWorld(UWorld* World)
+	{
+		GEngine->DestroyWorldContext(World);
+		World->DestroyWorld(false);
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FKeplerNetDriftTest, "Portfolio.Kepler.NetDrift", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FKeplerNetDriftTest::RunTest(const FString& Parameters)
+{
+	const FKeplerOrbitConfig OrbitConfig(500.0f, 1500.0f, FRotator(20.0f, 40.0f, 0.0f), 30.0f);
+	const FVector Focus(1.0e5f, -2.0e4f, 0.0f);
+	const float DriftTolerance = GetDefault<UKeplerOrbitComponent>()->DriftTolerance;
+	const float TimeScale = 1000.0f;
+
+	// One world for each side, ticked by hand, with clocks that start far apart.
+	UWorld* ServerWorld = KeplerNetDriftTest::CreateTestWorld();
+	UWorld* ClientWorld = KeplerNetDriftTest::CreateTestWorld();
+	UKeplerSubsystem* Server = ServerWorld->GetSubsystem<UKeplerSubsystem>();
+	UKeplerSubsystem* Client = ClientWorld->GetSubsystem<UKeplerSubsystem>();
+	if (!Server || !Client)
+	{
+		AddError(TEXT("The test worlds have no Kepler subsystem."));
+		KeplerNetDriftTest::DestroyTestWorld(ServerWorld);
+		KeplerNetDriftTest::DestroyTestWorld(ClientWorld);
+		return false;
+	}
+	Server->TimeScale = TimeScale;
+	Client->TimeScale = TimeScale;
+	Server->FastForward(1.0e6f);
+	Client->FastForward(2.5e6f);
+
+	const int32 ServerBodyId = Server->RegisterBody(OrbitConfig, INDEX_NONE, Focus, nullptr);
+	const int32 ClientBodyId = Client->RegisterBody(OrbitConfig, INDEX_NONE, Focus, nullptr);
+	Server->Tick(12.345f);
+	Client->Tick(0.5f);
+
+	// Capture the orbit on the server, as UpdateNetState does, at a game state time unrelated to either clock.
+	const float ServerWorldTime = 3000.25f;
+	FKeplerOrbitNetState NetState;
+	NetState.OrbitConfig = OrbitConfig;
+	NetState.Epoch = Server->GetBodyEpoch(ServerBodyId);
+	NetState.TimeScale = Server->TimeScale;
+	NetState.ServerTimeOffset = Server->GetPreciseSimulationTime() - ((double)TimeScale * ServerWorldTime);
+	TestTrue(TEXT("Server time offset is nonzero"), NetState.ServerTimeOffset != 0.0);
+
+	Client->SetOrbitConfig(ClientBodyId, OrbitConfig, NetState.GetLocalEpoch(Client->GetPreciseSimulationTime(), ServerWorldTime));
+
+	// Step both simulations for another million seconds, comparing each frame.
+	const double Period = (2.0 * PI) / OrbitConfig.Compiled.MeanMotion;
+	float MaxDrift = 0.0f;
+	float MaxError = 0.0f;
+	for (int32 Frame = 0; Frame < 1000; Frame++)
+	{
+		Server->Tick(1.0f);
+		Client->Tick(1.0f);
+
+		const FVector ServerLocation = Server->GetBodyLocation(ServerBodyId);
+		const FVector ClientLocation = Client->GetBodyLocation(ClientBodyId);
+
+		// The library takes a float time, so reduce the elapsed time to one period first.
+		const double ElapsedTime = Server->GetPreciseSimulationTime() - NetState.Epoch;
+		const FVector Expected = Focus + UKeplerLibrary::GetOrbitalPositionAtTime(OrbitConfig, (float)fmod(ElapsedTime, Period));
+
+		MaxDrift = FMath::Max(MaxDrift, FVector::Dist(ServerLocation, ClientLocation));
+		MaxError = FMath::Max(MaxError, FMath::Max(FVector::Dist(ServerLocation, Expected), FVector::Dist(ClientLocation, Expected)));
+	}
+
+	TestTrue(TEXT("Simulations reached large times"), Server->GetPreciseSimulationTime() >= 1.0e6 && Client->GetPreciseSimulationTime() >= 1.0e6);
+	TestTrue(FString::Printf(TEXT("Drift between server and client (%f) is under the tolerance (%f)"), MaxDrift, DriftTolerance), MaxDrift < DriftTolerance);
+	TestTrue(FString::Printf(TEXT("Error against GetOrbitalPositionAtTime (%f) is under the tolerance (%f)"), MaxError, DriftTolerance), MaxError < DriftTolerance);
+
+	KeplerNetDriftTest::DestroyTestWorld(ServerWorld);
+	KeplerNetDriftTest::DestroyTestWorld(ClientWorld);
+	return true;
+}
+
+#endif
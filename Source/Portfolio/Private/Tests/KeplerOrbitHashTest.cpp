@@ -0,0 +1,124 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "Misc/AutomationTest.h"
+#include "KeplerOrbit.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace KeplerOrbitHashTest
+{
+	/** Quanta of FKeplerOrbitConfig::QuantizeLength and QuantizeAngle. */
+	static const double LengthQuantum = 1e-3;
+	static const double AngleQuantum = 1e-4;
+
+	/** Floats on both sides of each value, a few ulps apart, so some round up and some round down. */
+	static void AddNeighbors(const double Value, TArray<float>& OutValues)
+	{
+		const float Center = (float)Value;
+		float Below = Center;
+		float Above = Center;
+		OutValues.Add(Center);
+		for (int32 Ulp = 0; Ulp < 4; Ulp++)
+		{
+			Below = nextafterf(Below, -MAX_FLT);
+			Above = nextafterf(Above, MAX_FLT);
+			OutValues.Add(Below);
+			OutValues.Add(Above);
+		}
+	}
+
+	/** Values around the rounding boundaries, halfway between two quanta, at several magnitudes. */
+	static void MakeLengths(TArray<float>& OutLengths)
+	{
+		for (const double Base : { 1.0, 12.345, 1234.567, 50000.0 })
+		{
+			AddNeighbors(Base + (0.5 * LengthQuantum), OutLengths);
+			AddNeighbors(Base - (0.5 * LengthQuantum), OutLengths);
+		}
+	}
+
+	/** Values around the rounding boundaries, and around the wrap at 180 degrees, where both signs must land on the same step. */
+	static void MakeAngles(TArray<float>& OutAngles)
+	{
+		for (const double Base : { 0.0, 45.0, -90.0, 179.9999, 180.0, -180.0, 360.0 })
+		{
+			AddNeighbors(Base + (0.5 * AngleQuantum), OutAngles);
+			AddNeighbors(Base - (0.5 * AngleQuantum), OutAngles);
+		}
+		AddNeighbors(180.0, OutAngles);
+		AddNeighbors(-180.0, OutAngles);
+	}
+
+	/** Compare every pair. Equal configs must hash alike, and so must configs of the same shape. */
+	static void CheckPairs(FAutomationTestBase& Test, const TCHAR* What, const TArray<FKeplerOrbitConfig>& OrbitConfigs)
+	{
+		int32 NumEqual = 0;
+		int32 NumMismatches = 0;
+		for (int32 i = 0; i < OrbitConfigs.Num(); i++)
+		{
+			for (int32 j = 0; j < OrbitConfigs.Num(); j++)
+			{
+				const FKeplerOrbitConfig& A = OrbitConfigs[i];
+				const FKeplerOrbitConfig& B = OrbitConfigs[j];
+				if (A.Equals(B))
+				{
+					NumEqual += (i != j) ? 1 : 0;
+					NumMismatches += (GetTypeHash(A) == GetTypeHash(B) && A.GetElementsHash() == B.GetElementsHash()) ? 0 : 1;
+				}
+				if (A.HasSameShape(B))
+				{
+					NumMismatches += (A.GetShapeHash() == B.GetShapeHash()) ? 0 : 1;
+				}
+			}
+		}
+		Test.TestTrue(FString::Printf(TEXT("%s: some distinct configs are equal"), What), NumEqual > 0);
+		Test.TestEqual(FString::Printf(TEXT("%s: equal configs with different hashes"), What), NumMismatches, 0);
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FKeplerOrbitHashTest, "Portfolio.Kepler.Orbit.Hash", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FKeplerOrbitHashTest::RunTest(const FString& Parameters)
+{
+	TArray<float> Lengths;
+	TArray<float> Angles;
+	KeplerOrbitHashTest::MakeLengths(Lengths);
+	KeplerOrbitHashTest::MakeAngles(Angles);
+
+	// Apoapses well above every periapsis, and periapses well below every apoapsis, so no config is fixed up.
+	TArray<FKeplerOrbitConfig> Periapses;
+	TArray<FKeplerOrbitConfig> Apoapses;
+	for (const float Length : Lengths)
+	{
+		Periapses.Add(FKeplerOrbitConfig(Length, 1.0e5f));
+		Apoapses.Add(FKeplerOrbitConfig(0.5f, Length));
+	}
+	KeplerOrbitHashTest::CheckPairs(*this, TEXT("Periapsis"), Periapses);
+	KeplerOrbitHashTest::CheckPairs(*this, TEXT("Apoapsis"), Apoapses);
+
+	TArray<FKeplerOrbitConfig> Pitches;
+	TArray<FKeplerOrbitConfig> Yaws;
+	TArray<FKeplerOrbitConfig> Rolls;
+	TArray<FKeplerOrbitConfig> Anomalies;
+	for (const float Angle : Angles)
+	{
+		Pitches.Add(FKeplerOrbitConfig(100.0f, 200.0f, FRotator(Angle, 0.0f, 0.0f)));
+		Yaws.Add(FKeplerOrbitConfig(100.0f, 200.0f, FRotator(0.0f, Angle, 0.0f)));
+		Rolls.Add(FKeplerOrbitConfig(100.0f, 200.0f, FRotator(0.0f, 0.0f, Angle)));
+		Anomalies.Add(FKeplerOrbitConfig(100.0f, 200.0f, FRotator::ZeroRotator, Angle));
+	}
+	KeplerOrbitHashTest::CheckPairs(*this, TEXT("Pitch"), Pitches);
+	KeplerOrbitHashTest::CheckPairs(*this, TEXT("Yaw"), Yaws);
+	KeplerOrbitHashTest::CheckPairs(*this, TEXT("Roll"), Rolls);
+	KeplerOrbitHashTest::CheckPairs(*this, TEXT("Initial true anomaly"), Anomalies);
+
+	// Both ends of the wrap are the same angle.
+	const FKeplerOrbitConfig Positive(100.0f, 200.0f, FRotator(180.0f, 180.0f, 180.0f), 180.0f);
+	const FKeplerOrbitConfig Negative(100.0f, 200.0f, FRotator(-180.0f, -180.0f, -180.0f), -180.0f);
+	TestTrue(TEXT("180 and -180 degrees are equal"), Positive.Equals(Negative));
+	TestEqual(TEXT("180 and -180 degrees hash alike"), GetTypeHash(Positive), GetTypeHash(Negative));
+	return true;
+}
+
+#endif
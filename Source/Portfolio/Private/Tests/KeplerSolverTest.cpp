@@ -0,0 +1,61 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "Misc/AutomationTest.h"
+#include "KeplerOrbit.h"
+#include "KeplerSolverTable.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace KeplerSolverTest
+{
+	/** Mean anomalies per eccentricity, across [-PI, PI]. */
+	static const int32 NumMeanAnomalies = 4001;
+
+	/** Largest difference to Newton-Raphson, in radians. A few times its convergence tolerance, since both stop short of it. */
+	static const float MaxError = 1e-5f;
+
+	/** Eccentricities within the table, at its edge, and above it, where the lookup falls back to Newton-Raphson. */
+	static const float Eccentricities[] = { 0.0f, 0.05f, 0.2f, 0.4f, 0.6f, 0.75f, 0.8f, 0.85f, 0.9f, 0.95f, 0.99f };
+
+	/** Largest difference between the mode and Newton-Raphson at the eccentricity. */
+	static float GetMaxError(const EKeplerSolverMode Mode, const float Eccentricity)
+	{
+		FKeplerSolverSettings NewtonSettings;
+		NewtonSettings.Mode = EKeplerSolverMode::NewtonRaphson;
+		FKeplerSolverSettings Settings;
+		Settings.Mode = Mode;
+
+		float Error = 0.0f;
+		for (int32 i = 0; i < NumMeanAnomalies; i++)
+		{
+			const float MeanAnomaly = -PI + ((2.0f * PI * i) / (NumMeanAnomalies - 1));
+			int32 Iterations = 0;
+			const float Expected = FKeplerSolver::SolveEccentricAnomaly(MeanAnomaly, Eccentricity, NewtonSettings, Iterations);
+			const float Actual = FKeplerSolver::SolveEccentricAnomaly(MeanAnomaly, Eccentricity, Settings, Iterations);
+			Error = FMath::Max(Error, FMath::Abs(Actual - Expected));
+		}
+		return Error;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FKeplerSolverAccuracyTest, "Portfolio.Kepler.Solver.Accuracy", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FKeplerSolverAccuracyTest::RunTest(const FString& Parameters)
+{
+	TestTrue(TEXT("Lookup table is built"), FKeplerSolverTable::Get().IsBuilt());
+
+	const UEnum* ModeEnum = StaticEnum<EKeplerSolverMode>();
+	for (const EKeplerSolverMode Mode : { EKeplerSolverMode::LookupTable, EKeplerSolverMode::Markley })
+	{
+		for (const float Eccentricity : KeplerSolverTest::Eccentricities)
+		{
+			const float Error = KeplerSolverTest::GetMaxError(Mode, Eccentricity);
+			TestTrue(FString::Printf(TEXT("%s at e = %.2f: max error %e rad against Newton-Raphson is under %e"), *ModeEnum->GetNameStringByValue((int64)Mode), Eccentricity, Error, KeplerSolverTest::MaxError),
+				Error <= KeplerSolverTest::MaxError);
+		}
+	}
+	return true;
+}
+
+#endif
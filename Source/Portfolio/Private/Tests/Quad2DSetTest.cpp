@@ -0,0 +1,127 @@
+// Copyright Bruno Silva. All rights reserved.
+
+
+#include "Misc/AutomationTest.h"
+#include "Math/RandomStream.h"
+#include "Quad2DSet.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace Quad2DSetTest
+{
+	/** Not a multiple of the SIMD width, so the last packet is partial. */
+	static const int32 NumQuads = (1 << 12) + 3;
+
+	/** Largest distance between a batch and a scalar corner. A few ulps at the largest coordinates. */
+	static const float ResizeTolerance = 0.25f;
+
+	/** Convex quads of every size, with some collapsed edges and some collapsed to a point. */
+	static void MakeQuads(TArray<FQuad2D>& OutQuads, TArray<float>& OutFractions)
+	{
+		FRandomStream Random(0x51554144);
+		OutQuads.SetNumUninitialized(NumQuads);
+		OutFractions.SetNumUninitialized(NumQuads);
+		for (int32 i = 0; i < NumQuads; i++)
+		{
+			const FVector2D Center(Random.FRandRange(-1e6f, 1e6f), Random.FRandRange(-1e6f, 1e6f));
+			const float Size = Random.FRandRange(1.0f, 5000.0f);
+			const float Jitter = 0.3f * Size;
+			FQuad2D Quad(
+				Center + FVector2D(-Size + Random.FRandRange(0.0f, Jitter), -Size + Random.FRandRange(0.0f, Jitter)),
+				Center + FVector2D(Size - Random.FRandRange(0.0f, Jitter), -Size + Random.FRandRange(0.0f, Jitter)),
+				Center + FVector2D(Size - Random.FRandRange(0.0f, Jitter), Size - Random.FRandRange(0.0f, Jitter)),
+				Center + FVector2D(-Size + Random.FRandRange(0.0f, Jitter), Size - Random.FRandRange(0.0f, Jitter)));
+			switch (i % 16)
+			{
+			case 0: Quad.D = Quad.C; break;
+			case 1: Quad.B = Quad.A; break;
+			case 2: Quad = FQuad2D(Center, Center, Center, Center); break;
+			default: break;
+			}
+			OutQuads[i] = Quad;
+			OutFractions[i] = Random.GetFraction();
+		}
+	}
+
+	static float GetError(const FQuad2D& Expected, const FQuad2D& Actual)
+	{
+		return FMath::Max(FMath::Max(FVector2D::Distance(Expected.A, Actual.A), FVector2D::Distance(Expected.B, Actual.B)),
+			FMath::Max(FVector2D::Distance(Expected.C, Actual.C), FVector2D::Distance(Expected.D, Actual.D)));
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FQuad2DSetResizeTest, "Portfolio.Quad2DSet.Resize", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FQuad2DSetResizeTest::RunTest(const FString& Parameters)
+{
+	TArray<FQuad2D> Quads;
+	TArray<float> Fractions;
+	Quad2DSetTest::MakeQuads(Quads, Fractions);
+
+	for (const float Delta : { -150.0f, 75.0f })
+	{
+		TArray<FQuad2D> Actual;
+		Actual.SetNumUninitialized(Quads.Num());
+		FQuad2DSet::ResizeQuads(Quads, Delta, Actual);
+
+		// The output may be the same memory as the input.
+		TArray<FQuad2D> InPlace = Quads;
+		FQuad2DSet::ResizeQuads(InPlace, Delta, InPlace);
+
+		FQuad2DSet Set;
+		Set.Assign(Quads);
+		Set.Resize(Delta);
+
+		float MaxError = 0.0f;
+		float MaxInPlaceError = 0.0f;
+		for (int32 i = 0; i < Quads.Num(); i++)
+		{
+			const FQuad2D Expected = UGeneratorLibrary::ResizeQuad2D(Quads[i], Delta);
+			MaxError = FMath::Max(MaxError, FMath::Max(Quad2DSetTest::GetError(Expected, Actual[i]), Quad2DSetTest::GetError(Expected, Set.Get(i))));
+			MaxInPlaceError = FMath::Max(MaxInPlaceError, Quad2DSetTest::GetError(Expected, InPlace[i]));
+		}
+		TestTrue(FString::Printf(TEXT("Resize by %f: max error %e is under %e"), Delta, MaxError, Quad2DSetTest::ResizeTolerance), MaxError <= Quad2DSetTest::ResizeTolerance);
+		TestTrue(FString::Printf(TEXT("Resize by %f in place: max error %e is under %e"), Delta, MaxInPlaceError, Quad2DSetTest::ResizeTolerance), MaxInPlaceError <= Quad2DSetTest::ResizeTolerance);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FQuad2DSetDivideTest, "Portfolio.Quad2DSet.Divide", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FQuad2DSetDivideTest::RunTest(const FString& Parameters)
+{
+	TArray<FQuad2D> Quads;
+	TArray<float> Fractions;
+	Quad2DSetTest::MakeQuads(Quads, Fractions);
+
+	FQuad2DSet Set;
+	Set.Assign(Quads);
+
+	// Division only interpolates, so the batch must match the scalar function within the tolerance of FQuad2D::Equals.
+	for (const bool bUseADAxis : { false, true })
+	{
+		TArray<FQuad2D> ActualFirst;
+		TArray<FQuad2D> ActualSecond;
+		ActualFirst.SetNumUninitialized(Quads.Num());
+		ActualSecond.SetNumUninitialized(Quads.Num());
+		FQuad2DSet::DivideQuads(Quads, Fractions, bUseADAxis, ActualFirst, ActualSecond);
+
+		FQuad2DSet SetFirst;
+		FQuad2DSet SetSecond;
+		Set.Divide(Fractions, bUseADAxis, SetFirst, SetSecond);
+
+		int32 NumMismatches = 0;
+		for (int32 i = 0; i < Quads.Num(); i++)
+		{
+			FQuad2D First;
+			FQuad2D Second;
+			Quads[i].Divide(Fractions[i], bUseADAxis, First, Second);
+			NumMismatches += (First == ActualFirst[i] && Second == ActualSecond[i]) ? 0 : 1;
+			NumMismatches += (First == SetFirst.Get(i) && Second == SetSecond.Get(i)) ? 0 : 1;
+		}
+		TestEqual(FString::Printf(TEXT("Divide mismatches across %s"), bUseADAxis ? TEXT("AD") : TEXT("AB")), NumMismatches, 0);
+	}
+	return true;
+}
+
+#endif
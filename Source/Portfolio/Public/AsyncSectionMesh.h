@@ -0,0 +1,91 @@
+// Copyright Bruno Silva. All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ProceduralMeshComponent.h"
+#include "AsyncSectionMesh.generated.h"
+
+/** Buffers of one mesh section, in the layout of the procedural mesh sections. Unused buffers stay empty. */
+struct PORTFOLIO_API FAsyncMeshSection
+{
+	TArray<FVector> Vertices;
+	TArray<int32> Triangles;
+	TArray<FVector> Normals;
+	TArray<FVector2D> UV0;
+	TArray<FLinearColor> Colors;
+	TArray<FProcMeshTangent> Tangents;
+};
+
+/**
+ * Procedural mesh whose sections are built on the task graph and handed to the game thread once
+ * done. Subclasses keep the inputs of each section and request a build when they change. Builds
+ * are started on the next tick, so requests made in the same frame are merged, and a build that
+ * finishes after its section changed again is dropped.
+ */
+UCLASS(Abstract)
+class PORTFOLIO_API UAsyncSectionMeshComponent : public UProceduralMeshComponent
+{
+	GENERATED_BODY()
+
+public:
+	/** Constructor. */
+	UAsyncSectionMeshComponent(const FObjectInitializer& ObjectInitializer);
+
+//------------------------------------------------------------------------
+// METHODS
+//------------------------------------------------------------------------
+
+public:
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+protected:
+
+	/** Rebuild the section on the next tick. */
+	void RequestSectionBuild(const int32 SectionIndex);
+
+	/** Clear the section and drop its build if it is in flight. */
+	void RemoveSection(const int32 SectionIndex);
+
+	void ClearSections();
+
+	/** Sections waiting for their buffers. */
+	int32 GetNumPendingSections() const;
+
+	/** Task that fills the buffers of a section. It runs on the task graph, so it must own copies of its inputs. */
+	virtual TFunction<void(FAsyncMeshSection&)> CreateSectionBuild(const int32 SectionIndex) const PURE_VIRTUAL(UAsyncSectionMeshComponent::CreateSectionBuild, return nullptr;);
+
+	virtual UMaterialInterface* GetSectionMaterial(const int32 SectionIndex) const PURE_VIRTUAL(UAsyncSectionMeshComponent::GetSectionMaterial, return nullptr;);
+
+private:
+
+	/** Start a build for every changed section. */
+	void DispatchBuilds();
+
+	/** Upload the buffers of a section, unless it changed again since they were requested. */
+	void OnSectionBuilt(const int32 SectionIndex, const uint32 Generation, const FAsyncMeshSection& Mesh);
+
+//------------------------------------------------------------------------
+// PROPERTIES
+//------------------------------------------------------------------------
+
+private:
+
+	struct FSectionBuild
+	{
+		/** Changes with every request, so stale builds are dropped. */
+		uint32 Generation;
+
+		/** Changed since the last dispatch. */
+		bool bIsDirty;
+
+		/** A build of the current generation is in flight. */
+		bool bIsPending;
+	};
+
+	TMap<int32, FSectionBuild> SectionBuilds;
+
+	/** Shared by every section, so a section removed and added again never matches an older build. */
+	uint32 NextGeneration;
+};
@@ -0,0 +1,301 @@
+// Copyright Bruno Silva. All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SceneComponent.h"
+#include "CityPlanGenerator.h"
+#include "CityBuilder.generated.h"
+
+class UHierarchicalInstancedStaticMeshComponent;
+class UMaterialInterface;
+class UProceduralMeshComponent;
+class UStaticMesh;
+
+UENUM(BlueprintType)
+enum class ECityPropPlacement : uint8
+{
+	/** Along both sides of every road, facing it, such as street lights. */
+	AlongRoads,
+
+	/** On the roof of buildings, aligned with the lot, such as water tanks. */
+	OnRoofs
+};
+
+/** Static mesh repeated across a district, drawn with one instanced component per district. */
+USTRUCT(BlueprintType)
+struct FCityPropSettings
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder")
+	UStaticMesh* Mesh;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder")
+	ECityPropPlacement Placement;
+
+	/** Distance between props along a road. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder", meta = (ClampMin = "1"))
+	float Spacing;
+
+	/** Distance from the side of the road toward its middle. Negative values move props onto the sidewalk. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder")
+	float Offset;
+
+	/** Chance of a prop on each roof. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder", meta = (ClampMin = "0", ClampMax = "1"))
+	float Chance;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder", meta = (ClampMin = "0"))
+	float MinScale;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder", meta = (ClampMin = "0"))
+	float MaxScale;
+
+public:
+
+	FCityPropSettings()
+	{
+		Mesh = nullptr;
+		Placement = ECityPropPlacement::AlongRoads;
+		Spacing = 2500.0f;
+		Offset = -150.0f;
+		Chance = 0.5f;
+		MinScale = 1.0f;
+		MaxScale = 1.0f;
+	}
+};
+
+USTRUCT(BlueprintType)
+struct FCityBuilderSettings
+{
+	GENERATED_BODY()
+
+public:
+
+	/** Combined with the index of each district, then of each lot, so rebuilding a district gives the same buildings. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder")
+	int32 Seed;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder", meta = (ClampMin = "1"))
+	int32 MinFloors;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder", meta = (ClampMin = "1"))
+	int32 MaxFloors;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder", meta = (ClampMin = "1"))
+	float FloorHeight;
+
+	/** Height of the road surfaces above the component. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder")
+	float RoadHeight;
+
+	/** World size of one repeat of the textures. UVs are planar for roads and roofs, and along the walls for facades. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder", meta = (ClampMin = "1"))
+	float TextureSize;
+
+	/** Lots or roads per mesh section. Each section is committed on its own, so smaller sections spread better across frames. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder", meta = (ClampMin = "1"))
+	int32 MaxQuadsPerSection;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder")
+	UMaterialInterface* BuildingMaterial;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder")
+	UMaterialInterface* RoadMaterial;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder")
+	TArray<FCityPropSettings> Props;
+
+public:
+
+	FCityBuilderSettings()
+	{
+		Seed = 0;
+		MinFloors = 2;
+		MaxFloors = 12;
+		FloorHeight = 350.0f;
+		RoadHeight = 5.0f;
+		TextureSize = 400.0f;
+		MaxQuadsPerSection = 256;
+		BuildingMaterial = nullptr;
+		RoadMaterial = nullptr;
+	}
+};
+
+/** Buffers of one mesh section, in the layout of the procedural mesh sections. */
+struct PORTFOLIO_API FCityMeshSection
+{
+	TArray<FVector> Vertices;
+	TArray<int32> Triangles;
+	TArray<FVector> Normals;
+	TArray<FVector2D> UVs;
+
+	bool bIsRoad;
+
+	FCityMeshSection() : bIsRoad(false) {}
+};
+
+/** Geometry of a district, built off the game thread from its lots and roads. */
+struct PORTFOLIO_API FCityDistrictGeometry
+{
+	TArray<FCityMeshSection> Sections;
+
+	/** Instance transforms, by prop in the settings. */
+	TArray<TArray<FTransform>> PropTransforms;
+
+	/**
+	 * Extrude a building from every lot and a surface from every road. Roads are expected with
+	 * their centerline from the middle of DA to the middle of BC, as the generator lays them out.
+	 */
+	void Build(TArrayView<const FQuad2D> Lots, TArrayView<const FQuad2D> Roads, const FCityBuilderSettings& Settings, const uint32 Seed);
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnCityDistrictBuiltSignature, int32, DistrictIndex);
+
+/**
+ * Turns lots and roads into buildings, road surfaces and props, for any number of districts.
+ * Geometry is built on the thread pool, then committed on the game thread a few sections or
+ * instance batches at a time, within a budget per frame, so spawning a district doesn't hitch.
+ * Each district has its own procedural mesh, and one hierarchical instanced component per prop
+ * mesh, so committing or removing a district never touches the sections, collision or instances
+ * of the others. Components of removed or replaced districts are destroyed one per step too.
+ */
+UCLASS(ClassGroup = (CityPlan), meta = (BlueprintSpawnableComponent))
+class PORTFOLIO_API UCityBuilderComponent : public USceneComponent
+{
+	GENERATED_BODY()
+
+public:
+	/** Constructor. */
+	UCityBuilderComponent(const FObjectInitializer& ObjectInitializer);
+
+//------------------------------------------------------------------------
+// METHODS
+//------------------------------------------------------------------------
+
+public:
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	virtual void OnComponentDestroyed(bool bDestroyingHierarchy) override;
+
+	/** Keeps the materials and prop meshes of each district alive until it is committed. */
+	static void AddReferencedObjects(UObject* InThis, FReferenceCollector& Collector);
+
+public:
+
+	/** Build the lots and roads of the plan as the given district, replacing it if it exists. */
+	UFUNCTION(BlueprintCallable, Category = "City Builder")
+	void BuildPlan(const int32 DistrictIndex, const FCityPlan& Plan);
+
+	/** Build the quads as the given district, replacing it if it exists. */
+	UFUNCTION(BlueprintCallable, Category = "City Builder")
+	void BuildQuads(const int32 DistrictIndex, const TArray<FQuad2D>& Lots, const TArray<FQuad2D>& Roads);
+
+	/** Remove the geometry of a district, and drop its build if it is in flight. */
+	UFUNCTION(BlueprintCallable, Category = "City Builder")
+	void RemoveDistrict(const int32 DistrictIndex);
+
+	UFUNCTION(BlueprintCallable, Category = "City Builder")
+	void ClearDistricts();
+
+	/** Districts being built or waiting to be committed. */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "City Builder")
+	int32 GetNumPendingDistricts() const;
+
+protected:
+
+	/** Keep the geometry for the commit queue, unless the district changed again since it was requested. */
+	void OnGeometryBuilt(const int32 DistrictIndex, const uint32 Generation, TSharedRef<FCityDistrictGeometry, ESPMode::ThreadSafe> Geometry);
+
+	/**
+	 * Destroy one released component, or else commit one section, the collision or one batch of
+	 * instances of the first district in the queue. Returns false once there is nothing left.
+	 */
+	bool CommitStep();
+
+	/** Attach and register a new component of a district. */
+	void AddDistrictComponent(USceneComponent* Component);
+
+	/** Queue the components for destruction, one per step. */
+	void ReleaseComponents(TArray<USceneComponent*>& Components);
+
+//------------------------------------------------------------------------
+// PROPERTIES
+//------------------------------------------------------------------------
+
+public:
+
+	/** Applies to districts built after the change, including their materials and prop meshes. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder")
+	FCityBuilderSettings Settings;
+
+	/** Time spent committing geometry each frame, in milliseconds. At least one step is committed per frame. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder", meta = (ClampMin = "0"))
+	float CommitBudgetMs;
+
+	/** Instances added per step. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Builder", meta = (ClampMin = "1"))
+	int32 InstancesPerStep;
+
+	/** Called once every section and instance of a district is in the world. */
+	UPROPERTY(BlueprintAssignable, Category = "City Builder")
+	FOnCityDistrictBuiltSignature OnDistrictBuilt;
+
+protected:
+
+	struct FDistrict
+	{
+		/** Changes with every build, so stale geometry is dropped. */
+		uint32 Generation;
+
+		/** Mesh and prop components of the current geometry, complete unless it is being committed. */
+		TArray<USceneComponent*> Components;
+
+		/** Components of the previous geometry, shown until the current one is complete. */
+		TArray<USceneComponent*> PreviousComponents;
+
+		/** Mesh of the geometry being committed, and the prop component being filled. */
+		UProceduralMeshComponent* MeshComponent;
+		UHierarchicalInstancedStaticMeshComponent* PropComponent;
+
+		/** Materials and prop meshes of the settings the build was requested with, so later changes only apply to later builds. */
+		UMaterialInterface* BuildingMaterial;
+		UMaterialInterface* RoadMaterial;
+		TArray<UStaticMesh*> PropMeshes;
+
+		/** Geometry waiting to be committed, with how far the commit got. */
+		TSharedPtr<FCityDistrictGeometry, ESPMode::ThreadSafe> Geometry;
+		int32 NextSection;
+		int32 NextProp;
+		int32 NextInstance;
+
+		/** A build of the current generation is in flight. */
+		bool bIsPending;
+
+		/** The commit of the current geometry started and is not complete yet. */
+		bool bIsCommitting;
+
+		/** Every section is in, with its collision. */
+		bool bHasCollision;
+
+		FDistrict() : Generation(0), MeshComponent(nullptr), PropComponent(nullptr), BuildingMaterial(nullptr), RoadMaterial(nullptr), NextSection(0), NextProp(0), NextInstance(0), bIsPending(false), bIsCommitting(false), bHasCollision(false) {}
+	};
+
+	TMap<int32, FDistrict> Districts;
+
+	/** Districts whose geometry is ready, in the order it arrived. */
+	TArray<int32> CommitQueue;
+
+	/** Components of removed or replaced geometry, destroyed one per step. */
+	TArray<USceneComponent*> ReleaseQueue;
+
+	/** Keeps the components of every district alive, including those waiting in the release queue. */
+	UPROPERTY(Transient)
+	TArray<USceneComponent*> AllDistrictComponents;
+
+	uint32 NextGeneration;
+};
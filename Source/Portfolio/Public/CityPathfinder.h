@@ -0,0 +1,177 @@
+// Copyright Bruno Silva. All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CityRoadGraph.h"
+
+/** Path request between two nodes of the road graph. */
+struct FCityPathQuery
+{
+	int32 Start;
+	int32 Goal;
+
+	FCityPathQuery() : Start(INDEX_NONE), Goal(INDEX_NONE) {}
+	FCityPathQuery(const int32 InStart, const int32 InGoal) : Start(InStart), Goal(InGoal) {}
+};
+
+/** Path found for one query, as a range of FCityPathBatch::Nodes. Empty if the goal can't be reached. */
+struct FCityPathResult
+{
+	float Length;
+	int32 FirstNode;
+	int32 NumNodes;
+
+	FCityPathResult() : Length(0.0f), FirstNode(0), NumNodes(0) {}
+
+	bool IsFound() const { return NumNodes > 0; }
+};
+
+/** Paths of a batch of queries, in query order, with the nodes of every path in one array. */
+struct FCityPathBatch
+{
+	TArray<FCityPathResult> Results;
+	TArray<int32> Nodes;
+
+	void Reset()
+	{
+		Results.Reset();
+		Nodes.Reset();
+	}
+
+	/** Nodes of the path of a query, from start to goal. */
+	TArrayView<const int32> GetPath(const int32 QueryIndex) const
+	{
+		const FCityPathResult& Result = Results[QueryIndex];
+		return TArrayView<const int32>(Nodes.GetData() + Result.FirstNode, Result.NumNodes);
+	}
+};
+
+/**
+ * Working memory of a path query. Sized to the graph on first use, then reused, so queries don't
+ * allocate. Visited nodes are tagged with the number of the query instead of being cleared.
+ */
+class PORTFOLIO_API FCityPathScratch
+{
+	friend class FCityPathfinder;
+
+	struct FHeapEntry
+	{
+		float Distance;
+		int32 Node;
+
+		bool operator<(const FHeapEntry& Other) const { return Distance < Other.Distance; }
+	};
+
+	/** Forward search from the start, then backward search from the goal. */
+	TArray<float> Distances[2];
+	TArray<int32> Parents[2];
+	TArray<uint32> Visits[2];
+	TArray<FHeapEntry> Heaps[2];
+
+	/** Arcs of the hierarchy waiting to be expanded into road edges. */
+	TArray<TPair<int32, int32>> UnpackStack;
+
+	uint32 QueryNumber;
+
+	/** Size the arrays to the graph and start a new query. */
+	void Prepare(const int32 NumNodes);
+
+	bool IsVisited(const int32 Direction, const int32 Node) const { return Visits[Direction][Node] == QueryNumber; }
+
+public:
+
+	FCityPathScratch() : QueryNumber(0) {}
+};
+
+/**
+ * Shortest paths on a city road graph, through a contraction hierarchy. Nodes are removed one at a
+ * time, least important first, and shortcuts are added between their neighbors wherever the
+ * removed node was on the only shortest path. Queries then search upward from both ends, which
+ * settles a few hundred nodes at most, and expand the shortcuts of the path they meet on.
+ *
+ * Built once per road graph. Queries only read the hierarchy, so any number of threads can run
+ * them at once, each with its own scratch.
+ */
+class PORTFOLIO_API FCityPathfinder
+{
+public:
+
+	FCityPathfinder() : NumShortcuts(0), GridOrigin(FVector2D::ZeroVector), GridSize(0, 0), GridCellSize(1.0f) {}
+
+	FCityPathfinder(const FCityPathfinder&) = delete;
+	FCityPathfinder& operator=(const FCityPathfinder&) = delete;
+
+public:
+
+	/** Contract the graph. Takes roughly a second per hundred thousand nodes. */
+	void Build(const FCityRoadGraph& Graph);
+
+	bool IsBuilt() const { return UpOffsets.Num() > 0; }
+
+	int32 GetNumNodes() const { return NodeLocations.Num(); }
+
+	int32 GetNumShortcuts() const { return NumShortcuts; }
+
+	/** Road graph node closest to the location, or INDEX_NONE if the graph is empty. */
+	int32 FindNearestNode(const FVector2D& Location) const;
+
+	/**
+	 * Shortest path between two nodes. Appends its nodes, from start to goal, to OutPath. Returns
+	 * false, without touching OutPath, if the goal can't be reached.
+	 */
+	bool FindPath(const int32 Start, const int32 Goal, FCityPathScratch& Scratch, TArray<int32>& OutPath, float& OutLength) const;
+
+	/** Answer a batch of queries on every worker thread, with pooled scratch. */
+	void FindPaths(TArrayView<const FCityPathQuery> Queries, FCityPathBatch& OutBatch) const;
+
+	/**
+	 * Answer a batch of queries on the thread pool, then call OnComplete on the game thread. The
+	 * pathfinder is kept alive by the task.
+	 */
+	static void FindPathsAsync(const TSharedRef<const FCityPathfinder, ESPMode::ThreadSafe>& Pathfinder, TArray<FCityPathQuery>&& Queries, TFunction<void(FCityPathBatch&&)>&& OnComplete);
+
+	SIZE_T GetAllocatedSize() const;
+
+public:
+
+	/** Shortest path length with plain Dijkstra on the road graph. Used to check the hierarchy. */
+	static float FindPathLengthReference(const FCityRoadGraph& Graph, const int32 Start, const int32 Goal);
+
+private:
+
+	/** Index of the upward arc between two nodes, stored on the lower of the two. */
+	int32 FindArc(const int32 From, const int32 To) const;
+
+	/** Expand the arcs on the unpack stack into road graph edges, appending the node each one leads to. */
+	void UnpackArcs(FCityPathScratch& Scratch, TArray<int32>& OutPath) const;
+
+	FCityPathScratch* AcquireScratch() const;
+
+	void ReleaseScratch(FCityPathScratch* Scratch) const;
+
+private:
+
+	TArray<FVector2D> NodeLocations;
+
+	/** Arcs from each node to the nodes contracted after it, in compressed sparse rows. */
+	TArray<int32> UpOffsets;
+	TArray<int32> UpTargets;
+	TArray<float> UpWeights;
+
+	/** Node a shortcut skips over, or INDEX_NONE for road graph edges. */
+	TArray<int32> UpMiddles;
+
+	int32 NumShortcuts;
+
+	/** Uniform grid of the nodes, for FindNearestNode. */
+	FVector2D GridOrigin;
+	FIntPoint GridSize;
+	float GridCellSize;
+	TArray<int32> GridOffsets;
+	TArray<int32> GridNodes;
+
+	/** Scratch of finished queries, reused by the next batches. */
+	mutable TArray<TUniquePtr<FCityPathScratch>> ScratchPool;
+	mutable FCriticalSection ScratchLock;
+};
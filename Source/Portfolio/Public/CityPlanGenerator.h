@@ -0,0 +1,265 @@
+// Copyright Bruno Silva. All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ProceduralGenerator.h"
+#include "CityRoadGraph.h"
+#include "CityPlanGenerator.generated.h"
+
+struct FConvexVolume;
+
+UENUM(BlueprintType)
+enum class ECityPlanNodeType : uint8
+{
+	/** Area still being split by roads. Its children are two districts or blocks, with the road between them. */
+	District,
+
+	/** Road between two districts or blocks. Its centerline runs from the middle of DA to the middle of BC. */
+	Road,
+
+	/** Area enclosed by roads. Its children are its lots. */
+	Block,
+
+	/** Building lot, already inset by the setback. */
+	Lot
+};
+
+UENUM(BlueprintType)
+enum class ECityPlanSplitAxis : uint8
+{
+	/** Cut across the longest side, which keeps blocks and lots close to square. */
+	Longest,
+
+	/** Switch axis at every level, which gives a regular grid. */
+	Alternate,
+
+	/** Pick any axis that still needs cutting. */
+	Random
+};
+
+USTRUCT(BlueprintType)
+struct FCityPlanSettings
+{
+	GENERATED_BODY()
+
+public:
+
+	/** Same seed and settings always give the same plan. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan")
+	int32 Seed;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan")
+	ECityPlanSplitAxis SplitAxis;
+
+	/** Shortest side of a block. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan", meta = (ClampMin = "1"))
+	float MinBlockSize;
+
+	/** Districts are split until no side is longer than this. Should be at least twice MinBlockSize plus RoadWidth. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan", meta = (ClampMin = "1"))
+	float MaxBlockSize;
+
+	/** Shortest side of a lot. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan", meta = (ClampMin = "1"))
+	float MinLotSize;
+
+	/** Blocks are split until no lot side is longer than this. Should be at least twice MinLotSize. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan", meta = (ClampMin = "1"))
+	float MaxLotSize;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan", meta = (ClampMin = "0"))
+	float RoadWidth;
+
+	/** Blocks are shrunk by this before being split into lots. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan", meta = (ClampMin = "0"))
+	float SidewalkWidth;
+
+	/** Lots are shrunk by this, so buildings don't touch. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan", meta = (ClampMin = "0"))
+	float LotSetback;
+
+	/** Generate the subtrees below ParallelDepth on worker threads. The plan is the same either way. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan")
+	bool bMultithreaded;
+
+	/** Districts at this depth are generated as independent subtrees, up to 2^ParallelDepth of them. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan", meta = (ClampMin = "0", ClampMax = "16"))
+	int32 ParallelDepth;
+
+	/** Guards against settings that can't be met. Areas this deep stop being split. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan", meta = (ClampMin = "1"))
+	int32 MaxDepth;
+
+public:
+
+	FCityPlanSettings()
+	{
+		Seed = 0;
+		SplitAxis = ECityPlanSplitAxis::Longest;
+		MinBlockSize = 6000.0f;
+		MaxBlockSize = 15000.0f;
+		MinLotSize = 1200.0f;
+		MaxLotSize = 3000.0f;
+		RoadWidth = 1500.0f;
+		SidewalkWidth = 300.0f;
+		LotSetback = 100.0f;
+		bMultithreaded = true;
+		ParallelDepth = 6;
+		MaxDepth = 32;
+	}
+};
+
+USTRUCT(BlueprintType)
+struct FCityPlanNode
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan")
+	FQuad2D Quad;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan")
+	ECityPlanNodeType Type;
+
+	/** Index of the area this was cut from. INDEX_NONE for the root district. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan")
+	int32 Parent;
+
+	/** Children are contiguous, starting here. INDEX_NONE for roads and lots. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan")
+	int32 FirstChild;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan")
+	int32 NumChildren;
+
+public:
+
+	FCityPlanNode()
+	{
+		Type = ECityPlanNodeType::District;
+		Parent = INDEX_NONE;
+		FirstChild = INDEX_NONE;
+		NumChildren = 0;
+	}
+};
+
+/**
+ * Subdivision tree of a city, flattened into a single array. The root district is the first
+ * node, and every node comes after its parent.
+ *
+ * The tree doubles as a bounding volume hierarchy: every node keeps the bounds of its subtree,
+ * and siblings don't overlap, so spatial queries only descend into a few branches per level.
+ * Queries don't modify the plan, so any number of threads can run them at once.
+ */
+USTRUCT(BlueprintType)
+struct FCityPlan
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan")
+	TArray<FCityPlanNode> Nodes;
+
+	/** Bounds of the subtree of each node. Not serialized, so it is rebuilt on load, or by BuildIndex after editing the nodes. */
+	TArray<FBox2D> Bounds;
+
+	/** Intersections and road stretches of the plan. Not serialized, so it is rebuilt on load, or by BuildIndex after editing the nodes. */
+	FCityRoadGraph RoadGraph;
+
+public:
+
+	void Reset()
+	{
+		Nodes.Reset();
+		Bounds.Reset();
+		RoadGraph.Reset();
+	}
+
+	/** Append the quads of every node of the given type. */
+	void GetQuads(const ECityPlanNodeType Type, TArray<FQuad2D>& OutQuads) const;
+
+	int32 GetNumNodes(const ECityPlanNodeType Type) const;
+
+public:
+
+	/** Compute the bounds of every subtree, from the leaves up. */
+	void BuildBounds();
+
+	/** Rebuild the bounds and the road graph from the nodes. */
+	void BuildIndex();
+
+	/** Rebuild the data derived from the nodes once they are loaded. */
+	void PostSerialize(const FArchive& Ar);
+
+	bool HasBounds() const { return Bounds.Num() == Nodes.Num() && Nodes.Num() > 0; }
+
+	/** Deepest node that contains the point, or INDEX_NONE if the point is outside the plan. */
+	int32 FindLeafAt(const FVector2D& Point) const;
+
+	/** Node of the given type that contains the point, such as the lot or block under a player. INDEX_NONE if none does. */
+	int32 FindNodeAt(const FVector2D& Point, const ECityPlanNodeType Type) const;
+
+	/** Append the nodes of the given type that are at least partly within the radius. */
+	void QueryRadius(const FVector2D& Center, const float Radius, const ECityPlanNodeType Type, TArray<int32>& OutNodes) const;
+
+	/** Append the nodes of the given type whose bounds, extruded between the heights, intersect the frustum. */
+	void QueryFrustum(const FConvexVolume& Frustum, const float MinHeight, const float MaxHeight, const ECityPlanNodeType Type, TArray<int32>& OutNodes) const;
+};
+
+template<>
+struct TStructOpsTypeTraits<FCityPlan> : public TStructOpsTypeTraitsBase2<FCityPlan>
+{
+	enum
+	{
+		WithPostSerialize = true,
+	};
+};
+
+/**
+ * Generates city plans in a non-uniform grid style. Districts are split by roads until they
+ * are small enough to be blocks, and blocks are split into lots.
+ *
+ * Every area draws its random numbers from a seed hashed from its parent's, so the plan
+ * doesn't depend on the order areas are generated in. The districts at ParallelDepth are
+ * generated on worker threads, then merged in a fixed order, so the plan is identical for
+ * any number of threads.
+ */
+UCLASS(BlueprintType, EditInlineNew, DefaultToInstanced)
+class PORTFOLIO_API UCityPlanGenerator : public UObject
+{
+	GENERATED_BODY()
+
+public:
+
+	/** Generate a plan for the district with the settings of this generator. */
+	UFUNCTION(BlueprintCallable, Category = "City Plan")
+	void Generate(const FQuad2D& District, FCityPlan& OutPlan) const;
+
+	/** Quads of every node of the given type in the plan. */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "City Plan")
+	static void GetPlanQuads(const FCityPlan& Plan, const ECityPlanNodeType Type, TArray<FQuad2D>& OutQuads);
+
+	/** Rebuild the bounds and the road graph of a plan whose nodes were edited. */
+	UFUNCTION(BlueprintCallable, Category = "City Plan")
+	static void RebuildPlanIndex(UPARAM(ref) FCityPlan& Plan);
+
+	/** Index of the node of the given type under the location, or INDEX_NONE. Plans without bounds are queried through a rebuilt copy. */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "City Plan")
+	static int32 FindPlanNodeAt(const FCityPlan& Plan, const FVector& Location, const ECityPlanNodeType Type);
+
+	/** Indices of the nodes of the given type within the radius of the location. Plans without bounds are queried through a rebuilt copy. */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "City Plan")
+	static void GetPlanNodesInRadius(const FCityPlan& Plan, const FVector& Location, const float Radius, const ECityPlanNodeType Type, TArray<int32>& OutNodes);
+
+public:
+
+	static void GeneratePlan(const FQuad2D& District, const FCityPlanSettings& InSettings, FCityPlan& OutPlan);
+
+public:
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan")
+	FCityPlanSettings Settings;
+};
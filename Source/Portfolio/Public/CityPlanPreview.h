@@ -0,0 +1,102 @@
+// Copyright Bruno Silva. All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AsyncSectionMesh.h"
+#include "CityPlanGenerator.h"
+#include "CityPlanPreview.generated.h"
+
+/** Buffers of a preview layer. Only the vertices, triangles and colors are used. */
+struct PORTFOLIO_API FCityPreviewMesh : public FAsyncMeshSection
+{
+	/**
+	 * Build the outline of every quad as a flat ring, LineWidth wide, inside the quad. Quads are
+	 * filled instead if LineWidth is 0. Quads with a transparent color are skipped.
+	 */
+	void Build(TArrayView<const FQuad2D> Quads, TArrayView<const FLinearColor> QuadColors, const float LineWidth, const float Height);
+};
+
+/**
+ * Draws many quads with a few draw calls, as a replacement for the persistent debug lines of
+ * DrawQuad2D. Quads are grouped in layers, one mesh section each, so a plan can be split by
+ * chunk or by category. Only layers whose quads or colors changed are rebuilt.
+ */
+UCLASS(ClassGroup = (CityPlan), meta = (BlueprintSpawnableComponent))
+class PORTFOLIO_API UCityPlanPreviewComponent : public UAsyncSectionMeshComponent
+{
+	GENERATED_BODY()
+
+public:
+	/** Constructor. */
+	UCityPlanPreviewComponent(const FObjectInitializer& ObjectInitializer);
+
+//------------------------------------------------------------------------
+// METHODS
+//------------------------------------------------------------------------
+
+public:
+
+	/** Draw the quads as the given layer, all of the same color. Does nothing if the layer already shows them. */
+	UFUNCTION(BlueprintCallable, Category = "City Plan Preview")
+	void SetQuads(const int32 LayerIndex, const TArray<FQuad2D>& Quads, const FLinearColor Color);
+
+	/** Draw the nodes of the plan as the given layer, colored by type. Types without a color in TypeColors are skipped. */
+	UFUNCTION(BlueprintCallable, Category = "City Plan Preview")
+	void SetPlan(const int32 LayerIndex, const FCityPlan& Plan);
+
+	/** Same as SetQuads, with a color per quad. */
+	void SetLayer(const int32 LayerIndex, TArray<FQuad2D>&& Quads, TArray<FLinearColor>&& QuadColors);
+
+	UFUNCTION(BlueprintCallable, Category = "City Plan Preview")
+	void RemoveLayer(const int32 LayerIndex);
+
+	UFUNCTION(BlueprintCallable, Category = "City Plan Preview")
+	void ClearLayers();
+
+	/** Layers waiting for their buffers. */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "City Plan Preview")
+	int32 GetNumPendingLayers() const { return GetNumPendingSections(); }
+
+protected:
+
+	virtual TFunction<void(FAsyncMeshSection&)> CreateSectionBuild(const int32 SectionIndex) const override;
+
+	virtual UMaterialInterface* GetSectionMaterial(const int32 SectionIndex) const override { return PreviewMaterial; }
+
+//------------------------------------------------------------------------
+// PROPERTIES
+//------------------------------------------------------------------------
+
+public:
+
+	/** Width of the outlines. 0 fills the quads. Applies to layers built after the change. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan Preview", meta = (ClampMin = "0"))
+	float LineWidth;
+
+	/** Height of the quads above the component. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan Preview")
+	float Height;
+
+	/** Color of each node type drawn by SetPlan. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan Preview")
+	TMap<ECityPlanNodeType, FLinearColor> TypeColors;
+
+	/** Material of every layer. Should be two-sided and use the vertex color. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Plan Preview")
+	UMaterialInterface* PreviewMaterial;
+
+protected:
+
+	struct FLayer
+	{
+		TArray<FQuad2D> Quads;
+
+		TArray<FLinearColor> QuadColors;
+
+		/** Hash of the quads and colors, so changed layers are told apart without a full compare. */
+		uint32 Hash;
+	};
+
+	TMap<int32, FLayer> Layers;
+};
@@ -0,0 +1,60 @@
+// Copyright Bruno Silva. All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FCityPlan;
+
+/**
+ * Road network of a city plan, with intersections and dead ends as nodes and the stretches of
+ * road between them as edges. Edges are stored in compressed sparse rows: the edges leaving
+ * node i are EdgeOffsets[i] to EdgeOffsets[i + 1]. Every road is stored in both directions.
+ */
+struct PORTFOLIO_API FCityRoadGraph
+{
+	TArray<FVector2D> NodeLocations;
+
+	/** First edge of each node, plus one past the last edge at the end. */
+	TArray<int32> EdgeOffsets;
+
+	/** Node at the end of each edge. */
+	TArray<int32> EdgeTargets;
+
+	TArray<float> EdgeLengths;
+
+	/** Plan node of the road each edge runs along. */
+	TArray<int32> EdgeRoads;
+
+public:
+
+	/**
+	 * Build the graph from the roads of the plan, in time linear in the number of nodes. Roads
+	 * that end on another road meet its centerline, and nodes closer than the weld tolerance are
+	 * merged through a spatial hash.
+	 */
+	void Build(const FCityPlan& Plan, const float WeldTolerance = 1.0f);
+
+	void Reset();
+
+	int32 GetNumNodes() const { return NodeLocations.Num(); }
+
+	/** Number of directed edges, twice the number of road stretches. */
+	int32 GetNumEdges() const { return EdgeTargets.Num(); }
+
+	int32 GetFirstEdge(const int32 Node) const { return EdgeOffsets[Node]; }
+
+	int32 GetEndEdge(const int32 Node) const { return EdgeOffsets[Node + 1]; }
+
+	/** Nodes one edge away from the node. */
+	TArrayView<const int32> GetNeighbors(const int32 Node) const
+	{
+		return TArrayView<const int32>(EdgeTargets.GetData() + EdgeOffsets[Node], EdgeOffsets[Node + 1] - EdgeOffsets[Node]);
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return NodeLocations.GetAllocatedSize() + EdgeOffsets.GetAllocatedSize() + EdgeTargets.GetAllocatedSize()
+			+ EdgeLengths.GetAllocatedSize() + EdgeRoads.GetAllocatedSize();
+	}
+};
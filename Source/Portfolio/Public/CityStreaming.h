@@ -0,0 +1,202 @@
+// Copyright Bruno Silva. All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "CityPlanGenerator.h"
+#include "CityStreaming.generated.h"
+
+USTRUCT(BlueprintType)
+struct FCityStreamingSettings
+{
+	GENERATED_BODY()
+
+public:
+
+	/** Settings of the plan of each chunk. Its seed is combined with the coordinates of the chunk. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Streaming")
+	FCityPlanSettings PlanSettings;
+
+	/** Side of the square chunks, in world units. Chunk (0, 0) starts at the world origin. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Streaming", meta = (ClampMin = "1"))
+	float ChunkSize;
+
+	/** Chunks whose center is within this many chunks of a player are generated. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Streaming", meta = (ClampMin = "0"))
+	float LoadRadius;
+
+	/** Chunks farther than this many chunks from every player are evicted. Larger than LoadRadius, so chunks on the border don't flicker. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Streaming", meta = (ClampMin = "0"))
+	float UnloadRadius;
+
+	/** Upper bound of chunks being generated at once. Closest chunks go first. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "City Streaming", meta = (ClampMin = "1"))
+	int32 MaxPendingChunks;
+
+public:
+
+	FCityStreamingSettings()
+	{
+		ChunkSize = 100000.0f;
+		LoadRadius = 2.0f;
+		UnloadRadius = 3.0f;
+		MaxPendingChunks = 4;
+	}
+};
+
+USTRUCT(BlueprintType)
+struct FCityChunk
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY(BlueprintReadOnly, Category = "City Streaming")
+	FIntPoint Coords;
+
+	/** Plan of the chunk, inset by half a road on every side. */
+	UPROPERTY(BlueprintReadOnly, Category = "City Streaming")
+	FCityPlan Plan;
+
+	/** Half-width roads along the four borders. With the ones of the neighbors, they make the roads between chunks. */
+	UPROPERTY(BlueprintReadOnly, Category = "City Streaming")
+	TArray<FQuad2D> BorderRoads;
+
+public:
+
+	FCityChunk()
+	{
+		Coords = FIntPoint::ZeroValue;
+	}
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnCityChunkLoadedSignature, const FCityChunk&, Chunk);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnCityChunkUnloadedSignature, FIntPoint, Coords);
+
+/**
+ * Generates the city in square chunks around the players, and evicts them once every player
+ * is far enough. Memory and startup time depend on the load radius, not on the size of the city.
+ *
+ * Each chunk is generated from a seed hashed from its coordinates, so it comes back the same
+ * after being evicted, whatever the order chunks are loaded in. Plans are inset by half a road
+ * from the chunk borders, so neighboring chunks always meet along a full road.
+ */
+UCLASS()
+class PORTFOLIO_API UCityStreamingSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	/** Constructor. */
+	UCityStreamingSubsystem();
+
+//------------------------------------------------------------------------
+// METHODS
+//------------------------------------------------------------------------
+
+public:
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+	virtual void Deinitialize() override;
+
+public: // FTickableGameObject
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual bool IsTickable() const override;
+
+	virtual TStatId GetStatId() const override;
+
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+
+public:
+
+	/** Start streaming chunks around the players. Chunks loaded with other settings are evicted. */
+	UFUNCTION(BlueprintCallable, Category = "City Streaming")
+	void StartStreaming(const FCityStreamingSettings& InSettings);
+
+	/** Stop streaming and evict every chunk. */
+	UFUNCTION(BlueprintCallable, Category = "City Streaming")
+	void StopStreaming();
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "City Streaming")
+	FIntPoint GetChunkCoords(const FVector& WorldLocation) const;
+
+	/** Generate a chunk on the calling thread. Used by the workers, and by anything that needs a chunk out of range. */
+	static void GenerateChunk(const FIntPoint& Coords, const FCityStreamingSettings& InSettings, FCityChunk& OutChunk);
+
+	/** Copy of a loaded chunk. Returns false if the chunk isn't loaded. */
+	UFUNCTION(BlueprintCallable, Category = "City Streaming")
+	bool GetChunk(const FIntPoint& Coords, FCityChunk& OutChunk) const;
+
+	/** Loaded chunk, without copying it. Valid until the next tick. */
+	const FCityChunk* FindChunk(const FIntPoint& Coords) const;
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "City Streaming")
+	bool IsChunkLoaded(const FIntPoint& Coords) const { return FindChunk(Coords) != nullptr; }
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "City Streaming")
+	int32 GetNumLoadedChunks() const;
+
+protected:
+
+	/** Gather the location of every player. The server streams around remote players as well. */
+	void UpdateViews();
+
+	/** Evict the chunks far from every player. */
+	void EvictChunks();
+
+	/** Start generating the closest missing chunks, within the pending budget. */
+	void RequestChunks();
+
+	/** Store a generated chunk, unless it was evicted or requested again since. */
+	void OnChunkGenerated(const uint32 Generation, FCityChunk&& Chunk);
+
+	/** Distance from the center of the chunk to the closest player, in chunks. */
+	float GetDistanceToViews(const FIntPoint& Coords) const;
+
+//------------------------------------------------------------------------
+// PROPERTIES
+//------------------------------------------------------------------------
+
+public:
+
+	/** Called when a chunk is generated and stored. */
+	UPROPERTY(BlueprintAssignable, Category = "City Streaming")
+	FOnCityChunkLoadedSignature OnChunkLoaded;
+
+	/** Called when a loaded chunk is evicted. */
+	UPROPERTY(BlueprintAssignable, Category = "City Streaming")
+	FOnCityChunkUnloadedSignature OnChunkUnloaded;
+
+protected:
+
+	struct FChunkState
+	{
+		FCityChunk Chunk;
+
+		/** Changes with every request, so stale results are dropped. */
+		uint32 Generation;
+
+		bool bIsLoaded;
+	};
+
+	FCityStreamingSettings Settings;
+
+	TMap<FIntPoint, FChunkState> Chunks;
+
+	/** Player locations, in chunk units. */
+	TArray<FVector2D> ViewLocations;
+
+	int32 NumPendingChunks;
+
+	/** Shared by every chunk, so a chunk evicted and requested again never matches an older result. */
+	uint32 NextGeneration;
+
+	bool bIsStreaming;
+
+	bool bIsInitialized;
+};
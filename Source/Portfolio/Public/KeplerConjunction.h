@@ -0,0 +1,135 @@
+// Copyright Bruno Silva. All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "KeplerOrbit.h"
+#include "KeplerConjunction.generated.h"
+
+/** Close approach between two orbits of a conjunction finder. */
+USTRUCT(BlueprintType)
+struct FKeplerEncounter
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Conjunction")
+	int32 OrbitA;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Conjunction")
+	int32 OrbitB;
+
+	/** Time of the closest approach. Rounded to float for Blueprints, so prefer PreciseTime in code. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Conjunction")
+	float Time;
+
+	/** Time of the closest approach, in double precision. */
+	double PreciseTime;
+
+	/** Distance between both bodies at the closest approach. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Conjunction")
+	float Distance;
+
+public:
+
+	FKeplerEncounter()
+	{
+		OrbitA = INDEX_NONE;
+		OrbitB = INDEX_NONE;
+		Time = 0.0f;
+		PreciseTime = 0.0;
+		Distance = 0.0f;
+	}
+};
+
+/**
+ * Finds the close approaches between orbits around the same focus, within a time window.
+ * Pairs are culled with a sweep-and-prune over the periapsis-apoapsis shells, then by the
+ * bounds of each ellipse. The remaining pairs are searched by conservative advancement.
+ * Encounters are cached, and only the pairs of changed orbits are searched again.
+ */
+class PORTFOLIO_API FKeplerConjunctionFinder
+{
+public:
+
+	FKeplerConjunctionFinder();
+
+public:
+
+	/** Add an orbit. Epoch is the time at which the body is at its initial true anomaly. */
+	int32 Add(const FKeplerOrbitConfig& OrbitConfig, const double Epoch = 0.0);
+
+	/** Replace the orbit at the given index. Only the encounters of this orbit are searched again. */
+	void Set(const int32 Index, const FKeplerOrbitConfig& OrbitConfig, const double Epoch = 0.0);
+
+	/** Remove every orbit and encounter. */
+	void Reset();
+
+	int32 Num() const { return Orbits.Num(); }
+
+	/** Distance under which two bodies are reported. Invalidates every encounter. */
+	void SetThreshold(const float NewThreshold);
+
+	/** Time window searched for encounters. Double, so windows late in a long session stay accurate. Invalidates every encounter. */
+	void SetWindow(const double NewStartTime, const double NewDuration);
+
+	/** Encounters within the window, sorted by time. Searches the changed orbits first. */
+	const TArray<FKeplerEncounter>& GetEncounters();
+
+	/** Pairs left by the broadphase in the last update. */
+	int32 GetNumCandidatePairs() const { return NumCandidatePairs; }
+
+	/** Pairs of the last update whose search hit the step limit, so some of their encounters may be missing. */
+	int32 GetNumTruncatedPairs() const { return NumTruncatedPairs; }
+
+private:
+
+	struct FOrbit
+	{
+		FKeplerCompiledOrbit Compiled;
+
+		double Epoch;
+
+		/** Bounds of the ellipse, relative to the focus. */
+		FBox Bounds;
+
+		float MaxSpeed;
+
+		bool bIsDirty;
+	};
+
+	/** Fill the bounds and speed of an orbit from its config. */
+	static void BuildOrbit(FOrbit& Orbit, const FKeplerOrbitConfig& OrbitConfig, const double Epoch);
+
+	/** Pairs whose shells and bounds overlap, with at least one changed orbit, or every pair if bAll. */
+	void FindCandidatePairs(const bool bAll, TArray<TPair<int32, int32>>& OutPairs) const;
+
+	/**
+	 * Every local minimum of the distance under the threshold, within the window. Returns true if
+	 * the step limit stopped the search early, or forced steps too coarse for the threshold.
+	 */
+	bool SearchPair(const int32 IndexA, const int32 IndexB, TArray<FKeplerEncounter>& OutEncounters) const;
+
+private:
+
+	TArray<FOrbit> Orbits;
+
+	TArray<FKeplerEncounter> Encounters;
+
+	float Threshold;
+
+	double StartTime;
+
+	double Duration;
+
+	int32 NumCandidatePairs;
+
+	int32 NumTruncatedPairs;
+
+	/** Some orbits changed since the last update. */
+	bool bHasDirtyOrbits;
+
+	/** The threshold or window changed, so every pair must be searched again. */
+	bool bIsFullUpdateNeeded;
+};
@@ -0,0 +1,197 @@
+// Copyright Bruno Silva. All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "KeplerOrbit.h"
+#include "KeplerEphemeris.generated.h"
+
+USTRUCT(BlueprintType)
+struct FKeplerEphemerisSettings
+{
+	GENERATED_BODY()
+
+public:
+
+	/** Largest distance allowed between the fitted and the analytic position. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Ephemeris")
+	float MaxError;
+
+	/** Degree of the Chebyshev polynomial fitted to each segment. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Ephemeris", meta = (ClampMin = "2", ClampMax = "16"))
+	int32 Degree;
+
+	/** Segments per period after which the fit stops subdividing, even if the error bound is not met. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Ephemeris", meta = (ClampMin = "1", ClampMax = "4096"))
+	int32 MaxSegments;
+
+public:
+
+	FKeplerEphemerisSettings()
+	{
+		MaxError = 1.0f;
+		Degree = 8;
+		MaxSegments = 512;
+	}
+
+	bool operator==(const FKeplerEphemerisSettings& Other) const
+	{
+		return MaxError == Other.MaxError && Degree == Other.Degree && MaxSegments == Other.MaxSegments;
+	}
+
+	/** For use in TMap/TSet. */
+	friend inline uint32 GetTypeHash(const FKeplerEphemerisSettings& Settings)
+	{
+		uint32 Hash = GetTypeHash(Settings.MaxError);
+		Hash = HashCombine(Hash, GetTypeHash(Settings.Degree));
+		Hash = HashCombine(Hash, GetTypeHash(Settings.MaxSegments));
+		return Hash;
+	}
+};
+
+USTRUCT(BlueprintType)
+struct FKeplerEphemerisReport
+{
+	GENERATED_BODY()
+
+public:
+
+	/** Number of polynomial segments over one period. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Ephemeris")
+	int32 NumSegments;
+
+	/** Memory used by the coefficients and the lookup table, in bytes. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Ephemeris")
+	int32 MemoryBytes;
+
+	/** Largest distance to the analytic position found while validating the fit. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Ephemeris")
+	float MaxError;
+
+	/** Mean distance to the analytic position found while validating the fit. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Ephemeris")
+	float AverageError;
+
+	/** False if MaxSegments was reached before the error bound was met. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Ephemeris")
+	bool bMeetsErrorBound;
+
+public:
+
+	FKeplerEphemerisReport()
+	{
+		NumSegments = 0;
+		MemoryBytes = 0;
+		MaxError = 0.0f;
+		AverageError = 0.0f;
+		bMeetsErrorBound = false;
+	}
+};
+
+/**
+ * Piecewise Chebyshev fit of an orbit over one period. Evaluating it is a table
+ * lookup plus a short polynomial, with no Kepler solve. Only suited to orbits that
+ * never change, as building the fit costs many analytic evaluations.
+ */
+class PORTFOLIO_API FKeplerEphemeris
+{
+public:
+
+	FKeplerEphemeris() : Degree(0) {}
+
+	/** Fit the orbit. Segments are bisected until each one meets the error bound. */
+	void Build(const FKeplerOrbitConfig& OrbitConfig, const FKeplerEphemerisSettings& Settings);
+
+	bool IsValid() const { return SegmentStarts.Num() > 0; }
+
+	/** Position relative to the focus, Time seconds after the epoch. */
+	FVector Evaluate(const double Time) const;
+
+	const FKeplerEphemerisReport& GetReport() const { return Report; }
+
+	SIZE_T GetAllocatedSize() const;
+
+private:
+
+	/** Chebyshev coefficients of a position in the orbital plane, interpolated at Chebyshev nodes. */
+	void FitSegment(const float StartAnomaly, const float EndAnomaly, float* OutCoefficients) const;
+
+	/** Evaluate the plane position of a segment, for a mean anomaly inside of it. */
+	FVector2D EvaluateSegment(const int32 Segment, const float MeanAnomaly) const;
+
+	/** Exact plane position at the given mean anomaly. */
+	FVector2D EvaluateAnalytic(const float MeanAnomaly) const;
+
+private:
+
+	FKeplerCompiledOrbit Compiled;
+
+	int32 Degree;
+
+	/** Mean anomaly at the start of each segment, in [0, 2 * PI). Sorted. */
+	TArray<float> SegmentStarts;
+
+	/** Per segment: Degree + 1 coefficients for X, then Degree + 1 for Y. */
+	TArray<float> Coefficients;
+
+	/** Uniform grid over [0, 2 * PI) with the first segment of each cell. Cells are no wider than the smallest segment. */
+	TArray<uint16> SegmentLookup;
+
+	FKeplerEphemerisReport Report;
+};
+
+typedef TSharedPtr<const FKeplerEphemeris, ESPMode::ThreadSafe> FKeplerEphemerisPtr;
+
+/**
+ * Shares ephemerides between equal orbits, such as the duplicates of a procedural belt.
+ * Only weak references are kept, so an ephemeris is freed with its last user. Thread-safe.
+ */
+class PORTFOLIO_API FKeplerEphemerisCache
+{
+public:
+
+	static FKeplerEphemerisCache& Get();
+
+	/** Find the ephemeris of an equal orbit built with the same settings, building it if needed. */
+	FKeplerEphemerisPtr FindOrBuild(const FKeplerOrbitConfig& OrbitConfig, const FKeplerEphemerisSettings& Settings);
+
+	/** Number of cached entries, including the ones whose ephemeris was freed but not yet pruned. */
+	int32 Num() const;
+
+private:
+
+	/** Remove the entries whose ephemeris was freed. Expects the lock to be held. */
+	void PruneExpired();
+
+private:
+
+	struct FKey
+	{
+		FKeplerOrbitConfig OrbitConfig;
+		FKeplerEphemerisSettings Settings;
+
+		FKey(const FKeplerOrbitConfig& InOrbitConfig, const FKeplerEphemerisSettings& InSettings)
+			: OrbitConfig(InOrbitConfig)
+			, Settings(InSettings)
+		{
+		}
+
+		bool operator==(const FKey& Other) const
+		{
+			return OrbitConfig == Other.OrbitConfig && Settings == Other.Settings;
+		}
+
+		/** For use in TMap/TSet. */
+		friend inline uint32 GetTypeHash(const FKey& Key)
+		{
+			return HashCombine(GetTypeHash(Key.OrbitConfig), GetTypeHash(Key.Settings));
+		}
+	};
+
+	TMap<FKey, TWeakPtr<const FKeplerEphemeris, ESPMode::ThreadSafe>> Ephemerides;
+
+	/** Entries after which expired ones are pruned. Grows with the cache, so pruning stays amortized. */
+	int32 PruneThreshold = 64;
+
+	mutable FCriticalSection CriticalSection;
+};
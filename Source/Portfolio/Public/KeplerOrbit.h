@@ -4,8 +4,269 @@
 
 #include "CoreMinimal.h"
 #include "Kismet/BlueprintFunctionLibrary.h"
+#include "Templates/Atomic.h"
 #include "KeplerOrbit.generated.h"
 
+DECLARE_LOG_CATEGORY_EXTERN(LogKepler, Log, All);
+
+UENUM(BlueprintType)
+enum class EKeplerSolverMode : uint8
+{
+	/** Iterates E = M + e * sin(E). Cheap steps, but slow to converge on eccentric orbits. */
+	FixedPoint,
+
+	/** Newton-Raphson iterations. Converges quadratically. */
+	NewtonRaphson,
+
+	/** Halley iterations. Converges cubically, at the cost of a more expensive step. */
+	Halley,
+
+	/** Markley's non-iterative solution, refined with Newton-Raphson only if it misses the tolerance. */
+	Markley,
+
+	/** Bilinear lookup in a precomputed table, refined with a single Newton-Raphson step. Falls back to Newton-Raphson above the eccentricity of the table. */
+	LookupTable
+};
+
+USTRUCT(BlueprintType)
+struct FKeplerSolverSettings
+{
+	GENERATED_BODY()
+
+public:
+
+	/** Method used to solve Kepler's equation. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Solver")
+	EKeplerSolverMode Mode;
+
+	/** Largest correction, in radians, that is still considered converged. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Solver")
+	float Tolerance;
+
+	/** Iterations after which the solver gives up and returns its best estimate. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Solver")
+	int32 MaxIterations;
+
+public:
+
+	FKeplerSolverSettings()
+	{
+		Mode = EKeplerSolverMode::NewtonRaphson;
+		Tolerance = 1e-6f;
+		MaxIterations = 32;
+	}
+};
+
+USTRUCT(BlueprintType)
+struct FKeplerSolverStatsBucket
+{
+	GENERATED_BODY()
+
+public:
+
+	/** Eccentricity range covered by this bucket. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Solver")
+	float MinEccentricity;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Solver")
+	float MaxEccentricity;
+
+	/** Number of solves recorded in this bucket. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Solver")
+	int32 NumCalls;
+
+	/** Sum of the iterations of every recorded solve. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Solver")
+	int64 TotalIterations;
+
+	/** Highest iteration count of a single solve. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Solver")
+	int32 MaxIterations;
+
+	/** Mean iterations per solve. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Solver")
+	float AverageIterations;
+
+public:
+
+	FKeplerSolverStatsBucket()
+	{
+		MinEccentricity = 0.0f;
+		MaxEccentricity = 0.0f;
+		NumCalls = 0;
+		TotalIterations = 0;
+		MaxIterations = 0;
+		AverageIterations = 0.0f;
+	}
+};
+
+/** Solvers for Kepler's equation, M = E - e * sin(E). Every angle is in radians. */
+struct PORTFOLIO_API FKeplerSolver
+{
+	/** Wrap an angle to the [-PI, PI] range. */
+	static float ReduceAngle(const float AngleRad);
+
+	/** Wrap an angle to the [-PI, PI] range, in double precision, so large angles keep their fraction of a turn. */
+	static double ReduceAngle(const double AngleRad);
+
+	/** Danby's starter, a good initial guess for every iterative mode. Expects a reduced mean anomaly. */
+	static float GetStarterGuess(const float MeanAnomalyRad, const float Eccentricity);
+
+	/** Markley's non-iterative approximation of the eccentric anomaly. Expects a reduced mean anomaly. */
+	static float GetMarkleyEstimate(const float MeanAnomalyRad, const float Eccentricity);
+
+	/** Solve for the eccentric anomaly. The mean anomaly is range-reduced first, so the result is in [-PI, PI]. */
+	static float SolveEccentricAnomaly(const float MeanAnomalyRad, const float Eccentricity, const FKeplerSolverSettings& Settings, int32& OutIterations);
+};
+
+/** Per-eccentricity iteration counters for the Kepler solvers. Disabled by default. Thread-safe. */
+class PORTFOLIO_API FKeplerSolverStats
+{
+public:
+
+	static const int32 NumBuckets = 10;
+
+	static bool IsEnabled() { return bEnabled.Load(EMemoryOrder::Relaxed); }
+
+	static void SetEnabled(const bool bEnable) { bEnabled.Store(bEnable); }
+
+	/** Add one solve to the bucket of the given eccentricity. */
+	static void Record(const float Eccentricity, const int32 Iterations);
+
+	static void Reset();
+
+	static void GetBuckets(TArray<FKeplerSolverStatsBucket>& OutBuckets);
+
+private:
+
+	/** Read by every solve, on any thread, and set from the game thread. */
+	static TAtomic<bool> bEnabled;
+
+	static volatile int32 NumCalls[NumBuckets];
+
+	static volatile int64 TotalIterations[NumBuckets];
+
+	static volatile int32 MaxIterations[NumBuckets];
+};
+
+struct FKeplerOrbitConfig;
+
+/**
+ * Orbit data derived once from a FKeplerOrbitConfig, so positions can be evaluated with
+ * a few multiply-adds instead of building a quaternion per call. Angles are in radians.
+ *
+ * Times are in double precision, and the mean anomaly is range-reduced before it is
+ * narrowed to float, so orbits stay accurate after days of simulation.
+ */
+struct PORTFOLIO_API FKeplerCompiledOrbit
+{
+public:
+
+	/** Unit vector from the focus towards the periapsis. */
+	FVector PeriapsisAxis;
+
+	/** Unit vector in the orbital plane, 90 degrees ahead of the periapsis. */
+	FVector SemiLatusAxis;
+
+	/** Normal of the orbital plane. */
+	FVector NormalAxis;
+
+	float SemiMajorAxis;
+
+	float SemiMinorAxis;
+
+	float Eccentricity;
+
+	/** Equal to a * (1 - e^2). */
+	float SemiLatusRectum;
+
+	/** Equal to sqrt(1 - e^2), or b / a. */
+	float AxisRatio;
+
+	/** Mean anomaly swept per second. */
+	float MeanMotion;
+
+	/** Mean anomaly at time zero, derived from the initial true anomaly. */
+	float InitialMeanAnomaly;
+
+public:
+
+	FKeplerCompiledOrbit()
+	{
+		PeriapsisAxis = FVector::ForwardVector;
+		SemiLatusAxis = FVector::RightVector;
+		NormalAxis = FVector::UpVector;
+		SemiMajorAxis = 0.0f;
+		SemiMinorAxis = 0.0f;
+		Eccentricity = 0.0f;
+		SemiLatusRectum = 0.0f;
+		AxisRatio = 1.0f;
+		MeanMotion = 0.0f;
+		InitialMeanAnomaly = 0.0f;
+	}
+
+	/** Fill the cache from the given config. The derived data of the config must be up to date. */
+	void Compile(const FKeplerOrbitConfig& OrbitConfig);
+
+	/** Rotation from the orbital plane, where X points to the periapsis, to the world. */
+	FMatrix GetPerifocalToWorld() const
+	{
+		return FMatrix(PeriapsisAxis, SemiLatusAxis, NormalAxis, FVector::ZeroVector);
+	}
+
+	/** Mean anomaly at the given time, including the initial anomaly, in [-PI, PI]. */
+	float GetMeanAnomalyAtTime(const double Time) const
+	{
+		return (float)FKeplerSolver::ReduceAngle((double)InitialMeanAnomaly + ((double)MeanMotion * Time));
+	}
+
+	float GetTrueAnomaly(const float EccentricAnomalyRad) const
+	{
+		float SinE;
+		float CosE;
+		FMath::SinCos(&SinE, &CosE, EccentricAnomalyRad);
+		return FMath::Atan2(AxisRatio * SinE, CosE - Eccentricity);
+	}
+
+	FVector GetPositionFromTrueAnomaly(const float TrueAnomalyRad) const
+	{
+		float SinV;
+		float CosV;
+		FMath::SinCos(&SinV, &CosV, TrueAnomalyRad);
+		const float Distance = SemiLatusRectum / (1.0f + (Eccentricity * CosV));
+		return (PeriapsisAxis * (Distance * CosV)) + (SemiLatusAxis * (Distance * SinV));
+	}
+
+	FVector GetPositionFromEccentricAnomaly(const float EccentricAnomalyRad) const
+	{
+		float SinE;
+		float CosE;
+		FMath::SinCos(&SinE, &CosE, EccentricAnomalyRad);
+		return (PeriapsisAxis * (SemiMajorAxis * (CosE - Eccentricity))) + (SemiLatusAxis * (SemiMinorAxis * SinE));
+	}
+
+	/** Solve Kepler's equation and evaluate the position at the given time. */
+	FVector GetPositionAtTime(const double Time, const FKeplerSolverSettings& Settings = FKeplerSolverSettings()) const;
+
+	/** Velocity at the given eccentric anomaly, in units per second. */
+	FVector GetVelocityFromEccentricAnomaly(const float EccentricAnomalyRad) const;
+
+	/** Solve Kepler's equation once and evaluate both the position and the velocity at the given time. */
+	void GetStateAtTime(const double Time, FVector& OutPosition, FVector& OutVelocity, const FKeplerSolverSettings& Settings = FKeplerSolverSettings()) const;
+
+	/** Closed-form inverse of Kepler's equation, in [-PI, PI]. */
+	float GetMeanAnomalyFromTrueAnomaly(const float TrueAnomalyRad) const;
+
+	/** Seconds from the given time until the body next reaches the true anomaly, in [0, Period). */
+	float GetTimeUntilTrueAnomaly(const double Time, const float TrueAnomalyRad) const;
+
+	/** True anomaly at which the body crosses the XY plane upwards. False if the orbit lies in that plane. */
+	bool GetAscendingNodeAnomaly(float& OutTrueAnomalyRad) const;
+
+	/** Fastest speed along the orbit, reached at the periapsis. */
+	float GetPeriapsisSpeed() const;
+};
+
 USTRUCT(BlueprintType)
 struct FKeplerOrbitConfig
 {
@@ -37,21 +298,24 @@ public:
 public:
 
 	/** Half of the longest diameter of the orbit. */
-	UPROPERTY(BlueprintReadOnly, Category = "Kepler Orbit")
+	UPROPERTY(BlueprintReadOnly, NotReplicated, Category = "Kepler Orbit")
 	float SemiMajorAxis;
 
 	/** Half of the shortest diameter of the orbit. */
-	UPROPERTY(BlueprintReadOnly, Category = "Kepler Orbit")
+	UPROPERTY(BlueprintReadOnly, NotReplicated, Category = "Kepler Orbit")
 	float SemiMinorAxis;
 
 	/** Determines the amount by which the orbit deviates from a perfect circle. */
-	UPROPERTY(BlueprintReadOnly, Category = "Kepler Orbit")
+	UPROPERTY(BlueprintReadOnly, NotReplicated, Category = "Kepler Orbit")
 	float Eccentricity;
 
-	/** How long the orbiting body takes to complete one orbit. */
-	UPROPERTY(BlueprintReadOnly, Category = "Kepler Orbit")
+	/** How long the orbiting body takes to complete one orbit. For display, as the propagation derives its own from the semi-major axis. */
+	UPROPERTY(BlueprintReadOnly, NotReplicated, Category = "Kepler Orbit")
 	float Period;
 
+	/** Cached basis and constants, filled by UpdateOrbitData. Not serialized, so it is rebuilt after loading. */
+	FKeplerCompiledOrbit Compiled;
+
 public:
 
 	FKeplerOrbitConfig() {};
@@ -82,8 +346,36 @@ public:
 
 	void UpdateOrbitData();
 
+	/** Rebuild the derived data once the elements are loaded. */
+	void PostSerialize(const FArchive& Ar);
+
+	/** True if both orbits quantize to the same defining elements. Derived data is ignored. */
 	bool Equals(const FKeplerOrbitConfig& Other) const;
 
+	/** True if both orbits have the same periapsis and apoapsis, regardless of orientation and anomaly. */
+	bool HasSameShape(const FKeplerOrbitConfig& Other) const;
+
+	/** Hash of the quantized defining elements. Consistent with Equals. */
+	uint32 GetElementsHash() const;
+
+	/** Hash of the quantized periapsis and apoapsis. Consistent with HasSameShape. */
+	uint32 GetShapeHash() const;
+
+	/** Round a distance to the precision used by Equals and the hashes. */
+	static int64 QuantizeLength(const float Length);
+
+	/** Wrap an angle, in degrees, to (-180, 180] and round it to the precision used by Equals and the hashes. */
+	static int64 QuantizeAngle(const float Angle);
+
+	/** Gravitational parameter implied by Period, which is 720 * sqrt(a^3). */
+	static float GetGravitationalParameter();
+
+	/**
+	 * Osculating orbit of a body with the given position and velocity relative to the focus.
+	 * The body is at the initial true anomaly. Returns false if the body would escape or fall straight in.
+	 */
+	static bool FromStateVectors(const FVector& Position, const FVector& Velocity, FKeplerOrbitConfig& OutOrbitConfig);
+
 public:
 
 	bool operator==(const FKeplerOrbitConfig& Other) const
@@ -98,13 +390,22 @@ public:
 		return !bIsEqual;
 	}
 
-	uint32 GetTypeHash(const FKeplerOrbitConfig& Other)
+	/** For use in TMap/TSet. */
+	friend inline uint32 GetTypeHash(const FKeplerOrbitConfig& OrbitConfig)
 	{
-		uint32 Hash = FCrc::MemCrc32(&Other, sizeof(FKeplerOrbitConfig));
-		return Hash;
+		return OrbitConfig.GetElementsHash();
 	}
 };
 
+template<>
+struct TStructOpsTypeTraits<FKeplerOrbitConfig> : public TStructOpsTypeTraitsBase2<FKeplerOrbitConfig>
+{
+	enum
+	{
+		WithPostSerialize = true,
+	};
+};
+
 UCLASS()
 class PORTFOLIO_API UKeplerLibrary : public UBlueprintFunctionLibrary
 {
@@ -124,12 +425,16 @@ public:
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Kepler Orbit", meta = (DisplayName = "Equals"))
 	static bool Equals(const FKeplerOrbitConfig& A, const FKeplerOrbitConfig& B);
 
+	/** Mean anomaly swept in Time seconds, in degrees, wrapped to [-180, 180]. */
 	UFUNCTION(BlueprintCallable, Category = "Kepler Orbit", meta = (DisplayName = "Get Mean Anomaly"))
 	static float GetMeanAnomaly(const FKeplerOrbitConfig& OrbitConfig, const float Time);
 
 	UFUNCTION(BlueprintCallable, Category = "Kepler Orbit", meta = (DisplayName = "Get Eccentric Anomaly"))
 	static float GetEccentricAnomaly(const FKeplerOrbitConfig& OrbitConfig, const float MeanAnomaly);
 
+	UFUNCTION(BlueprintCallable, Category = "Kepler Orbit", meta = (DisplayName = "Get Eccentric Anomaly w/ Solver"))
+	static float GetEccentricAnomalyWithSolver(const FKeplerOrbitConfig& OrbitConfig, const float MeanAnomaly, const FKeplerSolverSettings& Settings, int32& OutIterations);
+
 	UFUNCTION(BlueprintCallable, Category = "Kepler Orbit", meta = (DisplayName = "Get True Anomaly"))
 	static float GetTrueAnomaly(const FKeplerOrbitConfig& OrbitConfig, const float EccentricAnomaly);
 
@@ -139,9 +444,34 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Kepler Orbit", meta = (DisplayName = "Get Orbital Position w/ Eccentric Anomaly"))
 	static FVector GetOrbitalPositionEcc(const FKeplerOrbitConfig& OrbitConfig, const float EccentricAnomaly);
 
+	/** Position relative to the focus, Time seconds after the body was at its initial true anomaly. */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Kepler Orbit", meta = (DisplayName = "Get Orbital Position at Time"))
+	static FVector GetOrbitalPositionAtTime(const FKeplerOrbitConfig& OrbitConfig, const float Time);
+
+	/** Seconds until the body next reaches the true anomaly, in degrees, Time seconds after it was at its initial true anomaly. */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Kepler Orbit", meta = (DisplayName = "Get Time Until True Anomaly"))
+	static float GetTimeUntilTrueAnomaly(const FKeplerOrbitConfig& OrbitConfig, const float Time, const float TrueAnomaly);
+
+	/** Seconds until the body next crosses the XY plane, upwards if bAscending. Returns false if the orbit lies in that plane. */
+	UFUNCTION(BlueprintCallable, Category = "Kepler Orbit", meta = (DisplayName = "Get Time Until Node Crossing"))
+	static bool GetTimeUntilNodeCrossing(const FKeplerOrbitConfig& OrbitConfig, const float Time, const bool bAscending, float& OutTime);
+
 	UFUNCTION(BlueprintCallable, Category = "Kepler Orbit", meta = (DisplayName = "Get Orbit Points"))
 	static void GetOrbitPoints(const FKeplerOrbitConfig& OrbitConfig, const int NumOfPoints, TArray<FVector>& OutPoints);
 
+	/** Points placed by chord error, with MaxChordError scaled by r/a so they are dense around the periapsis and sparse around the apoapsis. The shape is shared by equal orbits. */
+	UFUNCTION(BlueprintCallable, Category = "Kepler Orbit", meta = (DisplayName = "Get Orbit Points Adaptive"))
+	static void GetOrbitPointsAdaptive(const FKeplerOrbitConfig& OrbitConfig, const float MaxChordError, TArray<FVector>& OutPoints);
+
 	UFUNCTION(BlueprintCallable, Category = "Kepler Orbit", meta = (DisplayName = "Get Opposite Focus"))
 	static FKeplerOrbitConfig GetOppositeFocus(const FKeplerOrbitConfig& OrbitConfig);
+
+	UFUNCTION(BlueprintCallable, Category = "Kepler Solver", meta = (DisplayName = "Set Solver Stats Enabled"))
+	static void SetSolverStatsEnabled(const bool bEnable);
+
+	UFUNCTION(BlueprintCallable, Category = "Kepler Solver", meta = (DisplayName = "Reset Solver Stats"))
+	static void ResetSolverStats();
+
+	UFUNCTION(BlueprintCallable, Category = "Kepler Solver", meta = (DisplayName = "Get Solver Stats"))
+	static void GetSolverStats(TArray<FKeplerSolverStatsBucket>& OutBuckets);
 };
@@ -0,0 +1,86 @@
+// Copyright Bruno Silva. All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "KeplerOrbit.h"
+
+/** Identifies the shape of a polyline. Orbits that only differ in orientation or anomaly share it. */
+struct FKeplerPolylineKey
+{
+	int64 Periapsis;
+	int64 Apoapsis;
+	float MaxChordError;
+
+	FKeplerPolylineKey(const FKeplerOrbitConfig& OrbitConfig, const float InMaxChordError)
+	{
+		Periapsis = FKeplerOrbitConfig::QuantizeLength(OrbitConfig.Periapsis);
+		Apoapsis = FKeplerOrbitConfig::QuantizeLength(OrbitConfig.Apoapsis);
+		MaxChordError = InMaxChordError;
+	}
+
+	bool operator==(const FKeplerPolylineKey& Other) const
+	{
+		return Periapsis == Other.Periapsis && Apoapsis == Other.Apoapsis && MaxChordError == Other.MaxChordError;
+	}
+
+	/** For use in TMap/TSet. */
+	friend inline uint32 GetTypeHash(const FKeplerPolylineKey& Key)
+	{
+		uint32 Hash = GetTypeHash(Key.Periapsis);
+		Hash = HashCombine(Hash, GetTypeHash(Key.Apoapsis));
+		Hash = HashCombine(Hash, GetTypeHash(Key.MaxChordError));
+		return Hash;
+	}
+};
+
+/**
+ * Polylines of orbits in the orbital plane, where X points to the periapsis.
+ * Points are placed by chord error, with a tolerance that grows with the distance
+ * to the focus, so they are dense around the periapsis and sparse around the
+ * apoapsis. Each shape is built once and shared while any orbit still holds it,
+ * and every orbit with that shape only needs to transform it. Thread-safe.
+ */
+class PORTFOLIO_API FKeplerPolylineCache
+{
+public:
+
+	typedef TSharedRef<const TArray<FVector2D>, ESPMode::ThreadSafe> FPolylineRef;
+
+	static FKeplerPolylineCache& Get();
+
+	/** Find the polyline of the orbit's shape, building it if needed. */
+	FPolylineRef FindOrBuild(const FKeplerOrbitConfig& OrbitConfig, const float MaxChordError);
+
+	/** Forget every cached polyline. Polylines still referenced elsewhere stay alive. */
+	void Empty();
+
+	/** Number of cached entries, including the ones whose polyline was freed but not yet pruned. */
+	int32 Num() const;
+
+public:
+
+	/**
+	 * Sample the ellipse by bisecting eccentric anomaly spans until the distance from each
+	 * chord to the curve is below MaxChordError scaled by r/a, from 1 - e at the periapsis to
+	 * 1 + e at the apoapsis. The first point is the periapsis, and the last point is not repeated.
+	 */
+	static void BuildPolyline(const FKeplerOrbitConfig& OrbitConfig, const float MaxChordError, const int32 MaxPoints, TArray<FVector2D>& OutPoints);
+
+	/** Place the points of a plane polyline along the orbit in the world, relative to the focus. */
+	static void TransformPolyline(const FKeplerOrbitConfig& OrbitConfig, const TArray<FVector2D>& PlanePoints, TArray<FVector>& OutPoints);
+
+private:
+
+	/** Remove the entries whose polyline was freed. Expects the lock to be held. */
+	void PruneExpired();
+
+private:
+
+	TMap<FKeplerPolylineKey, TWeakPtr<const TArray<FVector2D>, ESPMode::ThreadSafe>> Polylines;
+
+	/** Entries after which expired ones are pruned. Grows with the cache, so pruning stays amortized. */
+	int32 PruneThreshold = 64;
+
+	mutable FCriticalSection CriticalSection;
+};
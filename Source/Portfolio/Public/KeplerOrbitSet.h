@@ -0,0 +1,90 @@
+// Copyright Bruno Silva. All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "KeplerOrbit.h"
+
+/**
+ * Structure-of-arrays storage for propagating a large number of orbits in a single call.
+ * The hot arrays are padded to a multiple of the SIMD width, so the propagator never
+ * needs a remainder loop. Padded lanes describe a degenerate orbit at the focus.
+ */
+class PORTFOLIO_API FKeplerOrbitSet
+{
+public:
+
+	typedef TArray<float, TAlignedHeapAllocator<16>> FAlignedFloatArray;
+
+	FKeplerOrbitSet() : NumOrbits(0) {}
+
+public:
+
+	/** Add an orbit to the set. Epoch is the time at which the body is at its initial true anomaly. */
+	int32 Add(const FKeplerOrbitConfig& OrbitConfig, const double Epoch = 0.0);
+
+	/** Replace the orbit at the given index. */
+	void Set(const int32 Index, const FKeplerOrbitConfig& OrbitConfig, const double Epoch = 0.0);
+
+	/** Remove every orbit from the set. */
+	void Reset();
+
+	/** Preallocate memory for the given number of orbits. */
+	void Reserve(const int32 Num);
+
+	int32 Num() const { return NumOrbits; }
+
+	const FKeplerOrbitConfig& GetOrbitConfig(const int32 Index) const { return OrbitConfigs[Index]; }
+
+public:
+
+	/** Compute the position of every orbit, relative to its focus, at the given time. */
+	void Propagate(const double Time, TArrayView<FVector> OutPositions) const;
+
+	/** Compute the position of every orbit, relative to its focus, at the given time. */
+	void Propagate(const double Time, TArray<FVector>& OutPositions) const;
+
+	/** Compute the positions of a range of orbits. StartIndex must be a multiple of 4. OutPositions[0] receives orbit StartIndex. */
+	void Propagate(const double Time, const int32 StartIndex, const int32 Count, TArrayView<FVector> OutPositions) const;
+
+	/** Reference path that evaluates each orbit through UKeplerLibrary. Slow, but matches the library exactly. */
+	void PropagateScalar(const double Time, TArrayView<FVector> OutPositions) const;
+
+private:
+
+	void WriteOrbit(const int32 Index, const FKeplerOrbitConfig& OrbitConfig, const double Epoch);
+
+	void WritePadding(const int32 Index);
+
+	int32 GetPaddedNum() const { return Align(NumOrbits, 4); }
+
+private:
+
+	int32 NumOrbits;
+
+	/** Configs used by the scalar path. Not touched by Propagate. */
+	TArray<FKeplerOrbitConfig> OrbitConfigs;
+
+	FAlignedFloatArray Eccentricity;
+	FAlignedFloatArray SemiMajorAxis;
+	FAlignedFloatArray SemiMinorAxis;
+
+	/** Mean motion, in radians per second. */
+	FAlignedFloatArray MeanMotion;
+
+	/** Mean anomaly at the epoch, in radians. */
+	FAlignedFloatArray MeanAnomalyAtEpoch;
+
+	/** Only read to reduce the mean anomaly, which is done in double precision. */
+	TArray<double> Epochs;
+
+	/** Unit vector pointing from the focus to the periapsis. */
+	FAlignedFloatArray PeriapsisX;
+	FAlignedFloatArray PeriapsisY;
+	FAlignedFloatArray PeriapsisZ;
+
+	/** Unit vector in the orbital plane, 90 degrees ahead of the periapsis. */
+	FAlignedFloatArray SemiLatusX;
+	FAlignedFloatArray SemiLatusY;
+	FAlignedFloatArray SemiLatusZ;
+};
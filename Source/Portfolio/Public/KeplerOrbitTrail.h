@@ -0,0 +1,123 @@
+// Copyright Bruno Silva. All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AsyncSectionMesh.h"
+#include "KeplerOrbit.h"
+#include "KeplerOrbitTrail.generated.h"
+
+USTRUCT(BlueprintType)
+struct FKeplerTrailSettings
+{
+	GENERATED_BODY()
+
+public:
+
+	/** Width of the ribbon, in the orbital plane. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Trail", meta = (ClampMin = "0"))
+	float Width;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Trail")
+	FLinearColor Color;
+
+	/** Alpha at both edges of the ribbon. The middle is opaque, so lower values fade the edges out. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Trail", meta = (ClampMin = "0", ClampMax = "1"))
+	float EdgeAlpha;
+
+	/** Largest distance between the ribbon and the orbit. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Trail", meta = (ClampMin = "0.01"))
+	float MaxChordError;
+
+public:
+
+	FKeplerTrailSettings()
+	{
+		Width = 100.0f;
+		Color = FLinearColor::White;
+		EdgeAlpha = 0.0f;
+		MaxChordError = 10.0f;
+	}
+
+	bool operator==(const FKeplerTrailSettings& Other) const
+	{
+		return Width == Other.Width && Color == Other.Color && EdgeAlpha == Other.EdgeAlpha && MaxChordError == Other.MaxChordError;
+	}
+
+	bool operator!=(const FKeplerTrailSettings& Other) const
+	{
+		return !(*this == Other);
+	}
+};
+
+/** Buffers of a trail ribbon. */
+struct PORTFOLIO_API FKeplerTrailMesh : public FAsyncMeshSection
+{
+	/**
+	 * Build a flat ribbon along the orbit, relative to the focus. Each point has three vertices
+	 * across the ribbon, so the alpha fades from the middle to the edges. U is the fraction of the
+	 * period since the periapsis, so materials can fade the trail behind the body.
+	 */
+	void Build(const FKeplerOrbitConfig& OrbitConfig, const FKeplerTrailSettings& Settings);
+};
+
+/**
+ * Draws orbit ribbons, one mesh section per trail. Only trails whose orbit or settings changed
+ * are rebuilt. Place it at the focus of the orbits.
+ */
+UCLASS(ClassGroup = (Kepler), meta = (BlueprintSpawnableComponent))
+class PORTFOLIO_API UKeplerOrbitTrailComponent : public UAsyncSectionMeshComponent
+{
+	GENERATED_BODY()
+
+public:
+	/** Constructor. */
+	UKeplerOrbitTrailComponent(const FObjectInitializer& ObjectInitializer);
+
+//------------------------------------------------------------------------
+// METHODS
+//------------------------------------------------------------------------
+
+public:
+
+	/** Draw the orbit as the given trail. Does nothing if the trail already shows that orbit with those settings. */
+	UFUNCTION(BlueprintCallable, Category = "Kepler Trail")
+	void SetTrail(const int32 TrailIndex, const FKeplerOrbitConfig& OrbitConfig, const FKeplerTrailSettings& Settings);
+
+	UFUNCTION(BlueprintCallable, Category = "Kepler Trail")
+	void RemoveTrail(const int32 TrailIndex);
+
+	UFUNCTION(BlueprintCallable, Category = "Kepler Trail")
+	void ClearTrails();
+
+	/** Trails waiting for their buffers. */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Kepler Trail")
+	int32 GetNumPendingTrails() const { return GetNumPendingSections(); }
+
+protected:
+
+	virtual TFunction<void(FAsyncMeshSection&)> CreateSectionBuild(const int32 SectionIndex) const override;
+
+	virtual UMaterialInterface* GetSectionMaterial(const int32 SectionIndex) const override { return TrailMaterial; }
+
+//------------------------------------------------------------------------
+// PROPERTIES
+//------------------------------------------------------------------------
+
+public:
+
+	/** Material of every trail. Should be two-sided and translucent to show the fade. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Trail")
+	UMaterialInterface* TrailMaterial;
+
+protected:
+
+	struct FTrail
+	{
+		FKeplerOrbitConfig OrbitConfig;
+
+		FKeplerTrailSettings Settings;
+	};
+
+	TMap<int32, FTrail> Trails;
+};
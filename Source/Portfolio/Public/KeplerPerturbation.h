@@ -0,0 +1,123 @@
+// Copyright Bruno Silva. All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "KeplerPerturbation.generated.h"
+
+USTRUCT(BlueprintType)
+struct FKeplerPerturbationSettings
+{
+	GENERATED_BODY()
+
+public:
+
+	/** Disturb perturbed bodies with the gravity of massive ones. Off by default, as pure Kepler orbits are much cheaper. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Perturbation")
+	bool bEnabled;
+
+	/** Simulation seconds between updates of the perturbed orbits. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Perturbation", meta = (ClampMin = "0.001"))
+	float UpdateInterval;
+
+	/** Nodes smaller than this fraction of their distance are taken as a single mass. 0 sums every body exactly. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Perturbation", meta = (ClampMin = "0"))
+	float OpeningAngle;
+
+	/** Distance under which the pull of a mass stops growing, so close passes don't fling bodies away. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Perturbation", meta = (ClampMin = "0"))
+	float Softening;
+
+	/** Upper bound of nodes in the tree. Bodies past it are summed directly, so accuracy is kept, but not speed. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Perturbation", meta = (ClampMin = "1"))
+	int32 MaxNodes;
+
+public:
+
+	FKeplerPerturbationSettings()
+	{
+		bEnabled = false;
+		UpdateInterval = 1.0f;
+		OpeningAngle = 0.5f;
+		Softening = 100.0f;
+		MaxNodes = 4096;
+	}
+};
+
+/**
+ * Barnes-Hut octree over point masses. Each node keeps the total mass and center of mass of
+ * its sources, which stand in for them when the node is small and far enough. Sources are
+ * sorted so every node covers a contiguous range, which makes them cheap to skip.
+ *
+ * Nodes come from a pool of fixed size, so rebuilding the tree never allocates once warm.
+ */
+class PORTFOLIO_API FKeplerGravityTree
+{
+public:
+
+	FKeplerGravityTree();
+
+public:
+
+	/** Build the tree. Masses are gravitational parameters, in the units of FKeplerOrbitConfig::GetGravitationalParameter. */
+	void Build(TArrayView<const FVector> Positions, TArrayView<const float> Masses, const int32 MaxNodes);
+
+	/** Remove every source and node, keeping the memory. */
+	void Reset();
+
+	/** Acceleration at the location, ignoring up to two sources by index. Thread-safe once built. */
+	FVector GetAcceleration(const FVector& Location, const int32 IgnoredA, const int32 IgnoredB, const float OpeningAngle, const float Softening) const;
+
+	int32 GetNumNodes() const { return Nodes.Num(); }
+
+	int32 GetNumSources() const { return SortedPositions.Num(); }
+
+	SIZE_T GetAllocatedSize() const;
+
+private:
+
+	struct FNode
+	{
+		/** Center of the cube covered by the node. */
+		FVector Center;
+
+		float HalfSize;
+
+		FVector CenterOfMass;
+
+		float Mass;
+
+		/** Children are contiguous. INDEX_NONE for leaves. */
+		int32 FirstChild;
+
+		int32 NumChildren;
+
+		/** Range of the node in the sorted sources. */
+		int32 FirstSource;
+
+		int32 NumSources;
+	};
+
+	/** Split the sources of a node among its octants, while the pool lasts. */
+	void Subdivide(const int32 NodeIndex, const int32 Depth, const int32 MaxNodes);
+
+	/** Add the pull of the sources of a leaf, skipping the ignored slots. */
+	void AddLeafAcceleration(const FNode& Node, const FVector& Location, const int32 IgnoredSlotA, const int32 IgnoredSlotB, const float SofteningSquared, FVector& OutAcceleration) const;
+
+private:
+
+	TArray<FNode> Nodes;
+
+	/** Sources in tree order. */
+	TArray<FVector> SortedPositions;
+
+	TArray<float> SortedMasses;
+
+	/** Index of each source in tree order, by original index. */
+	TArray<int32> SourceSlots;
+
+	/** Scratch of the build. Original index of each source in tree order. */
+	TArray<int32> SortedSources;
+
+	TArray<int32> ScratchSources;
+};
@@ -0,0 +1,654 @@
+// Copyright Bruno Silva. All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "Engine/NetSerialization.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "KeplerEphemeris.h"
+#include "KeplerOrbit.h"
+#include "KeplerOrbitSet.h"
+#include "KeplerPerturbation.h"
+#include "KeplerSimulation.generated.h"
+
+USTRUCT(BlueprintType)
+struct FKeplerLodSettings
+{
+	GENERATED_BODY()
+
+public:
+
+	/** Update far bodies less often. Without a local player camera, every body is updated every frame. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler LOD")
+	bool bEnabled;
+
+	/** Bodies closer than this to a camera are updated every frame. Each doubling of the distance halves the rate. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler LOD", meta = (ClampMin = "1"))
+	float FullRateDistance;
+
+	/** Coarsest level. Bodies at level k are updated every 2^k frames. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler LOD", meta = (ClampMin = "0", ClampMax = "8"))
+	int32 MaxLod;
+
+	/** Bodies smaller than this on every screen, as a fraction of half the screen width, use the coarsest level. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler LOD")
+	float MinScreenSize;
+
+	/** Radius used for bodies whose component has no bounds. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler LOD")
+	float DefaultBodyRadius;
+
+	/** Solver time per frame, in microseconds summed across threads. Near bodies are always updated, far ones wait for a later frame. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler LOD", meta = (ClampMin = "0"))
+	float BudgetMicroseconds;
+
+public:
+
+	FKeplerLodSettings()
+	{
+		bEnabled = true;
+		FullRateDistance = 50000.0f;
+		MaxLod = 4;
+		MinScreenSize = 0.002f;
+		DefaultBodyRadius = 100.0f;
+		BudgetMicroseconds = 1000.0f;
+	}
+};
+
+UENUM(BlueprintType)
+enum class EKeplerEventType : uint8
+{
+	Periapsis,
+	Apoapsis,
+	/** Crossing of the XY plane, upwards. */
+	AscendingNode,
+	/** Crossing of the XY plane, downwards. */
+	DescendingNode,
+	/** Entry into a sphere around another body, such as its sphere of influence. */
+	SphereEntry,
+	SphereExit
+};
+
+USTRUCT(BlueprintType)
+struct FKeplerEvent
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Event")
+	int32 BodyId;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Event")
+	EKeplerEventType Type;
+
+	/** Simulation time of the event. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Event")
+	float Time;
+
+	/** Body at the center of the sphere, for sphere events. INDEX_NONE otherwise. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Event")
+	int32 OtherBodyId;
+
+public:
+
+	FKeplerEvent()
+	{
+		BodyId = INDEX_NONE;
+		Type = EKeplerEventType::Periapsis;
+		Time = 0.0f;
+		OtherBodyId = INDEX_NONE;
+	}
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnKeplerEventSignature, const FKeplerEvent&, Event);
+
+/** Orbit of a body as sent to clients. Positions follow from it, so it is only sent when the orbit changes. */
+USTRUCT(BlueprintType)
+struct FKeplerOrbitNetState
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Orbit")
+	FKeplerOrbitConfig OrbitConfig;
+
+	/** Server simulation time at which the body was at its initial true anomaly. Double, so long sessions stay accurate. */
+	UPROPERTY()
+	double Epoch;
+
+	/** Server simulation time minus the scaled server world time, when the orbit changed. */
+	UPROPERTY()
+	double ServerTimeOffset;
+
+	/** Time scale of the server simulation, when the orbit changed. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Orbit")
+	float TimeScale;
+
+public:
+
+	FKeplerOrbitNetState()
+	{
+		Epoch = 0.0;
+		ServerTimeOffset = 0.0;
+		TimeScale = 1.0f;
+	}
+
+	/** Server simulation time at the given server world time. */
+	double GetServerSimulationTime(const float ServerWorldTime) const
+	{
+		return ServerTimeOffset + ((double)TimeScale * ServerWorldTime);
+	}
+
+	/** Epoch in a local simulation, so the body has spent as long on its orbit there as on the server. */
+	double GetLocalEpoch(const double LocalSimulationTime, const float ServerWorldTime) const
+	{
+		return LocalSimulationTime - (GetServerSimulationTime(ServerWorldTime) - Epoch);
+	}
+};
+
+/**
+ * Moves its owner along an orbit. The orbit is propagated by the UKeplerSubsystem,
+ * so the owner does not need to tick.
+ *
+ * In multiplayer, the server replicates the orbit and its epoch instead of the movement
+ * of the owner, and clients propagate the orbit locally.
+ */
+UCLASS(ClassGroup = (Kepler), meta = (BlueprintSpawnableComponent))
+class PORTFOLIO_API UKeplerOrbitComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	/** Constructor. */
+	UKeplerOrbitComponent();
+
+//------------------------------------------------------------------------
+// METHODS
+//------------------------------------------------------------------------
+
+public:
+
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	/** Replicate properties to clients. */
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
+public:
+
+	/** Add this body to the simulation. Registers the parent first, if needed. */
+	void RegisterWithSubsystem();
+
+	/** Remove this body from the simulation. */
+	void UnregisterFromSubsystem();
+
+	/** Change the orbit followed by the owner. */
+	UFUNCTION(BlueprintCallable, Category = "Kepler Orbit")
+	void SetOrbitConfig(const FKeplerOrbitConfig& NewOrbitConfig);
+
+	/** Id of this body in the simulation, or INDEX_NONE if not registered. */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Kepler Orbit")
+	int32 GetBodyId() const { return BodyId; }
+
+	/** Largest distance between the server and the client positions found by the drift checks. */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Kepler Orbit")
+	float GetMaxDrift() const { return MaxDrift; }
+
+	/** Server simulation time as estimated from the replicated game state. */
+	double GetServerSimulationTime() const;
+
+public:
+
+	UFUNCTION()
+	void OnRep_NetState();
+
+	/** Send the server position at the given server simulation time, so clients can measure their drift. */
+	UFUNCTION(NetMulticast, Unreliable)
+	void MulticastCheckDrift(const double ServerSimulationTime, const FVector_NetQuantize100& ServerPosition);
+
+protected:
+
+	/** Capture the orbit and the server clock to be replicated. Server only. */
+	void UpdateNetState();
+
+	/** Follow the replicated orbit, at the epoch mapped to the local simulation time. Clients only. */
+	void ApplyNetState();
+
+	/** Broadcast a drift check. Server only. */
+	void SendDriftCheck();
+
+//------------------------------------------------------------------------
+// PROPERTIES
+//------------------------------------------------------------------------
+
+public:
+
+	/** Orbit followed by the owner. Ignored by static bodies. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Kepler Orbit")
+	FKeplerOrbitConfig OrbitConfig;
+
+	/** Actor at the focus of the orbit. Must have an orbit component. If unset, the focus is the owner's location at begin play. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Kepler Orbit")
+	AActor* OrbitParent;
+
+	/** Static bodies, such as a star, don't move and only serve as the focus of other orbits. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Kepler Orbit")
+	bool bIsStaticBody;
+
+	/** Evaluate the orbit from a precomputed ephemeris instead of solving it every frame. Best for orbits that never change. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Kepler Orbit")
+	bool bUseEphemeris;
+
+	/** Accuracy and memory limits of the ephemeris. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Kepler Orbit", meta = (EditCondition = "bUseEphemeris"))
+	FKeplerEphemerisSettings EphemerisSettings;
+
+	/** Mass as a fraction of the mass at the focus of every orbit. Massive bodies perturb the others when perturbations are enabled. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Kepler Orbit|Perturbation", meta = (ClampMin = "0"))
+	float Mass;
+
+	/** Let massive bodies disturb this orbit. Perturbed orbits are not replicated, so best for local bodies such as asteroids. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Kepler Orbit|Perturbation", meta = (EditCondition = "!bIsStaticBody && !bUseEphemeris"))
+	bool bIsPerturbed;
+
+	/** Replicate the orbit instead of the movement of the owner. Clients should use the same time scale as the server. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Kepler Orbit|Network")
+	bool bReplicateOrbit;
+
+	/** Seconds between drift checks, or 0 to disable them. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Kepler Orbit|Network", meta = (EditCondition = "bReplicateOrbit", ClampMin = "0"))
+	float DriftCheckInterval;
+
+	/** Drift after which a client maps the epoch to its simulation time again. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Kepler Orbit|Network", meta = (EditCondition = "bReplicateOrbit", ClampMin = "0"))
+	float DriftTolerance;
+
+protected:
+
+	/** Orbit and epoch sent to clients. */
+	UPROPERTY(ReplicatedUsing = OnRep_NetState)
+	FKeplerOrbitNetState NetState;
+
+	/** Id of this body in the simulation. */
+	int32 BodyId;
+
+	/** Guards against cycles in the parent chain while registering. */
+	bool bIsRegistering;
+
+	/** True once a client has received the orbit from the server. */
+	bool bHasNetState;
+
+	float MaxDrift;
+
+	FTimerHandle DriftCheckTimer;
+};
+
+/**
+ * Propagates every orbit of the world in a single pass per frame. Bodies are kept in a
+ * flat array sorted by depth (star, planets, moons...), so a parent is always updated
+ * before its children. Each depth level is propagated in parallel, and the resulting
+ * locations are written to the scene components in one batch at the end of the frame.
+ *
+ * Bodies are scheduled in packets of 4, the width of the orbit set solver. Packets far
+ * from every camera are solved every 2^k frames, in staggered buckets, and extrapolated
+ * along their orbit in between.
+ *
+ * Watched events are predicted in closed form, or by conservative advancement for spheres,
+ * and kept in a queue. Time-warp jumps from one event to the next, so its cost grows with
+ * the number of events instead of the number of frames.
+ *
+ * Optionally, massive bodies perturb the others. Their pull is summed with a Barnes-Hut
+ * tree, in parallel, and folded into the orbits at a low rate as osculating elements, so
+ * perturbed bodies are still propagated as Kepler orbits between updates.
+ */
+UCLASS()
+class PORTFOLIO_API UKeplerSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	/** Constructor. */
+	UKeplerSubsystem();
+
+//------------------------------------------------------------------------
+// METHODS
+//------------------------------------------------------------------------
+
+public:
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+	virtual void Deinitialize() override;
+
+public: // FTickableGameObject
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual bool IsTickable() const override;
+
+	virtual TStatId GetStatId() const override;
+
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+
+public:
+
+	/**
+	 * Add an orbiting body. If ParentId is INDEX_NONE, the body orbits around Focus.
+	 * If EphemerisSettings is given, the body is evaluated from a precomputed ephemeris.
+	 * Returns the id of the body.
+	 */
+	int32 RegisterBody(const FKeplerOrbitConfig& OrbitConfig, const int32 ParentId, const FVector& Focus, USceneComponent* Target, const FKeplerEphemerisSettings* EphemerisSettings = nullptr);
+
+	/** Add a body that never moves, such as a star. Returns the id of the body. */
+	int32 RegisterStaticBody(const FVector& Location, USceneComponent* Target);
+
+	/** Remove a body. Its children keep orbiting around its last location. */
+	void UnregisterBody(const int32 BodyId);
+
+	/** Change the orbit of a registered body. The body starts at its initial true anomaly now. */
+	void SetOrbitConfig(const int32 BodyId, const FKeplerOrbitConfig& OrbitConfig);
+
+	/** Change the orbit of a registered body, which was at its initial true anomaly at the given simulation time. */
+	void SetOrbitConfig(const int32 BodyId, const FKeplerOrbitConfig& OrbitConfig, const double Epoch);
+
+	/** Simulation time at which the body was at its initial true anomaly. */
+	double GetBodyEpoch(const int32 BodyId) const;
+
+	/** Mass as a fraction of the mass at the focus of every orbit. Massive bodies perturb the others. */
+	UFUNCTION(BlueprintCallable, Category = "Kepler Simulation")
+	void SetBodyMass(const int32 BodyId, const float Mass);
+
+	/** Let massive bodies disturb the orbit of the body. Ignored by static and ephemeris bodies. */
+	UFUNCTION(BlueprintCallable, Category = "Kepler Simulation")
+	void SetBodyPerturbed(const int32 BodyId, const bool bIsPerturbed);
+
+	/** World location of the body, as of the last update. */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Kepler Simulation")
+	FVector GetBodyLocation(const int32 BodyId) const;
+
+	/** Time used to propagate the orbits. Rounded to float for Blueprints, so prefer GetPreciseSimulationTime in code. */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Kepler Simulation")
+	float GetSimulationTime() const { return (float)SimulationTime; }
+
+	/** Time used to propagate the orbits, in double precision. */
+	double GetPreciseSimulationTime() const { return SimulationTime; }
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Kepler Simulation")
+	int32 GetNumBodies() const { return Bodies.Num(); }
+
+	/** Memory and accuracy of the ephemeris of a body. Returns false if the body doesn't use one. */
+	UFUNCTION(BlueprintCallable, Category = "Kepler Simulation")
+	bool GetEphemerisReport(const int32 BodyId, FKeplerEphemerisReport& OutReport) const;
+
+	/** Exact world location at any simulation time, following the parent chain analytically. */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Kepler Simulation")
+	FVector GetBodyLocationAtTime(const int32 BodyId, const float Time) const;
+
+	/** Same as GetBodyLocationAtTime, in double precision. */
+	FVector GetBodyLocationAtPreciseTime(const int32 BodyId, const double Time) const;
+
+	/** Report every occurrence of an orbital event of the body. Sphere events are watched with WatchSphere. */
+	UFUNCTION(BlueprintCallable, Category = "Kepler Simulation")
+	void WatchEvent(const int32 BodyId, const EKeplerEventType Type);
+
+	/** Report when the body enters or leaves a sphere around the other body, such as its sphere of influence. */
+	UFUNCTION(BlueprintCallable, Category = "Kepler Simulation")
+	void WatchSphere(const int32 BodyId, const int32 OtherBodyId, const float Radius);
+
+	/** Stop reporting the events of the body, including the spheres around it. */
+	UFUNCTION(BlueprintCallable, Category = "Kepler Simulation")
+	void UnwatchBody(const int32 BodyId);
+
+	/** Earliest scheduled event. Returns false if no event is watched. */
+	UFUNCTION(BlueprintCallable, Category = "Kepler Simulation")
+	bool GetNextEvent(FKeplerEvent& OutEvent) const;
+
+	/**
+	 * Jump the simulation forward, stopping only at watched events to broadcast them.
+	 * Bodies are moved on the next tick. Returns the number of events broadcast.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Kepler Simulation")
+	int32 FastForward(const float Duration);
+
+	/** Bodies solved in the last frame. The others were extrapolated. */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Kepler Simulation")
+	int32 GetNumRefreshedBodies() const { return NumRefreshedBodies; }
+
+protected:
+
+	struct FScheduledEvent;
+
+	/** Sort the bodies by depth and rebuild the orbit sets of each level. */
+	void RebuildHierarchy();
+
+	/** Gather the location and field of view of the local player cameras. */
+	void UpdateViews();
+
+	/** Decide which packets are solved this frame, within the budget, and update their LOD. */
+	void ScheduleRefreshes();
+
+	/** Coarsest LOD allowed by the distance and screen size of a body, as of its last location. */
+	int32 ComputeLod(const int32 FlatIndex) const;
+
+	/** Compute the world location of every body, level by level. */
+	void PropagateOrbits();
+
+	/** Broadcast the events up to the given time, in order, and advance the simulation time to it. */
+	int32 ProcessEvents(const double EndTime);
+
+	/** Reschedule the events of a body whose orbit or parent changed. */
+	void RescheduleEvents(const int32 BodyId);
+
+	/** Queue the next occurrence of an event, after the given time. */
+	void ScheduleEvent(FScheduledEvent Scheduled, const double FromTime);
+
+	/** Search a sphere crossing within [StartTime, EndTime]. If none is found, OutTime is how far the search got. */
+	bool FindSphereCrossing(const FScheduledEvent& Scheduled, const double StartTime, const double EndTime, double& OutTime) const;
+
+	/** Upper bound of the world speed of a body, summed along its parent chain. */
+	float GetMaxBodySpeed(const int32 BodyId) const;
+
+	/** Fold the pull of massive bodies into the orbits of perturbed bodies, once per update interval. */
+	void ApplyPerturbations();
+
+	/** Move the scene components of every body. */
+	void WriteTransforms();
+
+//------------------------------------------------------------------------
+// PROPERTIES
+//------------------------------------------------------------------------
+
+public:
+
+	/** Multiplier applied to the world's delta time. */
+	UPROPERTY(BlueprintReadWrite, Category = "Kepler Simulation")
+	float TimeScale;
+
+	/** Bodies propagated by each worker task. Must be a multiple of 4. */
+	UPROPERTY(BlueprintReadWrite, Category = "Kepler Simulation")
+	int32 BatchSize;
+
+	UPROPERTY(BlueprintReadWrite, Category = "Kepler Simulation")
+	FKeplerLodSettings LodSettings;
+
+	/** Simulation time searched for a sphere crossing at once. Longer windows take fewer rechecks. */
+	UPROPERTY(BlueprintReadWrite, Category = "Kepler Simulation")
+	float EventSearchWindow;
+
+	UPROPERTY(BlueprintReadWrite, Category = "Kepler Simulation")
+	FKeplerPerturbationSettings PerturbationSettings;
+
+	/** Called for each watched event, with the simulation time set to the time of the event. */
+	UPROPERTY(BlueprintAssignable, Category = "Kepler Simulation")
+	FOnKeplerEventSignature OnKeplerEvent;
+
+protected:
+
+	struct FBody
+	{
+		FKeplerOrbitConfig OrbitConfig;
+
+		/** Id of the body at the focus of the orbit, or INDEX_NONE. */
+		int32 ParentId;
+
+		/** Focus of the orbit when there is no parent. Location of static bodies. */
+		FVector Focus;
+
+		/** Time at which the body is at its initial true anomaly. */
+		double Epoch;
+
+		TWeakObjectPtr<USceneComponent> Target;
+
+		/** Precomputed fit of the orbit, if the body uses one. */
+		FKeplerEphemerisPtr Ephemeris;
+
+		FKeplerEphemerisSettings EphemerisSettings;
+
+		bool bIsStatic;
+
+		/** Mass as a fraction of the mass at the focus of every orbit. */
+		float Mass;
+
+		bool bIsPerturbed;
+
+		/** Depth of the body in the hierarchy. Static bodies are level 0. */
+		int32 Level;
+
+		/** Index of the body in its level. */
+		int32 LevelIndex;
+
+		/** Index of the body in the flat arrays, or INDEX_NONE until the hierarchy is rebuilt. */
+		int32 FlatIndex;
+	};
+
+	struct FLevel
+	{
+		/** Orbits of the analytic bodies in this level, in flat order. Unused by static bodies. */
+		FKeplerOrbitSet OrbitSet;
+
+		/** Ephemerides of the bodies that follow the analytic ones, in flat order. */
+		TArray<FKeplerEphemerisPtr> Ephemerides;
+
+		TArray<double> EphemerisEpochs;
+
+		/** Orbits of every body in this level, in level order. Used to extrapolate between solves. */
+		TArray<FKeplerCompiledOrbit> Orbits;
+
+		/** Index of the first body of this level in the flat arrays. */
+		int32 FirstFlatIndex;
+
+		int32 Num;
+
+		/** Analytic packets come first, so they line up with the orbit set. */
+		int32 FirstPacket;
+		int32 NumAnalyticPackets;
+		int32 NumPackets;
+	};
+
+	/** Up to 4 consecutive bodies of a level, solved together. */
+	struct FPacket
+	{
+		/** Index of the first body in its level. A multiple of 4 within the analytic and the ephemeris bodies. */
+		int32 Start;
+
+		int32 Count;
+
+		/** Packets at level k are solved every 2^k frames. */
+		int32 Lod;
+
+		/** First frame at which the packet is due again. */
+		uint64 NextRefreshFrame;
+
+		/** Solve the packet this frame, instead of extrapolating it. */
+		bool bRefresh;
+	};
+
+	/** Every registered body, indexed by id. */
+	TSparseArray<FBody> Bodies;
+
+	TArray<FLevel> Levels;
+
+	/** Flat, parent-before-child arrays. */
+	TArray<int32> FlatParents;
+	TArray<FVector> FlatFoci;
+	TArray<FVector> FlatLocations;
+	TArray<TWeakObjectPtr<USceneComponent>> FlatTargets;
+	TArray<float> FlatRadii;
+
+	/** Eccentric anomaly, its rate and the time of the last solve. Extrapolation advances the anomaly linearly. */
+	TArray<float> FlatEccAnomalies;
+	TArray<float> FlatEccRates;
+	TArray<double> FlatRefreshTimes;
+
+	struct FScheduledEvent
+	{
+		FKeplerEvent Event;
+
+		/** Time of the event, in double precision. Event.Time is its rounded copy, for Blueprints. */
+		double Time;
+
+		float Radius;
+
+		/** The search window ended before a crossing was found. Searched again, but not broadcast. */
+		bool bIsRecheck;
+
+		bool operator<(const FScheduledEvent& Other) const { return Time < Other.Time; }
+	};
+
+	/** Watched events, as a min-heap on time. */
+	TArray<FScheduledEvent> EventQueue;
+
+	/** Packets of every level, in flat order. */
+	TArray<FPacket> Packets;
+
+	/** Local player cameras, and the inverse tangent of their half field of view. */
+	TArray<FVector> ViewLocations;
+	TArray<float> ViewScreenScales;
+
+	uint64 FrameNumber;
+
+	/** Packet at which the search for due far packets resumes, so postponed packets go first. */
+	int32 PacketCursor;
+
+	/** Smoothed cost of solving a packet, in seconds. */
+	double RefreshCostPerPacket;
+
+	int32 NumRefreshedPackets;
+
+	int32 NumRefreshedBodies;
+
+	/** True while the extrapolation state is kept up to date. */
+	bool bIsLodActive;
+
+	/** Barnes-Hut tree of the massive bodies, rebuilt at each perturbation update. */
+	FKeplerGravityTree GravityTree;
+
+	/** Source of each body in the gravity tree, by id, or INDEX_NONE. */
+	TArray<int32> GravitySources;
+
+	/** Scratch of the perturbation update. Reset, not freed, so updates don't allocate once warm. */
+	TArray<FVector> GravitySourceLocations;
+	TArray<float> GravitySourceMasses;
+	TArray<int32> PerturbedIds;
+	TArray<FKeplerOrbitConfig> PerturbedOrbitConfigs;
+	TArray<bool> HasPerturbedOrbit;
+
+	/** Simulation time of the last perturbation update. */
+	double LastPerturbationTime;
+
+	/** Double, so orbits stay accurate on long-running servers. */
+	double SimulationTime;
+
+	bool bIsHierarchyDirty;
+
+	bool bIsInitialized;
+};
@@ -0,0 +1,78 @@
+// Copyright Bruno Silva. All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "KeplerOrbit.h"
+
+/** Throughput and accuracy of one solver mode, as measured by FKeplerSolverTable::Benchmark. */
+struct FKeplerSolverBenchmark
+{
+	EKeplerSolverMode Mode;
+
+	float NanosecondsPerSolve;
+
+	/** Largest difference to a double-precision reference, in radians. */
+	float MaxError;
+
+	float AverageIterations;
+};
+
+/**
+ * Table of E(M, e) - M, for M in [0, PI] and e in [0, MaxEccentricity]. Kepler's equation is odd
+ * in M, so negative anomalies read the table mirrored. Rows of constant eccentricity are
+ * contiguous, so a bilinear lookup reads two adjacent pairs of floats. One Newton-Raphson
+ * step after the lookup brings the error close to float precision.
+ *
+ * Built once at module startup, then shared read-only by every thread.
+ */
+class PORTFOLIO_API FKeplerSolverTable
+{
+public:
+
+	/** Samples along the mean anomaly, from 0 to PI. */
+	static const int32 NumMeanSamples = 257;
+
+	/** Samples along the eccentricity, from 0 to MaxEccentricity. */
+	static const int32 NumEccSamples = 65;
+
+	/** Eccentricities above this are too steep near the periapsis for the table, so they are solved iteratively. */
+	static const float MaxEccentricity;
+
+	static FKeplerSolverTable& Get();
+
+	/** Fill the table. Called once at module startup, before any other thread can read it. */
+	void Build();
+
+	bool IsBuilt() const { return bIsBuilt; }
+
+	/** True if the table covers the eccentricity. */
+	bool CanSolve(const float Eccentricity) const
+	{
+		return bIsBuilt && Eccentricity >= 0.0f && Eccentricity <= MaxEccentricity;
+	}
+
+	/** Eccentric anomaly of a reduced mean anomaly. Expects CanSolve to be true. */
+	float Solve(const float MeanAnomalyRad, const float Eccentricity) const;
+
+	SIZE_T GetAllocatedSize() const { return Values.GetAllocatedSize(); }
+
+public:
+
+	/** Eccentric anomaly solved in double precision, to the last bit. Used to fill the table and as the benchmark reference. */
+	static double SolveReference(const double MeanAnomalyRad, const double Eccentricity);
+
+	/** Time every solver mode on the same random anomalies and eccentricities, within the range of the table. */
+	static void Benchmark(const int32 NumSamples, TArray<FKeplerSolverBenchmark>& OutResults);
+
+private:
+
+	FKeplerSolverTable() : bIsBuilt(false) {}
+
+private:
+
+	/** E - M, by eccentricity, then mean anomaly. */
+	TArray<float> Values;
+
+	bool bIsBuilt;
+};
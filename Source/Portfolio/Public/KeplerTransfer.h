@@ -0,0 +1,196 @@
+// Copyright Bruno Silva. All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "Kismet/BlueprintAsyncActionBase.h"
+#include "KeplerOrbit.h"
+#include "KeplerTransfer.generated.h"
+
+USTRUCT(BlueprintType)
+struct FKeplerTransferSettings
+{
+	GENERATED_BODY()
+
+public:
+
+	/** Time at which the origin body is at its initial true anomaly. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Transfer")
+	float OriginEpoch;
+
+	/** Time at which the target body is at its initial true anomaly. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Transfer")
+	float TargetEpoch;
+
+	/** Earliest departure time. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Transfer")
+	float DepartureStart;
+
+	/** Span of departure times covered by the grid. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Transfer", meta = (ClampMin = "0"))
+	float DepartureDuration;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Transfer", meta = (ClampMin = "1"))
+	int32 NumDepartureSteps;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Transfer", meta = (ClampMin = "0"))
+	float MinTravelTime;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Transfer", meta = (ClampMin = "0"))
+	float MaxTravelTime;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Transfer", meta = (ClampMin = "1"))
+	int32 NumTravelTimeSteps;
+
+	/** Local minima of the grid refined between cells. 0 keeps the best cell as is. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Transfer", meta = (ClampMin = "0"))
+	int32 NumRefinedMinima;
+
+	/** Refinement stops once its step is below this, in seconds. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Kepler Transfer", meta = (ClampMin = "0"))
+	float RefineTolerance;
+
+public:
+
+	FKeplerTransferSettings()
+	{
+		OriginEpoch = 0.0f;
+		TargetEpoch = 0.0f;
+		DepartureStart = 0.0f;
+		DepartureDuration = 3600.0f;
+		NumDepartureSteps = 64;
+		MinTravelTime = 60.0f;
+		MaxTravelTime = 1800.0f;
+		NumTravelTimeSteps = 64;
+		NumRefinedMinima = 4;
+		RefineTolerance = 0.01f;
+	}
+};
+
+USTRUCT(BlueprintType)
+struct FKeplerTransferWindow
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Transfer")
+	float DepartureTime;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Transfer")
+	float ArrivalTime;
+
+	/** Velocity change needed to leave the origin orbit. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Transfer")
+	FVector DepartureDeltaV;
+
+	/** Velocity change needed to match the target orbit on arrival. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Transfer")
+	FVector ArrivalDeltaV;
+
+	/** Sum of the magnitudes of both burns. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Transfer")
+	float TotalDeltaV;
+
+public:
+
+	FKeplerTransferWindow()
+	{
+		DepartureTime = 0.0f;
+		ArrivalTime = 0.0f;
+		DepartureDeltaV = FVector::ZeroVector;
+		ArrivalDeltaV = FVector::ZeroVector;
+		TotalDeltaV = -1.0f;
+	}
+};
+
+USTRUCT(BlueprintType)
+struct FKeplerTransferGrid
+{
+	GENERATED_BODY()
+
+public:
+
+	/** Total delta-v of each cell, by departure, then travel time. Negative where no transfer was found. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Transfer")
+	TArray<float> DeltaV;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Transfer")
+	int32 NumDepartureSteps;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Transfer")
+	int32 NumTravelTimeSteps;
+
+	/** Cheapest transfer, refined between cells if requested. */
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Transfer")
+	FKeplerTransferWindow BestWindow;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Kepler Transfer")
+	bool bFoundTransfer;
+
+public:
+
+	FKeplerTransferGrid()
+	{
+		NumDepartureSteps = 0;
+		NumTravelTimeSteps = 0;
+		bFoundTransfer = false;
+	}
+
+	float GetDeltaV(const int32 DepartureIndex, const int32 TravelTimeIndex) const
+	{
+		return DeltaV[(DepartureIndex * NumTravelTimeSteps) + TravelTimeIndex];
+	}
+};
+
+/**
+ * Transfer search between two orbits around the same focus. Each cell of the grid solves
+ * Lambert's problem between the origin at departure and the target at arrival. Rows are
+ * evaluated in parallel, against orbits compiled once and shared by every worker.
+ */
+class PORTFOLIO_API FKeplerTransferSearch
+{
+public:
+
+	/** Fill the grid and find the best window. Blocks until done. */
+	static void Search(const FKeplerOrbitConfig& Origin, const FKeplerOrbitConfig& Target, const FKeplerTransferSettings& Settings, FKeplerTransferGrid& OutGrid);
+
+	/** Run the search on the thread pool. */
+	static TFuture<FKeplerTransferGrid> SearchAsync(const FKeplerOrbitConfig& Origin, const FKeplerOrbitConfig& Target, const FKeplerTransferSettings& Settings);
+
+	/**
+	 * Velocities at both ends of the prograde conic from R1 to R2 in the given time, using
+	 * universal variables. Prograde is relative to Normal. Returns false if there is no solution.
+	 */
+	static bool SolveLambert(const FVector& R1, const FVector& R2, const float TravelTime, const FVector& Normal, FVector& OutV1, FVector& OutV2);
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnTransferSearchCompletedSignature, const FKeplerTransferGrid&, Grid);
+
+/** Blueprint node that runs a transfer search without blocking the game thread. */
+UCLASS()
+class PORTFOLIO_API UKeplerTransferSearchAction : public UBlueprintAsyncActionBase
+{
+	GENERATED_BODY()
+
+public:
+
+	UFUNCTION(BlueprintCallable, Category = "Kepler Transfer", meta = (BlueprintInternalUseOnly = "true", WorldContext = "WorldContextObject"))
+	static UKeplerTransferSearchAction* FindTransferWindow(UObject* WorldContextObject, const FKeplerOrbitConfig& Origin, const FKeplerOrbitConfig& Target, const FKeplerTransferSettings& Settings);
+
+	virtual void Activate() override;
+
+public:
+
+	UPROPERTY(BlueprintAssignable)
+	FOnTransferSearchCompletedSignature OnCompleted;
+
+private:
+
+	FKeplerOrbitConfig Origin;
+
+	FKeplerOrbitConfig Target;
+
+	FKeplerTransferSettings Settings;
+};
@@ -5,6 +5,8 @@
 #include "Portfolio\Portfolio.h"
 #include "ProceduralGenerator.generated.h"
 
+DECLARE_LOG_CATEGORY_EXTERN(LogProceduralGenerator, Log, All);
+
 
 USTRUCT(BlueprintType)
 struct FQuad2D
@@ -47,6 +49,32 @@ public:
 	FVector2D GetCD() const { return (D - C); };
 	FVector2D GetDA() const { return (A - D); };
 
+	/** Length across the cut of a division, averaged between the two edges the cut crosses. */
+	float GetLength(const bool bUseADAxis) const
+	{
+		return bUseADAxis ? (0.5f * (GetBC().Size() + GetDA().Size())) : (0.5f * (GetAB().Size() + GetCD().Size()));
+	}
+
+	/** Area of the quad. Exact for convex and concave quads. */
+	float GetArea() const
+	{
+		return 0.5f * FMath::Abs((C - A) ^ (D - B));
+	}
+
+	FBox2D GetBounds() const
+	{
+		return FBox2D(FVector2D::Min(FVector2D::Min(A, B), FVector2D::Min(C, D)), FVector2D::Max(FVector2D::Max(A, B), FVector2D::Max(C, D)));
+	}
+
+	/** True if the point is inside or on the quad. Expects a convex quad, in either winding. */
+	bool Contains(const FVector2D& Point) const;
+
+	/** Squared distance from the point to the quad. 0 inside. Expects a convex quad. */
+	float GetDistanceSquared(const FVector2D& Point) const;
+
+	/** Divide the quad in two at the given fraction, without allocating. Same layout as UGeneratorLibrary::DivideQuad2D. */
+	void Divide(const float Fraction, const bool bUseADAxis, FQuad2D& OutFirst, FQuad2D& OutSecond) const;
+
 	/** Draw the vector quad in the world, for debug purposes. */
 	void DebugDraw(UWorld* InWorld, FColor DrawColor, float Height) const;
 
@@ -98,6 +126,10 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "VectorQuad", meta = (DisplayName = "Draw Quad2D"))
 	static void DrawQuad2D(UObject* WorldContext, FQuad2D QuadToDraw, FLinearColor LineColor, float Height);
 
+	/** Clear the lines drawn by DrawQuad2D. For many quads, prefer a UCityPlanPreviewComponent. */
+	UFUNCTION(BlueprintCallable, Category = "VectorQuad", meta = (DisplayName = "Clear Drawn Quad2Ds"))
+	static void ClearDrawnQuad2Ds(UObject* WorldContext);
+
 	/** Divide one quad into two smaller quads. */
 	UFUNCTION(BlueprintCallable, Category = "VectorQuad", meta = (DisplayName = "Divide Quad2D"))
 	static void DivideQuad2D(const FQuad2D& InQuad, const float Fraction, const bool bUseADAxis, TArray<FQuad2D>& OutResult);
@@ -106,7 +138,7 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "VectorQuad", meta = (DisplayName = "Divide Quad2D Multiple"))
 	static void DivideQuad2DMultiple(const FQuad2D& InQuad, TArray<float> Fractions, const bool bUseADAxis, TArray<FQuad2D>& OutResult);
 
-	/** Scale the given VectorQuad linearly. */
+	/** Scale the given VectorQuad linearly. For many quads, prefer FQuad2DSet::ResizeQuads. */
 	UFUNCTION(BlueprintCallable, Category = "VectorQuad", meta = (DisplayName = "Resize Quad2D"))
 	static FQuad2D ResizeQuad2D(const FQuad2D& InQuad, const float Delta);
 
@@ -0,0 +1,79 @@
+// Copyright Bruno Silva. All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ProceduralGenerator.h"
+
+/**
+ * Structure-of-arrays storage for resizing and dividing a large number of quads in a single
+ * call. Each corner coordinate has its own array, padded to a multiple of the SIMD width, so
+ * the kernels never need a remainder loop. Padded lanes hold a degenerate quad at the origin.
+ *
+ * The kernels match UGeneratorLibrary::ResizeQuad2D and DivideQuad2D, but normalize each edge
+ * once, for four quads at a time.
+ */
+class PORTFOLIO_API FQuad2DSet
+{
+public:
+
+	typedef TArray<float, TAlignedHeapAllocator<16>> FAlignedFloatArray;
+
+	FQuad2DSet() : NumQuads(0) {}
+
+public:
+
+	int32 Add(const FQuad2D& Quad);
+
+	void Set(const int32 Index, const FQuad2D& Quad);
+
+	FQuad2D Get(const int32 Index) const;
+
+	/** Replace the content of the set with the given quads. */
+	void Assign(TArrayView<const FQuad2D> Quads);
+
+	/** Copy every quad of the set out. OutQuads must hold at least Num quads. */
+	void CopyTo(TArrayView<FQuad2D> OutQuads) const;
+
+	/** Resize the set. New quads are degenerate, at the origin. */
+	void SetNum(const int32 Num);
+
+	void Reset();
+
+	int32 Num() const { return NumQuads; }
+
+	/** X coordinates of a corner of every quad, from A to D. */
+	TArrayView<const float> GetCornerX(const int32 Corner) const { return TArrayView<const float>(X[Corner].GetData(), NumQuads); }
+
+	/** Y coordinates of a corner of every quad, from A to D. */
+	TArrayView<const float> GetCornerY(const int32 Corner) const { return TArrayView<const float>(Y[Corner].GetData(), NumQuads); }
+
+public:
+
+	/** Resize every quad in place, like ResizeQuad2D. */
+	void Resize(const float Delta);
+
+	/** Divide every quad in two at its own fraction, like DivideQuad2D. */
+	void Divide(TArrayView<const float> Fractions, const bool bUseADAxis, FQuad2DSet& OutFirst, FQuad2DSet& OutSecond) const;
+
+	/**
+	 * Resize quads stored as an array of structures, four at a time. OutQuads must hold as many
+	 * quads as InQuads, and may be the same memory.
+	 */
+	static void ResizeQuads(TArrayView<const FQuad2D> InQuads, const float Delta, TArrayView<FQuad2D> OutQuads);
+
+	/** Divide quads stored as an array of structures, four at a time. Each output must hold as many quads as InQuads. */
+	static void DivideQuads(TArrayView<const FQuad2D> InQuads, TArrayView<const float> Fractions, const bool bUseADAxis, TArrayView<FQuad2D> OutFirst, TArrayView<FQuad2D> OutSecond);
+
+private:
+
+	int32 GetPaddedNum() const { return Align(NumQuads, 4); }
+
+private:
+
+	int32 NumQuads;
+
+	/** Corner coordinates, by corner from A to D. */
+	FAlignedFloatArray X[4];
+	FAlignedFloatArray Y[4];
+};